@@ -0,0 +1,723 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "AmbisonicBus.h"
+#include "HrtfSet.h"
+
+using namespace Wazappy;
+
+// Elevation marking a channel with no speaker to decode to, such as a low frequency effects channel.
+static const float NoSpeaker = 1000;
+
+// The layouts used when no speaker positions are given: (azimuth, elevation) in degrees per channel, in the
+// channel order of the usual WAVEFORMATEXTENSIBLE masks.
+static const float StereoLayout[] = { 30, 0, -30, 0 };
+static const float QuadLayout[] = { 45, 0, -45, 0, 135, 0, -135, 0 };
+static const float Surround51Layout[] = { 30, 0, -30, 0, 0, 0, 0, NoSpeaker, 110, 0, -110, 0 };
+static const float Surround71Layout[] = { 30, 0, -30, 0, 0, 0, 0, NoSpeaker, 150, 0, -150, 0, 90, 0, -90, 0 };
+
+// Add frameCount frames of source into destination, with a gain going linearly from just after from to to.
+static void AddRamped(const float* source, float from, float to, float* destination, UINT32 frameCount)
+{
+	float step = (to - from) / frameCount;
+	UINT32 frame = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	if (0 == step)
+	{
+		__m128 gain = _mm_set1_ps(from);
+		for (; frame + 4 <= frameCount; frame += 4)
+		{
+			_mm_storeu_ps(destination + frame, _mm_add_ps(_mm_loadu_ps(destination + frame), _mm_mul_ps(_mm_loadu_ps(source + frame), gain)));
+		}
+	}
+	else
+	{
+		__m128 gain = _mm_setr_ps(from + step, from + (step * 2), from + (step * 3), from + (step * 4));
+		__m128 increment = _mm_set1_ps(step * 4);
+		for (; frame + 4 <= frameCount; frame += 4)
+		{
+			_mm_storeu_ps(destination + frame, _mm_add_ps(_mm_loadu_ps(destination + frame), _mm_mul_ps(_mm_loadu_ps(source + frame), gain)));
+			gain = _mm_add_ps(gain, increment);
+		}
+	}
+#endif
+	for (; frame < frameCount; frame++)
+	{
+		destination[frame] += source[frame] * (from + (step * (frame + 1)));
+	}
+}
+
+// Max-rE weight of each order up to order, which narrows the decoded image's energy as far as it will go.
+static void MaxReWeights(UINT32 order, double* weights)
+{
+	double x = cos((137.9 * M_PI / 180) / (order + 1.51));
+	double legendre[AMBISONIC_MAX_ORDER + 1] = { 1, x, ((3 * x * x) - 1) / 2, ((5 * x * x * x) - (3 * x)) / 2 };
+	for (UINT32 l = 0; l <= AMBISONIC_MAX_ORDER; l++)
+	{
+		weights[l] = (l <= order) ? legendre[l] : 0;
+	}
+}
+
+// The order an ACN channel belongs to.
+static UINT32 OrderOf(UINT32 channel)
+{
+	return (UINT32)sqrt((double)channel);
+}
+
+AmbisonicBus::AmbisonicBus() :
+	m_Order(0),
+	m_FieldChannels(0),
+	m_OutputChannels(0),
+	m_DecodeChannels(0),
+	m_IsBinaural(false),
+	m_IsFieldAudible(false),
+	m_HasRotation(false),
+	m_ListenerGeneration(0),
+	m_Fft(AMBISONIC_BLOCK_FRAMES * 2),
+	m_PartitionCount(0),
+	m_StagedFrames(0),
+	m_Frame(0),
+	m_Block(0),
+	m_AudibleEnd(0),
+	m_IsQuiet(true),
+	m_OutputFrames(0),
+	m_AudibleFrames(0),
+	m_Periods(0),
+	m_EncodedSources(0),
+	m_RotationUpdates(0),
+	m_EncodeTicks(0),
+	m_DecodeTicks(0)
+{
+}
+
+void AmbisonicBus::EvaluateHarmonics(float front, float left, float up, UINT32 channelCount, float* harmonics)
+{
+	// With x ahead, y left and z up.
+	const float x = front;
+	const float y = left;
+	const float z = up;
+	const float sqrt3 = 1.7320508f;
+	const float sqrt15 = 3.8729833f;
+	const float sqrt3Over8 = 0.61237244f;
+	const float sqrt5Over8 = 0.79056942f;
+	float all[AMBISONIC_MAX_CHANNELS] =
+	{
+		1,
+		y,
+		z,
+		x,
+		sqrt3 * x * y,
+		sqrt3 * y * z,
+		((3 * z * z) - 1) / 2,
+		sqrt3 * x * z,
+		(sqrt3 / 2) * ((x * x) - (y * y)),
+		sqrt5Over8 * y * ((3 * x * x) - (y * y)),
+		sqrt15 * x * y * z,
+		sqrt3Over8 * y * ((5 * z * z) - 1),
+		z * ((5 * z * z) - 3) / 2,
+		sqrt3Over8 * x * ((5 * z * z) - 1),
+		(sqrt15 / 2) * z * ((x * x) - (y * y)),
+		sqrt5Over8 * x * ((x * x) - (3 * y * y)),
+	};
+	memcpy(harmonics, all, channelCount * sizeof(float));
+}
+
+HRESULT AmbisonicBus::Initialize(const AMBISONICPARAMS& params, UINT32 channelCount, UINT32 sampleRate)
+{
+	if (params.Order < 1 || params.Order > AMBISONIC_MAX_ORDER || 0 == channelCount || 0 == sampleRate)
+	{
+		return E_INVALIDARG;
+	}
+	if (params.Decoder != AmbisonicDecoder_Speakers && params.Decoder != AmbisonicDecoder_Binaural)
+	{
+		return E_INVALIDARG;
+	}
+	if (params.Decoder == AmbisonicDecoder_Binaural && (channelCount < 2 || nullptr == params.Hrtf))
+	{
+		return E_INVALIDARG;
+	}
+
+	m_Order = params.Order;
+	m_FieldChannels = (m_Order + 1) * (m_Order + 1);
+	m_OutputChannels = channelCount;
+	m_IsBinaural = (params.Decoder == AmbisonicDecoder_Binaural);
+	const UINT32 C = m_FieldChannels;
+	const UINT32 K = AMBISONIC_DESIGN_DIRECTIONS;
+
+	// A Fibonacci lattice, which spreads any number of points near evenly.
+	const double goldenAngle = M_PI * (3 - sqrt(5.0));
+	m_Directions.resize(K * 3);
+	for (UINT32 k = 0; k < K; k++)
+	{
+		double up = 1 - ((2 * k + 1) / (double)K);
+		double radius = sqrt(1 - (up * up));
+		m_Directions[k * 3] = (float)(radius * cos(goldenAngle * k));
+		m_Directions[(k * 3) + 1] = (float)(radius * sin(goldenAngle * k));
+		m_Directions[(k * 3) + 2] = (float)up;
+	}
+
+	// The fit is the pseudo-inverse of the harmonics at the design directions, A^T (A A^T)^-1, with A
+	// [channel][direction]; the Gram matrix is solved by Gauss-Jordan elimination.
+	std::vector<double> harmonics((size_t)K * C);
+	for (UINT32 k = 0; k < K; k++)
+	{
+		float values[AMBISONIC_MAX_CHANNELS];
+		EvaluateHarmonics(m_Directions[k * 3], m_Directions[(k * 3) + 1], m_Directions[(k * 3) + 2], C, values);
+		for (UINT32 c = 0; c < C; c++)
+		{
+			harmonics[((size_t)k * C) + c] = values[c];
+		}
+	}
+	std::vector<double> gram((size_t)C * C * 2, 0.0);
+	for (UINT32 i = 0; i < C; i++)
+	{
+		for (UINT32 j = 0; j < C; j++)
+		{
+			double sum = 0;
+			for (UINT32 k = 0; k < K; k++)
+			{
+				sum += harmonics[((size_t)k * C) + i] * harmonics[((size_t)k * C) + j];
+			}
+			gram[(i * C * 2) + j] = sum;
+		}
+		gram[(i * C * 2) + C + i] = 1;
+	}
+	for (UINT32 column = 0; column < C; column++)
+	{
+		UINT32 pivot = column;
+		for (UINT32 row = column + 1; row < C; row++)
+		{
+			if (fabs(gram[(row * C * 2) + column]) > fabs(gram[(pivot * C * 2) + column]))
+			{
+				pivot = row;
+			}
+		}
+		if (fabs(gram[(pivot * C * 2) + column]) < 1e-9)
+		{
+			return E_FAIL;
+		}
+		for (UINT32 j = 0; j < C * 2; j++)
+		{
+			std::swap(gram[(pivot * C * 2) + j], gram[(column * C * 2) + j]);
+		}
+		double scale = 1 / gram[(column * C * 2) + column];
+		for (UINT32 j = 0; j < C * 2; j++)
+		{
+			gram[(column * C * 2) + j] *= scale;
+		}
+		for (UINT32 row = 0; row < C; row++)
+		{
+			double factor = gram[(row * C * 2) + column];
+			if (row != column && factor != 0)
+			{
+				for (UINT32 j = 0; j < C * 2; j++)
+				{
+					gram[(row * C * 2) + j] -= factor * gram[(column * C * 2) + j];
+				}
+			}
+		}
+	}
+	m_Fit.resize((size_t)K * C);
+	for (UINT32 k = 0; k < K; k++)
+	{
+		for (UINT32 c = 0; c < C; c++)
+		{
+			double sum = 0;
+			for (UINT32 j = 0; j < C; j++)
+			{
+				sum += harmonics[((size_t)k * C) + j] * gram[(j * C * 2) + C + c];
+			}
+			m_Fit[((size_t)k * C) + c] = (float)sum;
+		}
+	}
+
+	HRESULT hr = m_IsBinaural ? BuildBinauralDecoder(*params.Hrtf, sampleRate) : BuildSpeakerDecoder(params.SpeakerPositions);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	m_HasRotation = false;
+	m_IsFieldAudible = false;
+	return S_OK;
+}
+
+HRESULT AmbisonicBus::BuildSpeakerDecoder(const float* speakerPositions)
+{
+	const UINT32 C = m_FieldChannels;
+	if (nullptr == speakerPositions)
+	{
+		switch (m_OutputChannels)
+		{
+		case 2: speakerPositions = StereoLayout; break;
+		case 4: speakerPositions = QuadLayout; break;
+		case 6: speakerPositions = Surround51Layout; break;
+		case 8: speakerPositions = Surround71Layout; break;
+		default: return E_INVALIDARG;
+		}
+	}
+
+	UINT32 speakers = 0;
+	for (UINT32 s = 0; s < m_OutputChannels; s++)
+	{
+		if (fabsf(speakerPositions[(s * 2) + 1]) <= 90)
+		{
+			speakers++;
+		}
+	}
+	if (0 == speakers)
+	{
+		return E_INVALIDARG;
+	}
+
+	// Sampling the field at each speaker, with the max-rE weights for the order decoded; a layout resolves no
+	// more orders than a ring of its speakers would.
+	UINT32 order = (std::min)(m_Order, (std::max)(1u, (speakers - 1) / 2));
+	m_DecodeChannels = (order + 1) * (order + 1);
+	double weights[AMBISONIC_MAX_ORDER + 1];
+	MaxReWeights(order, weights);
+
+	const double toRadians = M_PI / 180;
+	m_Decoder.assign((size_t)m_OutputChannels * C, 0.0f);
+	for (UINT32 s = 0; s < m_OutputChannels; s++)
+	{
+		double azimuth = speakerPositions[s * 2] * toRadians;
+		double elevation = speakerPositions[(s * 2) + 1];
+		if (fabs(elevation) > 90)
+		{
+			continue;
+		}
+		elevation *= toRadians;
+
+		float values[AMBISONIC_MAX_CHANNELS];
+		EvaluateHarmonics((float)(cos(elevation) * cos(azimuth)), (float)(cos(elevation) * sin(azimuth)), (float)sin(elevation), m_DecodeChannels, values);
+		for (UINT32 c = 0; c < m_DecodeChannels; c++)
+		{
+			UINT32 l = OrderOf(c);
+			m_Decoder[((size_t)s * C) + c] = (float)(((2 * l) + 1) * weights[l] * values[c]);
+		}
+	}
+
+	// Normalized so a source on the horizon, where layouts put their speakers, gives unit energy on average.
+	const UINT32 samples = 360;
+	double energy = 0;
+	for (UINT32 k = 0; k < samples; k++)
+	{
+		double azimuth = 2 * M_PI * k / samples;
+		float values[AMBISONIC_MAX_CHANNELS];
+		EvaluateHarmonics((float)cos(azimuth), (float)sin(azimuth), 0, m_DecodeChannels, values);
+		for (UINT32 s = 0; s < m_OutputChannels; s++)
+		{
+			double gain = 0;
+			for (UINT32 c = 0; c < m_DecodeChannels; c++)
+			{
+				gain += m_Decoder[((size_t)s * C) + c] * values[c];
+			}
+			energy += gain * gain;
+		}
+	}
+	float scale = (float)(1 / sqrt(energy / samples));
+	for (float& gain : m_Decoder)
+	{
+		gain *= scale;
+	}
+
+	return S_OK;
+}
+
+HRESULT AmbisonicBus::BuildBinauralDecoder(const HRTFDATASET& dataset, UINT32 sampleRate)
+{
+	const UINT32 B = AMBISONIC_BLOCK_FRAMES;
+	const UINT32 C = m_FieldChannels;
+	const UINT32 K = AMBISONIC_DESIGN_DIRECTIONS;
+
+	HrtfSet hrtf(B);
+	HRESULT hr = hrtf.Initialize(dataset, sampleRate);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	m_DecodeChannels = C;
+	m_PartitionCount = hrtf.GetPartitionCount();
+	const UINT32 P = m_PartitionCount;
+
+	// Each virtual speaker gets the projection of the field onto its direction, with max-rE weights, and an
+	// even share of the sphere; its response, blended as BinauralSpatializer would, goes into every channel's
+	// response in that proportion.
+	double weights[AMBISONIC_MAX_ORDER + 1];
+	MaxReWeights(m_Order, weights);
+	m_FilterSpectra.assign((size_t)C * 2 * P * B, std::complex<float>());
+	for (UINT32 k = 0; k < K; k++)
+	{
+		float front = m_Directions[k * 3];
+		float left = m_Directions[(k * 3) + 1];
+		float up = m_Directions[(k * 3) + 2];
+		float values[AMBISONIC_MAX_CHANNELS];
+		EvaluateHarmonics(front, left, up, C, values);
+		const HrtfSet::Blend& blend = hrtf.GetBlend(HrtfSet::GetCell(-left, up, -front));
+
+		for (UINT32 c = 0; c < C; c++)
+		{
+			UINT32 l = OrderOf(c);
+			float gain = (float)(((2 * l) + 1) * weights[l] * values[c] / K);
+			std::complex<float>* filter = FilterSpectrum(c, 0, 0);
+			for (UINT32 n = 0; n < HRTF_NEIGHBOURS; n++)
+			{
+				float weight = gain * blend.Weights[n];
+				if (0 == weight)
+				{
+					continue;
+				}
+				const std::complex<float>* spectrum = hrtf.GetSpectrum(blend.Measurements[n], 0, 0);
+				for (size_t bin = 0; bin < (size_t)2 * P * B; bin++)
+				{
+					filter[bin] += weight * spectrum[bin];
+				}
+			}
+		}
+	}
+
+	m_InputSpectra.assign((size_t)C * P * B, std::complex<float>());
+	for (UINT32 ear = 0; ear < 2; ear++)
+	{
+		m_Sums[ear].assign(B, std::complex<float>());
+	}
+	m_Samples.assign(B * 2, 0.0f);
+	return S_OK;
+}
+
+void AmbisonicBus::Reserve(UINT32 maxFrameCount)
+{
+	const UINT32 B = AMBISONIC_BLOCK_FRAMES;
+
+	m_Field.Allocate(m_FieldChannels, maxFrameCount);
+	m_Mono.assign(maxFrameCount, 0.0f);
+	m_IsFieldAudible = false;
+	if (m_IsBinaural)
+	{
+		// As in BinauralSpatializer, neither the stage nor the output queue ever holds a block before a
+		// period's frames are added.
+		m_Stage.Allocate(m_FieldChannels, (B * 2) + maxFrameCount);
+		m_StagedFrames = 0;
+		m_Output.Allocate(2, (B * 2) + maxFrameCount);
+		m_OutputFrames = B;
+		m_AudibleFrames = 0;
+		m_AudibleEnd = m_Frame - ((INT64)m_PartitionCount * B);
+		m_IsQuiet = true;
+	}
+	else
+	{
+		m_Rotated.Allocate(m_DecodeChannels, maxFrameCount);
+	}
+}
+
+void AmbisonicBus::AddSource(SpatialSource& source, const PlanarView& input, UINT32 frameCount)
+{
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+
+	const float* mono = input.Channel(0);
+	if (input.ChannelCount > 1)
+	{
+		memcpy(m_Mono.data(), mono, frameCount * sizeof(float));
+		for (UINT32 channel = 1; channel < input.ChannelCount; channel++)
+		{
+			const float* samples = input.Channel(channel);
+			for (UINT32 i = 0; i < frameCount; i++)
+			{
+				m_Mono[i] += samples[i];
+			}
+		}
+		float scale = 1.0f / input.ChannelCount;
+		for (UINT32 i = 0; i < frameCount; i++)
+		{
+			m_Mono[i] *= scale;
+		}
+		mono = m_Mono.data();
+	}
+
+	// All the harmonics are kept whatever the bus's order, so the source can move to another bus.
+	float gains[AMBISONIC_MAX_CHANNELS];
+	UINT32 generation = source.GetGeneration();
+	if (!source.m_HasAmbisonicGains || generation != source.m_AmbisonicGeneration)
+	{
+		float x, y, z;
+		source.GetPosition(&x, &y, &z);
+		float length = sqrtf((x * x) + (y * y) + (z * z));
+		if (length > 0)
+		{
+			EvaluateHarmonics(-z / length, -x / length, y / length, AMBISONIC_MAX_CHANNELS, gains);
+		}
+		else
+		{
+			EvaluateHarmonics(1, 0, 0, AMBISONIC_MAX_CHANNELS, gains);
+		}
+
+		// A source's first period starts where it is.
+		if (!source.m_HasAmbisonicGains)
+		{
+			memcpy(source.m_AmbisonicGains, gains, sizeof(gains));
+		}
+		source.m_HasAmbisonicGains = true;
+		source.m_AmbisonicGeneration = generation;
+	}
+	else
+	{
+		memcpy(gains, source.m_AmbisonicGains, sizeof(gains));
+	}
+
+	for (UINT32 c = 0; c < m_FieldChannels; c++)
+	{
+		AddRamped(mono, source.m_AmbisonicGains[c], gains[c], m_Field.Channel(c), frameCount);
+	}
+	memcpy(source.m_AmbisonicGains, gains, sizeof(gains));
+	m_IsFieldAudible = true;
+
+	LARGE_INTEGER end;
+	QueryPerformanceCounter(&end);
+	m_EncodedSources.store(m_EncodedSources.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	m_EncodeTicks.store(m_EncodeTicks.load(std::memory_order_relaxed) + (end.QuadPart - start.QuadPart), std::memory_order_relaxed);
+}
+
+void AmbisonicBus::ComputeRotation(const ListenerOrientation& listener, float* rotation) const
+{
+	// The matrix takes the harmonics at each design direction to those at where it lies from the head; only
+	// channels of the same order mix.
+	const UINT32 C = m_FieldChannels;
+	const UINT32 K = AMBISONIC_DESIGN_DIRECTIONS;
+	float rotated[AMBISONIC_DESIGN_DIRECTIONS][AMBISONIC_MAX_CHANNELS];
+	for (UINT32 k = 0; k < K; k++)
+	{
+		float x = -m_Directions[(k * 3) + 1];
+		float y = m_Directions[(k * 3) + 2];
+		float z = -m_Directions[k * 3];
+		listener.IntoHead(&x, &y, &z);
+		EvaluateHarmonics(-z, -x, y, C, rotated[k]);
+	}
+
+	memset(rotation, 0, (size_t)C * C * sizeof(float));
+	for (UINT32 l = 0; l <= m_Order; l++)
+	{
+		for (UINT32 i = l * l; i < (l + 1) * (l + 1); i++)
+		{
+			for (UINT32 j = l * l; j < (l + 1) * (l + 1); j++)
+			{
+				float sum = 0;
+				for (UINT32 k = 0; k < K; k++)
+				{
+					sum += rotated[k][i] * m_Fit[((size_t)k * C) + j];
+				}
+				rotation[(i * C) + j] = sum;
+			}
+		}
+	}
+}
+
+void AmbisonicBus::Rotate(const PlanarView& destination, UINT32 frameCount)
+{
+	const UINT32 C = m_FieldChannels;
+	destination.Zero(frameCount);
+	for (UINT32 i = 0; i < destination.ChannelCount; i++)
+	{
+		UINT32 l = OrderOf(i);
+		for (UINT32 j = l * l; j < (l + 1) * (l + 1); j++)
+		{
+			float from = m_Rotation[(i * C) + j];
+			float to = m_TargetRotation[(i * C) + j];
+			if (from != 0 || to != 0)
+			{
+				AddRamped(m_Field.Channel(j), from, to, destination.Channel(i), frameCount);
+			}
+		}
+	}
+}
+
+void AmbisonicBus::ProcessBlock(UINT32 offset)
+{
+	const UINT32 B = AMBISONIC_BLOCK_FRAMES;
+	const UINT32 P = m_PartitionCount;
+	UINT32 index = (UINT32)(m_Block % P);
+	float* output[2] = { m_Output.Channel(0) + m_OutputFrames, m_Output.Channel(1) + m_OutputFrames };
+
+	// As for a BinauralSpatializer slot: once the field has been silent for as long as the response, so is the
+	// output, and coming back from that the delay line is stale.
+	if (m_AudibleEnd <= m_Frame - ((INT64)P * B))
+	{
+		m_IsQuiet = true;
+		memset(output[0], 0, B * sizeof(float));
+		memset(output[1], 0, B * sizeof(float));
+	}
+	else
+	{
+		if (m_IsQuiet)
+		{
+			std::fill(m_InputSpectra.begin(), m_InputSpectra.end(), std::complex<float>());
+			m_IsQuiet = false;
+		}
+
+		bool isWindowSilent = m_AudibleEnd <= m_Frame - B;
+		for (UINT32 ear = 0; ear < 2; ear++)
+		{
+			std::fill(m_Sums[ear].begin(), m_Sums[ear].end(), std::complex<float>());
+		}
+		for (UINT32 c = 0; c < m_FieldChannels; c++)
+		{
+			std::complex<float>* spectrum = InputSpectrum(c, index);
+			if (isWindowSilent)
+			{
+				std::fill(spectrum, spectrum + B, std::complex<float>());
+			}
+			else
+			{
+				m_Fft.Forward(m_Stage.Channel(c) + offset, spectrum);
+			}
+
+			for (UINT32 ear = 0; ear < 2; ear++)
+			{
+				UINT32 inputIndex = index;
+				for (UINT32 partition = 0; partition < P; partition++)
+				{
+					RealFft::MultiplyAccumulate(FilterSpectrum(c, ear, partition), InputSpectrum(c, inputIndex), m_Sums[ear].data(), B);
+					inputIndex = (0 == inputIndex) ? (P - 1) : (inputIndex - 1);
+				}
+			}
+		}
+
+		for (UINT32 ear = 0; ear < 2; ear++)
+		{
+			m_Fft.Inverse(m_Sums[ear].data(), m_Samples.data());
+			memcpy(output[ear], m_Samples.data() + B, B * sizeof(float));
+		}
+		m_AudibleFrames = m_OutputFrames + B;
+	}
+
+	m_OutputFrames += B;
+	m_Frame += B;
+	m_Block++;
+}
+
+bool AmbisonicBus::Render(const PlanarView& mix, UINT32 frameCount, const ListenerOrientation& listener)
+{
+	const UINT32 B = AMBISONIC_BLOCK_FRAMES;
+
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+
+	// A new orientation is ramped to across the period; the first is started at.
+	UINT32 generation = listener.GetGeneration();
+	if (!m_HasRotation || generation != m_ListenerGeneration)
+	{
+		ComputeRotation(listener, m_TargetRotation);
+		if (!m_HasRotation)
+		{
+			memcpy(m_Rotation, m_TargetRotation, sizeof(m_Rotation));
+		}
+		m_HasRotation = true;
+		m_ListenerGeneration = generation;
+		m_RotationUpdates.store(m_RotationUpdates.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	bool isAudible = false;
+	if (m_IsBinaural)
+	{
+		PlanarView stage = m_Stage.GetView().Offset(B + m_StagedFrames);
+		if (m_IsFieldAudible)
+		{
+			Rotate(stage, frameCount);
+			m_AudibleEnd = m_Frame + m_StagedFrames + frameCount;
+		}
+		else
+		{
+			stage.Zero(frameCount);
+		}
+		m_StagedFrames += frameCount;
+
+		UINT32 offset = 0;
+		while (offset + B <= m_StagedFrames)
+		{
+			ProcessBlock(offset);
+			offset += B;
+		}
+		if (offset > 0)
+		{
+			m_StagedFrames -= offset;
+			for (UINT32 c = 0; c < m_FieldChannels; c++)
+			{
+				memmove(m_Stage.Channel(c), m_Stage.Channel(c) + offset, (B + m_StagedFrames) * sizeof(float));
+			}
+		}
+
+		isAudible = m_AudibleFrames > 0;
+		for (UINT32 ear = 0; ear < 2; ear++)
+		{
+			float* output = m_Output.Channel(ear);
+			if (isAudible)
+			{
+				float* samples = mix.Channel(ear);
+				for (UINT32 frame = 0; frame < frameCount; frame++)
+				{
+					samples[frame] += output[frame];
+				}
+			}
+			memmove(output, output + frameCount, (m_OutputFrames - frameCount) * sizeof(float));
+		}
+		m_OutputFrames -= frameCount;
+		m_AudibleFrames = (m_AudibleFrames > frameCount) ? (m_AudibleFrames - frameCount) : 0;
+	}
+	else if (m_IsFieldAudible)
+	{
+		// Only the orders the layout can resolve are rotated and decoded.
+		Rotate(m_Rotated.GetView(), frameCount);
+		for (UINT32 s = 0; s < m_OutputChannels; s++)
+		{
+			const float* gains = &m_Decoder[(size_t)s * m_FieldChannels];
+			for (UINT32 c = 0; c < m_DecodeChannels; c++)
+			{
+				if (gains[c] != 0)
+				{
+					AddRamped(m_Rotated.Channel(c), gains[c], gains[c], mix.Channel(s), frameCount);
+				}
+			}
+		}
+		isAudible = true;
+	}
+
+	if (m_IsFieldAudible)
+	{
+		m_Field.GetView().Zero(frameCount);
+		m_IsFieldAudible = false;
+	}
+	memcpy(m_Rotation, m_TargetRotation, sizeof(m_Rotation));
+
+	LARGE_INTEGER end;
+	QueryPerformanceCounter(&end);
+	m_Periods.store(m_Periods.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	m_DecodeTicks.store(m_DecodeTicks.load(std::memory_order_relaxed) + (end.QuadPart - start.QuadPart), std::memory_order_relaxed);
+
+	return isAudible;
+}
+
+void AmbisonicBus::GetStatistics(AMBISONICSTATS* stats) const
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	stats->Order = m_Order;
+	stats->FieldChannels = m_FieldChannels;
+	stats->LatencyFrames = GetLatencyFrames();
+	stats->Periods = m_Periods.load(std::memory_order_relaxed);
+	stats->EncodedSources = m_EncodedSources.load(std::memory_order_relaxed);
+	stats->RotationUpdates = m_RotationUpdates.load(std::memory_order_relaxed);
+	stats->EncodeNanoseconds = (UINT64)((double)m_EncodeTicks.load(std::memory_order_relaxed) * 1e9 / frequency.QuadPart);
+	stats->DecodeNanoseconds = (UINT64)((double)m_DecodeTicks.load(std::memory_order_relaxed) * 1e9 / frequency.QuadPart);
+}
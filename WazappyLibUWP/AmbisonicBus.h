@@ -0,0 +1,174 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <complex>
+#include <vector>
+
+#include "WazappyDllInterface.h"
+#include "Fft.h"
+#include "PlanarBuffer.h"
+#include "SpatialSource.h"
+
+using namespace Microsoft::WRL;
+
+// Frames in each block the binaural decoder convolves, and so the frames voices through a binaural bus run behind
+// the rest.
+#define AMBISONIC_BLOCK_FRAMES 128
+
+// Directions, spread evenly over the sphere, which the field's rotation is fitted at and the binaural decoder's
+// virtual speakers stand at.
+#define AMBISONIC_DESIGN_DIRECTIONS 64
+
+namespace Wazappy
+{
+	// A higher order ambisonic bus: every voice sent to it is encoded into one sound field of up to
+	// AMBISONIC_MAX_ORDER, which is rotated to the listener's head and decoded once per period, so each voice
+	// costs only its encoding (a gain per field channel, in SIMD, ramped across a period when it moves) however
+	// the field is decoded.
+	// The field is in world coordinates, SN3D normalized in ACN order (AmbiX).  Each period the listener's
+	// orientation is turned into a rotation matrix for the field (one block per order, fitted at
+	// AMBISONIC_DESIGN_DIRECTIONS directions, which is exact since rotation keeps each order to itself), ramped
+	// across the period from the last orientation's, so head turns never click.
+	// Two decoders:
+	// - AmbisonicDecoder_Speakers decodes to the device's channels by sampling at each speaker, with max-rE
+	//   weights, normalized for unit energy on average around the horizon.  The order decoded is held to what the
+	//   layout can resolve, half the speakers less one (but at least 1).
+	// - AmbisonicDecoder_Binaural decodes to virtual speakers at the design directions, each through the head
+	//   related impulse response for its direction; since decoding and convolving are both linear, each field
+	//   channel's share of every virtual speaker's response is summed into one response per channel and ear when
+	//   the bus is loaded, and a block costs a forward transform per field channel and one inverse transform per
+	//   ear, whatever the number of voices or virtual speakers.
+	// Initialize and Reserve are for client threads; everything else but GetStatistics is audio thread only.
+	class AmbisonicBus :
+		public RuntimeClass<RuntimeClassFlags<ClassicCom>, IUnknown>
+	{
+	public:
+		AmbisonicBus();
+
+		// Set up the bus for a device with channelCount channels at sampleRate.  Allocates, and for a binaural
+		// decoder transforms every impulse response, so may take a while.
+		HRESULT Initialize(const AMBISONICPARAMS& params, UINT32 channelCount, UINT32 sampleRate);
+
+		// Size the bus for periods of up to maxFrameCount frames.  Must be called before Render, and not
+		// concurrently with it.
+		void Reserve(UINT32 maxFrameCount);
+
+		UINT32 GetLatencyFrames() const { return m_IsBinaural ? AMBISONIC_BLOCK_FRAMES : 0; }
+
+		// Encode frameCount frames of a source's audio (downmixed from input's channels) into the field at its
+		// position, ramping from where it was last encoded if it has moved.  Called at most once per source per
+		// period, before Render.
+		void AddSource(SpatialSource& source, const PlanarView& input, UINT32 frameCount);
+
+		// Rotate the field encoded this period into the listener's head and add its decode into mix, which has the
+		// channel count the bus was set up for.  Returns false if nothing audible was added.
+		bool Render(const PlanarView& mix, UINT32 frameCount, const ListenerOrientation& listener);
+
+		// Any thread.
+		void GetStatistics(AMBISONICSTATS* stats) const;
+
+		// Write the first channelCount real spherical harmonics, SN3D normalized in ACN order, of the unit vector
+		// (front, left, up).
+		static void EvaluateHarmonics(float front, float left, float up, UINT32 channelCount, float* harmonics);
+
+	private:
+		virtual ~AmbisonicBus() {}
+
+		// Work out the matrix ([row][column], m_FieldChannels square) rotating the field into head coordinates
+		// for the listener's orientation.
+		void ComputeRotation(const ListenerOrientation& listener, float* rotation) const;
+
+		// Overwrite frameCount frames of destination's channels with those of the rotated field, ramping from
+		// m_Rotation to m_TargetRotation.
+		void Rotate(const PlanarView& destination, UINT32 frameCount);
+
+		// Fill m_Decoder for the given speaker positions, one (azimuth, elevation) pair per output channel.
+		HRESULT BuildSpeakerDecoder(const float* speakerPositions);
+
+		// Fill m_FilterSpectra from the dataset.
+		HRESULT BuildBinauralDecoder(const HRTFDATASET& dataset, UINT32 sampleRate);
+
+		// Convolve one block of the staged field, from the given offset, and append it to m_Output.
+		void ProcessBlock(UINT32 offset);
+
+		std::complex<float>* FilterSpectrum(UINT32 channel, UINT32 ear, UINT32 partition)
+		{
+			return &m_FilterSpectra[((((size_t)channel * 2) + ear) * m_PartitionCount + partition) * AMBISONIC_BLOCK_FRAMES];
+		}
+		std::complex<float>* InputSpectrum(UINT32 channel, UINT32 index)
+		{
+			return &m_InputSpectra[(((size_t)channel * m_PartitionCount) + index) * AMBISONIC_BLOCK_FRAMES];
+		}
+
+	private:
+		UINT32 m_Order;
+		UINT32 m_FieldChannels;
+		UINT32 m_OutputChannels;
+
+		// Field channels decoded: all of them binaurally, those of the orders the layout resolves to speakers.
+		UINT32 m_DecodeChannels;
+		bool m_IsBinaural;
+
+		// The design directions, as (front, left, up), and the least squares fit taking a field's values at them
+		// back to the field ([direction][channel]).
+		std::vector<float> m_Directions;
+		std::vector<float> m_Fit;
+
+		// The field encoded this period, and whether anything has been.
+		PlanarBuffer m_Field;
+		bool m_IsFieldAudible;
+
+		// Mono downmix of a source with more than one channel.
+		std::vector<float> m_Mono;
+
+		// The rotation the last period ended at, and the one this period ends at.
+		float m_Rotation[AMBISONIC_MAX_CHANNELS * AMBISONIC_MAX_CHANNELS];
+		float m_TargetRotation[AMBISONIC_MAX_CHANNELS * AMBISONIC_MAX_CHANNELS];
+		bool m_HasRotation;
+		UINT32 m_ListenerGeneration;
+
+		// Speakers: the decoder ([output channel][field channel]), and the rotated field.
+		std::vector<float> m_Decoder;
+		PlanarBuffer m_Rotated;
+
+		// Binaural: as in BinauralSpatializer, for one source per field channel with a fixed response for each
+		// ear.  The responses are [channel][ear][partition][bin], the delay line [channel][index][bin].
+		RealFft m_Fft;
+		UINT32 m_PartitionCount;
+		std::vector<std::complex<float>> m_FilterSpectra;
+		std::vector<std::complex<float>> m_InputSpectra;
+
+		// The rotated field staged for convolution: the block before the next to convolve, then m_StagedFrames
+		// frames not yet convolved.
+		PlanarBuffer m_Stage;
+		UINT32 m_StagedFrames;
+
+		// Frame the next block starts at, its index, and the frame after the last the field was audible for;
+		// whether the delay line is all silent or stale.
+		INT64 m_Frame;
+		UINT64 m_Block;
+		INT64 m_AudibleEnd;
+		bool m_IsQuiet;
+
+		// Output not yet mixed, two channels, m_OutputFrames long; only the first m_AudibleFrames frames may be
+		// other than silent.
+		PlanarBuffer m_Output;
+		UINT32 m_OutputFrames;
+		UINT32 m_AudibleFrames;
+
+		// Per block scratch.
+		std::vector<std::complex<float>> m_Sums[2];
+		std::vector<float> m_Samples;
+
+		// Written on the audio thread, read by GetStatistics.
+		std::atomic<UINT64> m_Periods;
+		std::atomic<UINT64> m_EncodedSources;
+		std::atomic<UINT64> m_RotationUpdates;
+		std::atomic<UINT64> m_EncodeTicks;
+		std::atomic<UINT64> m_DecodeTicks;
+	};
+}
@@ -0,0 +1,184 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+
+#include "WazappyDllInterface.h"
+#include "GainStage.h"
+#include "FilterBank.h"
+#include "DelayLine.h"
+#include "PlanarBuffer.h"
+#include "SpatialSource.h"
+
+// Marks a voice's pending-seek slot as empty.
+#define NO_PENDING_SEEK ((UINT64)-1)
+
+// Priority voices start with, and the priority of voices which should never be virtualized while anything else
+// could be (live input, calibration).
+#define VOICE_PRIORITY_DEFAULT 0
+#define VOICE_PRIORITY_HIGHEST INT_MAX
+
+using namespace Microsoft::WRL;
+
+namespace Wazappy
+{
+	// A source of audio which is mixed into a render device's output by a VoiceMixer.
+	// Voices render 32-bit float planar frames (see PlanarView), in the channel count and sample rate of the
+	// device they are playing on.
+	// RenderVoice is only ever called from the device's audio thread; Stop may be called from any thread.
+	class AudioVoice :
+		public RuntimeClass<RuntimeClassFlags<ClassicCom>, IUnknown>
+	{
+	public:
+		AudioVoice(VoiceId voiceId) :
+			m_VoiceId(voiceId),
+			m_IsStopRequested(false),
+			m_IsFinished(false),
+			m_Priority(VOICE_PRIORITY_DEFAULT),
+			m_DelayLine(nullptr),
+			m_IsOutputSilent(false),
+			m_IsWantedReal(true),
+			m_RealFade(-1.0f)
+		{
+		}
+
+		VoiceId GetVoiceId() const { return m_VoiceId; }
+
+		// Add up to frameCount frames of this voice into every channel of mix.  Returns the number of frames
+		// actually rendered; returning fewer than frameCount means the voice is done.
+		virtual UINT32 RenderVoice(const PlanarView& mix, UINT32 frameCount) = 0;
+
+		// RenderVoice, also reporting whether the voice knows it added nothing (see MarkOutputSilent), so the mixer
+		// can skip whatever it would do with the voice's output.  Audio thread only.
+		UINT32 RenderPeriod(const PlanarView& mix, UINT32 frameCount, bool* isSilent)
+		{
+			m_IsOutputSilent = false;
+			UINT32 framesRendered = RenderVoice(mix, frameCount);
+			*isSilent = m_IsOutputSilent;
+			return framesRendered;
+		}
+
+		// Move on by frameCount frames as RenderVoice would, but without producing output; the mixer calls this
+		// instead of RenderVoice while the voice is inaudible, so it keeps time.  Returns the frames moved on by,
+		// with the same meaning as RenderVoice's result.  The default renders into scratch (at least frameCount
+		// frames in the device's channel count) and throws the result away; voices which can skip ahead more
+		// cheaply override it.
+		virtual UINT32 SkipVoice(const PlanarView& scratch, UINT32 frameCount)
+		{
+			scratch.Zero(frameCount);
+			return RenderVoice(scratch, frameCount);
+		}
+
+		// Move the play position to the given frame, sample accurately.  Any thread; takes effect as soon as the
+		// audio is available (the next period, for audio already in memory).
+		// Voices which cannot seek return E_NOTIMPL.
+		virtual HRESULT Seek(UINT64 frame) { return E_NOTIMPL; }
+
+		// Ask the voice to stop; the mixer retires it at the start of its next period.
+		void Stop() { m_IsStopRequested = true; }
+
+		bool IsStopRequested() const { return m_IsStopRequested; }
+
+		// True once the mixer has retired this voice.
+		bool IsFinished() const { return m_IsFinished; }
+
+		// True for voices playing live input, whose audible output means someone is performing.
+		virtual bool IsLiveInput() const { return false; }
+
+		// How loud the voice's output is about to be, before its gain stage, on a linear scale where 1 is full
+		// scale.  The mixer ranks voices by priority, then by this times their gain, when it cannot render them
+		// all.  Called on the audio thread once per period; must be cheap.  The default assumes full scale.
+		virtual float GetAudibility() { return 1.0f; }
+
+		// Size any per period scratch for periods of up to maxFrameCount frames; never shrinks it.  Called by the
+		// mixer on a client thread when the voice is added and whenever the device's period is renegotiated, never
+		// concurrently with RenderVoice.  Voices with no such scratch need not override it.
+		virtual void Reserve(UINT32 maxFrameCount) {}
+
+		// Called by the mixer when its shed level changes, and when the voice starts; voices with optional
+		// processing drop it from ShedLevel_Quality up.  Audio thread only.
+		virtual void SetShedLevel(ShedLevel level) {}
+
+		// Called by the mixer when the device's tempo changes, and when the voice starts, in frames per beat (0 if
+		// the device has none); voices which keep time with the device follow it.  Audio thread only.
+		virtual void SetFramesPerBeat(float framesPerBeat) {}
+
+		// Higher priority voices are kept real in preference to lower ones, however quiet.  Any thread.
+		void SetPriority(INT32 priority) { m_Priority = priority; }
+		INT32 GetPriority() const { return m_Priority; }
+
+		// Gain and pan the mixer applies to whatever the voice renders.
+		GainStage& GetGainStage() { return m_GainStage; }
+
+		// Filters the mixer runs whatever the voice renders through, before its gain stage.
+		FilterBank& GetFilterBank() { return m_FilterBank; }
+
+		// The delay line the mixer runs whatever the voice renders through, after its filters; nullptr until a
+		// client first sets one up.  Any thread.
+		DelayLine* GetDelayLine() const { return m_DelayLine.load(std::memory_order_acquire); }
+
+		// Get the voice's delay line, allocating it (with the given size) if it has none yet.  Never call this on
+		// an audio thread.
+		DelayLine* EnsureDelayLine(UINT32 channelCount, UINT32 maxDelayFrames)
+		{
+			DelayLine* delayLine = m_DelayLine.load(std::memory_order_acquire);
+			if (delayLine == nullptr)
+			{
+				DelayLine* newDelayLine = new DelayLine(channelCount, maxDelayFrames);
+				if (m_DelayLine.compare_exchange_strong(delayLine, newDelayLine, std::memory_order_acq_rel))
+				{
+					delayLine = newDelayLine;
+				}
+				else
+				{
+					// Another client got there first; delayLine now holds theirs.
+					delete newDelayLine;
+				}
+			}
+			return delayLine;
+		}
+
+		// Where the voice is around the listener, if the mixer spatializes it.
+		SpatialSource& GetSpatialSource() { return m_SpatialSource; }
+
+		// Called by the mixer (on the audio thread) when the voice is retired.  Voices which hold resources released
+		// elsewhere may override it to say so, but must call through and must not block.
+		virtual void MarkFinished() { m_IsFinished = true; }
+
+		// The mixer's virtualization state for this voice: whether it made this period's real voice budget, and
+		// the fade applied to its output, which moves towards 1 while it is wanted real and towards 0 while it
+		// is not.  A voice whose fade reaches 0 is virtual: it is skipped ahead instead of rendered.  The fade is
+		// negative until the mixer first ranks the voice.  Audio thread only.
+		bool IsWantedReal() const { return m_IsWantedReal; }
+		void SetWantedReal(bool isWantedReal) { m_IsWantedReal = isWantedReal; }
+		float& GetRealFade() { return m_RealFade; }
+
+	protected:
+		virtual ~AudioVoice() { delete m_DelayLine.load(); }
+
+		// Called from RenderVoice when the voice added nothing to the buffer this period (it is waiting for data,
+		// or its source is silent here).
+		void MarkOutputSilent() { m_IsOutputSilent = true; }
+
+	private:
+		const VoiceId m_VoiceId;
+		std::atomic<bool> m_IsStopRequested;
+		std::atomic<bool> m_IsFinished;
+		GainStage m_GainStage;
+		FilterBank m_FilterBank;
+		SpatialSource m_SpatialSource;
+
+		std::atomic<INT32> m_Priority;
+
+		// Owned by the voice once set.
+		std::atomic<DelayLine*> m_DelayLine;
+
+		// Audio thread only.
+		bool m_IsOutputSilent;
+		bool m_IsWantedReal;
+		float m_RealFade;
+	};
+}
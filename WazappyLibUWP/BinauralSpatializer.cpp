@@ -0,0 +1,465 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "BinauralSpatializer.h"
+
+using namespace Wazappy;
+
+std::atomic<UINT32> BinauralSpatializer::s_NextSerial(0);
+
+// Overwrite length floats of destination (a multiple of four) with the weighted sum of count sources.
+static void Blend(const float* const* sources, const float* weights, UINT32 count, float* destination, UINT32 length)
+{
+#if defined(_M_IX86) || defined(_M_X64)
+	for (UINT32 i = 0; i < length; i += 4)
+	{
+		__m128 sum = _mm_mul_ps(_mm_loadu_ps(sources[0] + i), _mm_set1_ps(weights[0]));
+		for (UINT32 k = 1; k < count; k++)
+		{
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(sources[k] + i), _mm_set1_ps(weights[k])));
+		}
+		_mm_storeu_ps(destination + i, sum);
+	}
+#else
+	for (UINT32 i = 0; i < length; i++)
+	{
+		float sum = sources[0][i] * weights[0];
+		for (UINT32 k = 1; k < count; k++)
+		{
+			sum += sources[k][i] * weights[k];
+		}
+		destination[i] = sum;
+	}
+#endif
+}
+
+BinauralSpatializer::BinauralSpatializer() :
+	m_Serial(s_NextSerial.fetch_add(1) + 1),
+	m_MaxSources(0),
+	m_PartitionCount(0),
+	m_Hrtf(SPATIALIZER_BLOCK_FRAMES),
+	m_Fft(SPATIALIZER_BLOCK_FRAMES * 2),
+	m_StageFrames(0),
+	m_StagedFrames(0),
+	m_Frame(0),
+	m_Block(0),
+	m_OutputFrames(0),
+	m_AudibleFrames(0),
+	m_HasOverflowed(false),
+	m_ActiveSources(0),
+	m_Blocks(0),
+	m_CrossfadeBlocks(0),
+	m_FilterUpdates(0),
+	m_OverflowPeriods(0),
+	m_ProcessTicks(0)
+{
+}
+
+HRESULT BinauralSpatializer::Initialize(const HRTFDATASET& dataset, UINT32 sampleRate, UINT32 maxSources)
+{
+	const UINT32 B = SPATIALIZER_BLOCK_FRAMES;
+	if (0 == maxSources || maxSources > SPATIALIZER_MAX_SOURCES)
+	{
+		return E_INVALIDARG;
+	}
+
+	HRESULT hr = m_Hrtf.Initialize(dataset, sampleRate);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	m_MaxSources = maxSources;
+	m_PartitionCount = m_Hrtf.GetPartitionCount();
+	const UINT32 P = m_PartitionCount;
+
+	m_Slots.resize(maxSources);
+	m_FilterSpectra.assign((size_t)maxSources * 2 * 2 * P * B, std::complex<float>());
+	m_InputSpectra.assign((size_t)maxSources * P * B, std::complex<float>());
+	m_UsedSlots.clear();
+	m_UsedSlots.reserve(maxSources);
+	m_FreeSlots.clear();
+	m_FreeSlots.reserve(maxSources);
+	for (UINT32 slot = maxSources; slot > 0; slot--)
+	{
+		m_FreeSlots.push_back(slot - 1);
+	}
+
+	for (UINT32 ear = 0; ear < 2; ear++)
+	{
+		m_Sums[ear].assign(B, std::complex<float>());
+		m_OldSums[ear].assign(B, std::complex<float>());
+		m_NewSums[ear].assign(B, std::complex<float>());
+	}
+	m_Samples.assign(B * 2, 0.0f);
+	m_FadeSamples.assign(B * 2, 0.0f);
+
+	// Equal gain, since both sides of a fade are the same source through much the same response.
+	m_Fade.resize(B);
+	for (UINT32 i = 0; i < B; i++)
+	{
+		double s = sin(M_PI_2 * (i + 0.5) / B);
+		m_Fade[i] = (float)(s * s);
+	}
+
+	return S_OK;
+}
+
+void BinauralSpatializer::Reserve(UINT32 maxFrameCount)
+{
+	const UINT32 B = SPATIALIZER_BLOCK_FRAMES;
+
+	// Staged input never reaches a block before a period's frames are added; the output queue likewise never
+	// holds a block before a period's blocks are appended.
+	m_StageFrames = (B * 2) + maxFrameCount;
+	m_Stage.assign((size_t)m_MaxSources * m_StageFrames, 0.0f);
+	m_StagedFrames = 0;
+	m_Output.Allocate(2, (B * 2) + maxFrameCount);
+	m_OutputFrames = B;
+	m_AudibleFrames = 0;
+}
+
+bool BinauralSpatializer::Attach(SpatialSource& source)
+{
+	if (source.m_SpatializerSerial == m_Serial && source.m_Slot != SPATIAL_NO_SLOT)
+	{
+		return true;
+	}
+
+	if (m_FreeSlots.empty())
+	{
+		m_HasOverflowed = true;
+		return false;
+	}
+
+	UINT32 slotIndex = m_FreeSlots.back();
+	m_FreeSlots.pop_back();
+	m_UsedSlots.push_back(slotIndex);
+
+	// Starts quiet, so its delay line is cleared when it is first fed; its staged input before then is silence.
+	Slot& slot = m_Slots[slotIndex];
+	slot.IsAttached = true;
+	slot.IsFed = false;
+	slot.IsQuiet = true;
+	slot.AudibleEnd = m_Frame - ((INT64)m_PartitionCount * SPATIALIZER_BLOCK_FRAMES);
+	slot.Cell = SPATIAL_NO_SLOT;
+	slot.TargetCell = SPATIAL_NO_SLOT;
+	slot.CurrentFilter = 0;
+	slot.HasDirection = false;
+	slot.SourceGeneration = 0;
+	slot.ListenerGeneration = 0;
+	memset(Stage(slotIndex), 0, (SPATIALIZER_BLOCK_FRAMES + m_StagedFrames) * sizeof(float));
+
+	source.m_SpatializerSerial = m_Serial;
+	source.m_Slot = slotIndex;
+	return true;
+}
+
+void BinauralSpatializer::Detach(SpatialSource& source)
+{
+	if (source.m_SpatializerSerial != m_Serial || source.m_Slot == SPATIAL_NO_SLOT)
+	{
+		return;
+	}
+
+	m_Slots[source.m_Slot].IsAttached = false;
+	source.m_Slot = SPATIAL_NO_SLOT;
+}
+
+void BinauralSpatializer::AddSource(SpatialSource& source, const PlanarView& input, UINT32 frameCount, const ListenerOrientation& listener)
+{
+	Slot& slot = m_Slots[source.m_Slot];
+
+	UINT32 sourceGeneration = source.GetGeneration();
+	UINT32 listenerGeneration = listener.GetGeneration();
+	if (!slot.HasDirection || sourceGeneration != slot.SourceGeneration || listenerGeneration != slot.ListenerGeneration)
+	{
+		float x, y, z;
+		source.GetPosition(&x, &y, &z);
+		listener.IntoHead(&x, &y, &z);
+		slot.TargetCell = HrtfSet::GetCell(x, y, z);
+		slot.HasDirection = true;
+		slot.SourceGeneration = sourceGeneration;
+		slot.ListenerGeneration = listenerGeneration;
+	}
+
+	float* stage = Stage(source.m_Slot) + SPATIALIZER_BLOCK_FRAMES + m_StagedFrames;
+	memcpy(stage, input.Channel(0), frameCount * sizeof(float));
+	for (UINT32 channel = 1; channel < input.ChannelCount; channel++)
+	{
+		const float* samples = input.Channel(channel);
+		for (UINT32 i = 0; i < frameCount; i++)
+		{
+			stage[i] += samples[i];
+		}
+	}
+	if (input.ChannelCount > 1)
+	{
+		float scale = 1.0f / input.ChannelCount;
+		for (UINT32 i = 0; i < frameCount; i++)
+		{
+			stage[i] *= scale;
+		}
+	}
+
+	slot.IsFed = true;
+	slot.AudibleEnd = m_Frame + m_StagedFrames + frameCount;
+}
+
+void BinauralSpatializer::BuildFilter(UINT32 slot, UINT32 filter, UINT32 cell)
+{
+	// Both ears' partitions lie together, for measurements and slots alike, so the blend is one run.
+	const HrtfSet::Blend& blend = m_Hrtf.GetBlend(cell);
+	const float* sources[HRTF_NEIGHBOURS];
+	for (UINT32 k = 0; k < HRTF_NEIGHBOURS; k++)
+	{
+		sources[k] = reinterpret_cast<const float*>(m_Hrtf.GetSpectrum(blend.Measurements[k], 0, 0));
+	}
+	UINT32 count = (blend.Weights[1] > 0) ? HRTF_NEIGHBOURS : 1;
+	Blend(sources, blend.Weights, count, reinterpret_cast<float*>(FilterSpectrum(slot, filter, 0, 0)), 2 * 2 * m_PartitionCount * SPATIALIZER_BLOCK_FRAMES);
+	m_FilterUpdates.store(m_FilterUpdates.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void BinauralSpatializer::Accumulate(UINT32 slot, UINT32 filter, UINT32 index, std::vector<std::complex<float>>* sums)
+{
+	// Partition p meets the input from p blocks ago.
+	for (UINT32 ear = 0; ear < 2; ear++)
+	{
+		UINT32 inputIndex = index;
+		for (UINT32 partition = 0; partition < m_PartitionCount; partition++)
+		{
+			RealFft::MultiplyAccumulate(FilterSpectrum(slot, filter, ear, partition), InputSpectrum(slot, inputIndex), sums[ear].data(), SPATIALIZER_BLOCK_FRAMES);
+			inputIndex = (0 == inputIndex) ? (m_PartitionCount - 1) : (inputIndex - 1);
+		}
+	}
+}
+
+void BinauralSpatializer::ProcessBlock(UINT32 offset)
+{
+	const UINT32 B = SPATIALIZER_BLOCK_FRAMES;
+	const UINT32 P = m_PartitionCount;
+	UINT32 index = (UINT32)(m_Block % P);
+	bool isAudible = false;
+	bool isCrossfading = false;
+	for (UINT32 ear = 0; ear < 2; ear++)
+	{
+		std::fill(m_Sums[ear].begin(), m_Sums[ear].end(), std::complex<float>());
+	}
+
+	size_t i = 0;
+	while (i < m_UsedSlots.size())
+	{
+		UINT32 slotIndex = m_UsedSlots[i];
+		Slot& slot = m_Slots[slotIndex];
+
+		// Once the input has been silent for as long as the response, so is the output; a slot let go of is
+		// then done with.
+		if (slot.AudibleEnd <= m_Frame - ((INT64)P * B))
+		{
+			if (!slot.IsAttached)
+			{
+				m_UsedSlots[i] = m_UsedSlots.back();
+				m_UsedSlots.pop_back();
+				m_FreeSlots.push_back(slotIndex);
+				continue;
+			}
+			slot.IsQuiet = true;
+			i++;
+			continue;
+		}
+
+		// Coming back from quiet, the delay line holds stale spectra.
+		if (slot.IsQuiet)
+		{
+			std::fill(InputSpectrum(slotIndex, 0), InputSpectrum(slotIndex, 0) + ((size_t)P * B), std::complex<float>());
+			slot.IsQuiet = false;
+		}
+
+		// The window is the previous block and this one; with both silent its spectrum is zero.
+		std::complex<float>* spectrum = InputSpectrum(slotIndex, index);
+		if (slot.AudibleEnd <= m_Frame - B)
+		{
+			std::fill(spectrum, spectrum + B, std::complex<float>());
+		}
+		else
+		{
+			m_Fft.Forward(Stage(slotIndex) + offset, spectrum);
+		}
+
+		// The first response is used straight away; later ones are faded to.
+		if (SPATIAL_NO_SLOT == slot.Cell)
+		{
+			BuildFilter(slotIndex, slot.CurrentFilter, slot.TargetCell);
+			slot.Cell = slot.TargetCell;
+		}
+
+		if (slot.TargetCell == slot.Cell)
+		{
+			Accumulate(slotIndex, slot.CurrentFilter, index, m_Sums);
+		}
+		else
+		{
+			if (!isCrossfading)
+			{
+				for (UINT32 ear = 0; ear < 2; ear++)
+				{
+					std::fill(m_OldSums[ear].begin(), m_OldSums[ear].end(), std::complex<float>());
+					std::fill(m_NewSums[ear].begin(), m_NewSums[ear].end(), std::complex<float>());
+				}
+				isCrossfading = true;
+			}
+
+			UINT32 next = 1 - slot.CurrentFilter;
+			BuildFilter(slotIndex, next, slot.TargetCell);
+			Accumulate(slotIndex, slot.CurrentFilter, index, m_OldSums);
+			Accumulate(slotIndex, next, index, m_NewSums);
+			slot.CurrentFilter = next;
+			slot.Cell = slot.TargetCell;
+		}
+
+		isAudible = true;
+		i++;
+	}
+
+	// The first half of each inverse transform is wrapped around by the circular convolution; the second is
+	// the output.
+	for (UINT32 ear = 0; ear < 2; ear++)
+	{
+		float* output = m_Output.Channel(ear) + m_OutputFrames;
+		if (!isAudible)
+		{
+			memset(output, 0, B * sizeof(float));
+		}
+		else if (!isCrossfading)
+		{
+			m_Fft.Inverse(m_Sums[ear].data(), m_Samples.data());
+			memcpy(output, m_Samples.data() + B, B * sizeof(float));
+		}
+		else
+		{
+			std::complex<float>* sums = m_Sums[ear].data();
+			std::complex<float>* oldSums = m_OldSums[ear].data();
+			std::complex<float>* newSums = m_NewSums[ear].data();
+			for (UINT32 bin = 0; bin < B; bin++)
+			{
+				newSums[bin] += sums[bin];
+				sums[bin] += oldSums[bin];
+			}
+			m_Fft.Inverse(sums, m_Samples.data());
+			m_Fft.Inverse(newSums, m_FadeSamples.data());
+
+			const float* from = m_Samples.data() + B;
+			const float* to = m_FadeSamples.data() + B;
+			for (UINT32 frame = 0; frame < B; frame++)
+			{
+				output[frame] = from[frame] + (m_Fade[frame] * (to[frame] - from[frame]));
+			}
+		}
+	}
+
+	m_OutputFrames += B;
+	if (isAudible)
+	{
+		m_AudibleFrames = m_OutputFrames;
+	}
+
+	m_Frame += B;
+	m_Block++;
+	m_Blocks.store(m_Blocks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	if (isCrossfading)
+	{
+		m_CrossfadeBlocks.store(m_CrossfadeBlocks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+}
+
+bool BinauralSpatializer::Render(const PlanarView& mix, UINT32 frameCount)
+{
+	const UINT32 B = SPATIALIZER_BLOCK_FRAMES;
+
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+
+	// Sources which gave nothing this period are silent through it.
+	for (UINT32 slotIndex : m_UsedSlots)
+	{
+		Slot& slot = m_Slots[slotIndex];
+		if (!slot.IsFed)
+		{
+			memset(Stage(slotIndex) + B + m_StagedFrames, 0, frameCount * sizeof(float));
+		}
+		slot.IsFed = false;
+	}
+	m_StagedFrames += frameCount;
+
+	UINT32 offset = 0;
+	while (offset + B <= m_StagedFrames)
+	{
+		ProcessBlock(offset);
+		offset += B;
+	}
+
+	// Keep the last block convolved, as the first half of the next window, and whatever is staged after it.
+	if (offset > 0)
+	{
+		m_StagedFrames -= offset;
+		for (UINT32 slotIndex : m_UsedSlots)
+		{
+			memmove(Stage(slotIndex), Stage(slotIndex) + offset, (B + m_StagedFrames) * sizeof(float));
+		}
+	}
+
+	bool isAudible = m_AudibleFrames > 0;
+	for (UINT32 ear = 0; ear < 2; ear++)
+	{
+		float* output = m_Output.Channel(ear);
+		if (isAudible)
+		{
+			float* samples = mix.Channel(ear);
+			for (UINT32 frame = 0; frame < frameCount; frame++)
+			{
+				samples[frame] += output[frame];
+			}
+		}
+		memmove(output, output + frameCount, (m_OutputFrames - frameCount) * sizeof(float));
+	}
+	m_OutputFrames -= frameCount;
+	m_AudibleFrames = (m_AudibleFrames > frameCount) ? (m_AudibleFrames - frameCount) : 0;
+
+	if (m_HasOverflowed)
+	{
+		m_OverflowPeriods.store(m_OverflowPeriods.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		m_HasOverflowed = false;
+	}
+	m_ActiveSources.store((UINT32)m_UsedSlots.size(), std::memory_order_relaxed);
+
+	LARGE_INTEGER end;
+	QueryPerformanceCounter(&end);
+	m_ProcessTicks.store(m_ProcessTicks.load(std::memory_order_relaxed) + (end.QuadPart - start.QuadPart), std::memory_order_relaxed);
+
+	return isAudible;
+}
+
+void BinauralSpatializer::GetStatistics(SPATIALIZERSTATS* stats) const
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	stats->MaxSources = m_MaxSources;
+	stats->ActiveSources = m_ActiveSources.load(std::memory_order_relaxed);
+	stats->PartitionCount = m_PartitionCount;
+	stats->LatencyFrames = SPATIALIZER_BLOCK_FRAMES;
+	stats->Blocks = m_Blocks.load(std::memory_order_relaxed);
+	stats->CrossfadeBlocks = m_CrossfadeBlocks.load(std::memory_order_relaxed);
+	stats->FilterUpdates = m_FilterUpdates.load(std::memory_order_relaxed);
+	stats->OverflowPeriods = m_OverflowPeriods.load(std::memory_order_relaxed);
+	stats->ProcessNanoseconds = (UINT64)((double)m_ProcessTicks.load(std::memory_order_relaxed) * 1e9 / frequency.QuadPart);
+}
@@ -0,0 +1,187 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <complex>
+#include <vector>
+
+#include "WazappyDllInterface.h"
+#include "Fft.h"
+#include "HrtfSet.h"
+#include "PlanarBuffer.h"
+#include "SpatialSource.h"
+
+using namespace Microsoft::WRL;
+
+// Frames in each block the spatializer convolves, and so the frames spatialized voices run behind the rest.
+#define SPATIALIZER_BLOCK_FRAMES 128
+
+// Most sources a spatializer can be loaded with room for.
+#define SPATIALIZER_MAX_SOURCES 1024
+
+namespace Wazappy
+{
+	// Renders many voices binaurally, each through the head related impulse responses for its direction from the
+	// listener's head, into the first two channels of the mix.
+	// The impulse responses come from a measured dataset, loaded into an HrtfSet, whose grid each source's
+	// direction is rounded to.
+	// Convolution is by uniformly partitioned overlap-save in blocks of SPATIALIZER_BLOCK_FRAMES, batched across
+	// sources: each source's block of input is transformed once, into a delay line of its past spectra, and its
+	// products with its partitions' spectra are summed with every other source's in the frequency domain, so the
+	// two ears need one inverse transform each per block however many sources there are.  A source whose
+	// direction changes (because it moved, or the listener turned) has a new response built and is crossfaded
+	// to it over a block: that block, it contributes its old response's output to one pair of sums and its new
+	// one's to another, which are transformed separately and crossfaded in the time domain, so a block with any
+	// number of changes costs two more inverse transforms.  Sources whose input has been silent for as long as
+	// their response skip all their work.
+	// Initialize and Reserve are for client threads; everything else but GetStatistics is audio thread only.
+	class BinauralSpatializer :
+		public RuntimeClass<RuntimeClassFlags<ClassicCom>, IUnknown>
+	{
+	public:
+		BinauralSpatializer();
+
+		// Load the dataset, resampling it to sampleRate if need be, with room for maxSources sources.  Allocates
+		// and transforms every impulse response, so may take a while.
+		HRESULT Initialize(const HRTFDATASET& dataset, UINT32 sampleRate, UINT32 maxSources);
+
+		// Size the spatializer for periods of up to maxFrameCount frames.  Must be called before Render, and not
+		// concurrently with it.
+		void Reserve(UINT32 maxFrameCount);
+
+		UINT32 GetLatencyFrames() const { return SPATIALIZER_BLOCK_FRAMES; }
+
+		// Give source a place in the spatializer, if it has none yet.  Returns false if none is free; the
+		// source's voice is then silent this period.
+		bool Attach(SpatialSource& source);
+
+		// Take source's place away, if it has one.  Whatever it has been given already plays out.
+		void Detach(SpatialSource& source);
+
+		// Take frameCount frames of an attached source's audio (downmixed from input's channels), placed where its
+		// position is relative to listener.  Called at most once per source per period, before Render.
+		void AddSource(SpatialSource& source, const PlanarView& input, UINT32 frameCount, const ListenerOrientation& listener);
+
+		// Add the spatialized output of every source for the period into the first two channels of mix, which
+		// must have at least two.  Returns false if nothing audible was added.
+		bool Render(const PlanarView& mix, UINT32 frameCount);
+
+		// Any thread.
+		void GetStatistics(SPATIALIZERSTATS* stats) const;
+
+	private:
+		virtual ~BinauralSpatializer() {}
+
+		// What the spatializer knows of a source with a place in it.
+		struct Slot
+		{
+			// Whether a source holds the slot; once it lets go, the slot plays out its tail and is then freed.
+			bool IsAttached;
+
+			// Whether the source gave audio this period; if not, it is taken as silent.
+			bool IsFed;
+
+			// Whether everything in the slot's delay line is silent (or stale), so it has nothing to contribute.
+			bool IsQuiet;
+
+			// Frame (counted from the spatializer's start) after the last the source gave audio for.
+			INT64 AudibleEnd;
+
+			// Grid points of the response in use and of the one wanted, or SPATIAL_NO_SLOT before the first.
+			UINT32 Cell;
+			UINT32 TargetCell;
+
+			// Which of the slot's two response buffers is in use.
+			UINT32 CurrentFilter;
+
+			// The source's and the listener's generations the target was worked out for.
+			bool HasDirection;
+			UINT32 SourceGeneration;
+			UINT32 ListenerGeneration;
+		};
+
+		// Blend the response for cell into the given response buffer of a slot.
+		void BuildFilter(UINT32 slot, UINT32 filter, UINT32 cell);
+
+		// Convolve one block for every source, from the given offset into their staged input, and append the
+		// output to m_Output.
+		void ProcessBlock(UINT32 offset);
+
+		// Add the products of a slot's delay line, whose newest spectrum is at index, with one of its response
+		// buffers into each ear's sums.
+		void Accumulate(UINT32 slot, UINT32 filter, UINT32 index, std::vector<std::complex<float>>* sums);
+
+		std::complex<float>* FilterSpectrum(UINT32 slot, UINT32 filter, UINT32 ear, UINT32 partition)
+		{
+			return &m_FilterSpectra[((((((size_t)slot * 2) + filter) * 2) + ear) * m_PartitionCount + partition) * SPATIALIZER_BLOCK_FRAMES];
+		}
+		std::complex<float>* InputSpectrum(UINT32 slot, UINT32 index)
+		{
+			return &m_InputSpectra[(((size_t)slot * m_PartitionCount) + index) * SPATIALIZER_BLOCK_FRAMES];
+		}
+		float* Stage(UINT32 slot) { return &m_Stage[(size_t)slot * m_StageFrames]; }
+
+	private:
+		// Identifies this spatializer to the sources attached to it.
+		const UINT32 m_Serial;
+		static std::atomic<UINT32> s_NextSerial;
+
+		UINT32 m_MaxSources;
+		UINT32 m_PartitionCount;
+		HrtfSet m_Hrtf;
+
+		// Transform of two blocks of real samples; each spectrum is SPATIALIZER_BLOCK_FRAMES packed bins.
+		RealFft m_Fft;
+
+		// Per slot: the state above, two buffers of response spectra ([slot][filter][ear][partition][bin]), and
+		// the delay line of input spectra ([slot][index][bin]; block j's is at index j % m_PartitionCount).
+		std::vector<Slot> m_Slots;
+		std::vector<std::complex<float>> m_FilterSpectra;
+		std::vector<std::complex<float>> m_InputSpectra;
+
+		// Slots in use, in no order, and those free.
+		std::vector<UINT32> m_UsedSlots;
+		std::vector<UINT32> m_FreeSlots;
+
+		// Each slot's staged mono input, m_StageFrames long: the block before the next to convolve, then
+		// m_StagedFrames frames not yet convolved.
+		std::vector<float> m_Stage;
+		UINT32 m_StageFrames;
+		UINT32 m_StagedFrames;
+
+		// Frame (counted from the start) the next block to convolve starts at, and its index.
+		INT64 m_Frame;
+		UINT64 m_Block;
+
+		// Output not yet mixed, two channels, m_OutputFrames long (always SPATIALIZER_BLOCK_FRAMES less
+		// m_StagedFrames between periods).  Only the first m_AudibleFrames frames may be other than silent.
+		PlanarBuffer m_Output;
+		UINT32 m_OutputFrames;
+		UINT32 m_AudibleFrames;
+
+		// Set when a source could not be given a slot this period.
+		bool m_HasOverflowed;
+
+		// Per block scratch: each ear's sum of products, for sources keeping their responses and for the old and
+		// new responses of those changing them; and the samples of the inverse transforms either side of a fade.
+		std::vector<std::complex<float>> m_Sums[2];
+		std::vector<std::complex<float>> m_OldSums[2];
+		std::vector<std::complex<float>> m_NewSums[2];
+		std::vector<float> m_Samples;
+		std::vector<float> m_FadeSamples;
+
+		// Gain of the new response across a crossfade block.
+		std::vector<float> m_Fade;
+
+		// Written on the audio thread, read by GetStatistics.
+		std::atomic<UINT32> m_ActiveSources;
+		std::atomic<UINT64> m_Blocks;
+		std::atomic<UINT64> m_CrossfadeBlocks;
+		std::atomic<UINT64> m_FilterUpdates;
+		std::atomic<UINT64> m_OverflowPeriods;
+		std::atomic<UINT64> m_ProcessTicks;
+	};
+}
@@ -0,0 +1,286 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include "CaptureLinkVoice.h"
+
+using namespace Wazappy;
+
+CaptureLinkVoice::CaptureLinkVoice(
+	VoiceId voiceId,
+	UINT32 captureChannelCount,
+	UINT32 captureSampleRate,
+	UINT32 renderChannelCount,
+	UINT32 renderSampleRate,
+	UINT32 targetFrames,
+	UINT32 maxFrameCount,
+	const DeviceClock* renderClock,
+	bool isAdaptive,
+	UINT32 inputLatencyMicroseconds) :
+	CaptureSinkVoice(voiceId),
+	m_CaptureChannelCount(captureChannelCount),
+	m_CaptureSampleRate(captureSampleRate),
+	m_RenderChannelCount(renderChannelCount),
+	m_RenderSampleRate(renderSampleRate),
+	m_MinimumTargetFrames(targetFrames),
+	m_MaxFrameCount(maxFrameCount),
+	m_IsAdaptive(isAdaptive),
+	m_InputLatencyMicroseconds(inputLatencyMicroseconds),
+	m_TargetFrames(targetFrames),
+	m_NominalRatio((double)captureSampleRate / renderSampleRate),
+	m_RenderClock(renderClock),
+	m_RingFrames(1),
+	m_WritePosition(0),
+	m_ReadPosition(0),
+	m_CaptureRateRatio(1.0),
+	m_LastPacketEnd(0),
+	m_IsLocked(false),
+	m_SmoothedFill(0.0),
+	m_Integral(0.0),
+	m_LargestTargetFrames(0),
+	m_WindowFrames(0),
+	m_WindowHeadroom(UINT_MAX),
+	m_DriftPartsPerMillion(0),
+	m_CorrectionPartsPerMillion(0),
+	m_OverrunCount(0),
+	m_UnderrunCount(0),
+	m_HeadroomFrames(0),
+	m_SmoothedFillFrames(0)
+{
+	Contract::Requires(targetFrames > 0, L"Link must buffer something");
+	Contract::Requires(renderClock != nullptr, L"Render clock must be given");
+
+	// Room for the target, plus a generous margin for capture packets arriving in bursts (and, if adaptive,
+	// for the target to grow).
+	UINT32 ringMinimum = 4 * (targetFrames + maxFrameCount) * (isAdaptive ? 2 : 1);
+	while (m_RingFrames < ringMinimum)
+	{
+		m_RingFrames <<= 1;
+	}
+	m_LargestTargetFrames = m_RingFrames / 2 - maxFrameCount;
+	m_Ring.Allocate(captureChannelCount, m_RingFrames);
+
+	// Enough input for a full period at the largest ratio the controller and clock estimates can produce.
+	UINT32 maxInputFrames = (UINT32)(maxFrameCount * m_NominalRatio * (1.0 + CAPTURE_LINK_MAX_CORRECTION + 2 * DEVICE_CLOCK_MAX_DEVIATION)) + 4;
+	m_InputScratch.Allocate(captureChannelCount, maxInputFrames);
+	m_OutputScratch.Allocate(captureChannelCount, maxFrameCount);
+	m_Resampler.Reset(captureChannelCount);
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_QpcFrequency = frequency.QuadPart;
+}
+
+void CaptureLinkVoice::Reserve(UINT32 maxFrameCount)
+{
+	if (maxFrameCount <= m_MaxFrameCount)
+	{
+		return;
+	}
+
+	m_MaxFrameCount = maxFrameCount;
+	UINT32 maxInputFrames = (UINT32)(maxFrameCount * m_NominalRatio * (1.0 + CAPTURE_LINK_MAX_CORRECTION + 2 * DEVICE_CLOCK_MAX_DEVIATION)) + 4;
+	m_InputScratch.Allocate(m_CaptureChannelCount, maxInputFrames);
+	m_OutputScratch.Allocate(m_CaptureChannelCount, maxFrameCount);
+	m_LargestTargetFrames = max(m_MinimumTargetFrames, (m_RingFrames / 2 > maxFrameCount) ? (m_RingFrames / 2 - maxFrameCount) : 0);
+	m_TargetFrames.store(min(m_TargetFrames.load(std::memory_order_relaxed), m_LargestTargetFrames), std::memory_order_relaxed);
+}
+
+void CaptureLinkVoice::WriteCapturedFrames(const PlanarView& frames, UINT32 frameCount, UINT64 qpcPosition, double captureRateRatio)
+{
+	m_CaptureRateRatio.store(captureRateRatio, std::memory_order_relaxed);
+	m_LastPacketEnd.store(qpcPosition + (UINT64)frameCount * 10000000 / m_CaptureSampleRate, std::memory_order_relaxed);
+
+	UINT64 writePosition = m_WritePosition.load(std::memory_order_relaxed);
+	UINT32 buffered = (UINT32)(writePosition - m_ReadPosition.load(std::memory_order_acquire));
+	UINT32 framesToWrite = min(frameCount, m_RingFrames - buffered);
+	if (framesToWrite < frameCount)
+	{
+		m_OverrunCount++;
+	}
+
+	// Copy in up to two pieces, around the end of the ring.
+	UINT32 ringOffset = (UINT32)(writePosition & (m_RingFrames - 1));
+	UINT32 firstPiece = min(framesToWrite, m_RingFrames - ringOffset);
+	for (UINT32 c = 0; c < m_CaptureChannelCount; c++)
+	{
+		CopyMemory(m_Ring.Channel(c) + ringOffset, frames.Channel(c), firstPiece * sizeof(float));
+		CopyMemory(m_Ring.Channel(c), frames.Channel(c) + firstPiece, (framesToWrite - firstPiece) * sizeof(float));
+	}
+
+	m_WritePosition.store(writePosition + framesToWrite, std::memory_order_release);
+}
+
+double CaptureLinkVoice::GetContinuousFill(UINT32 buffered) const
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	UINT64 now100ns = (UINT64)((double)now.QuadPart * 10000000.0 / m_QpcFrequency);
+
+	UINT64 lastPacketEnd = m_LastPacketEnd.load(std::memory_order_relaxed);
+	if (lastPacketEnd == 0 || now100ns <= lastPacketEnd)
+	{
+		return buffered;
+	}
+
+	// Never credit more than one buffer's worth, in case the capture device has stopped delivering.
+	double pending = (double)(now100ns - lastPacketEnd) * m_CaptureSampleRate / 10000000.0;
+	return buffered + min(pending, (double)m_MaxFrameCount);
+}
+
+double CaptureLinkVoice::UpdateRatio(UINT32 buffered, UINT32 frameCount)
+{
+	// Feed forward the measured drift between the two clocks...
+	double drift = m_CaptureRateRatio.load(std::memory_order_relaxed) / m_RenderClock->GetRateRatio();
+
+	// ...and let the PI controller take out whatever error remains in the estimate, steering the smoothed fill
+	// back to the target.  Running fuller than the target means reading a little faster.
+	UINT32 targetFrames = m_TargetFrames.load(std::memory_order_relaxed);
+	m_SmoothedFill += CAPTURE_LINK_FILL_SMOOTHING * (GetContinuousFill(buffered) - m_SmoothedFill);
+	m_SmoothedFillFrames.store((UINT32)m_SmoothedFill, std::memory_order_relaxed);
+	double error = (m_SmoothedFill - targetFrames) / targetFrames;
+
+	double periodSeconds = (double)frameCount / m_RenderSampleRate;
+	double maxIntegral = CAPTURE_LINK_MAX_CORRECTION / CAPTURE_LINK_INTEGRAL_GAIN;
+	m_Integral += error * periodSeconds;
+	m_Integral = max(-maxIntegral, min(maxIntegral, m_Integral));
+
+	double correction = CAPTURE_LINK_PROPORTIONAL_GAIN * error + CAPTURE_LINK_INTEGRAL_GAIN * m_Integral;
+	correction = max(-CAPTURE_LINK_MAX_CORRECTION, min(CAPTURE_LINK_MAX_CORRECTION, correction));
+
+	m_DriftPartsPerMillion.store((INT32)((drift - 1.0) * 1000000.0), std::memory_order_relaxed);
+	m_CorrectionPartsPerMillion.store((INT32)(correction * 1000000.0), std::memory_order_relaxed);
+
+	return m_NominalRatio * drift * (1.0 + correction);
+}
+
+void CaptureLinkVoice::AdaptTarget(UINT32 headroom, UINT32 frameCount)
+{
+	m_WindowHeadroom = min(m_WindowHeadroom, headroom);
+	m_WindowFrames += frameCount;
+	if (m_WindowFrames < (UINT64)m_RenderSampleRate * CAPTURE_LINK_ADAPT_WINDOW_MS / 1000)
+	{
+		return;
+	}
+
+	m_HeadroomFrames.store(m_WindowHeadroom, std::memory_order_relaxed);
+
+	// The controller moves the fill to a new target gradually (at most CAPTURE_LINK_MAX_CORRECTION of the rate),
+	// so retargeting is inaudible.
+	UINT32 wanted = (UINT32)(frameCount * m_NominalRatio * CAPTURE_LINK_HEADROOM_FRACTION);
+	UINT32 targetFrames = m_TargetFrames.load(std::memory_order_relaxed);
+	if (m_WindowHeadroom < wanted)
+	{
+		targetFrames += wanted - m_WindowHeadroom;
+	}
+	else if (m_WindowHeadroom > 2 * wanted)
+	{
+		// Give back a quarter of the surplus per window; jitter tends to come in bursts, so be slow to trust calm.
+		targetFrames -= min(targetFrames - m_MinimumTargetFrames, (m_WindowHeadroom - wanted) / 4);
+	}
+	m_TargetFrames.store(min(targetFrames, m_LargestTargetFrames), std::memory_order_relaxed);
+
+	m_WindowFrames = 0;
+	m_WindowHeadroom = UINT_MAX;
+}
+
+UINT32 CaptureLinkVoice::RenderVoice(const PlanarView& mix, UINT32 frameCount)
+{
+	Contract::Requires(mix.ChannelCount == m_RenderChannelCount, L"Link must be created in the device's channel count");
+	Contract::Requires(frameCount <= m_MaxFrameCount, L"Period must fit the link's scratch buffers");
+
+	UINT64 readPosition = m_ReadPosition.load(std::memory_order_relaxed);
+	UINT32 buffered = (UINT32)(m_WritePosition.load(std::memory_order_acquire) - readPosition);
+
+	if (!m_IsLocked)
+	{
+		UINT32 targetFrames = m_TargetFrames.load(std::memory_order_relaxed);
+		if (buffered < targetFrames)
+		{
+			// Still filling up to the target; stay alive but silent.
+			MarkOutputSilent();
+			return frameCount;
+		}
+
+		// Skip anything beyond the target, so playback starts at exactly the target latency.
+		readPosition += buffered - targetFrames;
+		buffered = targetFrames;
+		m_SmoothedFill = targetFrames;
+		m_Integral = 0.0;
+		m_Resampler.Reset(m_CaptureChannelCount);
+		m_IsLocked = true;
+	}
+
+	double ratio = UpdateRatio(buffered, frameCount);
+	UINT32 framesNeeded = m_Resampler.GetInputFramesNeeded(frameCount, ratio);
+	if (framesNeeded > buffered)
+	{
+		// The capture device stalled; go quiet and build back up to the target.  An adaptive link takes this as
+		// proof its target was too small, and adds half a period straight away.
+		m_UnderrunCount++;
+		m_IsLocked = false;
+		if (m_IsAdaptive)
+		{
+			UINT32 targetFrames = m_TargetFrames.load(std::memory_order_relaxed) + (UINT32)(frameCount * m_NominalRatio / 2);
+			m_TargetFrames.store(min(targetFrames, m_LargestTargetFrames), std::memory_order_relaxed);
+			m_WindowFrames = 0;
+			m_WindowHeadroom = UINT_MAX;
+		}
+		m_ReadPosition.store(readPosition, std::memory_order_release);
+		MarkOutputSilent();
+		return frameCount;
+	}
+
+	// Gather the input contiguously, in up to two pieces around the end of the ring.
+	UINT32 ringOffset = (UINT32)(readPosition & (m_RingFrames - 1));
+	UINT32 firstPiece = min(framesNeeded, m_RingFrames - ringOffset);
+	for (UINT32 c = 0; c < m_CaptureChannelCount; c++)
+	{
+		CopyMemory(m_InputScratch.Channel(c), m_Ring.Channel(c) + ringOffset, firstPiece * sizeof(float));
+		CopyMemory(m_InputScratch.Channel(c) + firstPiece, m_Ring.Channel(c), (framesNeeded - firstPiece) * sizeof(float));
+	}
+
+	if (m_IsAdaptive)
+	{
+		AdaptTarget(buffered - framesNeeded, frameCount);
+	}
+
+	UINT32 consumed = m_Resampler.Process(m_InputScratch.GetView(), framesNeeded, m_OutputScratch.GetView(), frameCount, ratio);
+	m_ReadPosition.store(readPosition + consumed, std::memory_order_release);
+
+	// Mix in, spreading mono input to every output channel and dropping input channels the output lacks.
+	for (UINT32 c = 0; c < mix.ChannelCount; c++)
+	{
+		UINT32 sourceChannel = (m_CaptureChannelCount == 1) ? 0 : c;
+		if (sourceChannel >= m_CaptureChannelCount)
+		{
+			continue;
+		}
+
+		const float* source = m_OutputScratch.Channel(sourceChannel);
+		float* destination = mix.Channel(c);
+		for (UINT32 frame = 0; frame < frameCount; frame++)
+		{
+			destination[frame] += source[frame];
+		}
+	}
+
+	return frameCount;
+}
+
+void CaptureLinkVoice::GetStatistics(CAPTURELINKSTATS* stats) const
+{
+	stats->TargetFrames = m_TargetFrames;
+	stats->BufferedFrames = GetBufferedFrames();
+	stats->ClockDriftPartsPerMillion = m_DriftPartsPerMillion;
+	stats->CorrectionPartsPerMillion = m_CorrectionPartsPerMillion;
+	stats->OverrunCount = m_OverrunCount;
+	stats->UnderrunCount = m_UnderrunCount;
+	stats->IsAdaptive = m_IsAdaptive;
+	stats->HeadroomFrames = m_HeadroomFrames;
+
+	// Input latency ahead of the ring, plus the time audio spends in the ring itself.
+	UINT64 fillMicroseconds = (UINT64)m_SmoothedFillFrames * 1000000 / m_CaptureSampleRate;
+	stats->RoundTripMicroseconds = m_InputLatencyMicroseconds + (UINT32)fillMicroseconds;
+}
@@ -0,0 +1,153 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <vector>
+
+#include "CaptureSinkVoice.h"
+#include "DeviceClock.h"
+#include "DriftResampler.h"
+
+// Proportional and integral gains of the fill controller, applied to the fill error as a fraction of the target.
+#define CAPTURE_LINK_PROPORTIONAL_GAIN 0.001
+#define CAPTURE_LINK_INTEGRAL_GAIN 0.0001
+
+// Largest correction the fill controller may apply to the resampling ratio.
+#define CAPTURE_LINK_MAX_CORRECTION 0.002
+
+// Weight given to each period's fill level in the smoothed fill the controller acts on.
+#define CAPTURE_LINK_FILL_SMOOTHING 0.02
+
+// Latency to ask for to get an adaptive link.
+#define CAPTURE_LINK_ADAPTIVE_LATENCY 0
+
+// How often an adaptive link reconsiders its target, in milliseconds of render time.
+#define CAPTURE_LINK_ADAPT_WINDOW_MS 1000
+
+// Headroom an adaptive link keeps between the input it needs each period and what is buffered, as a fraction
+// of the period; the target grows until the smallest headroom seen in a window reaches this.
+#define CAPTURE_LINK_HEADROOM_FRACTION 0.25
+
+namespace Wazappy
+{
+	// Voice which plays the live input of a capture device on a render device.
+	// The capture device's audio thread writes converted planar frames into a lock-free ring; the render device's
+	// audio thread reads them back through a DriftResampler.  The two devices' clocks never run at exactly the
+	// same rate, so the resampling ratio is the nominal rate ratio, corrected by both DeviceClocks' measured rates
+	// and trimmed by a PI controller which holds the ring at the target fill.  That way the link can run
+	// indefinitely without the ring slowly overrunning or running dry.
+	// An adaptive link (used for input monitoring) starts with the smallest workable target and moves it to
+	// follow the scheduling jitter it actually sees: up at once when headroom runs short, down slowly when a
+	// whole window passes with headroom to spare.
+	class CaptureLinkVoice : public CaptureSinkVoice
+	{
+	public:
+		// targetFrames is the ring fill to hold, in capture frames (the starting and smallest fill, if adaptive);
+		// maxFrameCount is the largest period the render device will ask for.  renderClock must outlive the voice
+		// (it belongs to the render device whose mixer holds the voice).  inputLatencyMicroseconds is the capture
+		// device's latency ahead of the ring, for the round trip estimate.
+		CaptureLinkVoice(
+			VoiceId voiceId,
+			UINT32 captureChannelCount,
+			UINT32 captureSampleRate,
+			UINT32 renderChannelCount,
+			UINT32 renderSampleRate,
+			UINT32 targetFrames,
+			UINT32 maxFrameCount,
+			const DeviceClock* renderClock,
+			bool isAdaptive,
+			UINT32 inputLatencyMicroseconds);
+
+		// Append captured frames.  Frames which do not fit are dropped and counted as an overrun.
+		virtual void WriteCapturedFrames(const PlanarView& frames, UINT32 frameCount, UINT64 qpcPosition, double captureRateRatio);
+
+		virtual UINT32 RenderVoice(const PlanarView& mix, UINT32 frameCount);
+
+		// Grow the render side's scratch buffers.  The ring, which the capture thread writes, keeps its size; a
+		// period much longer than the link was made for leaves it less room for the target to grow.
+		virtual void Reserve(UINT32 maxFrameCount);
+
+		virtual UINT32 GetCaptureChannelCount() const { return m_CaptureChannelCount; }
+
+		virtual bool IsLiveInput() const { return true; }
+
+		// Under load, resample linearly.
+		virtual void SetShedLevel(ShedLevel level) { m_Resampler.SetLinear(level >= ShedLevel_Quality); }
+
+		// Frames written and not yet read.  Any thread.
+		UINT32 GetBufferedFrames() const { return (UINT32)(m_WritePosition - m_ReadPosition); }
+
+		// Fills in everything but the render device's own output latency, which the device adds to
+		// RoundTripMicroseconds.
+		void GetStatistics(CAPTURELINKSTATS* stats) const;
+
+	protected:
+		virtual ~CaptureLinkVoice() {}
+
+	private:
+		// The fill level as of now, counting frames the capture device has recorded since its last packet.
+		// Capture packets arrive in bursts of a period or more, so the raw fill is a sawtooth whose phase
+		// against the render period wanders slowly; left in, that would steer the controller.
+		double GetContinuousFill(UINT32 buffered) const;
+
+		// Recompute the resampling ratio from the clocks and the fill level.  Render audio thread only.
+		double UpdateRatio(UINT32 buffered, UINT32 frameCount);
+
+		// Note this period's headroom and, at the end of each window, retarget.  Render audio thread only.
+		void AdaptTarget(UINT32 headroom, UINT32 frameCount);
+
+	private:
+		const UINT32 m_CaptureChannelCount;
+		const UINT32 m_CaptureSampleRate;
+		const UINT32 m_RenderChannelCount;
+		const UINT32 m_RenderSampleRate;
+		const UINT32 m_MinimumTargetFrames;
+		UINT32 m_MaxFrameCount;
+		const bool m_IsAdaptive;
+		const UINT32 m_InputLatencyMicroseconds;
+
+		// Only written on the render audio thread.
+		std::atomic<UINT32> m_TargetFrames;
+
+		// Capture frames per render frame if both clocks ran at their nominal rates.
+		const double m_NominalRatio;
+
+		const DeviceClock* m_RenderClock;
+
+		// Ring of planar capture frames; m_RingFrames is a power of two.
+		PlanarBuffer m_Ring;
+		UINT32 m_RingFrames;
+
+		// Total frames ever written by the capture thread / read by the render thread.
+		std::atomic<UINT64> m_WritePosition;
+		std::atomic<UINT64> m_ReadPosition;
+
+		// Latest capture DeviceClock estimate, and the QPC time (100ns units) just past the latest packet,
+		// published by the capture thread.
+		std::atomic<double> m_CaptureRateRatio;
+		std::atomic<UINT64> m_LastPacketEnd;
+
+		LONGLONG m_QpcFrequency;
+
+		// Render audio thread state.
+		DriftResampler m_Resampler;
+		PlanarBuffer m_InputScratch;
+		PlanarBuffer m_OutputScratch;
+		bool m_IsLocked;
+		double m_SmoothedFill;
+		double m_Integral;
+		UINT32 m_LargestTargetFrames;
+		UINT32 m_WindowFrames;
+		UINT32 m_WindowHeadroom;
+
+		// Published for GetStatistics.
+		std::atomic<INT32> m_DriftPartsPerMillion;
+		std::atomic<INT32> m_CorrectionPartsPerMillion;
+		std::atomic<UINT32> m_OverrunCount;
+		std::atomic<UINT32> m_UnderrunCount;
+		std::atomic<UINT32> m_HeadroomFrames;
+		std::atomic<UINT32> m_SmoothedFillFrames;
+	};
+}
@@ -0,0 +1,32 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "AudioVoice.h"
+
+namespace Wazappy
+{
+	// A voice playing on a render device which also consumes a capture device's input; the capture device
+	// hands it every packet it records (see WASAPICaptureDevice::AddCaptureLink) until the voice is retired.
+	class CaptureSinkVoice : public AudioVoice
+	{
+	public:
+		CaptureSinkVoice(VoiceId voiceId) : AudioVoice(voiceId)
+		{
+			// Live input cannot be skipped ahead and picked up later, so keep it ahead of ordinary voices
+			SetPriority(VOICE_PRIORITY_HIGHEST);
+		}
+
+		// Channel count of the frames WriteCapturedFrames expects; must match the capture device's.
+		virtual UINT32 GetCaptureChannelCount() const = 0;
+
+		// Take a captured packet, converted to planar float, along with the QPC time (in 100ns units) of its first
+		// frame and the capture device's current clock estimate.  Capture audio thread only.
+		virtual void WriteCapturedFrames(const PlanarView& frames, UINT32 frameCount, UINT64 qpcPosition, double captureRateRatio) = 0;
+
+	protected:
+		virtual ~CaptureSinkVoice() {}
+	};
+}
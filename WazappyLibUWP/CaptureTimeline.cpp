@@ -0,0 +1,111 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include <algorithm>
+
+#include "CaptureTimeline.h"
+
+using namespace Wazappy;
+
+CaptureTimeline::CaptureTimeline() :
+	m_SampleRate(0),
+	m_HasAnchor(false),
+	m_LastAnchor{}
+{
+	m_Anchors.reserve(CAPTURE_TIMELINE_MAX_ANCHORS);
+}
+
+void CaptureTimeline::Reset(UINT32 sampleRate)
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	m_SampleRate = sampleRate;
+	m_Anchors.clear();
+	m_HasAnchor = false;
+}
+
+void CaptureTimeline::RecordPacket(UINT64 capturedFrame, UINT64 devicePosition, UINT64 qpcPosition)
+{
+	if (m_HasAnchor)
+	{
+		// Frames lost or glitched at the device move the device position relative to the stream; those need an
+		// anchor of their own.  Otherwise one per interval is plenty to follow the clock.
+		bool isDiscontinuity = (devicePosition - capturedFrame) != (m_LastAnchor.DevicePosition - m_LastAnchor.CapturedFrame);
+		bool isDue = (capturedFrame - m_LastAnchor.CapturedFrame) >= (UINT64)m_SampleRate * CAPTURE_TIMELINE_ANCHOR_INTERVAL_MS / 1000;
+		if (!isDiscontinuity && !isDue)
+		{
+			return;
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(m_Mutex, std::try_to_lock);
+	if (!lock.owns_lock())
+	{
+		return;
+	}
+
+	if (m_Anchors.size() == CAPTURE_TIMELINE_MAX_ANCHORS)
+	{
+		// Stay within the reserved capacity, so the audio thread never allocates.
+		Thin();
+	}
+
+	m_LastAnchor.CapturedFrame = capturedFrame;
+	m_LastAnchor.DevicePosition = devicePosition;
+	m_LastAnchor.QpcPosition = qpcPosition;
+	m_Anchors.push_back(m_LastAnchor);
+	m_HasAnchor = true;
+}
+
+void CaptureTimeline::Thin()
+{
+	size_t count = m_Anchors.size();
+	size_t kept = 1;
+	bool isDropDue = true;
+	for (size_t i = 1; i < count; i++)
+	{
+		const CaptureTimelineAnchor& anchor = m_Anchors[i];
+		const CaptureTimelineAnchor& previous = m_Anchors[kept - 1];
+		bool isContinuation = (anchor.DevicePosition - anchor.CapturedFrame) == (previous.DevicePosition - previous.CapturedFrame);
+		if (isContinuation && isDropDue)
+		{
+			isDropDue = false;
+			continue;
+		}
+
+		isDropDue = true;
+		m_Anchors[kept++] = anchor;
+	}
+
+	// Mostly discontinuities: keep every other one, so the next anchors do not have to thin again straight away.
+	if (kept > count * 3 / 4)
+	{
+		size_t halved = 1;
+		for (size_t i = 2; i < kept; i += 2)
+		{
+			m_Anchors[halved++] = m_Anchors[i];
+		}
+		kept = halved;
+	}
+
+	m_Anchors.resize(kept);
+}
+
+bool CaptureTimeline::GetQpcOfFrame(UINT64 capturedFrame, double rateRatio, double* qpcPosition)
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+
+	// Last anchor at or before the frame.
+	auto found = std::upper_bound(m_Anchors.begin(), m_Anchors.end(), capturedFrame,
+		[](UINT64 frame, const CaptureTimelineAnchor& anchor) { return frame < anchor.CapturedFrame; });
+	if (found == m_Anchors.begin())
+	{
+		return false;
+	}
+	--found;
+
+	double ticksPerFrame = 10000000.0 / (m_SampleRate * rateRatio);
+	*qpcPosition = found->QpcPosition + (capturedFrame - found->CapturedFrame) * ticksPerFrame;
+	return true;
+}
@@ -0,0 +1,66 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+// Spacing, in milliseconds of captured audio, between anchors recorded while capture runs smoothly.
+#define CAPTURE_TIMELINE_ANCHOR_INTERVAL_MS 1000
+
+// Anchors held before they are thinned out (a little over an hour at the interval above).
+#define CAPTURE_TIMELINE_MAX_ANCHORS 4096
+
+namespace Wazappy
+{
+	// Where one captured frame came from: its index in the captured stream, the device position the capture
+	// client reported for it, and the QPC time (in 100ns units) at which the device recorded it.
+	struct CaptureTimelineAnchor
+	{
+		UINT64 CapturedFrame;
+		UINT64 DevicePosition;
+		UINT64 QpcPosition;
+	};
+
+	// Record of when each captured frame was recorded, kept by a capture device as it runs, so any frame of a
+	// recording can be placed on another device's timeline.
+	// An anchor is taken every CAPTURE_TIMELINE_ANCHOR_INTERVAL_MS and at every discontinuity (where the device
+	// position jumps relative to the captured stream); frames between anchors are placed from the nearest anchor
+	// before them at the capture clock's measured rate.  Once CAPTURE_TIMELINE_MAX_ANCHORS are held, every other
+	// anchor which only continues the one before is dropped, doubling their spacing; the first anchor and the
+	// discontinuities are kept (unless more than half of them are discontinuities, when every other one goes),
+	// so the whole recording stays placeable, just less precisely.
+	class CaptureTimeline
+	{
+	public:
+		CaptureTimeline();
+
+		// Forget all anchors, e.g. when capture (re)starts.  Must not be called while the audio thread runs.
+		void Reset(UINT32 sampleRate);
+
+		// Note the positions reported for a packet whose first frame is capturedFrame.  Audio thread only;
+		// never blocks (if a reader holds the lock, the anchor is taken on a later packet instead).
+		void RecordPacket(UINT64 capturedFrame, UINT64 devicePosition, UINT64 qpcPosition);
+
+		// The QPC time (100ns units) at which the given captured frame was recorded, given the capture clock's
+		// measured rate ratio.  Any thread; false if no anchor at or before the frame exists.
+		bool GetQpcOfFrame(UINT64 capturedFrame, double rateRatio, double* qpcPosition);
+
+	private:
+		// Drop anchors to make room for more, keeping the first.  Lock must be held.
+		void Thin();
+
+	private:
+		UINT32 m_SampleRate;
+
+		// Guards m_Anchors; the audio thread only ever try-locks it.
+		std::mutex m_Mutex;
+		std::vector<CaptureTimelineAnchor> m_Anchors;
+
+		// Last anchor taken.  Audio thread only.
+		bool m_HasAnchor;
+		CaptureTimelineAnchor m_LastAnchor;
+	};
+}
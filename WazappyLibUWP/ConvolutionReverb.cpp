@@ -0,0 +1,488 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include "ConvolutionReverb.h"
+
+using namespace Wazappy;
+
+PartitionedConvolver::PartitionedConvolver(UINT32 blockFrames) :
+	m_BlockFrames(blockFrames),
+	m_ChannelCount(0),
+	m_PartitionCount(0),
+	m_Fft(blockFrames * 2),
+	m_NextSlot(0),
+	m_SilentBlocks(0)
+{
+}
+
+void PartitionedConvolver::Initialize(const PlanarView& impulse, UINT32 impulseFrames, UINT32 offset, UINT32 frameCount)
+{
+	m_ChannelCount = impulse.ChannelCount;
+	m_PartitionCount = max(1u, (frameCount + m_BlockFrames - 1) / m_BlockFrames);
+	m_Partitions.assign((size_t)m_ChannelCount * m_PartitionCount * m_BlockFrames, std::complex<float>());
+	m_InputSpectra.assign(m_Partitions.size(), std::complex<float>());
+	m_Window.assign(m_BlockFrames * 2, 0.0f);
+	m_Accumulator.assign(m_BlockFrames, std::complex<float>());
+	m_NextSlot = 0;
+	m_SilentBlocks = 0;
+
+	// Each partition is a block of the impulse followed by a block of zeros, so the overlap-save output's last
+	// block holds the linear convolution.
+	for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+	{
+		for (UINT32 partition = 0; partition < m_PartitionCount; partition++)
+		{
+			std::fill(m_Window.begin(), m_Window.end(), 0.0f);
+			UINT32 start = offset + (partition * m_BlockFrames);
+			UINT32 end = min(min(start + m_BlockFrames, offset + frameCount), impulseFrames);
+			if (start < end)
+			{
+				memcpy(m_Window.data(), impulse.Channel(channel) + start, (end - start) * sizeof(float));
+			}
+			m_Fft.Forward(m_Window.data(), PartitionSpectrum(channel, partition));
+		}
+	}
+}
+
+void PartitionedConvolver::ZeroSlot(UINT32 slot)
+{
+	for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+	{
+		std::fill(InputSpectrum(channel, slot), InputSpectrum(channel, slot) + m_BlockFrames, std::complex<float>());
+	}
+}
+
+bool PartitionedConvolver::ProcessBlock(const PlanarView& previous, const PlanarView& current, const PlanarView& output, bool isSilent)
+{
+	m_SilentBlocks = isSilent ? min(m_SilentBlocks + 1, m_PartitionCount + 2) : 0;
+	UINT32 slot = m_NextSlot;
+	m_NextSlot = (m_NextSlot + 1) % m_PartitionCount;
+
+	// Once every spectrum in the delay line is of silence, so is the output; the slot being replaced still
+	// holds the last block which was not, until it has been zeroed once.
+	if (m_SilentBlocks > m_PartitionCount)
+	{
+		if (m_SilentBlocks == m_PartitionCount + 1)
+		{
+			ZeroSlot(slot);
+		}
+		output.Zero(m_BlockFrames);
+		return false;
+	}
+
+	for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+	{
+		// With both blocks silent the input's spectrum is zero.
+		std::complex<float>* spectrum = InputSpectrum(channel, slot);
+		if (m_SilentBlocks >= 2)
+		{
+			std::fill(spectrum, spectrum + m_BlockFrames, std::complex<float>());
+		}
+		else
+		{
+			memcpy(m_Window.data(), previous.Channel(channel), m_BlockFrames * sizeof(float));
+			memcpy(m_Window.data() + m_BlockFrames, current.Channel(channel), m_BlockFrames * sizeof(float));
+			m_Fft.Forward(m_Window.data(), spectrum);
+		}
+
+		// Partition p meets the input from p blocks ago.
+		std::fill(m_Accumulator.begin(), m_Accumulator.end(), std::complex<float>());
+		UINT32 inputSlot = slot;
+		for (UINT32 partition = 0; partition < m_PartitionCount; partition++)
+		{
+			RealFft::MultiplyAccumulate(PartitionSpectrum(channel, partition), InputSpectrum(channel, inputSlot), m_Accumulator.data(), m_BlockFrames);
+			inputSlot = (0 == inputSlot) ? (m_PartitionCount - 1) : (inputSlot - 1);
+		}
+
+		// The first half of the window is wrapped around by the circular convolution; the second is the output.
+		m_Fft.Inverse(m_Accumulator.data(), m_Window.data());
+		memcpy(output.Channel(channel), m_Window.data() + m_BlockFrames, m_BlockFrames * sizeof(float));
+	}
+
+	return true;
+}
+
+void PartitionedConvolver::SkipBlock()
+{
+	ZeroSlot(m_NextSlot);
+	m_NextSlot = (m_NextSlot + 1) % m_PartitionCount;
+
+	// The next block's window takes in this one's lost input, so it must not count as silent.
+	m_SilentBlocks = 0;
+}
+
+void PartitionedConvolver::ForgetLastBlock()
+{
+	ZeroSlot((0 == m_NextSlot) ? (m_PartitionCount - 1) : (m_NextSlot - 1));
+	m_SilentBlocks = 0;
+}
+
+ConvolutionReverb::ConvolutionReverb() :
+	m_ChannelCount(0),
+	m_ImpulseFrames(0),
+	m_Frame(0),
+	m_IsHeadBlockSilent(true),
+	m_IsHeadOutputAudible(false),
+	m_IsTailShed(false),
+	m_TailCount(0),
+	m_QueueId(0),
+	m_IsShutdown(false),
+	m_TailBlocks(0),
+	m_LateTailBlocks(0)
+{
+	for (TailLevel& level : m_Tails)
+	{
+		level.BlockFrames = 0;
+		level.PostedBlocks = 0;
+		for (UINT32 slot = 0; slot < CONVOLUTION_TAIL_SLOTS; slot++)
+		{
+			level.IsInputSilent[slot] = true;
+			level.IsInputShed[slot] = false;
+			level.CompletedBlock[slot] = -1;
+			level.IsOutputAudible[slot] = false;
+		}
+		level.NextBlock = 0;
+		level.IsBlockSilent = true;
+		level.IsPlaying = false;
+		level.FirstUnshedBlock = 0;
+		level.WakeEvent = nullptr;
+		level.WorkKey = 0;
+		level.WorkAsyncResult = nullptr;
+	}
+}
+
+ConvolutionReverb::~ConvolutionReverb()
+{
+	for (TailLevel& level : m_Tails)
+	{
+		SAFE_RELEASE(level.WorkAsyncResult);
+		if (level.WakeEvent != nullptr)
+		{
+			CloseHandle(level.WakeEvent);
+		}
+	}
+
+	if (m_QueueId != 0)
+	{
+		MFUnlockWorkQueue(m_QueueId);
+	}
+}
+
+HRESULT ConvolutionReverb::Initialize(const ComPtr<SampleAsset>& impulse)
+{
+	UINT64 impulseFrames = impulse->GetFrameCount();
+	if (0 == impulseFrames || impulseFrames > (UINT64)CONVOLUTION_MAX_IMPULSE_SECONDS * impulse->GetSampleRate())
+	{
+		return E_INVALIDARG;
+	}
+
+	m_ChannelCount = impulse->GetChannelCount();
+	m_ImpulseFrames = (UINT32)impulseFrames;
+
+	PlanarBuffer decoded;
+	decoded.Allocate(m_ChannelCount, m_ImpulseFrames);
+	bool isSilent = false;
+	impulse->MixFrames(0, m_ImpulseFrames, decoded.GetView(), &isSilent);
+
+	// The head covers the impulse up to where the first tail level starts, and each level up to the next.
+	const UINT32 headFrames = CONVOLUTION_HEAD_BLOCK_FRAMES;
+	UINT32 tailStart = (2 * headFrames * CONVOLUTION_TAIL_GROWTH) - headFrames;
+	m_Head.reset(new PartitionedConvolver(headFrames));
+	m_Head->Initialize(decoded.GetView(), m_ImpulseFrames, 0, min(m_ImpulseFrames, tailStart));
+	m_HeadInput.Allocate(m_ChannelCount, headFrames * 2);
+	m_HeadOutput.Allocate(m_ChannelCount, headFrames);
+
+	UINT32 blockFrames = headFrames;
+	m_TailCount = 0;
+	while (m_TailCount < CONVOLUTION_TAIL_LEVELS && tailStart < m_ImpulseFrames)
+	{
+		blockFrames *= CONVOLUTION_TAIL_GROWTH;
+		UINT32 tailEnd = (m_TailCount + 1 < CONVOLUTION_TAIL_LEVELS)
+			? (2 * blockFrames * CONVOLUTION_TAIL_GROWTH) - headFrames
+			: m_ImpulseFrames;
+
+		TailLevel& level = m_Tails[m_TailCount];
+		level.BlockFrames = blockFrames;
+		level.Convolver.reset(new PartitionedConvolver(blockFrames));
+		level.Convolver->Initialize(decoded.GetView(), m_ImpulseFrames, tailStart, min(tailEnd, m_ImpulseFrames) - tailStart);
+		level.Input.Allocate(m_ChannelCount, blockFrames * CONVOLUTION_TAIL_SLOTS);
+		level.Output.Allocate(m_ChannelCount, blockFrames * CONVOLUTION_TAIL_SLOTS);
+		level.Silence.Allocate(m_ChannelCount, blockFrames);
+
+		m_TailCount++;
+		tailStart = tailEnd;
+	}
+
+	if (0 == m_TailCount)
+	{
+		return S_OK;
+	}
+
+	// The tail workers run at audio priority, but on a queue of their own so they never delay a device's
+	// callbacks.
+	HRESULT hr = S_OK;
+	DWORD taskId = 0;
+	hr = MFLockSharedWorkQueue(L"Audio", 0, &taskId, &m_QueueId);
+	if (FAILED(hr))
+	{
+		m_QueueId = 0;
+		return hr;
+	}
+	m_xTailWork0.SetQueueID(m_QueueId);
+	m_xTailWork1.SetQueueID(m_QueueId);
+
+	std::lock_guard<std::mutex> guard(m_WorkMutex);
+	for (UINT32 levelIndex = 0; levelIndex < m_TailCount; levelIndex++)
+	{
+		TailLevel& level = m_Tails[levelIndex];
+		level.WakeEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+		if (level.WakeEvent == nullptr)
+		{
+			hr = HRESULT_FROM_WIN32(GetLastError());
+			break;
+		}
+
+		IMFAsyncCallback* callback = (0 == levelIndex) ? static_cast<IMFAsyncCallback*>(&m_xTailWork0) : static_cast<IMFAsyncCallback*>(&m_xTailWork1);
+		hr = MFCreateAsyncResult(nullptr, callback, nullptr, &level.WorkAsyncResult);
+		if (FAILED(hr))
+		{
+			break;
+		}
+
+		// Smaller blocks have nearer deadlines.
+		hr = MFPutWaitingWorkItem(level.WakeEvent, CONVOLUTION_TAIL_LEVELS - levelIndex, level.WorkAsyncResult, &level.WorkKey);
+		if (FAILED(hr))
+		{
+			break;
+		}
+	}
+
+	return hr;
+}
+
+void ConvolutionReverb::Shutdown()
+{
+	std::lock_guard<std::mutex> guard(m_WorkMutex);
+	m_IsShutdown = true;
+
+	// Cancelling releases the waiting work items' references; a worker which is running sees m_IsShutdown and
+	// does not wait again.
+	for (UINT32 levelIndex = 0; levelIndex < m_TailCount; levelIndex++)
+	{
+		TailLevel& level = m_Tails[levelIndex];
+		if (level.WorkKey != 0)
+		{
+			MFCancelWorkItem(level.WorkKey);
+			level.WorkKey = 0;
+		}
+		SAFE_RELEASE(level.WorkAsyncResult);
+	}
+}
+
+void ConvolutionReverb::GetStatistics(REVERBSTATS* stats) const
+{
+	stats->ImpulseFrames = m_ImpulseFrames;
+	stats->LatencyFrames = CONVOLUTION_HEAD_BLOCK_FRAMES;
+	stats->TailBlocks = m_TailBlocks;
+	stats->LateTailBlocks = m_LateTailBlocks;
+}
+
+void ConvolutionReverb::SetShedLevel(ShedLevel level)
+{
+	m_IsTailShed = (level >= ShedLevel_Quality);
+}
+
+bool ConvolutionReverb::Process(const PlanarView& input, const PlanarView& wet, UINT32 frameCount, bool isInputSilent)
+{
+	const UINT32 headFrames = CONVOLUTION_HEAD_BLOCK_FRAMES;
+	bool isAudible = false;
+	UINT64 lateBlocks = 0;
+
+	// Work at most a head block at a time; tail blocks are whole numbers of head blocks, so no chunk crosses
+	// the edge of any block.
+	UINT32 done = 0;
+	while (done < frameCount)
+	{
+		UINT32 headOffset = (UINT32)(m_Frame % headFrames);
+		UINT32 chunk = min(frameCount - done, headFrames - headOffset);
+		const PlanarView chunkInput = input.Offset(done);
+		const PlanarView chunkWet = wet.Offset(done);
+
+		// At the start of each tail block, see whether the level's worker delivered the output that plays
+		// through it: that of the block of input two blocks back, unless that was shed.
+		for (UINT32 levelIndex = 0; levelIndex < m_TailCount; levelIndex++)
+		{
+			TailLevel& level = m_Tails[levelIndex];
+			if (0 == (m_Frame % level.BlockFrames))
+			{
+				UINT64 block = m_Frame / level.BlockFrames;
+				if (m_IsTailShed)
+				{
+					level.FirstUnshedBlock = block + 1;
+				}
+				level.IsPlaying = false;
+				if (block >= 2 && block - 2 >= level.FirstUnshedBlock)
+				{
+					UINT32 slot = (UINT32)((block - 2) % CONVOLUTION_TAIL_SLOTS);
+					level.IsPlaying = (level.CompletedBlock[slot].load(std::memory_order_acquire) == (INT64)(block - 2));
+					lateBlocks += level.IsPlaying ? 0 : 1;
+				}
+			}
+		}
+
+		// Take the input.
+		for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+		{
+			const float* source = chunkInput.Channel(channel);
+			memcpy(m_HeadInput.Channel(channel) + headFrames + headOffset, source, chunk * sizeof(float));
+			for (UINT32 levelIndex = 0; levelIndex < m_TailCount; levelIndex++)
+			{
+				TailLevel& level = m_Tails[levelIndex];
+				UINT64 block = m_Frame / level.BlockFrames;
+				UINT32 offset = (UINT32)((block % CONVOLUTION_TAIL_SLOTS) * level.BlockFrames + (m_Frame % level.BlockFrames));
+				memcpy(level.Input.Channel(channel) + offset, source, chunk * sizeof(float));
+			}
+		}
+		m_IsHeadBlockSilent &= isInputSilent;
+
+		// Play the head's last output block, and each tail level's block if it came in time.
+		bool isChunkAudible = m_IsHeadOutputAudible;
+		for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+		{
+			if (isChunkAudible)
+			{
+				memcpy(chunkWet.Channel(channel), m_HeadOutput.Channel(channel) + headOffset, chunk * sizeof(float));
+			}
+			else
+			{
+				memset(chunkWet.Channel(channel), 0, chunk * sizeof(float));
+			}
+		}
+
+		for (UINT32 levelIndex = 0; levelIndex < m_TailCount; levelIndex++)
+		{
+			TailLevel& level = m_Tails[levelIndex];
+			level.IsBlockSilent &= isInputSilent;
+			if (!level.IsPlaying)
+			{
+				continue;
+			}
+
+			UINT64 block = (m_Frame / level.BlockFrames) - 2;
+			UINT32 slot = (UINT32)(block % CONVOLUTION_TAIL_SLOTS);
+			if (!level.IsOutputAudible[slot].load(std::memory_order_relaxed))
+			{
+				continue;
+			}
+
+			UINT32 offset = (slot * level.BlockFrames) + (UINT32)(m_Frame % level.BlockFrames);
+			for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+			{
+				const float* source = level.Output.Channel(channel) + offset;
+				float* destination = chunkWet.Channel(channel);
+				for (UINT32 frame = 0; frame < chunk; frame++)
+				{
+					destination[frame] += source[frame];
+				}
+			}
+			isChunkAudible = true;
+		}
+		isAudible |= isChunkAudible;
+
+		m_Frame += chunk;
+		done += chunk;
+
+		// Convolve the head as each of its blocks completes, and hand each completed tail block to its worker.
+		if (0 == (m_Frame % headFrames))
+		{
+			const PlanarView& headInput = m_HeadInput.GetView();
+			m_IsHeadOutputAudible = m_Head->ProcessBlock(headInput, headInput.Offset(headFrames), m_HeadOutput.GetView(), m_IsHeadBlockSilent);
+			for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+			{
+				memcpy(m_HeadInput.Channel(channel), m_HeadInput.Channel(channel) + headFrames, headFrames * sizeof(float));
+			}
+			m_IsHeadBlockSilent = true;
+		}
+
+		for (UINT32 levelIndex = 0; levelIndex < m_TailCount; levelIndex++)
+		{
+			TailLevel& level = m_Tails[levelIndex];
+			if (0 == (m_Frame % level.BlockFrames))
+			{
+				UINT64 blocks = m_Frame / level.BlockFrames;
+				level.IsInputSilent[(blocks - 1) % CONVOLUTION_TAIL_SLOTS].store(level.IsBlockSilent, std::memory_order_relaxed);
+				level.IsInputShed[(blocks - 1) % CONVOLUTION_TAIL_SLOTS].store(blocks - 1 < level.FirstUnshedBlock, std::memory_order_relaxed);
+				level.IsBlockSilent = true;
+				level.PostedBlocks.store(blocks, std::memory_order_release);
+				SetEvent(level.WakeEvent);
+			}
+		}
+	}
+
+	if (lateBlocks > 0)
+	{
+		m_LateTailBlocks.fetch_add(lateBlocks, std::memory_order_relaxed);
+	}
+
+	return isAudible;
+}
+
+HRESULT ConvolutionReverb::RunTailJobs(UINT32 levelIndex)
+{
+	TailLevel& level = m_Tails[levelIndex];
+	PartitionedConvolver& convolver = *level.Convolver;
+	const UINT32 blockFrames = level.BlockFrames;
+
+	UINT64 posted = level.PostedBlocks.load(std::memory_order_acquire);
+	while (level.NextBlock < posted)
+	{
+		UINT64 block = level.NextBlock++;
+
+		// The audio thread starts overwriting the previous block's input slot once block + SLOTS - 1 starts;
+		// by then this block is long overdue, so it is dropped.
+		if (posted > block + CONVOLUTION_TAIL_SLOTS - 2)
+		{
+			convolver.SkipBlock();
+			continue;
+		}
+
+		UINT32 slot = (UINT32)(block % CONVOLUTION_TAIL_SLOTS);
+		if (level.IsInputShed[slot].load(std::memory_order_relaxed))
+		{
+			convolver.SkipBlock();
+			continue;
+		}
+
+		const PlanarView& input = level.Input.GetView();
+		PlanarView previous = (block > 0)
+			? input.Offset((UINT32)((block - 1) % CONVOLUTION_TAIL_SLOTS) * blockFrames)
+			: level.Silence.GetView();
+		bool isAudible = convolver.ProcessBlock(
+			previous,
+			input.Offset(slot * blockFrames),
+			level.Output.GetView().Offset(slot * blockFrames),
+			level.IsInputSilent[slot].load(std::memory_order_relaxed));
+
+		posted = level.PostedBlocks.load(std::memory_order_acquire);
+		if (posted > block + CONVOLUTION_TAIL_SLOTS - 2)
+		{
+			// The input changed under the transform.
+			convolver.ForgetLastBlock();
+			continue;
+		}
+
+		level.IsOutputAudible[slot].store(isAudible, std::memory_order_relaxed);
+		level.CompletedBlock[slot].store((INT64)block, std::memory_order_release);
+		m_TailBlocks.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Wait for the next block.
+	std::lock_guard<std::mutex> guard(m_WorkMutex);
+	if (m_IsShutdown)
+	{
+		return S_OK;
+	}
+	return MFPutWaitingWorkItem(level.WakeEvent, CONVOLUTION_TAIL_LEVELS - levelIndex, level.WorkAsyncResult, &level.WorkKey);
+}
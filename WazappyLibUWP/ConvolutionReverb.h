@@ -0,0 +1,217 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "WazappyDllInterface.h"
+#include "Fft.h"
+#include "PlanarBuffer.h"
+#include "SampleAsset.h"
+
+using namespace Microsoft::WRL;
+
+// Frames in each of the head's partitions, which are convolved on the audio thread as each block of input
+// completes.  The reverb's output runs this many frames behind its input.
+#define CONVOLUTION_HEAD_BLOCK_FRAMES 128
+
+// Each tail level's partitions are this many times the size of the level before's.
+#define CONVOLUTION_TAIL_GROWTH 8
+
+// Levels of tail partitions after the head: with the growth above, 1024 and then 8192 frames.  Each has a
+// worker callback of its own in ConvolutionReverb.
+#define CONVOLUTION_TAIL_LEVELS 2
+
+// Blocks of input and of output each tail level keeps in flight.  A worker has one block to deliver its output
+// in; one which falls more than two blocks further behind finds its input overwritten, and drops the block.
+#define CONVOLUTION_TAIL_SLOTS 4
+
+// Longest impulse response accepted, in seconds.
+#define CONVOLUTION_MAX_IMPULSE_SECONDS 30
+
+namespace Wazappy
+{
+	// One segment of an impulse response, cut into partitions of a fixed block size and convolved with its input
+	// a block at a time by uniformly partitioned overlap-save: each block of input is transformed once (along with
+	// the block before it) into a delay line of past input spectra, and the output block is the sum of those
+	// spectra times the partitions' spectra, transformed back.  Channel c of the input convolves with channel c
+	// of the impulse.  Runs of silent input skip the transforms, and once the delay line holds nothing but
+	// silence, everything else too.
+	// Allocation free once initialized, but not thread safe: each convolver belongs to one thread.
+	class PartitionedConvolver
+	{
+	public:
+		PartitionedConvolver(UINT32 blockFrames);
+
+		// Take frames [offset, offset + frameCount) of impulse, which holds impulseFrames frames, as the segment
+		// to convolve with, zero padding it past the impulse's end.  Allocates.
+		void Initialize(const PlanarView& impulse, UINT32 impulseFrames, UINT32 offset, UINT32 frameCount);
+
+		UINT32 GetBlockFrames() const { return m_BlockFrames; }
+		UINT32 GetPartitionCount() const { return m_PartitionCount; }
+
+		// Convolve the next block of input, given as the previous block and this one, writing a block of output.
+		// isSilent says the current block is all zeros.  Returns false if the output is silent (it is zeroed).
+		bool ProcessBlock(const PlanarView& previous, const PlanarView& current, const PlanarView& output, bool isSilent);
+
+		// Move on a block without processing it, as though its input had been silent; for input which was lost.
+		void SkipBlock();
+
+		// Drop the last block's input from the delay line, as though it had been silent; for input which turned
+		// out to have been overwritten while it was read.
+		void ForgetLastBlock();
+
+	private:
+		std::complex<float>* PartitionSpectrum(UINT32 channel, UINT32 partition) { return &m_Partitions[((size_t)channel * m_PartitionCount + partition) * m_BlockFrames]; }
+		std::complex<float>* InputSpectrum(UINT32 channel, UINT32 slot) { return &m_InputSpectra[((size_t)channel * m_PartitionCount + slot) * m_BlockFrames]; }
+
+		// Zero the delay line slot of the given block.
+		void ZeroSlot(UINT32 slot);
+
+	private:
+		const UINT32 m_BlockFrames;
+		UINT32 m_ChannelCount;
+		UINT32 m_PartitionCount;
+
+		// Transform of two blocks of real samples; each spectrum is m_BlockFrames packed bins.
+		RealFft m_Fft;
+
+		// Spectra of each channel's partitions, [channel][partition][bin].
+		std::vector<std::complex<float>> m_Partitions;
+
+		// Spectra of each channel's recent input, [channel][slot][bin]; block j's is in slot j % m_PartitionCount.
+		std::vector<std::complex<float>> m_InputSpectra;
+		UINT32 m_NextSlot;
+
+		// Consecutive blocks of silent input, up to and including the last.
+		UINT32 m_SilentBlocks;
+
+		// Scratch: two blocks of samples, and the output spectrum.
+		std::vector<float> m_Window;
+		std::vector<std::complex<float>> m_Accumulator;
+	};
+
+	// Convolves a mix with a long impulse response (a room, a plate, a cabinet), partitioned non-uniformly so
+	// that its cost on the audio thread stays small and flat whatever the impulse's length.
+	// The head of the impulse is cut into CONVOLUTION_HEAD_BLOCK_FRAMES frame partitions, convolved on the audio
+	// thread as each block of input completes; this sets the reverb's latency.  The rest is cut into ever larger
+	// partitions, CONVOLUTION_TAIL_GROWTH times the size at each level, and each tail level is convolved on a
+	// worker of its own (waiting work items on a shared MMCSS work queue) which the audio thread wakes as each of
+	// the level's blocks of input completes.  A level of block size N starts 2N - CONVOLUTION_HEAD_BLOCK_FRAMES
+	// frames into the impulse, so its worker has a whole block's time to deliver each output block before it is
+	// due.  A block which is not delivered in time is played as silence and counted (the hand off is by
+	// per-slot completion counters, so the audio thread never waits); a worker that far behind skips ahead.
+	// Process is audio thread only; everything else is for client threads.
+	class ConvolutionReverb :
+		public RuntimeClass<RuntimeClassFlags<ClassicCom>, IUnknown>
+	{
+	public:
+		ConvolutionReverb();
+
+		// Partition the impulse, whose channel count and sample rate are the reverb's, and start the tail
+		// workers.  Allocates and transforms the whole impulse, so may take a while.
+		HRESULT Initialize(const ComPtr<SampleAsset>& impulse);
+
+		// Stop the tail workers, releasing their hold on the reverb.  Must be called once the audio thread has
+		// let go of the reverb, or it is never freed.
+		void Shutdown();
+
+		UINT32 GetChannelCount() const { return m_ChannelCount; }
+
+		// Take frameCount frames of input, all zeros if isInputSilent, and write the reverb's frameCount frames
+		// of output to wet.  Audio thread only.  Returns false if the output is silent (wet is then zeroed).
+		bool Process(const PlanarView& input, const PlanarView& wet, UINT32 frameCount, bool isInputSilent);
+
+		// From ShedLevel_Quality up, drop the tail: from each level's next block its worker skips its blocks
+		// instead of convolving them, and their output is not played, leaving only the head.  The tail comes back
+		// a level's block at a time once the level falls below that.  Audio thread only.
+		void SetShedLevel(ShedLevel level);
+
+		// Any thread.
+		void GetStatistics(REVERBSTATS* stats) const;
+
+		METHODASYNCCALLBACK(ConvolutionReverb, TailWork0, OnTailWork0);
+		METHODASYNCCALLBACK(ConvolutionReverb, TailWork1, OnTailWork1);
+
+	private:
+		virtual ~ConvolutionReverb();
+
+		HRESULT OnTailWork0(IMFAsyncResult* pResult) { return RunTailJobs(0); }
+		HRESULT OnTailWork1(IMFAsyncResult* pResult) { return RunTailJobs(1); }
+
+		// Convolve every block the audio thread has handed the given tail level, then wait for the next.
+		HRESULT RunTailJobs(UINT32 levelIndex);
+
+	private:
+		// A level of tail partitions, shared between the audio thread and the level's worker.
+		struct TailLevel
+		{
+			std::unique_ptr<PartitionedConvolver> Convolver;
+			UINT32 BlockFrames;
+
+			// CONVOLUTION_TAIL_SLOTS blocks of input and of output; block j uses slot j % CONVOLUTION_TAIL_SLOTS.
+			PlanarBuffer Input;
+			PlanarBuffer Output;
+
+			// A block of zeros, to stand before the first.
+			PlanarBuffer Silence;
+
+			// Blocks of input completed; bumped by the audio thread (with release ordering) after the block and
+			// its silent flag are written.
+			std::atomic<UINT64> PostedBlocks;
+			std::atomic<bool> IsInputSilent[CONVOLUTION_TAIL_SLOTS];
+			std::atomic<bool> IsInputShed[CONVOLUTION_TAIL_SLOTS];
+
+			// The block whose output each slot holds (-1 for none), stored by the worker (with release
+			// ordering) after the output and its audible flag.
+			std::atomic<INT64> CompletedBlock[CONVOLUTION_TAIL_SLOTS];
+			std::atomic<bool> IsOutputAudible[CONVOLUTION_TAIL_SLOTS];
+
+			// Worker only: the next block to convolve.
+			UINT64 NextBlock;
+
+			// Audio thread only: whether the block of input being taken is silent so far, whether the block
+			// of output being played was delivered in time, and the first block which started with the tail
+			// not shed.
+			bool IsBlockSilent;
+			bool IsPlaying;
+			UINT64 FirstUnshedBlock;
+
+			HANDLE WakeEvent;
+			MFWORKITEM_KEY WorkKey;
+			IMFAsyncResult* WorkAsyncResult;
+		};
+
+		UINT32 m_ChannelCount;
+		UINT32 m_ImpulseFrames;
+
+		// Audio thread state: frames taken since the start, the head's last two blocks of input and its
+		// output block, which plays through the block after it was convolved.
+		UINT64 m_Frame;
+		std::unique_ptr<PartitionedConvolver> m_Head;
+		PlanarBuffer m_HeadInput;
+		PlanarBuffer m_HeadOutput;
+		bool m_IsHeadBlockSilent;
+		bool m_IsHeadOutputAudible;
+		bool m_IsTailShed;
+
+		TailLevel m_Tails[CONVOLUTION_TAIL_LEVELS];
+		UINT32 m_TailCount;
+
+		// The shared work queue the tail workers run on, locked while they exist.
+		DWORD m_QueueId;
+
+		// Guards re-arming the tail workers against Shutdown.
+		std::mutex m_WorkMutex;
+		bool m_IsShutdown;
+
+		// Written by the workers and the audio thread, read by GetStatistics.
+		std::atomic<UINT64> m_TailBlocks;
+		std::atomic<UINT64> m_LateTailBlocks;
+	};
+}
@@ -0,0 +1,539 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "DelayLine.h"
+
+using namespace Wazappy;
+
+DelayLine::DelayLine(UINT32 channelCount, UINT32 maxDelayFrames) :
+	m_ChannelCount(channelCount),
+	m_Length(DELAY_LINE_CHUNK_FRAMES),
+	m_SeenGeneration(0),
+	m_WritePosition(0),
+	m_Beats(0),
+	m_RequestedDelay(DELAY_LINE_MIN_FRAMES),
+	m_Interpolation(Delay_Linear),
+	m_RampFrames(0),
+	m_Delay(DELAY_LINE_MIN_FRAMES),
+	m_Feedback(0),
+	m_WetGain(0),
+	m_TargetDelay(DELAY_LINE_MIN_FRAMES),
+	m_TargetFeedback(0),
+	m_TargetWetGain(0),
+	m_DelayStep(0),
+	m_FeedbackStep(0),
+	m_WetGainStep(0),
+	m_RampRemaining(0),
+	m_ModulationPhase(0),
+	m_ModulationFrequency(0),
+	m_ModulationDepth(0),
+	m_QuietFrames(UINT32_MAX),
+	m_ZeroFrames(UINT32_MAX)
+{
+	// Room for the longest delay, plus the interpolators' taps behind it.
+	while (m_Length < maxDelayFrames + 4)
+	{
+		m_Length <<= 1;
+	}
+	m_Mask = m_Length - 1;
+	m_Line.Allocate(channelCount, m_Length * 2);
+	m_AllpassState.assign(channelCount, 0.0f);
+
+	m_Settings.DelayFrames = (float)DELAY_LINE_MIN_FRAMES;
+	m_Settings.Beats = 0.0f;
+	m_Settings.Feedback = 0.0f;
+	m_Settings.WetGain = 0.0f;
+	m_Settings.ModulationFrequency = 0.0f;
+	m_Settings.ModulationDepth = 0.0f;
+	m_Settings.Interpolation = Delay_Linear;
+	m_Settings.RampFrames = 0;
+	m_Settings.Generation = 0;
+}
+
+void DelayLine::SetParameters(float delayFrames, float beats, float feedback, float wetGain, float modulationFrequency, float modulationDepth, DelayInterpolation interpolation, UINT32 rampFrames)
+{
+	m_Settings.DelayFrames.store(delayFrames, std::memory_order_relaxed);
+	m_Settings.Beats.store(beats, std::memory_order_relaxed);
+	m_Settings.Feedback.store(feedback, std::memory_order_relaxed);
+	m_Settings.WetGain.store(wetGain, std::memory_order_relaxed);
+	m_Settings.ModulationFrequency.store(modulationFrequency, std::memory_order_relaxed);
+	m_Settings.ModulationDepth.store(modulationDepth, std::memory_order_relaxed);
+	m_Settings.Interpolation.store(interpolation, std::memory_order_relaxed);
+	m_Settings.RampFrames.store(rampFrames, std::memory_order_relaxed);
+	m_Settings.Generation.fetch_add(1, std::memory_order_release);
+}
+
+float DelayLine::GetShortestDelay() const
+{
+	float shortest = ((m_RampRemaining > 0) ? min(m_Delay, m_TargetDelay) : m_Delay) - m_ModulationDepth;
+	return max((float)DELAY_LINE_MIN_FRAMES, shortest);
+}
+
+float DelayLine::GetLongestDelay() const
+{
+	float longest = ((m_RampRemaining > 0) ? max(m_Delay, m_TargetDelay) : m_Delay) + m_ModulationDepth;
+	return min((float)(m_Length - 4), longest);
+}
+
+bool DelayLine::IsQuiet() const
+{
+	return m_QuietFrames > (GetLongestDelay() + 2);
+}
+
+bool DelayLine::IsBypassed()
+{
+	return (0 == m_WetGain) && (0 == m_RampRemaining) && (0 == m_Settings.WetGain.load(std::memory_order_relaxed)) && IsQuiet();
+}
+
+// Clamp a setting into [lowest, highest].  The min and max macros pass a NaN straight through, and a NaN or
+// infinity written into the line would recirculate forever, so those become fallback instead.
+static float ClampSetting(float value, float lowest, float highest, float fallback)
+{
+	if (!isfinite(value))
+	{
+		return fallback;
+	}
+	return max(lowest, min(highest, value));
+}
+
+void DelayLine::UpdateSettings(float framesPerBeat)
+{
+	bool isChanged = false;
+	UINT32 generation = m_Settings.Generation.load(std::memory_order_acquire);
+	if (generation != m_SeenGeneration)
+	{
+		m_SeenGeneration = generation;
+		m_RequestedDelay = m_Settings.DelayFrames.load(std::memory_order_relaxed);
+		m_Beats = m_Settings.Beats.load(std::memory_order_relaxed);
+		m_TargetFeedback = ClampSetting(m_Settings.Feedback.load(std::memory_order_relaxed), -DELAY_LINE_MAX_FEEDBACK, DELAY_LINE_MAX_FEEDBACK, 0);
+		float wetGain = m_Settings.WetGain.load(std::memory_order_relaxed);
+		m_TargetWetGain = isfinite(wetGain) ? wetGain : 0;
+		m_ModulationFrequency = ClampSetting(m_Settings.ModulationFrequency.load(std::memory_order_relaxed), 0, 0.5f, 0);
+		m_ModulationDepth = ClampSetting(m_Settings.ModulationDepth.load(std::memory_order_relaxed), 0, (float)(m_Length / 2), 0);
+		m_RampFrames = m_Settings.RampFrames.load(std::memory_order_relaxed);
+
+		DelayInterpolation interpolation = m_Settings.Interpolation.load(std::memory_order_relaxed);
+		if (interpolation != m_Interpolation)
+		{
+			m_Interpolation = interpolation;
+			std::fill(m_AllpassState.begin(), m_AllpassState.end(), 0.0f);
+		}
+		isChanged = true;
+	}
+
+	float delay = (m_Beats > 0 && framesPerBeat > 0) ? (m_Beats * framesPerBeat) : m_RequestedDelay;
+	delay = ClampSetting(delay, DELAY_LINE_MIN_FRAMES, (float)(m_Length - 4), DELAY_LINE_MIN_FRAMES);
+	if (isChanged || delay != m_TargetDelay)
+	{
+		m_TargetDelay = delay;
+		StartRamp();
+	}
+}
+
+void DelayLine::StartRamp()
+{
+	// A line with nothing in it and nothing coming out jumps straight to its new settings.
+	bool isIdle = (0 == m_WetGain) && (0 == m_Feedback) && IsQuiet();
+	if (0 == m_RampFrames || isIdle)
+	{
+		m_Delay = m_TargetDelay;
+		m_Feedback = m_TargetFeedback;
+		m_WetGain = m_TargetWetGain;
+		m_RampRemaining = 0;
+		return;
+	}
+
+	m_DelayStep = (m_TargetDelay - m_Delay) / m_RampFrames;
+	m_FeedbackStep = (m_TargetFeedback - m_Feedback) / m_RampFrames;
+	m_WetGainStep = (m_TargetWetGain - m_WetGain) / m_RampFrames;
+	m_RampRemaining = m_RampFrames;
+}
+
+void DelayLine::Advance(UINT32 frameCount)
+{
+	if (m_RampRemaining > frameCount)
+	{
+		m_Delay += m_DelayStep * frameCount;
+		m_Feedback += m_FeedbackStep * frameCount;
+		m_WetGain += m_WetGainStep * frameCount;
+		m_RampRemaining -= frameCount;
+	}
+	else if (m_RampRemaining > 0)
+	{
+		m_Delay = m_TargetDelay;
+		m_Feedback = m_TargetFeedback;
+		m_WetGain = m_TargetWetGain;
+		m_RampRemaining = 0;
+	}
+
+	m_ModulationPhase += (double)m_ModulationFrequency * frameCount;
+	m_ModulationPhase -= floor(m_ModulationPhase);
+}
+
+void DelayLine::Process(const PlanarView& buffer, UINT32 frameCount, float framesPerBeat)
+{
+	UpdateSettings(framesPerBeat);
+
+	UINT32 done = 0;
+	while (done < frameCount)
+	{
+		// Every frame a chunk reads must have been written before it starts, and a ramp must not end mid-chunk.
+		UINT32 chunk = min(frameCount - done, (UINT32)DELAY_LINE_CHUNK_FRAMES);
+		chunk = min(chunk, max(1u, (UINT32)GetShortestDelay() - 2));
+		if (m_RampRemaining > 0)
+		{
+			chunk = min(chunk, m_RampRemaining);
+		}
+
+		ProcessChunk(buffer, done, chunk);
+		done += chunk;
+	}
+}
+
+void DelayLine::ProcessChunk(const PlanarView& buffer, UINT32 offset, UINT32 frameCount)
+{
+	bool isRamping = (m_RampRemaining > 0);
+	bool isMoving = (isRamping && m_DelayStep != 0) || (m_ModulationDepth > 0);
+	if (isMoving)
+	{
+		// The modulation runs as a rotating phasor through the chunk, starting from the exact phase.
+		double angle = 2.0 * M_PI * m_ModulationPhase;
+		double step = 2.0 * M_PI * m_ModulationFrequency;
+		float sine = (float)sin(angle);
+		float cosine = (float)cos(angle);
+		float stepSine = (float)sin(step);
+		float stepCosine = (float)cos(step);
+		float delayStep = isRamping ? m_DelayStep : 0.0f;
+		float longest = (float)(m_Length - 4);
+		for (UINT32 frame = 0; frame < frameCount; frame++)
+		{
+			float delay = m_Delay + (delayStep * frame) + (m_ModulationDepth * sine);
+			m_Delays[frame] = max((float)DELAY_LINE_MIN_FRAMES, min(longest, delay));
+
+			float nextSine = (sine * stepCosine) + (cosine * stepSine);
+			cosine = (cosine * stepCosine) - (sine * stepSine);
+			sine = nextSine;
+		}
+		PrepareMoving(frameCount);
+	}
+
+	float feedbackStep = isRamping ? m_FeedbackStep : 0.0f;
+	float wetGainStep = isRamping ? m_WetGainStep : 0.0f;
+	bool isLoud = false;
+	bool isZero = true;
+	for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+	{
+		if (isMoving)
+		{
+			ReadMoving(channel, frameCount);
+		}
+		else
+		{
+			ReadSteady(channel, frameCount);
+		}
+
+		float peak = Mix(buffer.Channel(channel) + offset, frameCount, feedbackStep, wetGainStep);
+		if (peak < DELAY_LINE_QUIET_LEVEL)
+		{
+			isZero &= (0 == peak);
+			memset(m_Written, 0, frameCount * sizeof(float));
+		}
+		else
+		{
+			isLoud = true;
+			isZero = false;
+		}
+
+		Write(channel, frameCount);
+	}
+
+	m_WritePosition = (m_WritePosition + frameCount) & m_Mask;
+	m_QuietFrames = isLoud ? 0 : (UINT32)min((UINT64)UINT32_MAX, (UINT64)m_QuietFrames + frameCount);
+	m_ZeroFrames = !isZero ? 0 : (UINT32)min((UINT64)UINT32_MAX, (UINT64)m_ZeroFrames + frameCount);
+	Advance(frameCount);
+}
+
+float DelayLine::Mix(float* samples, UINT32 frameCount, float feedbackStep, float wetGainStep)
+{
+	UINT32 frame = 0;
+	float peak = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	const __m128 ramp = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	const __m128 absolute = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 feedback = _mm_add_ps(_mm_set1_ps(m_Feedback), _mm_mul_ps(ramp, _mm_set1_ps(feedbackStep)));
+	__m128 wetGain = _mm_add_ps(_mm_set1_ps(m_WetGain), _mm_mul_ps(ramp, _mm_set1_ps(wetGainStep)));
+	__m128 feedbackStride = _mm_set1_ps(feedbackStep * 4);
+	__m128 wetGainStride = _mm_set1_ps(wetGainStep * 4);
+	__m128 peaks = _mm_setzero_ps();
+	for (; frame + 4 <= frameCount; frame += 4)
+	{
+		__m128 dry = _mm_loadu_ps(samples + frame);
+		__m128 delayed = _mm_loadu_ps(m_Delayed + frame);
+		__m128 written = _mm_add_ps(dry, _mm_mul_ps(feedback, delayed));
+		_mm_storeu_ps(m_Written + frame, written);
+		_mm_storeu_ps(samples + frame, _mm_add_ps(dry, _mm_mul_ps(wetGain, delayed)));
+		peaks = _mm_max_ps(peaks, _mm_and_ps(written, absolute));
+		feedback = _mm_add_ps(feedback, feedbackStride);
+		wetGain = _mm_add_ps(wetGain, wetGainStride);
+	}
+	peaks = _mm_max_ps(peaks, _mm_movehl_ps(peaks, peaks));
+	peaks = _mm_max_ss(peaks, _mm_shuffle_ps(peaks, peaks, _MM_SHUFFLE(1, 1, 1, 1)));
+	peak = _mm_cvtss_f32(peaks);
+#endif
+	for (; frame < frameCount; frame++)
+	{
+		float dry = samples[frame];
+		float delayed = m_Delayed[frame];
+		m_Written[frame] = dry + ((m_Feedback + (feedbackStep * frame)) * delayed);
+		samples[frame] = dry + ((m_WetGain + (wetGainStep * frame)) * delayed);
+		peak = max(peak, fabsf(m_Written[frame]));
+	}
+	return peak;
+}
+
+void DelayLine::Write(UINT32 channel, UINT32 frameCount)
+{
+	float* line = m_Line.Channel(channel);
+	UINT32 first = min(frameCount, m_Length - m_WritePosition);
+	memcpy(line + m_WritePosition, m_Written, first * sizeof(float));
+	memcpy(line + m_WritePosition + m_Length, m_Written, first * sizeof(float));
+	memcpy(line, m_Written + first, (frameCount - first) * sizeof(float));
+	memcpy(line + m_Length, m_Written + first, (frameCount - first) * sizeof(float));
+}
+
+// Catmull-Rom weights of the four samples around a point fraction of the way from the second to the third.
+static void CubicWeights(float fraction, float* weights)
+{
+	float squared = fraction * fraction;
+	float cubed = squared * fraction;
+	weights[0] = 0.5f * (-cubed + (2.0f * squared) - fraction);
+	weights[1] = 0.5f * ((3.0f * cubed) - (5.0f * squared) + 2.0f);
+	weights[2] = 0.5f * ((-3.0f * cubed) + (4.0f * squared) + fraction);
+	weights[3] = 0.5f * (cubed - squared);
+}
+
+void DelayLine::ReadSteady(UINT32 channel, UINT32 frameCount)
+{
+	const float* line = m_Line.Channel(channel);
+	UINT32 whole = (UINT32)m_Delay;
+	float fraction = m_Delay - whole;
+
+	// Frame t reads fraction of the way back from frame w + t - whole, towards w + t - whole - 1; older points
+	// at the latter.  The second copy of the line keeps every tap contiguous.
+	const float* older = line + ((m_WritePosition - whole - 1) & m_Mask);
+	UINT32 frame = 0;
+
+	switch (m_Interpolation)
+	{
+	case Delay_Linear:
+	{
+		float olderWeight = fraction;
+		float newerWeight = 1.0f - fraction;
+#if defined(_M_IX86) || defined(_M_X64)
+		__m128 olderWeights = _mm_set1_ps(olderWeight);
+		__m128 newerWeights = _mm_set1_ps(newerWeight);
+		for (; frame + 4 <= frameCount; frame += 4)
+		{
+			__m128 sum = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(older + frame), olderWeights), _mm_mul_ps(_mm_loadu_ps(older + frame + 1), newerWeights));
+			_mm_storeu_ps(m_Delayed + frame, sum);
+		}
+#endif
+		for (; frame < frameCount; frame++)
+		{
+			m_Delayed[frame] = (older[frame] * olderWeight) + (older[frame + 1] * newerWeight);
+		}
+		break;
+	}
+
+	case Delay_Cubic:
+	{
+		float weights[4];
+		CubicWeights(1.0f - fraction, weights);
+		const float* taps = line + ((m_WritePosition - whole - 2) & m_Mask);
+#if defined(_M_IX86) || defined(_M_X64)
+		__m128 weight0 = _mm_set1_ps(weights[0]);
+		__m128 weight1 = _mm_set1_ps(weights[1]);
+		__m128 weight2 = _mm_set1_ps(weights[2]);
+		__m128 weight3 = _mm_set1_ps(weights[3]);
+		for (; frame + 4 <= frameCount; frame += 4)
+		{
+			__m128 sum = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(taps + frame), weight0), _mm_mul_ps(_mm_loadu_ps(taps + frame + 1), weight1)),
+				_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(taps + frame + 2), weight2), _mm_mul_ps(_mm_loadu_ps(taps + frame + 3), weight3)));
+			_mm_storeu_ps(m_Delayed + frame, sum);
+		}
+#endif
+		for (; frame < frameCount; frame++)
+		{
+			m_Delayed[frame] = (taps[frame] * weights[0]) + (taps[frame + 1] * weights[1]) + (taps[frame + 2] * weights[2]) + (taps[frame + 3] * weights[3]);
+		}
+		break;
+	}
+
+	case Delay_Allpass:
+	{
+		// A first order allpass is best behaved delaying between half a frame and a frame and a half.
+		UINT32 allpassWhole = (UINT32)(m_Delay - 0.5f);
+		float allpassFraction = m_Delay - allpassWhole;
+		float coefficient = (1.0f - allpassFraction) / (1.0f + allpassFraction);
+		const float* taps = line + ((m_WritePosition - allpassWhole - 1) & m_Mask);
+		float state = m_AllpassState[channel];
+		for (; frame < frameCount; frame++)
+		{
+			state = (coefficient * (taps[frame + 1] - state)) + taps[frame];
+			m_Delayed[frame] = state;
+		}
+		m_AllpassState[channel] = state;
+		break;
+	}
+	}
+}
+
+void DelayLine::PrepareMoving(UINT32 frameCount)
+{
+	// Tap offsets count back from the frame being written; the allpass is best behaved delaying between half a
+	// frame and a frame and a half, so it splits the delay differently.
+	float split = (Delay_Allpass == m_Interpolation) ? 0.5f : 0.0f;
+	UINT32 frame = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	const __m128 splits = _mm_set1_ps(split);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	for (; frame + 4 <= frameCount; frame += 4)
+	{
+		__m128 delays = _mm_loadu_ps(m_Delays + frame);
+		__m128i whole = _mm_cvttps_epi32(_mm_sub_ps(delays, splits));
+		__m128 fraction = _mm_sub_ps(delays, _mm_cvtepi32_ps(whole));
+		_mm_storeu_si128((__m128i*)(m_TapOffsets + frame), whole);
+
+		switch (m_Interpolation)
+		{
+		case Delay_Linear:
+			_mm_storeu_ps(m_TapWeights[0] + frame, fraction);
+			_mm_storeu_ps(m_TapWeights[1] + frame, _mm_sub_ps(one, fraction));
+			break;
+
+		case Delay_Cubic:
+		{
+			__m128 position = _mm_sub_ps(one, fraction);
+			__m128 squared = _mm_mul_ps(position, position);
+			__m128 cubed = _mm_mul_ps(squared, position);
+			__m128 weight0 = _mm_sub_ps(_mm_sub_ps(_mm_add_ps(squared, squared), cubed), position);
+			__m128 weight1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), cubed), _mm_mul_ps(_mm_set1_ps(5.0f), squared)), _mm_set1_ps(2.0f));
+			__m128 weight2 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(4.0f), squared), _mm_mul_ps(_mm_set1_ps(3.0f), cubed)), position);
+			__m128 weight3 = _mm_sub_ps(cubed, squared);
+			_mm_storeu_ps(m_TapWeights[0] + frame, _mm_mul_ps(half, weight0));
+			_mm_storeu_ps(m_TapWeights[1] + frame, _mm_mul_ps(half, weight1));
+			_mm_storeu_ps(m_TapWeights[2] + frame, _mm_mul_ps(half, weight2));
+			_mm_storeu_ps(m_TapWeights[3] + frame, _mm_mul_ps(half, weight3));
+			break;
+		}
+
+		case Delay_Allpass:
+			_mm_storeu_ps(m_TapWeights[0] + frame, _mm_div_ps(_mm_sub_ps(one, fraction), _mm_add_ps(one, fraction)));
+			break;
+		}
+	}
+#endif
+	for (; frame < frameCount; frame++)
+	{
+		UINT32 whole = (UINT32)(m_Delays[frame] - split);
+		float fraction = m_Delays[frame] - whole;
+		m_TapOffsets[frame] = whole;
+
+		switch (m_Interpolation)
+		{
+		case Delay_Linear:
+			m_TapWeights[0][frame] = fraction;
+			m_TapWeights[1][frame] = 1.0f - fraction;
+			break;
+
+		case Delay_Cubic:
+		{
+			float weights[4];
+			CubicWeights(1.0f - fraction, weights);
+			for (UINT32 tap = 0; tap < 4; tap++)
+			{
+				m_TapWeights[tap][frame] = weights[tap];
+			}
+			break;
+		}
+
+		case Delay_Allpass:
+			m_TapWeights[0][frame] = (1.0f - fraction) / (1.0f + fraction);
+			break;
+		}
+	}
+}
+
+void DelayLine::ReadMoving(UINT32 channel, UINT32 frameCount)
+{
+	const float* line = m_Line.Channel(channel);
+
+	switch (m_Interpolation)
+	{
+	case Delay_Linear:
+		for (UINT32 frame = 0; frame < frameCount; frame++)
+		{
+			const float* older = line + ((m_WritePosition + frame - m_TapOffsets[frame] - 1) & m_Mask);
+			m_Delayed[frame] = (older[0] * m_TapWeights[0][frame]) + (older[1] * m_TapWeights[1][frame]);
+		}
+		break;
+
+	case Delay_Cubic:
+		for (UINT32 frame = 0; frame < frameCount; frame++)
+		{
+			const float* taps = line + ((m_WritePosition + frame - m_TapOffsets[frame] - 2) & m_Mask);
+			m_Delayed[frame] = (taps[0] * m_TapWeights[0][frame]) + (taps[1] * m_TapWeights[1][frame]) + (taps[2] * m_TapWeights[2][frame]) + (taps[3] * m_TapWeights[3][frame]);
+		}
+		break;
+
+	case Delay_Allpass:
+	{
+		float state = m_AllpassState[channel];
+		for (UINT32 frame = 0; frame < frameCount; frame++)
+		{
+			const float* taps = line + ((m_WritePosition + frame - m_TapOffsets[frame] - 1) & m_Mask);
+			state = (m_TapWeights[0][frame] * (taps[1] - state)) + taps[0];
+			m_Delayed[frame] = state;
+		}
+		m_AllpassState[channel] = state;
+		break;
+	}
+	}
+}
+
+void DelayLine::Skip(UINT32 frameCount, float framesPerBeat)
+{
+	UpdateSettings(framesPerBeat);
+
+	// The skipped frames are written as silence, unless the line holds nothing else already.
+	if (m_ZeroFrames < m_Length)
+	{
+		UINT32 count = min(frameCount, m_Length);
+		UINT32 first = min(count, m_Length - m_WritePosition);
+		for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+		{
+			float* line = m_Line.Channel(channel);
+			memset(line + m_WritePosition, 0, first * sizeof(float));
+			memset(line + m_WritePosition + m_Length, 0, first * sizeof(float));
+			memset(line, 0, (count - first) * sizeof(float));
+			memset(line + m_Length, 0, (count - first) * sizeof(float));
+		}
+	}
+
+	std::fill(m_AllpassState.begin(), m_AllpassState.end(), 0.0f);
+	m_WritePosition = (UINT32)((m_WritePosition + (UINT64)frameCount) & m_Mask);
+	m_QuietFrames = (UINT32)min((UINT64)UINT32_MAX, (UINT64)m_QuietFrames + frameCount);
+	m_ZeroFrames = (UINT32)min((UINT64)UINT32_MAX, (UINT64)m_ZeroFrames + frameCount);
+	Advance(frameCount);
+}
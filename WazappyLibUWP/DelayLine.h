@@ -0,0 +1,175 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "WazappyDllInterface.h"
+#include "PlanarBuffer.h"
+
+// Longest delay a delay line holds, in seconds (with any modulation).
+#define DELAY_LINE_MAX_SECONDS 4
+
+// Shortest delay, in frames; the interpolators need this many frames of history behind the read position.
+#define DELAY_LINE_MIN_FRAMES 3
+
+// Largest feedback gain, either way; any more and the line would ring forever.
+#define DELAY_LINE_MAX_FEEDBACK 0.98f
+
+// Most frames processed in one go.  A delay shorter than this is processed in chunks a little shorter than the
+// delay, so every read is of frames already written.
+#define DELAY_LINE_CHUNK_FRAMES 256
+
+// A chunk written to the line which peaks below this (-160dB) is written as silence, so a feedback tail ends
+// rather than decaying into denormals.
+#define DELAY_LINE_QUIET_LEVEL 1e-8f
+
+// Tempo synced delays follow until a device is given one.
+#define DELAY_LINE_DEFAULT_TEMPO 120.0f
+
+namespace Wazappy
+{
+	// A feedback delay line with a fractional, modulated delay: an echo, or with a short swept delay, a chorus or
+	// flanger, on a voice or a whole mix.
+	// Each channel's line is a power-of-two circular buffer stored twice over, end to end, with every frame
+	// written to both copies; so any run of frames up to the line's length is contiguous from wherever it starts,
+	// and reads never wrap mid-block.  With a steady delay the interpolator's taps are the same for every frame,
+	// and it runs as a short FIR across contiguous memory, four frames to a vector.
+	// Parameter changes (and tempo changes, for a delay in beats) glide over the given ramp.
+	// Setters may be called from any thread and never block; if two race, the last to finish wins.  Everything
+	// else is audio thread only.
+	class DelayLine
+	{
+	public:
+		// Allocates the line, so never call this on an audio thread.  maxDelayFrames is at most
+		// DELAY_LINE_MAX_SECONDS at the caller's sample rate.
+		DelayLine(UINT32 channelCount, UINT32 maxDelayFrames);
+
+		// Move to new settings.  The delay is in frames, or in beats if beats is above 0; the modulation
+		// frequency is in cycles per frame and its depth in frames.  The delay and depth are held within the
+		// line.  Any thread.
+		void SetParameters(float delayFrames, float beats, float feedback, float wetGain, float modulationFrequency, float modulationDepth, DelayInterpolation interpolation, UINT32 rampFrames);
+
+		// True when the line adds nothing and has nothing in it to add: the wet gain is (and is staying) 0 and
+		// the line is quiet.  Process would leave audio unchanged; Skip keeps the line in time.
+		bool IsBypassed();
+
+		// True when everything the line could play out next is silent.
+		bool IsQuiet() const;
+
+		// Run the first frameCount frames of buffer, which has the line's channel count, through the line in
+		// place.  framesPerBeat is the tempo, for delays in beats; with none (0), they fall back to their delay in
+		// frames.
+		void Process(const PlanarView& buffer, UINT32 frameCount, float framesPerBeat);
+
+		// Move on by frameCount frames without processing audio, writing them into the line as silence (with no
+		// feedback); what the line held from before still comes out of the taps once the delay reaches it.  For
+		// periods whose output is thrown away, or whose input is silent while the line is quiet.
+		void Skip(UINT32 frameCount, float framesPerBeat);
+
+	private:
+		// Settings written by SetParameters; Generation is bumped after the others so the audio thread sees each
+		// change.
+		struct Settings
+		{
+			std::atomic<float> DelayFrames;
+			std::atomic<float> Beats;
+			std::atomic<float> Feedback;
+			std::atomic<float> WetGain;
+			std::atomic<float> ModulationFrequency;
+			std::atomic<float> ModulationDepth;
+			std::atomic<DelayInterpolation> Interpolation;
+			std::atomic<UINT32> RampFrames;
+			std::atomic<UINT32> Generation;
+		};
+
+		// Pick up new settings, and a new tempo for a delay in beats, starting a ramp to them.
+		void UpdateSettings(float framesPerBeat);
+
+		// Glide from the current values to the targets over the ramp.
+		void StartRamp();
+
+		// Move the ramp and the modulation on by frameCount frames.
+		void Advance(UINT32 frameCount);
+
+		// Shortest and longest delays the line may read at before the ramp next changes.
+		float GetShortestDelay() const;
+		float GetLongestDelay() const;
+
+		void ProcessChunk(const PlanarView& buffer, UINT32 offset, UINT32 frameCount);
+
+		// Read frameCount delayed frames of one channel into m_Delayed: at m_Delay frames behind the write
+		// position for a steady delay, or at m_Delays for a moving one.
+		void ReadSteady(UINT32 channel, UINT32 frameCount);
+		void ReadMoving(UINT32 channel, UINT32 frameCount);
+
+		// Work out m_TapOffsets and m_TapWeights from m_Delays, once for every channel.
+		void PrepareMoving(UINT32 frameCount);
+
+		// Mix m_Delayed into frameCount frames of samples with the wet gain, and into m_Written with the
+		// feedback.  Returns the peak of m_Written.
+		float Mix(float* samples, UINT32 frameCount, float feedbackStep, float wetGainStep);
+
+		// Copy frameCount frames of m_Written into both copies of a channel's line at the write position.
+		void Write(UINT32 channel, UINT32 frameCount);
+
+	private:
+		Settings m_Settings;
+
+		const UINT32 m_ChannelCount;
+
+		// Frames in each copy of the line, a power of two, and the mask which wraps a frame index into it.
+		UINT32 m_Length;
+		UINT32 m_Mask;
+
+		// Each channel holds two copies of the line, 2 * m_Length frames.
+		PlanarBuffer m_Line;
+
+		// Audio thread state.
+		UINT32 m_SeenGeneration;
+		UINT32 m_WritePosition;
+		float m_Beats;
+		float m_RequestedDelay;
+		DelayInterpolation m_Interpolation;
+		UINT32 m_RampFrames;
+
+		// Current values, their targets, and their per frame steps while m_RampRemaining frames of ramp are left.
+		float m_Delay;
+		float m_Feedback;
+		float m_WetGain;
+		float m_TargetDelay;
+		float m_TargetFeedback;
+		float m_TargetWetGain;
+		float m_DelayStep;
+		float m_FeedbackStep;
+		float m_WetGainStep;
+		UINT32 m_RampRemaining;
+
+		// Modulation: phase in cycles, frequency in cycles per frame, and depth in frames.
+		double m_ModulationPhase;
+		float m_ModulationFrequency;
+		float m_ModulationDepth;
+
+		// Each channel's allpass interpolator output from the last frame.
+		std::vector<float> m_AllpassState;
+
+		// Frames since the line was last written anything above DELAY_LINE_QUIET_LEVEL, and since it was last
+		// written anything but zeros.
+		UINT32 m_QuietFrames;
+		UINT32 m_ZeroFrames;
+
+		// Scratch for one chunk: the delay at each frame while it moves, and one channel's delayed samples and
+		// the samples written back to its line.
+		float m_Delays[DELAY_LINE_CHUNK_FRAMES];
+		float m_Delayed[DELAY_LINE_CHUNK_FRAMES];
+
+		// While the delay moves, each frame's whole frames of delay (less half a frame, for the allpass) and its
+		// interpolator's weights, structure of arrays: all frames' first weight, then all frames' second...
+		UINT32 m_TapOffsets[DELAY_LINE_CHUNK_FRAMES];
+		float m_TapWeights[4][DELAY_LINE_CHUNK_FRAMES];
+		float m_Written[DELAY_LINE_CHUNK_FRAMES];
+	};
+}
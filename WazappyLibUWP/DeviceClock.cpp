@@ -0,0 +1,132 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include "DeviceClock.h"
+
+using namespace Wazappy;
+
+DeviceClock::DeviceClock() :
+	m_NominalSampleRate(0),
+	m_HasAnchor(false),
+	m_AnchorFrame(0),
+	m_AnchorQpc(0),
+	m_RateRatio(1.0),
+	m_HasEstimate(false),
+	m_Sequence(0),
+	m_LatestFrame(0),
+	m_LatestQpc(0)
+{
+}
+
+void DeviceClock::Reset(UINT32 nominalSampleRate)
+{
+	m_NominalSampleRate = nominalSampleRate;
+	m_HasAnchor = false;
+	m_RateRatio = 1.0;
+	m_HasEstimate = false;
+
+	m_Sequence.fetch_add(1, std::memory_order_acq_rel);
+	m_LatestQpc.store(0, std::memory_order_relaxed);
+	m_Sequence.fetch_add(1, std::memory_order_release);
+}
+
+void DeviceClock::AddObservation(UINT64 framePosition, UINT64 qpcPosition)
+{
+	if (m_NominalSampleRate == 0)
+	{
+		return;
+	}
+
+	m_Sequence.fetch_add(1, std::memory_order_acq_rel);
+	m_LatestFrame.store(framePosition, std::memory_order_relaxed);
+	m_LatestQpc.store(qpcPosition, std::memory_order_relaxed);
+	m_Sequence.fetch_add(1, std::memory_order_release);
+
+	if (!m_HasAnchor || framePosition < m_AnchorFrame || qpcPosition <= m_AnchorQpc)
+	{
+		m_HasAnchor = true;
+		m_AnchorFrame = framePosition;
+		m_AnchorQpc = qpcPosition;
+		return;
+	}
+
+	UINT64 elapsed = qpcPosition - m_AnchorQpc;
+	if (elapsed < DEVICE_CLOCK_MEASUREMENT_SPAN)
+	{
+		return;
+	}
+
+	// Frames per second over the span, relative to nominal.  Measuring over a long span keeps the error from
+	// jitter in the timestamps small; smoothing successive spans shrinks it further.
+	double measured = (double)(framePosition - m_AnchorFrame) * 10000000.0 / ((double)elapsed * m_NominalSampleRate);
+
+	m_AnchorFrame = framePosition;
+	m_AnchorQpc = qpcPosition;
+
+	if (measured < 1.0 - DEVICE_CLOCK_MAX_DEVIATION || measured > 1.0 + DEVICE_CLOCK_MAX_DEVIATION)
+	{
+		return;
+	}
+
+	if (!m_HasEstimate)
+	{
+		m_RateRatio = measured;
+		m_HasEstimate = true;
+	}
+	else
+	{
+		double ratio = m_RateRatio;
+		m_RateRatio = ratio + DEVICE_CLOCK_SMOOTHING * (measured - ratio);
+	}
+}
+
+bool DeviceClock::GetLatestObservation(UINT64* framePosition, UINT64* qpcPosition) const
+{
+	for (;;)
+	{
+		UINT32 before = m_Sequence.load(std::memory_order_acquire);
+		if (before & 1)
+		{
+			continue;
+		}
+
+		*framePosition = m_LatestFrame.load(std::memory_order_relaxed);
+		*qpcPosition = m_LatestQpc.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_Sequence.load(std::memory_order_relaxed) == before)
+		{
+			return *qpcPosition != 0;
+		}
+	}
+}
+
+bool DeviceClock::FrameAtQpc(double qpcPosition, double* framePosition) const
+{
+	UINT64 latestFrame;
+	UINT64 latestQpc;
+	if (!GetLatestObservation(&latestFrame, &latestQpc))
+	{
+		return false;
+	}
+
+	double framesPerTick = m_NominalSampleRate * m_RateRatio / 10000000.0;
+	*framePosition = latestFrame + (qpcPosition - (double)latestQpc) * framesPerTick;
+	return true;
+}
+
+bool DeviceClock::QpcAtFrame(double framePosition, double* qpcPosition) const
+{
+	UINT64 latestFrame;
+	UINT64 latestQpc;
+	if (!GetLatestObservation(&latestFrame, &latestQpc))
+	{
+		return false;
+	}
+
+	double ticksPerFrame = 10000000.0 / (m_NominalSampleRate * m_RateRatio);
+	*qpcPosition = latestQpc + (framePosition - (double)latestFrame) * ticksPerFrame;
+	return true;
+}
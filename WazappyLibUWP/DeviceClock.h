@@ -0,0 +1,68 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+
+// Minimum span, in 100ns units, between the two position observations a rate measurement is taken over.
+#define DEVICE_CLOCK_MEASUREMENT_SPAN (10 * 1000 * 1000)
+
+// Weight given to each new rate measurement in the running estimate.
+#define DEVICE_CLOCK_SMOOTHING 0.05
+
+// Measurements further than this from the nominal rate are taken to be glitches (e.g. a missed position
+// update) and discarded.
+#define DEVICE_CLOCK_MAX_DEVIATION 0.005
+
+namespace Wazappy
+{
+	// Estimates how fast an audio endpoint's sample clock actually runs, relative to QueryPerformanceCounter,
+	// from pairs of (device position, QPC position) such as IAudioCaptureClient::GetBuffer and
+	// IAudioClock::GetPosition report.
+	// Observations come from the device's audio thread; the estimate may be read from any thread.
+	class DeviceClock
+	{
+	public:
+		DeviceClock();
+
+		// Forget all observations, e.g. when the device (re)starts or reports a discontinuity.
+		void Reset(UINT32 nominalSampleRate);
+
+		// Note that the device was at the given frame at the given QPC time (in 100ns units).
+		void AddObservation(UINT64 framePosition, UINT64 qpcPosition);
+
+		// The device's measured sample rate divided by its nominal rate; 1.0 until enough has been observed.
+		double GetRateRatio() const { return m_RateRatio; }
+
+		bool HasEstimate() const { return m_HasEstimate; }
+
+		// The most recent observation.  Any thread; false until the device has been observed since it was reset.
+		bool GetLatestObservation(UINT64* framePosition, UINT64* qpcPosition) const;
+
+		// Where the device was (in fractional frames) at the given QPC time, extrapolating from the latest
+		// observation at the measured rate.  Any thread; false until the device has been observed.
+		bool FrameAtQpc(double qpcPosition, double* framePosition) const;
+
+		// The inverse: when (in 100ns units) the device was or will be at the given frame.
+		bool QpcAtFrame(double framePosition, double* qpcPosition) const;
+
+	private:
+		UINT32 m_NominalSampleRate;
+
+		// Start of the span the next measurement is taken over.
+		bool m_HasAnchor;
+		UINT64 m_AnchorFrame;
+		UINT64 m_AnchorQpc;
+
+		std::atomic<double> m_RateRatio;
+		std::atomic<bool> m_HasEstimate;
+
+		// Latest observation, published under a sequence count (odd while being written) so that readers on
+		// other threads always see a matching pair.
+		std::atomic<UINT32> m_Sequence;
+		std::atomic<UINT64> m_LatestFrame;
+		std::atomic<UINT64> m_LatestQpc;
+	};
+}
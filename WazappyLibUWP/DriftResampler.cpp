@@ -0,0 +1,92 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include "DriftResampler.h"
+
+using namespace Wazappy;
+
+DriftResampler::DriftResampler() :
+	m_ChannelCount(0),
+	m_Phase(0.0),
+	m_IsLinear(false)
+{
+}
+
+void DriftResampler::Reset(UINT32 channelCount)
+{
+	m_ChannelCount = channelCount;
+	m_History.assign(4 * channelCount, 0.0f);
+	m_Phase = 0.0;
+}
+
+UINT32 DriftResampler::GetInputFramesNeeded(UINT32 outputFrames, double ratio) const
+{
+	if (outputFrames == 0)
+	{
+		return 0;
+	}
+
+	// One input frame is shifted in each time the phase passes a whole frame, before each output frame.
+	double lastPhase = m_Phase + (outputFrames - 1) * ratio;
+	return (UINT32)lastPhase;
+}
+
+UINT32 DriftResampler::Process(const PlanarView& input, UINT32 inputFrames, const PlanarView& output, UINT32 outputFrames, double ratio)
+{
+	const double start = m_Phase;
+
+	// Every channel shifts in the same frames; this is how many, as GetInputFramesNeeded says.
+	const UINT32 shiftedFrames = GetInputFramesNeeded(outputFrames, ratio);
+
+	for (UINT32 c = 0; c < m_ChannelCount; c++)
+	{
+		const float* in = input.Channel(c);
+		float* out = output.Channel(c);
+		float* history = &m_History[c * 4];
+		float y0 = history[0], y1 = history[1], y2 = history[2], y3 = history[3];
+		UINT32 shifted = 0;
+
+		for (UINT32 frame = 0; frame < outputFrames; frame++)
+		{
+			// Compute each position from the start rather than accumulating, so the frames shifted in here always
+			// agree exactly with GetInputFramesNeeded.
+			double position = start + frame * ratio;
+			UINT32 whole = (UINT32)position;
+			while (shifted < whole)
+			{
+				// Shift in the next input sample, holding the last one if the caller came up short.
+				y0 = y1;
+				y1 = y2;
+				y2 = y3;
+				if (shifted < inputFrames)
+				{
+					y3 = in[shifted];
+				}
+				shifted++;
+			}
+
+			float t = (float)(position - whole);
+			if (m_IsLinear)
+			{
+				out[frame] = y1 + t * (y2 - y1);
+				continue;
+			}
+
+			float c1 = 0.5f * (y2 - y0);
+			float c2 = y0 - 2.5f * y1 + 2.0f * y2 - 0.5f * y3;
+			float c3 = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+			out[frame] = ((c3 * t + c2) * t + c1) * t + y1;
+		}
+
+		history[0] = y0;
+		history[1] = y1;
+		history[2] = y2;
+		history[3] = y3;
+	}
+
+	m_Phase = start + outputFrames * ratio - shiftedFrames;
+	UINT32 consumed = min(shiftedFrames, inputFrames);
+	return consumed;
+}
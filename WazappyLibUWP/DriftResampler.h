@@ -0,0 +1,50 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <vector>
+
+#include "PlanarBuffer.h"
+
+namespace Wazappy
+{
+	// Resampler for planar float audio whose ratio may change slightly on every call, as needed to absorb
+	// the drift between two devices' clocks.  Uses 4-point cubic Hermite interpolation, with the read position
+	// kept in double precision so ratios a few parts per million from 1.0 are tracked exactly.
+	// Not thread safe; owned by whichever thread consumes the output.
+	class DriftResampler
+	{
+	public:
+		DriftResampler();
+
+		// Start over with the given channel count, with silent history.
+		void Reset(UINT32 channelCount);
+
+		// Interpolate linearly between the middle two history frames instead of with the cubic: about half the
+		// work, at the cost of some high frequency loss.  Can be switched between calls without a discontinuity.
+		void SetLinear(bool isLinear) { m_IsLinear = isLinear; }
+
+		// Input frames the next Process call will consume to produce outputFrames at the given ratio
+		// (input frames per output frame).
+		UINT32 GetInputFramesNeeded(UINT32 outputFrames, double ratio) const;
+
+		// Write outputFrames frames to output from input, consuming GetInputFramesNeeded(outputFrames, ratio)
+		// input frames.  If fewer are supplied the last one is held.  Both views must have the channel count
+		// given to Reset.  Returns the input frames consumed.
+		UINT32 Process(const PlanarView& input, UINT32 inputFrames, const PlanarView& output, UINT32 outputFrames, double ratio);
+
+	private:
+		UINT32 m_ChannelCount;
+
+		// Last four input samples consumed on each channel (four per channel, oldest first); output is
+		// interpolated between the middle two.
+		std::vector<float> m_History;
+
+		// Position of the next output frame past the second history frame, in input frames.
+		double m_Phase;
+
+		bool m_IsLinear;
+	};
+}
@@ -0,0 +1,440 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <algorithm>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "DynamicsStage.h"
+
+using namespace Wazappy;
+
+// Decibels to a linear gain, and back.
+static float DbToGain(float db)
+{
+	return powf(10.0f, db / 20.0f);
+}
+
+static float GainToDb(float gain)
+{
+	return 20.0f * log10f(gain);
+}
+
+// One pole smoothing coefficient for the given time constant.
+static float SmoothingCoefficient(float milliseconds, UINT32 sampleRate)
+{
+	return (milliseconds > 0) ? expf(-1000.0f / (milliseconds * sampleRate)) : 0.0f;
+}
+
+static UINT32 RoundUpToPowerOfTwo(UINT32 value)
+{
+	UINT32 power = 1;
+	while (power < value)
+	{
+		power <<= 1;
+	}
+	return power;
+}
+
+DynamicsStage::DynamicsStage() :
+	m_ChannelCount(0),
+	m_SampleRate(0),
+	m_Lookahead(0),
+	m_LatencyFrames(0),
+	m_SeenGeneration(0),
+	m_IsEnabled(false),
+	m_ThresholdDb(0),
+	m_Slope(0),
+	m_KneeDb(0),
+	m_KneeStart(1.0f),
+	m_AttackCoefficient(0),
+	m_ReleaseCoefficient(0),
+	m_MakeupGainDb(0),
+	m_Ceiling(1.0f),
+	m_LimiterReleaseCoefficient(0),
+	m_CompressorGainDb(0),
+	m_CompressorGain(1.0f),
+	m_Position(0),
+	m_HeldGainSum(0),
+	m_RingMask(0),
+	m_DequeFront(0),
+	m_DequeBack(0),
+	m_DequeMask(0),
+	m_LimiterGain(1.0f),
+	m_SilentFrames(0),
+	m_IsResting(false),
+	m_CompressorReduction(0),
+	m_LimiterReduction(1.0f),
+	m_LastCompressorReductionDb(0),
+	m_LastLimiterReductionDb(0),
+	m_LimitedPeriods(0),
+	m_RestingPeriods(0)
+{
+	m_Settings.IsEnabled.store(true, std::memory_order_relaxed);
+	m_Settings.ThresholdDb.store(0, std::memory_order_relaxed);
+	m_Settings.Ratio.store(1.0f, std::memory_order_relaxed);
+	m_Settings.KneeDb.store(6.0f, std::memory_order_relaxed);
+	m_Settings.AttackMilliseconds.store(10.0f, std::memory_order_relaxed);
+	m_Settings.ReleaseMilliseconds.store(100.0f, std::memory_order_relaxed);
+	m_Settings.MakeupGainDb.store(0, std::memory_order_relaxed);
+	m_Settings.CeilingDb.store(DYNAMICS_DEFAULT_CEILING_DB, std::memory_order_relaxed);
+	m_Settings.LimiterReleaseMilliseconds.store(DYNAMICS_DEFAULT_LIMITER_RELEASE_MS, std::memory_order_relaxed);
+	m_Settings.Generation.store(0, std::memory_order_relaxed);
+
+	// Lanczos (a = 4) interpolation at each quarter frame, from the three frames before the point and the four
+	// after; normalized so a steady level reads as itself.
+	for (UINT32 phase = 0; phase < DYNAMICS_TRUE_PEAK_PHASES; phase++)
+	{
+		double fraction = (phase + 1.0) / (DYNAMICS_TRUE_PEAK_PHASES + 1);
+		double sum = 0;
+		for (UINT32 tap = 0; tap < DYNAMICS_TRUE_PEAK_TAPS; tap++)
+		{
+			double x = fraction - ((int)tap - (DYNAMICS_TRUE_PEAK_TAPS / 2 - 1));
+			double piX = M_PI * x;
+			double weight = (DYNAMICS_TRUE_PEAK_TAPS / 2) * sin(piX) * sin(piX / (DYNAMICS_TRUE_PEAK_TAPS / 2)) / (piX * piX);
+			m_TruePeakWeights[phase][tap] = (float)weight;
+			sum += weight;
+		}
+		for (UINT32 tap = 0; tap < DYNAMICS_TRUE_PEAK_TAPS; tap++)
+		{
+			m_TruePeakWeights[phase][tap] = (float)(m_TruePeakWeights[phase][tap] / sum);
+		}
+	}
+}
+
+void DynamicsStage::Reserve(UINT32 channelCount, UINT32 sampleRate)
+{
+	m_ChannelCount = channelCount;
+	m_SampleRate = sampleRate;
+	m_Lookahead = max((UINT32)DYNAMICS_TRUE_PEAK_TAPS, (UINT32)(DYNAMICS_LOOKAHEAD_MS * sampleRate / 1000 + 0.5));
+	m_LatencyFrames = m_Lookahead + (DYNAMICS_TRUE_PEAK_TAPS / 2);
+
+	m_Window.Allocate(channelCount, m_LatencyFrames + DYNAMICS_CHUNK_FRAMES);
+
+	UINT32 ringLength = RoundUpToPowerOfTwo(m_Lookahead + 1);
+	m_RingMask = ringLength - 1;
+	m_CompressorGains.assign(ringLength, 1.0f);
+	m_HeldGains.assign(ringLength, 1.0f);
+
+	// The sliding minimum's window is the lookahead and the frame either side of it.
+	UINT32 dequeLength = RoundUpToPowerOfTwo(m_Lookahead + 3);
+	m_DequeMask = dequeLength - 1;
+	m_DequeGains.assign(dequeLength, 1.0f);
+	m_DequePositions.assign(dequeLength, 0);
+
+	m_SeenGeneration = m_Settings.Generation.load(std::memory_order_acquire);
+	LoadSettings();
+	Rest();
+}
+
+void DynamicsStage::SetParameters(const DYNAMICSPARAMS& params)
+{
+	Contract::Requires(params.Ratio >= 1.0f, L"Compression ratio must be at least 1");
+	Contract::Requires(params.CeilingDb <= 0, L"Limiter ceiling must be at most 0dBFS");
+
+	m_Settings.IsEnabled.store(params.IsEnabled != FALSE, std::memory_order_relaxed);
+	m_Settings.ThresholdDb.store(params.ThresholdDb, std::memory_order_relaxed);
+	m_Settings.Ratio.store(params.Ratio, std::memory_order_relaxed);
+	m_Settings.KneeDb.store(params.KneeDb, std::memory_order_relaxed);
+	m_Settings.AttackMilliseconds.store(params.AttackMilliseconds, std::memory_order_relaxed);
+	m_Settings.ReleaseMilliseconds.store(params.ReleaseMilliseconds, std::memory_order_relaxed);
+	m_Settings.MakeupGainDb.store(params.MakeupGainDb, std::memory_order_relaxed);
+	m_Settings.CeilingDb.store(params.CeilingDb, std::memory_order_relaxed);
+	m_Settings.LimiterReleaseMilliseconds.store(params.LimiterReleaseMilliseconds, std::memory_order_relaxed);
+	m_Settings.Generation.fetch_add(1, std::memory_order_release);
+}
+
+UINT32 DynamicsStage::GetLatencyFrames() const
+{
+	return m_Settings.IsEnabled.load(std::memory_order_relaxed) ? m_LatencyFrames.load(std::memory_order_relaxed) : 0;
+}
+
+void DynamicsStage::UpdateSettings()
+{
+	UINT32 generation = m_Settings.Generation.load(std::memory_order_acquire);
+	if (generation != m_SeenGeneration)
+	{
+		m_SeenGeneration = generation;
+
+		bool wasEnabled = m_IsEnabled;
+		LoadSettings();
+
+		// Whatever the window held was passed straight through while disabled.
+		if (m_IsEnabled && !wasEnabled)
+		{
+			Rest();
+		}
+	}
+}
+
+void DynamicsStage::LoadSettings()
+{
+	m_IsEnabled = m_Settings.IsEnabled.load(std::memory_order_relaxed);
+	m_ThresholdDb = m_Settings.ThresholdDb.load(std::memory_order_relaxed);
+	m_Slope = 1.0f - 1.0f / max(1.0f, m_Settings.Ratio.load(std::memory_order_relaxed));
+	m_KneeDb = max(0.0f, m_Settings.KneeDb.load(std::memory_order_relaxed));
+	m_KneeStart = DbToGain(m_ThresholdDb - m_KneeDb / 2);
+	m_AttackCoefficient = SmoothingCoefficient(m_Settings.AttackMilliseconds.load(std::memory_order_relaxed), m_SampleRate);
+	m_ReleaseCoefficient = SmoothingCoefficient(m_Settings.ReleaseMilliseconds.load(std::memory_order_relaxed), m_SampleRate);
+	m_MakeupGainDb = m_Settings.MakeupGainDb.load(std::memory_order_relaxed);
+	m_Ceiling = DbToGain(min(0.0f, m_Settings.CeilingDb.load(std::memory_order_relaxed)));
+	m_LimiterReleaseCoefficient = SmoothingCoefficient(m_Settings.LimiterReleaseMilliseconds.load(std::memory_order_relaxed), m_SampleRate);
+}
+
+void DynamicsStage::Rest()
+{
+	m_Window.GetView().Zero(m_Window.GetMaxFrameCount());
+
+	m_CompressorGainDb = m_MakeupGainDb;
+	m_CompressorGain = DbToGain(m_MakeupGainDb);
+	std::fill(m_CompressorGains.begin(), m_CompressorGains.end(), m_CompressorGain);
+
+	// Silence needs no limiting; an empty deque reads as unity, which every gain the limiter needs is at most.
+	std::fill(m_HeldGains.begin(), m_HeldGains.end(), 1.0f);
+	m_HeldGainSum = m_Lookahead;
+	m_DequeFront = 0;
+	m_DequeBack = 0;
+	m_LimiterGain = 1.0f;
+
+	m_SilentFrames = m_LatencyFrames;
+	m_IsResting = true;
+}
+
+bool DynamicsStage::Process(const PlanarView& buffer, UINT32 frameCount, bool isInputSilent)
+{
+	UpdateSettings();
+	if (!m_IsEnabled)
+	{
+		m_LastCompressorReductionDb.store(0, std::memory_order_relaxed);
+		m_LastLimiterReductionDb.store(0, std::memory_order_relaxed);
+		return !isInputSilent;
+	}
+
+	Contract::Requires(buffer.ChannelCount == m_ChannelCount, L"Buffer must have the reserved channel count");
+
+	// With the whole window silent as well as the input, the output would be silent too.
+	if (isInputSilent && m_SilentFrames >= m_LatencyFrames)
+	{
+		if (!m_IsResting)
+		{
+			Rest();
+		}
+		m_LastCompressorReductionDb.store(0, std::memory_order_relaxed);
+		m_LastLimiterReductionDb.store(0, std::memory_order_relaxed);
+		m_RestingPeriods.store(m_RestingPeriods.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return false;
+	}
+
+	m_IsResting = false;
+	m_SilentFrames = isInputSilent ? min(m_SilentFrames + frameCount, (UINT32)UINT32_MAX / 2) : 0;
+
+	m_CompressorReduction = 0;
+	m_LimiterReduction = 1.0f;
+	for (UINT32 offset = 0; offset < frameCount; offset += DYNAMICS_CHUNK_FRAMES)
+	{
+		ProcessChunk(buffer, offset, min((UINT32)DYNAMICS_CHUNK_FRAMES, frameCount - offset));
+	}
+
+	m_LastCompressorReductionDb.store(-m_CompressorReduction, std::memory_order_relaxed);
+	m_LastLimiterReductionDb.store(-GainToDb(m_LimiterReduction), std::memory_order_relaxed);
+	if (m_LimiterReduction < 1.0f)
+	{
+		m_LimitedPeriods.store(m_LimitedPeriods.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+	return true;
+}
+
+void DynamicsStage::ProcessChunk(const PlanarView& buffer, UINT32 offset, UINT32 frameCount)
+{
+	UINT32 history = m_LatencyFrames.load(std::memory_order_relaxed);
+	for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+	{
+		memcpy(m_Window.Channel(channel) + history, buffer.Channel(channel) + offset, frameCount * sizeof(float));
+	}
+
+	DetectPeaks(frameCount);
+	ComputeGains(frameCount);
+	ApplyGains(buffer, offset, frameCount);
+
+	// Keep the newest frames for the next chunk.
+	for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+	{
+		float* window = m_Window.Channel(channel);
+		memmove(window, window + frameCount, history * sizeof(float));
+	}
+}
+
+void DynamicsStage::DetectPeaks(UINT32 frameCount)
+{
+	// The frame detected for each new input frame is as far behind it as the interpolator reaches ahead.
+	UINT32 first = m_LatencyFrames.load(std::memory_order_relaxed) - (DYNAMICS_TRUE_PEAK_TAPS / 2);
+	const UINT32 tapsBehind = DYNAMICS_TRUE_PEAK_TAPS / 2 - 1;
+
+	memset(m_Peaks, 0, frameCount * sizeof(float));
+	for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+	{
+		const float* samples = m_Window.Channel(channel) + first;
+		UINT32 frame = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		for (; frame + 4 <= frameCount; frame += 4)
+		{
+			const float* taps = samples + frame - tapsBehind;
+			__m128 window[DYNAMICS_TRUE_PEAK_TAPS];
+			for (UINT32 tap = 0; tap < DYNAMICS_TRUE_PEAK_TAPS; tap++)
+			{
+				window[tap] = _mm_loadu_ps(taps + tap);
+			}
+
+			__m128 peak = _mm_max_ps(_mm_loadu_ps(m_Peaks + frame), _mm_and_ps(window[tapsBehind], absMask));
+			for (UINT32 phase = 0; phase < DYNAMICS_TRUE_PEAK_PHASES; phase++)
+			{
+				const float* weights = m_TruePeakWeights[phase];
+				__m128 point = _mm_mul_ps(window[0], _mm_set1_ps(weights[0]));
+				for (UINT32 tap = 1; tap < DYNAMICS_TRUE_PEAK_TAPS; tap++)
+				{
+					point = _mm_add_ps(point, _mm_mul_ps(window[tap], _mm_set1_ps(weights[tap])));
+				}
+				peak = _mm_max_ps(peak, _mm_and_ps(point, absMask));
+			}
+			_mm_storeu_ps(m_Peaks + frame, peak);
+		}
+#endif
+		for (; frame < frameCount; frame++)
+		{
+			const float* taps = samples + frame - tapsBehind;
+			float peak = max(m_Peaks[frame], fabsf(taps[tapsBehind]));
+			for (UINT32 phase = 0; phase < DYNAMICS_TRUE_PEAK_PHASES; phase++)
+			{
+				float point = 0;
+				for (UINT32 tap = 0; tap < DYNAMICS_TRUE_PEAK_TAPS; tap++)
+				{
+					point += taps[tap] * m_TruePeakWeights[phase][tap];
+				}
+				peak = max(peak, fabsf(point));
+			}
+			m_Peaks[frame] = peak;
+		}
+	}
+}
+
+float DynamicsStage::CompressorCurve(float peak) const
+{
+	float over = GainToDb(peak) - m_ThresholdDb;
+	if (2 * over >= m_KneeDb)
+	{
+		return -m_Slope * over;
+	}
+
+	float intoKnee = over + m_KneeDb / 2;
+	return -m_Slope * intoKnee * intoKnee / (2 * m_KneeDb);
+}
+
+void DynamicsStage::ComputeGains(UINT32 frameCount)
+{
+	const UINT32 lookahead = m_Lookahead;
+	const bool isCompressing = (m_Slope > 0);
+
+	for (UINT32 frame = 0; frame < frameCount; frame++)
+	{
+		float peak = m_Peaks[frame];
+
+		// The compressor, smoothing its gain in decibels, and only converting it while it moves.
+		float targetDb = m_MakeupGainDb;
+		if (isCompressing && peak > m_KneeStart)
+		{
+			targetDb += CompressorCurve(peak);
+		}
+		if (targetDb != m_CompressorGainDb)
+		{
+			float coefficient = (targetDb < m_CompressorGainDb) ? m_AttackCoefficient : m_ReleaseCoefficient;
+			m_CompressorGainDb = targetDb + (m_CompressorGainDb - targetDb) * coefficient;
+			if (fabsf(m_CompressorGainDb - targetDb) < DYNAMICS_SETTLED_DB)
+			{
+				m_CompressorGainDb = targetDb;
+			}
+			m_CompressorGain = DbToGain(m_CompressorGainDb);
+		}
+		m_CompressorReduction = min(m_CompressorReduction, m_CompressorGainDb - m_MakeupGainDb);
+
+		// The compressor's gain reaches the audio along with the frame it was worked out for.
+		UINT32 position = m_Position++;
+		float delayedCompressorGain = m_CompressorGains[(position - lookahead) & m_RingMask];
+		m_CompressorGains[position & m_RingMask] = m_CompressorGain;
+
+		// The gain the limiter needs this frame, and the least needed across the lookahead window.
+		float level = peak * m_CompressorGain;
+		float needed = (level > m_Ceiling) ? (m_Ceiling / level) : 1.0f;
+		while (m_DequeBack != m_DequeFront && m_DequeGains[(m_DequeBack - 1) & m_DequeMask] >= needed)
+		{
+			m_DequeBack--;
+		}
+		m_DequeGains[m_DequeBack & m_DequeMask] = needed;
+		m_DequePositions[m_DequeBack & m_DequeMask] = position;
+		m_DequeBack++;
+		while (position - m_DequePositions[m_DequeFront & m_DequeMask] > lookahead + 1)
+		{
+			m_DequeFront++;
+		}
+		float held = m_DequeGains[m_DequeFront & m_DequeMask];
+
+		// Averaging the held gain over the lookahead turns each drop into a ramp which lands as its peak does;
+		// every frame averaged has held at most the gain the peak needs.
+		m_HeldGainSum += held - m_HeldGains[(position - lookahead) & m_RingMask];
+		m_HeldGains[position & m_RingMask] = held;
+		float average = (float)(m_HeldGainSum / lookahead);
+
+		// Releasing only ever holds the gain below the average.
+		if (average < m_LimiterGain)
+		{
+			m_LimiterGain = average;
+		}
+		else
+		{
+			m_LimiterGain = average + (m_LimiterGain - average) * m_LimiterReleaseCoefficient;
+		}
+		m_LimiterReduction = min(m_LimiterReduction, m_LimiterGain);
+
+		m_Gains[frame] = delayedCompressorGain * m_LimiterGain;
+	}
+}
+
+void DynamicsStage::ApplyGains(const PlanarView& output, UINT32 offset, UINT32 frameCount)
+{
+	const float ceiling = m_Ceiling;
+	for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+	{
+		const float* source = m_Window.Channel(channel);
+		float* destination = output.Channel(channel) + offset;
+		UINT32 frame = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+		const __m128 high = _mm_set1_ps(ceiling);
+		const __m128 low = _mm_set1_ps(-ceiling);
+		for (; frame + 4 <= frameCount; frame += 4)
+		{
+			__m128 sample = _mm_mul_ps(_mm_loadu_ps(source + frame), _mm_loadu_ps(m_Gains + frame));
+			_mm_storeu_ps(destination + frame, _mm_max_ps(_mm_min_ps(sample, high), low));
+		}
+#endif
+		for (; frame < frameCount; frame++)
+		{
+			float sample = source[frame] * m_Gains[frame];
+			destination[frame] = max(-ceiling, min(ceiling, sample));
+		}
+	}
+}
+
+void DynamicsStage::GetStatistics(DYNAMICSSTATS* stats) const
+{
+	stats->LatencyFrames = GetLatencyFrames();
+	stats->CompressorReductionDb = m_LastCompressorReductionDb;
+	stats->LimiterReductionDb = m_LastLimiterReductionDb;
+	stats->LimitedPeriods = m_LimitedPeriods;
+	stats->RestingPeriods = m_RestingPeriods;
+}
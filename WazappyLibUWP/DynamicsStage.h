@@ -0,0 +1,190 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "WazappyDllInterface.h"
+#include "PlanarBuffer.h"
+
+// How far ahead the limiter looks for peaks; it has this long to bring its gain down before one arrives.
+#define DYNAMICS_LOOKAHEAD_MS 1.5
+
+// Taps of the interpolator the true peak detector uses to find peaks between samples; it needs half of them
+// (less one) behind a frame and half ahead, which adds half of them to the latency.
+#define DYNAMICS_TRUE_PEAK_TAPS 8
+
+// Points between each pair of frames the true peak detector checks (4x oversampling).
+#define DYNAMICS_TRUE_PEAK_PHASES 3
+
+// Most frames processed in one go.
+#define DYNAMICS_CHUNK_FRAMES 256
+
+// The limiter's ceiling and release until a client sets them; the compressor starts with a ratio of 1 (off).
+#define DYNAMICS_DEFAULT_CEILING_DB -1.0f
+#define DYNAMICS_DEFAULT_LIMITER_RELEASE_MS 60.0f
+
+// Compressor gains within this many decibels of where they are heading are taken to have arrived.
+#define DYNAMICS_SETTLED_DB 0.001f
+
+namespace Wazappy
+{
+	// A compressor followed by a true peak lookahead limiter, on a render device's output, so a mix of many
+	// voices is brought under a ceiling smoothly instead of clipping when it is converted to the device format.
+	// Both work from one detector: each frame's peak across channels, taking in the peaks between samples a 4x
+	// oversampled reconstruction would show.  The compressor is feed forward with a soft knee, smoothing its gain
+	// in decibels.  The limiter finds the gain each frame needs to stay under the ceiling, takes the least of
+	// those over the lookahead window with a monotonic deque (O(1) per frame however long the window), and
+	// averages that over the lookahead, so its gain glides down to meet each peak exactly as it arrives and never
+	// steps.  Audio is delayed by the lookahead to match, and the gain is applied four frames to a vector, with a
+	// final clip at the ceiling to catch whatever the detector's estimate of the true peak missed.
+	// Setters may be called from any thread and never block; if two race, the last to finish wins.  Everything
+	// else is audio thread only.
+	class DynamicsStage
+	{
+	public:
+		DynamicsStage();
+
+		// Size the stage for the given channel count and sample rate, allocating, and forget any audio it holds.
+		// Must be called before Process, and not concurrently with it.
+		void Reserve(UINT32 channelCount, UINT32 sampleRate);
+
+		// Move to new settings; see DYNAMICSPARAMS.  Any thread.
+		void SetParameters(const DYNAMICSPARAMS& params);
+
+		// Frames by which the stage delays audio while enabled, or 0 while disabled or before Reserve.  Any thread.
+		UINT32 GetLatencyFrames() const;
+
+		// Run the first frameCount frames of buffer, which has the reserved channel count, through the stage in
+		// place.  isInputSilent says the buffer is all zeros, so once the stage has played out what it holds it can
+		// leave the buffer alone.  Returns false if the output is silent (the buffer is still all zeros).
+		bool Process(const PlanarView& buffer, UINT32 frameCount, bool isInputSilent);
+
+		// Any thread.
+		void GetStatistics(DYNAMICSSTATS* stats) const;
+
+	private:
+		// Settings written by SetParameters; Generation is bumped after the others so the audio thread sees each
+		// change.
+		struct Settings
+		{
+			std::atomic<bool> IsEnabled;
+			std::atomic<float> ThresholdDb;
+			std::atomic<float> Ratio;
+			std::atomic<float> KneeDb;
+			std::atomic<float> AttackMilliseconds;
+			std::atomic<float> ReleaseMilliseconds;
+			std::atomic<float> MakeupGainDb;
+			std::atomic<float> CeilingDb;
+			std::atomic<float> LimiterReleaseMilliseconds;
+			std::atomic<UINT32> Generation;
+		};
+
+		// Pick up new settings, if a setter has run since the last period.
+		void UpdateSettings();
+
+		// Work out the audio thread's settings from m_Settings.
+		void LoadSettings();
+
+		// Drop everything the stage holds and settle its gains, as if it had heard nothing but silence.
+		void Rest();
+
+		void ProcessChunk(const PlanarView& buffer, UINT32 offset, UINT32 frameCount);
+
+		// Find the true peak across channels of the frameCount frames m_LatencyFrames - m_Lookahead behind the
+		// newest in the window, into m_Peaks.
+		void DetectPeaks(UINT32 frameCount);
+
+		// Work out the gain for each of frameCount frames into m_Gains, from m_Peaks.
+		void ComputeGains(UINT32 frameCount);
+
+		// The compressor's gain in decibels (before smoothing) for the given detector level.
+		float CompressorCurve(float peak) const;
+
+		// Multiply the oldest frameCount frames of each channel's window by m_Gains into output, clipping at the
+		// ceiling.
+		void ApplyGains(const PlanarView& output, UINT32 offset, UINT32 frameCount);
+
+	private:
+		Settings m_Settings;
+
+		// Sizes set by Reserve.
+		UINT32 m_ChannelCount;
+		UINT32 m_SampleRate;
+
+		// Frames of lookahead, and the frames audio is delayed by (the lookahead, plus the half of the true peak
+		// interpolator which reaches ahead).
+		UINT32 m_Lookahead;
+		std::atomic<UINT32> m_LatencyFrames;
+
+		// The true peak interpolator's weights, for each point between frames.
+		float m_TruePeakWeights[DYNAMICS_TRUE_PEAK_PHASES][DYNAMICS_TRUE_PEAK_TAPS];
+
+		// Audio thread state.
+		UINT32 m_SeenGeneration;
+		bool m_IsEnabled;
+
+		// The settings in the units the audio thread works in.
+		float m_ThresholdDb;
+		float m_Slope;
+		float m_KneeDb;
+		float m_KneeStart;
+		float m_AttackCoefficient;
+		float m_ReleaseCoefficient;
+		float m_MakeupGainDb;
+		float m_Ceiling;
+		float m_LimiterReleaseCoefficient;
+
+		// Each channel's latest m_LatencyFrames frames, followed by room for a chunk of input; the oldest frames
+		// are the next to be output.
+		PlanarBuffer m_Window;
+
+		// The compressor's smoothed gain, in decibels and linearly.
+		float m_CompressorGainDb;
+		float m_CompressorGain;
+
+		// Frame counter the rings below are indexed by, wrapping.
+		UINT32 m_Position;
+
+		// Rings of m_RingMask + 1 (at least m_Lookahead + 1) entries, by position: the compressor gains not yet
+		// applied, and the sliding minimum of the limiter's gains, whose sum over the latest m_Lookahead is
+		// m_HeldGainSum.
+		std::vector<float> m_CompressorGains;
+		std::vector<float> m_HeldGains;
+		double m_HeldGainSum;
+		UINT32 m_RingMask;
+
+		// The monotonic deque for the sliding minimum: the gains each frame needed, and the positions they were
+		// needed at, rising from front to back; entries between m_DequeFront and m_DequeBack (free running, masked
+		// by m_DequeMask) are live.
+		std::vector<float> m_DequeGains;
+		std::vector<UINT32> m_DequePositions;
+		UINT32 m_DequeFront;
+		UINT32 m_DequeBack;
+		UINT32 m_DequeMask;
+
+		// The limiter's gain, after its release.
+		float m_LimiterGain;
+
+		// Input frames since anything but silence was given; once the whole window is silent the stage rests.
+		UINT32 m_SilentFrames;
+		bool m_IsResting;
+
+		// Scratch, per chunk.
+		float m_Peaks[DYNAMICS_CHUNK_FRAMES];
+		float m_Gains[DYNAMICS_CHUNK_FRAMES];
+
+		// Deepest reductions this period.
+		float m_CompressorReduction;
+		float m_LimiterReduction;
+
+		// Written on the audio thread, read by GetStatistics.
+		std::atomic<float> m_LastCompressorReductionDb;
+		std::atomic<float> m_LastLimiterReductionDb;
+		std::atomic<UINT64> m_LimitedPeriods;
+		std::atomic<UINT64> m_RestingPeriods;
+	};
+}
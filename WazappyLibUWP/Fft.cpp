@@ -0,0 +1,245 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "Contract.h"
+#include "Fft.h"
+
+using namespace Wazappy;
+
+Fft::Fft(UINT32 size) :
+	m_Size(size)
+{
+	Contract::Requires(size >= 2 && (size & (size - 1)) == 0, L"FFT size must be a power of two");
+
+	m_Twiddles.resize(size - 1);
+	for (UINT32 span = 1; span < size; span <<= 1)
+	{
+		for (UINT32 k = 0; k < span; k++)
+		{
+			double angle = -M_PI * k / span;
+			m_Twiddles[span - 1 + k] = std::complex<float>((float)cos(angle), (float)sin(angle));
+		}
+	}
+
+	UINT32 bits = 0;
+	while ((1u << bits) < size)
+	{
+		bits++;
+	}
+
+	m_BitReversed.resize(size);
+	for (UINT32 i = 0; i < size; i++)
+	{
+		UINT32 reversed = 0;
+		for (UINT32 b = 0; b < bits; b++)
+		{
+			reversed |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+		m_BitReversed[i] = reversed;
+	}
+}
+
+UINT32 Fft::RoundUpSize(UINT32 n)
+{
+	UINT32 size = 2;
+	while (size < n)
+	{
+		size <<= 1;
+	}
+	return size;
+}
+
+void Fft::Transform(std::complex<float>* data, bool isInverse, float scale) const
+{
+	for (UINT32 i = 0; i < m_Size; i++)
+	{
+		UINT32 j = m_BitReversed[i];
+		if (i < j)
+		{
+			std::swap(data[i], data[j]);
+		}
+	}
+
+#if defined(_M_IX86) || defined(_M_X64)
+	ButterfliesSimd(data, isInverse);
+#else
+	Butterflies(data, isInverse);
+#endif
+
+	if (scale != 1.0f)
+	{
+		for (UINT32 i = 0; i < m_Size; i++)
+		{
+			data[i] *= scale;
+		}
+	}
+}
+
+void Fft::Butterflies(std::complex<float>* data, bool isInverse) const
+{
+	for (UINT32 span = 1; span < m_Size; span <<= 1)
+	{
+		const std::complex<float>* twiddles = &m_Twiddles[span - 1];
+		for (UINT32 start = 0; start < m_Size; start += span * 2)
+		{
+			for (UINT32 k = 0; k < span; k++)
+			{
+				std::complex<float> twiddle = isInverse ? std::conj(twiddles[k]) : twiddles[k];
+				std::complex<float> odd = data[start + k + span] * twiddle;
+				data[start + k + span] = data[start + k] - odd;
+				data[start + k] += odd;
+			}
+		}
+	}
+}
+
+#if defined(_M_IX86) || defined(_M_X64)
+void Fft::ButterfliesSimd(std::complex<float>* data, bool isInverse) const
+{
+	float* samples = reinterpret_cast<float*>(data);
+
+	// The first pass has no twiddles: each adjacent pair becomes its sum and difference.
+	const __m128 negateHigh = _mm_castsi128_ps(_mm_set_epi32(0x80000000, 0x80000000, 0, 0));
+	for (UINT32 i = 0; i < m_Size; i += 2)
+	{
+		__m128 pair = _mm_loadu_ps(samples + (i * 2));
+		__m128 even = _mm_movelh_ps(pair, pair);
+		__m128 odd = _mm_xor_ps(_mm_movehl_ps(pair, pair), negateHigh);
+		_mm_storeu_ps(samples + (i * 2), _mm_add_ps(even, odd));
+	}
+
+	// (a + bi)(c + di) = (ac - bd) + (ad + bc)i: the products of a and b with d pick up these signs once swapped
+	// into place; conjugating the twiddle for the inverse flips them.
+	const __m128 crossSigns = isInverse
+		? _mm_castsi128_ps(_mm_set_epi32(0x80000000, 0, 0x80000000, 0))
+		: _mm_castsi128_ps(_mm_set_epi32(0, 0x80000000, 0, 0x80000000));
+
+	for (UINT32 span = 2; span < m_Size; span <<= 1)
+	{
+		const float* twiddles = reinterpret_cast<const float*>(&m_Twiddles[span - 1]);
+		for (UINT32 start = 0; start < m_Size; start += span * 2)
+		{
+			float* evens = samples + (start * 2);
+			float* odds = samples + ((start + span) * 2);
+			for (UINT32 k = 0; k < span; k += 2)
+			{
+				__m128 twiddle = _mm_loadu_ps(twiddles + (k * 2));
+				__m128 real = _mm_shuffle_ps(twiddle, twiddle, _MM_SHUFFLE(2, 2, 0, 0));
+				__m128 imaginary = _mm_xor_ps(_mm_shuffle_ps(twiddle, twiddle, _MM_SHUFFLE(3, 3, 1, 1)), crossSigns);
+
+				__m128 odd = _mm_loadu_ps(odds + (k * 2));
+				__m128 swapped = _mm_shuffle_ps(odd, odd, _MM_SHUFFLE(2, 3, 0, 1));
+				__m128 product = _mm_add_ps(_mm_mul_ps(odd, real), _mm_mul_ps(swapped, imaginary));
+
+				__m128 even = _mm_loadu_ps(evens + (k * 2));
+				_mm_storeu_ps(odds + (k * 2), _mm_sub_ps(even, product));
+				_mm_storeu_ps(evens + (k * 2), _mm_add_ps(even, product));
+			}
+		}
+	}
+}
+#endif
+
+RealFft::RealFft(UINT32 size) :
+	m_Size(size),
+	m_Half(max(2u, size / 2))
+{
+	Contract::Requires(size >= 4 && (size & (size - 1)) == 0, L"Real FFT size must be a power of two, at least 4");
+
+	m_Twiddles.resize(size / 2);
+	for (UINT32 k = 0; k < size / 2; k++)
+	{
+		double angle = -2.0 * M_PI * k / size;
+		m_Twiddles[k] = std::complex<float>((float)cos(angle), (float)sin(angle));
+	}
+}
+
+// The real input's even samples go in the real parts of a half size complex sequence z, and its odd samples in
+// the imaginary parts.  Z's conjugate symmetric part is then the even samples' spectrum E, and its antisymmetric
+// part (over i) the odd samples' spectrum O, and X[k] = E[k] + W^k O[k], with W = exp(-2 pi i / size).  Bins k
+// and size/2 - k are untangled together, since each needs the other.
+void RealFft::Forward(const float* input, std::complex<float>* spectrum) const
+{
+	const UINT32 half = m_Size / 2;
+	memcpy(reinterpret_cast<float*>(spectrum), input, m_Size * sizeof(float));
+	m_Half.Forward(spectrum);
+
+	std::complex<float> dc = spectrum[0];
+	spectrum[0] = std::complex<float>(dc.real() + dc.imag(), dc.real() - dc.imag());
+
+	const std::complex<float> minusHalfI(0.0f, -0.5f);
+	for (UINT32 k = 1; k <= half / 2; k++)
+	{
+		std::complex<float> z = spectrum[k];
+		std::complex<float> mirror = std::conj(spectrum[half - k]);
+		std::complex<float> even = (z + mirror) * 0.5f;
+		std::complex<float> odd = m_Twiddles[k] * ((z - mirror) * minusHalfI);
+
+		spectrum[k] = even + odd;
+		spectrum[half - k] = std::conj(even - odd);
+	}
+}
+
+// The reverse of Forward's untangling; the factors of 1/2 it drops are folded into the half size transform's
+// scaling.
+void RealFft::Inverse(std::complex<float>* spectrum, float* output) const
+{
+	const UINT32 half = m_Size / 2;
+
+	std::complex<float> dc = spectrum[0];
+	spectrum[0] = std::complex<float>(dc.real() + dc.imag(), dc.real() - dc.imag());
+
+	const std::complex<float> i(0.0f, 1.0f);
+	for (UINT32 k = 1; k <= half / 2; k++)
+	{
+		std::complex<float> x = spectrum[k];
+		std::complex<float> mirror = std::conj(spectrum[half - k]);
+		std::complex<float> even = x + mirror;
+		std::complex<float> odd = (x - mirror) * std::conj(m_Twiddles[k]);
+
+		spectrum[k] = even + (i * odd);
+		spectrum[half - k] = std::conj(even - (i * odd));
+	}
+
+	m_Half.Transform(spectrum, true, 1.0f / m_Size);
+	memmove(output, reinterpret_cast<const float*>(spectrum), m_Size * sizeof(float));
+}
+
+void RealFft::MultiplyAccumulate(const std::complex<float>* a, const std::complex<float>* b, std::complex<float>* accumulator, UINT32 binCount)
+{
+	// Bin 0 packs two real terms, which multiply separately.
+	std::complex<float> packed(accumulator[0].real() + (a[0].real() * b[0].real()), accumulator[0].imag() + (a[0].imag() * b[0].imag()));
+
+	UINT32 bin = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	const float* aSamples = reinterpret_cast<const float*>(a);
+	const float* bSamples = reinterpret_cast<const float*>(b);
+	float* sums = reinterpret_cast<float*>(accumulator);
+	const __m128 crossSigns = _mm_castsi128_ps(_mm_set_epi32(0, 0x80000000, 0, 0x80000000));
+	for (; bin + 2 <= binCount; bin += 2)
+	{
+		__m128 x = _mm_loadu_ps(aSamples + (bin * 2));
+		__m128 y = _mm_loadu_ps(bSamples + (bin * 2));
+		__m128 real = _mm_shuffle_ps(y, y, _MM_SHUFFLE(2, 2, 0, 0));
+		__m128 imaginary = _mm_xor_ps(_mm_shuffle_ps(y, y, _MM_SHUFFLE(3, 3, 1, 1)), crossSigns);
+		__m128 swapped = _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 product = _mm_add_ps(_mm_mul_ps(x, real), _mm_mul_ps(swapped, imaginary));
+		_mm_storeu_ps(sums + (bin * 2), _mm_add_ps(_mm_loadu_ps(sums + (bin * 2)), product));
+	}
+#endif
+	for (; bin < binCount; bin++)
+	{
+		accumulator[bin] += a[bin] * b[bin];
+	}
+
+	accumulator[0] = packed;
+}
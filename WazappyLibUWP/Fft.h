@@ -0,0 +1,82 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <complex>
+#include <vector>
+
+namespace Wazappy
+{
+	// In-place radix-2 complex FFT of a fixed power-of-two size, with twiddle factors and the bit reversal
+	// permutation computed once at construction.  Transform is allocation free, so a constructed Fft may be used
+	// on the audio thread.  On x86 the butterflies run two complex values to a vector, with each pass's twiddles
+	// stored contiguously so they load as vectors too.
+	class Fft
+	{
+	public:
+		// size must be a power of two.
+		Fft(UINT32 size);
+
+		UINT32 GetSize() const { return m_Size; }
+
+		// Transform size elements in place.  The inverse transform is scaled by 1/size, so Inverse(Forward(x)) == x.
+		void Forward(std::complex<float>* data) const { Transform(data, false, 1.0f); }
+		void Inverse(std::complex<float>* data) const { Transform(data, true, 1.0f / m_Size); }
+
+		// Smallest power of two at least n.
+		static UINT32 RoundUpSize(UINT32 n);
+
+	private:
+		friend class RealFft;
+
+		// Transform in place, multiplying the result by scale.
+		void Transform(std::complex<float>* data, bool isInverse, float scale) const;
+
+		void Butterflies(std::complex<float>* data, bool isInverse) const;
+
+#if defined(_M_IX86) || defined(_M_X64)
+		void ButterfliesSimd(std::complex<float>* data, bool isInverse) const;
+#endif
+
+		const UINT32 m_Size;
+
+		// Twiddles for the pass with butterflies span elements apart, for span = 1, 2, 4 ... size / 2, in order:
+		// the pass's span factors exp(-2 pi i k / (2 span)) for k < span start at element span - 1.
+		std::vector<std::complex<float>> m_Twiddles;
+
+		// Index each element is swapped with before the butterflies.
+		std::vector<UINT32> m_BitReversed;
+	};
+
+	// FFT of real input of a fixed power-of-two size, computed as a complex FFT of half the size.  The spectrum
+	// of size real samples is conjugate symmetric, so only its first size / 2 bins are kept, packed: bin 0 holds
+	// the (real) DC term in its real part and the (real) Nyquist term in its imaginary part.
+	// Allocation free once constructed, like Fft.
+	class RealFft
+	{
+	public:
+		// size must be a power of two, at least 4.
+		RealFft(UINT32 size);
+
+		UINT32 GetSize() const { return m_Size; }
+
+		// Transform size real samples into size / 2 packed bins.  input and spectrum must not overlap.
+		void Forward(const float* input, std::complex<float>* spectrum) const;
+
+		// Transform size / 2 packed bins back into size real samples, scaled by 1/size so Inverse(Forward(x)) == x.
+		// The spectrum is overwritten.
+		void Inverse(std::complex<float>* spectrum, float* output) const;
+
+		// Add the bin by bin product of two packed spectra of binCount bins into accumulator.
+		static void MultiplyAccumulate(const std::complex<float>* a, const std::complex<float>* b, std::complex<float>* accumulator, UINT32 binCount);
+
+	private:
+		const UINT32 m_Size;
+		Fft m_Half;
+
+		// exp(-2 pi i k / size) for k < size / 2.
+		std::vector<std::complex<float>> m_Twiddles;
+	};
+}
@@ -0,0 +1,629 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "FilterBank.h"
+
+using namespace Wazappy;
+
+// Frequencies (in cycles per frame) and q are held within these, so every response stays stable and well
+// conditioned in single precision.
+#define FILTER_BANK_MIN_FREQUENCY 0.00001f
+#define FILTER_BANK_MAX_FREQUENCY 0.49f
+#define FILTER_BANK_MIN_Q 0.05f
+
+// Shelf and peak gains are held within +-this many dB, well past any musical use, so the coefficients stay finite.
+#define FILTER_BANK_MAX_GAIN_DB 48.0f
+
+FilterBank::FilterBank() :
+	m_ActiveStageCount(0),
+	m_RampingStageCount(0),
+	m_IsQuiet(true)
+{
+	for (UINT32 i = 0; i < FILTER_BANK_MAX_STAGES; i++)
+	{
+		StageSettings& settings = m_Settings[i];
+		settings.Type = Filter_None;
+		settings.Frequency = FILTER_BANK_MAX_FREQUENCY;
+		settings.Q = (float)M_SQRT1_2;
+		settings.GainDb = 0.0f;
+		settings.RampFrames = 0;
+		settings.Generation = 0;
+
+		Stage& stage = m_Stages[i];
+		stage.SeenGeneration = 0;
+		stage.To = Parameters{ Filter_None, FILTER_BANK_MAX_FREQUENCY, (float)M_SQRT1_2, 0.0f };
+		stage.From = stage.To;
+		stage.ToCoefficients = ComputeCoefficients(stage.To);
+		stage.RampFrames = 0;
+		stage.RampRemaining = 0;
+		stage.Current = stage.ToCoefficients;
+		stage.Step = Coefficients{};
+		stage.SegmentEnd = stage.ToCoefficients;
+		stage.Outgoing = stage.ToCoefficients;
+		stage.Fade = 1.0f;
+		stage.FadeStep = 0.0f;
+		stage.FadeEnd = 1.0f;
+		stage.FadeFrames = 0;
+		stage.FadeRemaining = 0;
+	}
+
+	ZeroMemory(m_Z1, sizeof(m_Z1));
+	ZeroMemory(m_Z2, sizeof(m_Z2));
+	ZeroMemory(m_OutgoingZ1, sizeof(m_OutgoingZ1));
+	ZeroMemory(m_OutgoingZ2, sizeof(m_OutgoingZ2));
+}
+
+void FilterBank::SetStage(UINT32 stage, FilterType type, float frequency, float q, float gainDb, UINT32 rampFrames)
+{
+	Contract::Requires(stage < FILTER_BANK_MAX_STAGES, L"Filter stage must exist");
+
+	StageSettings& settings = m_Settings[stage];
+	settings.Type.store(type, std::memory_order_relaxed);
+	settings.Frequency.store(min(max(frequency, FILTER_BANK_MIN_FREQUENCY), FILTER_BANK_MAX_FREQUENCY), std::memory_order_relaxed);
+	settings.Q.store(max(q, FILTER_BANK_MIN_Q), std::memory_order_relaxed);
+	settings.GainDb.store(min(max(gainDb, -FILTER_BANK_MAX_GAIN_DB), FILTER_BANK_MAX_GAIN_DB), std::memory_order_relaxed);
+	settings.RampFrames.store(rampFrames, std::memory_order_relaxed);
+	settings.Generation.fetch_add(1, std::memory_order_release);
+}
+
+FilterBank::Coefficients FilterBank::ComputeCoefficients(const Parameters& parameters)
+{
+	// The responses are those of Robert Bristow-Johnson's Audio EQ Cookbook.
+	double w0 = 2.0 * M_PI * parameters.Frequency;
+	double cosW0 = cos(w0);
+	double alpha = sin(w0) / (2.0 * parameters.Q);
+	double a = pow(10.0, parameters.GainDb / 40.0);
+	double shelfAlpha = 2.0 * sqrt(a) * alpha;
+
+	double b0 = 1, b1 = 0, b2 = 0, a0 = 1, a1 = 0, a2 = 0;
+	switch (parameters.Type)
+	{
+	case Filter_None:
+		break;
+
+	case Filter_LowPass:
+		b0 = (1.0 - cosW0) / 2.0;
+		b1 = 1.0 - cosW0;
+		b2 = b0;
+		a0 = 1.0 + alpha;
+		a1 = -2.0 * cosW0;
+		a2 = 1.0 - alpha;
+		break;
+
+	case Filter_HighPass:
+		b0 = (1.0 + cosW0) / 2.0;
+		b1 = -(1.0 + cosW0);
+		b2 = b0;
+		a0 = 1.0 + alpha;
+		a1 = -2.0 * cosW0;
+		a2 = 1.0 - alpha;
+		break;
+
+	case Filter_BandPass:
+		b0 = alpha;
+		b1 = 0.0;
+		b2 = -alpha;
+		a0 = 1.0 + alpha;
+		a1 = -2.0 * cosW0;
+		a2 = 1.0 - alpha;
+		break;
+
+	case Filter_LowShelf:
+		b0 = a * ((a + 1.0) - ((a - 1.0) * cosW0) + shelfAlpha);
+		b1 = 2.0 * a * ((a - 1.0) - ((a + 1.0) * cosW0));
+		b2 = a * ((a + 1.0) - ((a - 1.0) * cosW0) - shelfAlpha);
+		a0 = (a + 1.0) + ((a - 1.0) * cosW0) + shelfAlpha;
+		a1 = -2.0 * ((a - 1.0) + ((a + 1.0) * cosW0));
+		a2 = (a + 1.0) + ((a - 1.0) * cosW0) - shelfAlpha;
+		break;
+
+	case Filter_HighShelf:
+		b0 = a * ((a + 1.0) + ((a - 1.0) * cosW0) + shelfAlpha);
+		b1 = -2.0 * a * ((a - 1.0) + ((a + 1.0) * cosW0));
+		b2 = a * ((a + 1.0) + ((a - 1.0) * cosW0) - shelfAlpha);
+		a0 = (a + 1.0) - ((a - 1.0) * cosW0) + shelfAlpha;
+		a1 = 2.0 * ((a - 1.0) - ((a + 1.0) * cosW0));
+		a2 = (a + 1.0) - ((a - 1.0) * cosW0) - shelfAlpha;
+		break;
+
+	case Filter_Peak:
+		b0 = 1.0 + (alpha * a);
+		b1 = -2.0 * cosW0;
+		b2 = 1.0 - (alpha * a);
+		a0 = 1.0 + (alpha / a);
+		a1 = -2.0 * cosW0;
+		a2 = 1.0 - (alpha / a);
+		break;
+	}
+
+	return Coefficients{ (float)(b0 / a0), (float)(b1 / a0), (float)(b2 / a0), (float)(a1 / a0), (float)(a2 / a0) };
+}
+
+FilterBank::Parameters FilterBank::RampedParameters(const Stage& stage, UINT32 framesLeft)
+{
+	if (framesLeft == 0)
+	{
+		return stage.To;
+	}
+
+	float t = 1.0f - ((float)framesLeft / stage.RampFrames);
+	Parameters parameters;
+	parameters.Type = stage.To.Type;
+	parameters.Frequency = stage.From.Frequency * powf(stage.To.Frequency / stage.From.Frequency, t);
+	parameters.Q = stage.From.Q * powf(stage.To.Q / stage.From.Q, t);
+	parameters.GainDb = stage.From.GainDb + ((stage.To.GainDb - stage.From.GainDb) * t);
+	return parameters;
+}
+
+FilterBank::Coefficients FilterBank::RampedCoefficients(const Stage& stage, UINT32 framesLeft)
+{
+	return (framesLeft == 0) ? stage.ToCoefficients : ComputeCoefficients(RampedParameters(stage, framesLeft));
+}
+
+void FilterBank::UpdateStages()
+{
+	bool anyChanged = false;
+	for (UINT32 i = 0; i < FILTER_BANK_MAX_STAGES; i++)
+	{
+		StageSettings& settings = m_Settings[i];
+		Stage& stage = m_Stages[i];
+		UINT32 generation = settings.Generation.load(std::memory_order_acquire);
+		if (generation == stage.SeenGeneration)
+		{
+			continue;
+		}
+		stage.SeenGeneration = generation;
+		anyChanged = true;
+
+		Parameters target;
+		target.Type = settings.Type.load(std::memory_order_relaxed);
+		target.Frequency = settings.Frequency.load(std::memory_order_relaxed);
+		target.Q = settings.Q.load(std::memory_order_relaxed);
+		target.GainDb = settings.GainDb.load(std::memory_order_relaxed);
+		UINT32 rampFrames = settings.RampFrames.load(std::memory_order_relaxed);
+
+		if (target.Type == stage.To.Type)
+		{
+			// A new parameter ramp starts from wherever the last one had got to.
+			stage.From = RampedParameters(stage, stage.RampRemaining);
+			stage.To = target;
+			stage.ToCoefficients = ComputeCoefficients(target);
+			stage.RampFrames = rampFrames;
+			stage.RampRemaining = rampFrames;
+			if (rampFrames == 0)
+			{
+				stage.Current = stage.ToCoefficients;
+			}
+			continue;
+		}
+
+		// A change of type: the new response starts in full, from rest, and fades in over the old one.
+		stage.From = target;
+		stage.To = target;
+		stage.ToCoefficients = ComputeCoefficients(target);
+		stage.RampFrames = 0;
+		stage.RampRemaining = 0;
+		stage.Outgoing = stage.Current;
+		stage.Current = stage.ToCoefficients;
+		stage.FadeFrames = rampFrames;
+		stage.FadeRemaining = rampFrames;
+		if (rampFrames == 0)
+		{
+			stage.Fade = 1.0f;
+			ZeroMemory(m_OutgoingZ1[i], sizeof(m_OutgoingZ1[i]));
+			ZeroMemory(m_OutgoingZ2[i], sizeof(m_OutgoingZ2[i]));
+		}
+		else
+		{
+			stage.Fade = 0.0f;
+			CopyMemory(m_OutgoingZ1[i], m_Z1[i], sizeof(m_Z1[i]));
+			CopyMemory(m_OutgoingZ2[i], m_Z2[i], sizeof(m_Z2[i]));
+			ZeroMemory(m_Z1[i], sizeof(m_Z1[i]));
+			ZeroMemory(m_Z2[i], sizeof(m_Z2[i]));
+		}
+	}
+
+	if (anyChanged)
+	{
+		UpdateActiveStages();
+	}
+}
+
+void FilterBank::UpdateActiveStages()
+{
+	m_ActiveStageCount = 0;
+	m_RampingStageCount = 0;
+	for (UINT32 i = 0; i < FILTER_BANK_MAX_STAGES; i++)
+	{
+		const Stage& stage = m_Stages[i];
+		bool isRamping = (stage.RampRemaining > 0) || (stage.Fade < 1.0f);
+		if (isRamping || stage.To.Type != Filter_None)
+		{
+			m_ActiveStages[m_ActiveStageCount++] = i;
+			m_RampingStageCount += isRamping ? 1 : 0;
+		}
+		else
+		{
+			ZeroMemory(m_Z1[i], sizeof(m_Z1[i]));
+			ZeroMemory(m_Z2[i], sizeof(m_Z2[i]));
+		}
+
+		if (stage.Fade >= 1.0f)
+		{
+			ZeroMemory(m_OutgoingZ1[i], sizeof(m_OutgoingZ1[i]));
+			ZeroMemory(m_OutgoingZ2[i], sizeof(m_OutgoingZ2[i]));
+		}
+	}
+
+	if (m_ActiveStageCount == 0)
+	{
+		m_IsQuiet = true;
+	}
+}
+
+bool FilterBank::IsBypassed()
+{
+	UpdateStages();
+	return m_ActiveStageCount == 0;
+}
+
+void FilterBank::StartSegment(UINT32 segmentFrames)
+{
+	for (UINT32 i = 0; i < m_ActiveStageCount; i++)
+	{
+		Stage& stage = m_Stages[m_ActiveStages[i]];
+
+		stage.Step = Coefficients{};
+		stage.SegmentEnd = stage.Current;
+		if (stage.RampRemaining > 0)
+		{
+			stage.RampRemaining -= min(segmentFrames, stage.RampRemaining);
+			stage.SegmentEnd = RampedCoefficients(stage, stage.RampRemaining);
+
+			const Coefficients& from = stage.Current;
+			const Coefficients& to = stage.SegmentEnd;
+			stage.Step = Coefficients{
+				(to.B0 - from.B0) / segmentFrames,
+				(to.B1 - from.B1) / segmentFrames,
+				(to.B2 - from.B2) / segmentFrames,
+				(to.A1 - from.A1) / segmentFrames,
+				(to.A2 - from.A2) / segmentFrames };
+		}
+
+		stage.FadeStep = 0.0f;
+		stage.FadeEnd = stage.Fade;
+		if (stage.FadeRemaining > 0)
+		{
+			stage.FadeRemaining -= min(segmentFrames, stage.FadeRemaining);
+			stage.FadeEnd = 1.0f - ((float)stage.FadeRemaining / stage.FadeFrames);
+			stage.FadeStep = (stage.FadeEnd - stage.Fade) / segmentFrames;
+		}
+	}
+}
+
+void FilterBank::EndSegment()
+{
+	for (UINT32 i = 0; i < m_ActiveStageCount; i++)
+	{
+		Stage& stage = m_Stages[m_ActiveStages[i]];
+		stage.Current = stage.SegmentEnd;
+		stage.Step = Coefficients{};
+		stage.Fade = stage.FadeEnd;
+		stage.FadeStep = 0.0f;
+	}
+
+	// Some ramps may have finished, leaving their stages pass throughs or their outgoing responses unheard.
+	UpdateActiveStages();
+}
+
+#if defined(_M_IX86) || defined(_M_X64)
+// One stage's coefficients, their ramp increments and its state, with a channel in each lane; and while it
+// crossfades, the same for its outgoing response.
+struct SimdStage
+{
+	__m128 B0, B1, B2, A1, A2;
+	__m128 StepB0, StepB1, StepB2, StepA1, StepA2;
+	__m128 Z1, Z2;
+
+	bool IsCrossfading;
+	__m128 OutgoingB0, OutgoingB1, OutgoingB2, OutgoingA1, OutgoingA2;
+	__m128 OutgoingZ1, OutgoingZ2;
+	__m128 Fade, FadeStep;
+};
+
+// Run one frame (a sample of each of four channels) through every stage in turn.
+template <bool isRamping>
+static inline __m128 FilterFrame(SimdStage* stages, UINT32 stageCount, __m128 x)
+{
+	for (UINT32 i = 0; i < stageCount; i++)
+	{
+		SimdStage& stage = stages[i];
+		if (isRamping)
+		{
+			stage.B0 = _mm_add_ps(stage.B0, stage.StepB0);
+			stage.B1 = _mm_add_ps(stage.B1, stage.StepB1);
+			stage.B2 = _mm_add_ps(stage.B2, stage.StepB2);
+			stage.A1 = _mm_add_ps(stage.A1, stage.StepA1);
+			stage.A2 = _mm_add_ps(stage.A2, stage.StepA2);
+		}
+
+		__m128 y = _mm_add_ps(_mm_mul_ps(stage.B0, x), stage.Z1);
+		stage.Z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(stage.B1, x), _mm_mul_ps(stage.A1, y)), stage.Z2);
+		stage.Z2 = _mm_sub_ps(_mm_mul_ps(stage.B2, x), _mm_mul_ps(stage.A2, y));
+
+		if (isRamping && stage.IsCrossfading)
+		{
+			__m128 outgoing = _mm_add_ps(_mm_mul_ps(stage.OutgoingB0, x), stage.OutgoingZ1);
+			stage.OutgoingZ1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(stage.OutgoingB1, x), _mm_mul_ps(stage.OutgoingA1, outgoing)), stage.OutgoingZ2);
+			stage.OutgoingZ2 = _mm_sub_ps(_mm_mul_ps(stage.OutgoingB2, x), _mm_mul_ps(stage.OutgoingA2, outgoing));
+
+			stage.Fade = _mm_add_ps(stage.Fade, stage.FadeStep);
+			y = _mm_add_ps(outgoing, _mm_mul_ps(stage.Fade, _mm_sub_ps(y, outgoing)));
+		}
+		x = y;
+	}
+	return x;
+}
+
+template <bool isRamping>
+void FilterBank::ProcessSegmentSimd(const PlanarView& buffer, UINT32 firstFrame, UINT32 frameCount)
+{
+	const UINT32 channelCount = min(buffer.ChannelCount, (UINT32)FILTER_BANK_MAX_CHANNELS);
+	SimdStage stages[FILTER_BANK_MAX_STAGES];
+
+	for (UINT32 group = 0; group < channelCount; group += 4)
+	{
+		const UINT32 laneCount = min(4u, channelCount - group);
+		float* channels[4] = {};
+		for (UINT32 lane = 0; lane < laneCount; lane++)
+		{
+			channels[lane] = buffer.Channel(group + lane) + firstFrame;
+		}
+
+		// Every group starts the segment from the same coefficients.
+		for (UINT32 i = 0; i < m_ActiveStageCount; i++)
+		{
+			const UINT32 index = m_ActiveStages[i];
+			const Stage& stage = m_Stages[index];
+			SimdStage& simd = stages[i];
+			simd.B0 = _mm_set1_ps(stage.Current.B0);
+			simd.B1 = _mm_set1_ps(stage.Current.B1);
+			simd.B2 = _mm_set1_ps(stage.Current.B2);
+			simd.A1 = _mm_set1_ps(stage.Current.A1);
+			simd.A2 = _mm_set1_ps(stage.Current.A2);
+			simd.StepB0 = _mm_set1_ps(stage.Step.B0);
+			simd.StepB1 = _mm_set1_ps(stage.Step.B1);
+			simd.StepB2 = _mm_set1_ps(stage.Step.B2);
+			simd.StepA1 = _mm_set1_ps(stage.Step.A1);
+			simd.StepA2 = _mm_set1_ps(stage.Step.A2);
+			simd.Z1 = _mm_loadu_ps(&m_Z1[index][group]);
+			simd.Z2 = _mm_loadu_ps(&m_Z2[index][group]);
+
+			simd.IsCrossfading = (stage.Fade < 1.0f);
+			if (simd.IsCrossfading)
+			{
+				simd.OutgoingB0 = _mm_set1_ps(stage.Outgoing.B0);
+				simd.OutgoingB1 = _mm_set1_ps(stage.Outgoing.B1);
+				simd.OutgoingB2 = _mm_set1_ps(stage.Outgoing.B2);
+				simd.OutgoingA1 = _mm_set1_ps(stage.Outgoing.A1);
+				simd.OutgoingA2 = _mm_set1_ps(stage.Outgoing.A2);
+				simd.OutgoingZ1 = _mm_loadu_ps(&m_OutgoingZ1[index][group]);
+				simd.OutgoingZ2 = _mm_loadu_ps(&m_OutgoingZ2[index][group]);
+				simd.Fade = _mm_set1_ps(stage.Fade);
+				simd.FadeStep = _mm_set1_ps(stage.FadeStep);
+			}
+		}
+
+		// Four frames at a time, transposed so each vector holds one frame across the group's channels.  Lanes
+		// without a channel run on zeros, so their state stays zero.
+		UINT32 frame = 0;
+		for (; frame + 4 <= frameCount; frame += 4)
+		{
+			__m128 row0 = _mm_loadu_ps(&channels[0][frame]);
+			__m128 row1 = (laneCount > 1) ? _mm_loadu_ps(&channels[1][frame]) : _mm_setzero_ps();
+			__m128 row2 = (laneCount > 2) ? _mm_loadu_ps(&channels[2][frame]) : _mm_setzero_ps();
+			__m128 row3 = (laneCount > 3) ? _mm_loadu_ps(&channels[3][frame]) : _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+			row0 = FilterFrame<isRamping>(stages, m_ActiveStageCount, row0);
+			row1 = FilterFrame<isRamping>(stages, m_ActiveStageCount, row1);
+			row2 = FilterFrame<isRamping>(stages, m_ActiveStageCount, row2);
+			row3 = FilterFrame<isRamping>(stages, m_ActiveStageCount, row3);
+
+			_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+			_mm_storeu_ps(&channels[0][frame], row0);
+			if (laneCount > 1)
+			{
+				_mm_storeu_ps(&channels[1][frame], row1);
+			}
+			if (laneCount > 2)
+			{
+				_mm_storeu_ps(&channels[2][frame], row2);
+			}
+			if (laneCount > 3)
+			{
+				_mm_storeu_ps(&channels[3][frame], row3);
+			}
+		}
+
+		for (; frame < frameCount; frame++)
+		{
+			float samples[4] = {};
+			for (UINT32 lane = 0; lane < laneCount; lane++)
+			{
+				samples[lane] = channels[lane][frame];
+			}
+			_mm_storeu_ps(samples, FilterFrame<isRamping>(stages, m_ActiveStageCount, _mm_loadu_ps(samples)));
+			for (UINT32 lane = 0; lane < laneCount; lane++)
+			{
+				channels[lane][frame] = samples[lane];
+			}
+		}
+
+		for (UINT32 i = 0; i < m_ActiveStageCount; i++)
+		{
+			const UINT32 index = m_ActiveStages[i];
+			_mm_storeu_ps(&m_Z1[index][group], stages[i].Z1);
+			_mm_storeu_ps(&m_Z2[index][group], stages[i].Z2);
+			if (stages[i].IsCrossfading)
+			{
+				_mm_storeu_ps(&m_OutgoingZ1[index][group], stages[i].OutgoingZ1);
+				_mm_storeu_ps(&m_OutgoingZ2[index][group], stages[i].OutgoingZ2);
+			}
+		}
+	}
+}
+#endif
+
+template <bool isRamping>
+void FilterBank::ProcessSegment(const PlanarView& buffer, UINT32 firstFrame, UINT32 frameCount)
+{
+	const UINT32 channelCount = min(buffer.ChannelCount, (UINT32)FILTER_BANK_MAX_CHANNELS);
+
+#if defined(_M_IX86) || defined(_M_X64)
+	// A single channel would leave three lanes idle and still pay for the transposes; it runs scalar below.
+	if (channelCount > 1)
+	{
+		ProcessSegmentSimd<isRamping>(buffer, firstFrame, frameCount);
+		return;
+	}
+#endif
+
+	for (UINT32 channel = 0; channel < channelCount; channel++)
+	{
+		float* samples = buffer.Channel(channel) + firstFrame;
+		Coefficients coefficients[FILTER_BANK_MAX_STAGES];
+		float fades[FILTER_BANK_MAX_STAGES];
+		for (UINT32 i = 0; i < m_ActiveStageCount; i++)
+		{
+			coefficients[i] = m_Stages[m_ActiveStages[i]].Current;
+			fades[i] = m_Stages[m_ActiveStages[i]].Fade;
+		}
+
+		for (UINT32 frame = 0; frame < frameCount; frame++)
+		{
+			float x = samples[frame];
+			for (UINT32 i = 0; i < m_ActiveStageCount; i++)
+			{
+				const UINT32 index = m_ActiveStages[i];
+				const Stage& stage = m_Stages[index];
+				Coefficients& c = coefficients[i];
+				if (isRamping)
+				{
+					c.B0 += stage.Step.B0;
+					c.B1 += stage.Step.B1;
+					c.B2 += stage.Step.B2;
+					c.A1 += stage.Step.A1;
+					c.A2 += stage.Step.A2;
+				}
+
+				float& z1 = m_Z1[index][channel];
+				float& z2 = m_Z2[index][channel];
+				float y = (c.B0 * x) + z1;
+				z1 = (c.B1 * x) - (c.A1 * y) + z2;
+				z2 = (c.B2 * x) - (c.A2 * y);
+
+				if (isRamping && stage.Fade < 1.0f)
+				{
+					const Coefficients& o = stage.Outgoing;
+					float& outgoingZ1 = m_OutgoingZ1[index][channel];
+					float& outgoingZ2 = m_OutgoingZ2[index][channel];
+					float outgoing = (o.B0 * x) + outgoingZ1;
+					outgoingZ1 = (o.B1 * x) - (o.A1 * outgoing) + outgoingZ2;
+					outgoingZ2 = (o.B2 * x) - (o.A2 * outgoing);
+
+					fades[i] += stage.FadeStep;
+					y = outgoing + (fades[i] * (y - outgoing));
+				}
+				x = y;
+			}
+			samples[frame] = x;
+		}
+	}
+}
+
+void FilterBank::Process(const PlanarView& buffer, UINT32 frameCount)
+{
+	UpdateStages();
+	if (m_ActiveStageCount == 0)
+	{
+		return;
+	}
+
+	// Outside ramps the coefficients are constant, so the whole period is one segment.
+	UINT32 frame = 0;
+	while (frame < frameCount)
+	{
+		if (m_RampingStageCount == 0)
+		{
+			ProcessSegment<false>(buffer, frame, frameCount - frame);
+			break;
+		}
+
+		UINT32 segmentFrames = min((UINT32)FILTER_BANK_SEGMENT_FRAMES, frameCount - frame);
+		StartSegment(segmentFrames);
+		ProcessSegment<true>(buffer, frame, segmentFrames);
+		EndSegment();
+		frame += segmentFrames;
+	}
+
+	// Flush what is left of decayed tails, and note whether anything is left at all.
+	bool isQuiet = true;
+	for (UINT32 i = 0; i < m_ActiveStageCount; i++)
+	{
+		const UINT32 index = m_ActiveStages[i];
+		for (UINT32 channel = 0; channel < FILTER_BANK_MAX_CHANNELS; channel++)
+		{
+			float* state[] = { &m_Z1[index][channel], &m_Z2[index][channel], &m_OutgoingZ1[index][channel], &m_OutgoingZ2[index][channel] };
+			for (float* value : state)
+			{
+				if (fabsf(*value) < FILTER_BANK_QUIET_LEVEL)
+				{
+					*value = 0.0f;
+				}
+				else
+				{
+					isQuiet = false;
+				}
+			}
+		}
+	}
+	m_IsQuiet = isQuiet;
+}
+
+void FilterBank::Skip(UINT32 frameCount)
+{
+	UpdateStages();
+
+	for (UINT32 i = 0; i < m_ActiveStageCount; i++)
+	{
+		Stage& stage = m_Stages[m_ActiveStages[i]];
+		if (stage.RampRemaining > 0)
+		{
+			stage.RampRemaining -= min(frameCount, stage.RampRemaining);
+			stage.Current = RampedCoefficients(stage, stage.RampRemaining);
+		}
+		if (stage.FadeRemaining > 0)
+		{
+			stage.FadeRemaining -= min(frameCount, stage.FadeRemaining);
+			stage.Fade = 1.0f - ((float)stage.FadeRemaining / stage.FadeFrames);
+		}
+	}
+
+	ZeroMemory(m_Z1, sizeof(m_Z1));
+	ZeroMemory(m_Z2, sizeof(m_Z2));
+	ZeroMemory(m_OutgoingZ1, sizeof(m_OutgoingZ1));
+	ZeroMemory(m_OutgoingZ2, sizeof(m_OutgoingZ2));
+	m_IsQuiet = true;
+
+	UpdateActiveStages();
+}
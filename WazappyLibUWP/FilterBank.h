@@ -0,0 +1,171 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+
+#include "WazappyDllInterface.h"
+#include "PlanarBuffer.h"
+
+// Biquad stages in each filter bank, run in series.
+#define FILTER_BANK_MAX_STAGES 4
+
+// Channels a filter bank filters; any beyond these pass through unfiltered.  A multiple of the SIMD width.
+#define FILTER_BANK_MAX_CHANNELS 8
+
+// While a stage ramps, its coefficients are recomputed from the ramping parameters every this many frames, and
+// interpolated linearly in between.
+#define FILTER_BANK_SEGMENT_FRAMES 32
+
+// Filter state below this (-160dB) is flushed to zero at the end of each period, so tails end rather than
+// decaying into denormals.
+#define FILTER_BANK_QUIET_LEVEL 1e-8f
+
+namespace Wazappy
+{
+	// A cascade of up to FILTER_BANK_MAX_STAGES biquad filters, applied to a voice or to a whole mix inside the
+	// engine.  Each stage runs in transposed direct form II, with the channels in SIMD lanes: a channel's filter
+	// state lives in one lane of a vector per stage, so four channels cost what one does.
+	// Parameter changes ramp sample accurately over a given number of frames.  While a stage keeps its type, its
+	// frequency and q ramp geometrically and its gain linearly in decibels, and its coefficients are recomputed
+	// from them every FILTER_BANK_SEGMENT_FRAMES frames, so sweeps never zipper.  A change of type (including to
+	// or from Filter_None) instead crossfades from the old response to the new one, since the filters in between
+	// two types' coefficients can resonate wildly; a second change of type during a crossfade cuts the first
+	// one's outgoing response short.
+	// Setters may be called from any thread and never block; if two race for a stage, the last to finish wins.
+	// Everything else is audio thread only.
+	class FilterBank
+	{
+	public:
+		FilterBank();
+
+		// Move the given stage to a new response over rampFrames frames.  frequency is in cycles per frame (the
+		// frequency in Hz over the sample rate), and is held within (0, 0.5).  gainDb only matters for shelves and
+		// peaks.  Any thread.
+		void SetStage(UINT32 stage, FilterType type, float frequency, float q, float gainDb, UINT32 rampFrames);
+
+		// True when every stage passes audio through unchanged and none is ramping; Process would do nothing.
+		bool IsBypassed();
+
+		// True when the filters hold no tail, so silent input would give silent output.
+		bool IsQuiet() const { return m_IsQuiet; }
+
+		// Filter the first frameCount frames of buffer in place.
+		void Process(const PlanarView& buffer, UINT32 frameCount);
+
+		// Move any ramps on by frameCount frames without processing audio, dropping any tail; for periods whose
+		// output is thrown away, or whose input is silent while the filters are quiet.
+		void Skip(UINT32 frameCount);
+
+	private:
+		// Normalized biquad coefficients (a0 == 1).
+		struct Coefficients
+		{
+			float B0, B1, B2, A1, A2;
+		};
+
+		struct Parameters
+		{
+			FilterType Type;
+			float Frequency;
+			float Q;
+			float GainDb;
+		};
+
+		// Settings written by SetStage; Generation is bumped after the others so the audio thread sees each change.
+		struct StageSettings
+		{
+			std::atomic<FilterType> Type;
+			std::atomic<float> Frequency;
+			std::atomic<float> Q;
+			std::atomic<float> GainDb;
+			std::atomic<UINT32> RampFrames;
+			std::atomic<UINT32> Generation;
+		};
+
+		// Audio thread state for one stage.
+		struct Stage
+		{
+			UINT32 SeenGeneration;
+
+			// The parameter ramp runs from From to To, which always have the same type.
+			Parameters From;
+			Parameters To;
+			Coefficients ToCoefficients;
+			UINT32 RampFrames;
+			UINT32 RampRemaining;
+
+			// Coefficients at the start of the current segment, their per frame increments across it, and where
+			// they land at its end.
+			Coefficients Current;
+			Coefficients Step;
+			Coefficients SegmentEnd;
+
+			// After a change of type, the response of the old type, and the weight of the new one; the stage's
+			// output moves from one to the other over FadeFrames frames.  Fade is 1 when there is no crossfade.
+			Coefficients Outgoing;
+			float Fade;
+			float FadeStep;
+			float FadeEnd;
+			UINT32 FadeFrames;
+			UINT32 FadeRemaining;
+		};
+
+		static Coefficients ComputeCoefficients(const Parameters& parameters);
+
+		// Pick up new settings for any stage, and note which stages need processing.
+		void UpdateStages();
+
+		// Start a segment of segmentFrames frames: set each ramping stage's steps so its coefficients and fade
+		// arrive where its ramps will be at the end of the segment.  A ramp ending within a segment lands at its
+		// end.
+		void StartSegment(UINT32 segmentFrames);
+
+		// Land each ramping stage's coefficients and fade exactly where the segment ends.
+		void EndSegment();
+
+		// The stage's coefficients with framesLeft frames of its parameter ramp still to run.
+		static Coefficients RampedCoefficients(const Stage& stage, UINT32 framesLeft);
+
+		// The stage's parameters with framesLeft frames of its parameter ramp still to run.
+		static Parameters RampedParameters(const Stage& stage, UINT32 framesLeft);
+
+		template <bool isRamping>
+		void ProcessSegment(const PlanarView& buffer, UINT32 firstFrame, UINT32 frameCount);
+
+#if defined(_M_IX86) || defined(_M_X64)
+		// ProcessSegment for two or more channels, four channels to a vector.
+		template <bool isRamping>
+		void ProcessSegmentSimd(const PlanarView& buffer, UINT32 firstFrame, UINT32 frameCount);
+#endif
+
+		// Rebuild the list of stages which need processing, zeroing any state which is no longer needed.
+		void UpdateActiveStages();
+
+	private:
+		StageSettings m_Settings[FILTER_BANK_MAX_STAGES];
+
+		// Audio thread state.
+		Stage m_Stages[FILTER_BANK_MAX_STAGES];
+
+		// Indices of the stages which are not plain pass throughs (or are ramping), in order.
+		UINT32 m_ActiveStages[FILTER_BANK_MAX_STAGES];
+		UINT32 m_ActiveStageCount;
+
+		// Active stages with a ramp still to run.
+		UINT32 m_RampingStageCount;
+
+		// Transposed direct form II state, structure of arrays: [stage][channel], so the lanes of a vector are
+		// consecutive channels.
+		float m_Z1[FILTER_BANK_MAX_STAGES][FILTER_BANK_MAX_CHANNELS];
+		float m_Z2[FILTER_BANK_MAX_STAGES][FILTER_BANK_MAX_CHANNELS];
+
+		// State of each stage's outgoing response while it crossfades; zero otherwise.
+		float m_OutgoingZ1[FILTER_BANK_MAX_STAGES][FILTER_BANK_MAX_CHANNELS];
+		float m_OutgoingZ2[FILTER_BANK_MAX_STAGES][FILTER_BANK_MAX_CHANNELS];
+
+		bool m_IsQuiet;
+	};
+}
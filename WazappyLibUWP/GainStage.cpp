@@ -0,0 +1,205 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "GainStage.h"
+
+using namespace Wazappy;
+
+GainStage::GainStage() :
+	m_TargetGain(1.0f),
+	m_TargetPan(0.0f),
+	m_RampFrames(0),
+	m_Shape(GainRamp_Linear),
+	m_Generation(0),
+	m_SeenGeneration(0),
+	m_RampRemaining(0),
+	m_RampShape(GainRamp_Linear)
+{
+	for (int i = 0; i < Ramp_Count; i++)
+	{
+		m_Current[i] = 1.0f;
+		m_Target[i] = 1.0f;
+		m_Step[i] = 0.0f;
+	}
+}
+
+void GainStage::SetGain(float gain, UINT32 rampFrames, GainRampShape shape)
+{
+	m_TargetGain.store(max(gain, 0.0f), std::memory_order_relaxed);
+	m_RampFrames.store(rampFrames, std::memory_order_relaxed);
+	m_Shape.store(shape, std::memory_order_relaxed);
+	m_Generation.fetch_add(1, std::memory_order_release);
+}
+
+void GainStage::SetPan(float pan, UINT32 rampFrames)
+{
+	m_TargetPan.store(min(max(pan, -1.0f), 1.0f), std::memory_order_relaxed);
+	m_RampFrames.store(rampFrames, std::memory_order_relaxed);
+	m_Shape.store(GainRamp_Linear, std::memory_order_relaxed);
+	m_Generation.fetch_add(1, std::memory_order_release);
+}
+
+void GainStage::UpdateTargets()
+{
+	UINT32 generation = m_Generation.load(std::memory_order_acquire);
+	if (generation == m_SeenGeneration)
+	{
+		return;
+	}
+	m_SeenGeneration = generation;
+
+	float gain = m_TargetGain.load(std::memory_order_relaxed);
+	float pan = m_TargetPan.load(std::memory_order_relaxed);
+	UINT32 rampFrames = m_RampFrames.load(std::memory_order_relaxed);
+	m_RampShape = m_Shape.load(std::memory_order_relaxed);
+
+	m_Target[Ramp_Left] = gain * ((pan > 0.0f) ? (float)cos(pan * M_PI_2) : 1.0f);
+	m_Target[Ramp_Right] = gain * ((pan < 0.0f) ? (float)cos(-pan * M_PI_2) : 1.0f);
+	m_Target[Ramp_Other] = gain;
+
+	// A new ramp starts from wherever the last one had got to.
+	m_RampRemaining = rampFrames;
+	for (int i = 0; i < Ramp_Count; i++)
+	{
+		if (rampFrames == 0)
+		{
+			m_Current[i] = m_Target[i];
+		}
+		else if (m_RampShape == GainRamp_Exponential)
+		{
+			m_Current[i] = max(m_Current[i], GAIN_STAGE_EXPONENTIAL_FLOOR);
+			float target = max(m_Target[i], GAIN_STAGE_EXPONENTIAL_FLOOR);
+			m_Step[i] = (float)pow((double)target / m_Current[i], 1.0 / rampFrames);
+		}
+		else
+		{
+			m_Step[i] = (m_Target[i] - m_Current[i]) / rampFrames;
+		}
+	}
+}
+
+bool GainStage::IsUnity()
+{
+	UpdateTargets();
+	return m_RampRemaining == 0 && m_Current[Ramp_Left] == 1.0f && m_Current[Ramp_Right] == 1.0f && m_Current[Ramp_Other] == 1.0f;
+}
+
+bool GainStage::IsSilent()
+{
+	UpdateTargets();
+	return m_RampRemaining == 0 && m_Current[Ramp_Left] == 0.0f && m_Current[Ramp_Right] == 0.0f && m_Current[Ramp_Other] == 0.0f;
+}
+
+void GainStage::Advance(UINT32 frameCount)
+{
+	UpdateTargets();
+	if (m_RampRemaining == 0)
+	{
+		return;
+	}
+
+	UINT32 frames = min(frameCount, m_RampRemaining);
+	m_RampRemaining -= frames;
+	for (int i = 0; i < Ramp_Count; i++)
+	{
+		if (m_RampRemaining == 0)
+		{
+			m_Current[i] = m_Target[i];
+		}
+		else if (m_RampShape == GainRamp_Exponential)
+		{
+			m_Current[i] *= (float)pow((double)m_Step[i], (double)frames);
+		}
+		else
+		{
+			m_Current[i] += m_Step[i] * frames;
+		}
+	}
+}
+
+void GainStage::MixInto(const PlanarView& source, const PlanarView& destination, UINT32 frameCount)
+{
+	UpdateTargets();
+	Process<true>(source, destination, frameCount);
+}
+
+void GainStage::ApplyInPlace(const PlanarView& buffer, UINT32 frameCount)
+{
+	UpdateTargets();
+	Process<false>(buffer, buffer, frameCount);
+}
+
+float GainStage::RampedGain(int rampChannel, UINT32 frames) const
+{
+	if (frames > 0 && frames == m_RampRemaining)
+	{
+		return m_Target[rampChannel];
+	}
+
+	float gain = m_Current[rampChannel];
+	for (UINT32 i = 0; i < frames; i++)
+	{
+		gain = (m_RampShape == GainRamp_Exponential) ? gain * m_Step[rampChannel] : gain + m_Step[rampChannel];
+	}
+	return gain;
+}
+
+template <bool isMixing>
+void GainStage::Process(const PlanarView& source, const PlanarView& destination, UINT32 frameCount)
+{
+	const UINT32 channelCount = destination.ChannelCount;
+
+	// A mono device has no sides to pan between.
+	const int firstClass = (channelCount == 1) ? Ramp_Other : Ramp_Left;
+
+	// Frames still ramping this period, and whether the ramp ends within it (landing exactly on the target,
+	// whatever rounding has crept in).
+	const UINT32 rampFrames = min(frameCount, m_RampRemaining);
+	const bool isLanding = (rampFrames > 0) && (rampFrames == m_RampRemaining);
+	const UINT32 stepFrames = isLanding ? rampFrames - 1 : rampFrames;
+	const bool isExponential = (m_RampShape == GainRamp_Exponential);
+
+	for (UINT32 c = 0; c < channelCount; c++)
+	{
+		const int rampChannel = (c < 2) ? firstClass + c : Ramp_Other;
+		const float* in = source.Channel(c);
+		float* out = destination.Channel(c);
+
+		// Each channel ramps on its own, one frame at a time.
+		float gain = m_Current[rampChannel];
+		const float step = m_Step[rampChannel];
+		UINT32 frame = 0;
+		for (; frame < stepFrames; frame++)
+		{
+			gain = isExponential ? gain * step : gain + step;
+			out[frame] = isMixing ? out[frame] + in[frame] * gain : in[frame] * gain;
+		}
+		if (isLanding)
+		{
+			gain = m_Target[rampChannel];
+			out[frame] = isMixing ? out[frame] + in[frame] * gain : in[frame] * gain;
+			frame++;
+		}
+
+		// The rest of the period is at constant gain; a plain loop over one channel, which the compiler vectorizes.
+		for (; frame < frameCount; frame++)
+		{
+			out[frame] = isMixing ? out[frame] + in[frame] * gain : in[frame] * gain;
+		}
+	}
+
+	if (rampFrames > 0)
+	{
+		for (int i = 0; i < Ramp_Count; i++)
+		{
+			m_Current[i] = RampedGain(i, rampFrames);
+		}
+		m_RampRemaining -= rampFrames;
+	}
+}
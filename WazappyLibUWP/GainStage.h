@@ -0,0 +1,92 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+
+#include "WazappyDllInterface.h"
+#include "PlanarBuffer.h"
+
+// Exponential ramps treat gains below this (-80dB) as this, since they cannot start or end at zero.
+#define GAIN_STAGE_EXPONENTIAL_FLOOR 0.0001f
+
+namespace Wazappy
+{
+	// Gain and pan applied to a voice, or to a whole mix, inside the engine.
+	// Changes are ramped sample accurately over a given number of frames, so continuous fader moves never
+	// zipper.  Pan is a balance control with a constant power law on the attenuated side: centre leaves both
+	// sides at the gain, and full left or right silences the other side.  It applies to the first two channels;
+	// any further channels get the gain alone.
+	// Setters may be called from any thread and never block; if two race, the last to finish wins.  Apply is
+	// audio thread only.
+	class GainStage
+	{
+	public:
+		GainStage();
+
+		// Move to the given linear gain over rampFrames frames.  Any thread.
+		void SetGain(float gain, UINT32 rampFrames, GainRampShape shape);
+
+		// Move to the given pan (-1 full left, 0 centre, 1 full right) over rampFrames frames, linearly.
+		// Any thread.  A gain and a pan change landing in the same period share the later one's ramp.
+		void SetPan(float pan, UINT32 rampFrames);
+
+		float GetGain() const { return m_TargetGain; }
+		float GetPan() const { return m_TargetPan; }
+
+		// True when the stage would leave audio unchanged: unity gain, centred, and not ramping.  Audio thread only.
+		bool IsUnity();
+
+		// True when the stage would silence audio entirely: zero gain, and not ramping.  Audio thread only.
+		bool IsSilent();
+
+		// Move any ramp on by frameCount frames without processing audio, for periods whose input is silent.
+		// The stage has no memory, so it has no tail to play out.  Audio thread only.
+		void Advance(UINT32 frameCount);
+
+		// Add source, with gain and pan applied, into destination, which has the same channel count.
+		// Audio thread only.
+		void MixInto(const PlanarView& source, const PlanarView& destination, UINT32 frameCount);
+
+		// Apply gain and pan to buffer in place.  Audio thread only.
+		void ApplyInPlace(const PlanarView& buffer, UINT32 frameCount);
+
+	private:
+		// Gains of the left, right and remaining channels; the unit the ramps work in.
+		enum RampChannel
+		{
+			Ramp_Left,
+			Ramp_Right,
+			Ramp_Other,
+			Ramp_Count
+		};
+
+		// Start ramping towards the latest targets, if a setter has run since the last period.
+		void UpdateTargets();
+
+		// Gain of the ramp at the end of the given number of frames from now, stepping as Process does.
+		float RampedGain(int rampChannel, UINT32 frames) const;
+
+		template <bool isMixing>
+		void Process(const PlanarView& source, const PlanarView& destination, UINT32 frameCount);
+
+	private:
+		// Written by setters; m_Generation is bumped after the others so the audio thread sees each change.
+		std::atomic<float> m_TargetGain;
+		std::atomic<float> m_TargetPan;
+		std::atomic<UINT32> m_RampFrames;
+		std::atomic<GainRampShape> m_Shape;
+		std::atomic<UINT32> m_Generation;
+
+		// Audio thread state.
+		UINT32 m_SeenGeneration;
+		float m_Current[Ramp_Count];
+		float m_Target[Ramp_Count];
+		// Per frame increment (linear) or multiplier (exponential).
+		float m_Step[Ramp_Count];
+		UINT32 m_RampRemaining;
+		GainRampShape m_RampShape;
+	};
+}
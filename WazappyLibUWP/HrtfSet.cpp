@@ -0,0 +1,182 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "HrtfSet.h"
+#include "Interpolator.h"
+
+using namespace Wazappy;
+
+HrtfSet::HrtfSet(UINT32 blockFrames) :
+	m_BlockFrames(blockFrames),
+	m_ImpulseFrames(0),
+	m_PartitionCount(0),
+	m_Fft(blockFrames * 2)
+{
+}
+
+HRESULT HrtfSet::Initialize(const HRTFDATASET& dataset, UINT32 sampleRate)
+{
+	if (0 == dataset.MeasurementCount || 0 == dataset.ImpulseFrames || 0 == dataset.SampleRate
+		|| nullptr == dataset.SourcePositions || nullptr == dataset.Impulses || 0 == sampleRate)
+	{
+		return E_INVALIDARG;
+	}
+
+	// Dataset frames per device frame.
+	double rate = (double)dataset.SampleRate / sampleRate;
+	double impulseFrames = ceil(dataset.ImpulseFrames / rate);
+	if (impulseFrames > HRTF_MAX_IMPULSE_FRAMES)
+	{
+		return E_INVALIDARG;
+	}
+
+	m_ImpulseFrames = (UINT32)impulseFrames;
+	m_PartitionCount = (m_ImpulseFrames + m_BlockFrames - 1) / m_BlockFrames;
+	const UINT32 P = m_PartitionCount;
+	const UINT32 B = m_BlockFrames;
+
+	// A response measured at another rate is resampled with the sinc kernel, scaled so its gain is kept; going
+	// down in rate, the kernel's cutoff falls to the device's Nyquist frequency, so nothing aliases.
+	const UINT32 N = dataset.ImpulseFrames;
+	std::vector<float> padded(INTERPOLATOR_FRAMES_BEFORE + N + INTERPOLATOR_FRAMES_AFTER + 2, 0.0f);
+	std::vector<float> resampled(P * B);
+	std::vector<float> window(B * 2);
+	m_Spectra.assign((size_t)dataset.MeasurementCount * 2 * P * B, std::complex<float>());
+	for (UINT32 measurement = 0; measurement < dataset.MeasurementCount; measurement++)
+	{
+		for (UINT32 ear = 0; ear < 2; ear++)
+		{
+			const float* impulse = dataset.Impulses + ((((size_t)measurement * 2) + ear) * N);
+			std::fill(resampled.begin(), resampled.end(), 0.0f);
+			if (dataset.SampleRate == sampleRate)
+			{
+				memcpy(resampled.data(), impulse, N * sizeof(float));
+			}
+			else
+			{
+				memcpy(padded.data() + INTERPOLATOR_FRAMES_BEFORE, impulse, N * sizeof(float));
+				Interpolator::Interpolate(Interpolation_Sinc, padded.data(), INTERPOLATOR_FRAMES_BEFORE, (float)rate, resampled.data(), m_ImpulseFrames);
+				for (UINT32 i = 0; i < m_ImpulseFrames; i++)
+				{
+					resampled[i] *= (float)rate;
+				}
+			}
+
+			for (UINT32 partition = 0; partition < P; partition++)
+			{
+				std::fill(window.begin(), window.end(), 0.0f);
+				memcpy(window.data(), resampled.data() + (partition * B), B * sizeof(float));
+				m_Fft.Forward(window.data(), Spectrum(measurement, ear, partition));
+			}
+		}
+	}
+
+	BuildCells(dataset);
+	return S_OK;
+}
+
+void HrtfSet::BuildCells(const HRTFDATASET& dataset)
+{
+	// Unit vectors (front, left, up) towards each measurement, from its azimuth (counterclockwise from ahead)
+	// and elevation in degrees, as in SOFA's spherical coordinates.
+	const UINT32 M = dataset.MeasurementCount;
+	const double toRadians = M_PI / 180;
+	std::vector<double> directions((size_t)M * 3);
+	for (UINT32 measurement = 0; measurement < M; measurement++)
+	{
+		double azimuth = dataset.SourcePositions[measurement * 3] * toRadians;
+		double elevation = dataset.SourcePositions[(measurement * 3) + 1] * toRadians;
+		directions[measurement * 3] = cos(elevation) * cos(azimuth);
+		directions[(measurement * 3) + 1] = cos(elevation) * sin(azimuth);
+		directions[(measurement * 3) + 2] = sin(elevation);
+	}
+
+	// Each point takes the nearest measurements, weighted by the inverse of the angle to them; a measurement
+	// right on the point is taken alone.
+	const UINT32 count = min((UINT32)HRTF_NEIGHBOURS, M);
+	m_Cells.resize(HRTF_AZIMUTH_CELLS * HRTF_ELEVATION_CELLS);
+	for (UINT32 elevationCell = 0; elevationCell < HRTF_ELEVATION_CELLS; elevationCell++)
+	{
+		double elevation = ((double)elevationCell * HRTF_GRID_DEGREES - 90) * toRadians;
+		for (UINT32 azimuthCell = 0; azimuthCell < HRTF_AZIMUTH_CELLS; azimuthCell++)
+		{
+			double azimuth = ((double)azimuthCell * HRTF_GRID_DEGREES) * toRadians;
+			double front = cos(elevation) * cos(azimuth);
+			double left = cos(elevation) * sin(azimuth);
+			double up = sin(elevation);
+
+			// Nearest first.
+			UINT32 nearest[HRTF_NEIGHBOURS] = {};
+			double nearestDot[HRTF_NEIGHBOURS];
+			for (UINT32 k = 0; k < HRTF_NEIGHBOURS; k++)
+			{
+				nearestDot[k] = -2;
+			}
+			for (UINT32 measurement = 0; measurement < M; measurement++)
+			{
+				double dot = (front * directions[measurement * 3]) + (left * directions[(measurement * 3) + 1]) + (up * directions[(measurement * 3) + 2]);
+				for (UINT32 k = 0; k < count; k++)
+				{
+					if (dot > nearestDot[k])
+					{
+						for (UINT32 j = count - 1; j > k; j--)
+						{
+							nearest[j] = nearest[j - 1];
+							nearestDot[j] = nearestDot[j - 1];
+						}
+						nearest[k] = measurement;
+						nearestDot[k] = dot;
+						break;
+					}
+				}
+			}
+
+			Blend& cell = m_Cells[(elevationCell * HRTF_AZIMUTH_CELLS) + azimuthCell];
+			double weights[HRTF_NEIGHBOURS] = {};
+			double total = 0;
+			for (UINT32 k = 0; k < count; k++)
+			{
+				double angle = acos((std::min)(1.0, nearestDot[k]));
+				if (0 == k && angle < 1e-4)
+				{
+					weights[0] = 1;
+					total = 1;
+					break;
+				}
+				weights[k] = 1 / angle;
+				total += weights[k];
+			}
+			for (UINT32 k = 0; k < HRTF_NEIGHBOURS; k++)
+			{
+				cell.Measurements[k] = nearest[k];
+				cell.Weights[k] = (float)(weights[k] / total);
+			}
+		}
+	}
+}
+
+UINT32 HrtfSet::GetCell(float x, float y, float z)
+{
+	// Head coordinates have x right, y up and -z ahead.
+	float front = -z;
+	float left = -x;
+	float up = y;
+
+	const float toDegrees = (float)(180 / M_PI);
+	float azimuth = atan2f(left, front) * toDegrees;
+	if (azimuth < 0)
+	{
+		azimuth += 360;
+	}
+	float elevation = atan2f(up, sqrtf((front * front) + (left * left))) * toDegrees;
+
+	UINT32 azimuthCell = (UINT32)((azimuth / HRTF_GRID_DEGREES) + 0.5f) % HRTF_AZIMUTH_CELLS;
+	UINT32 elevationCell = min((UINT32)(((elevation + 90) / HRTF_GRID_DEGREES) + 0.5f), (UINT32)HRTF_ELEVATION_CELLS - 1);
+	return (elevationCell * HRTF_AZIMUTH_CELLS) + azimuthCell;
+}
@@ -0,0 +1,89 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <complex>
+#include <vector>
+
+#include "WazappyDllInterface.h"
+#include "Fft.h"
+
+// Longest impulse response accepted, in frames at the device's sample rate.
+#define HRTF_MAX_IMPULSE_FRAMES 2048
+
+// Spacing of the grid of directions responses are looked up by, in degrees; each point of the grid has its
+// response blended from the measurements nearest it.
+#define HRTF_GRID_DEGREES 2
+
+// Measurements blended for each point of the grid.
+#define HRTF_NEIGHBOURS 3
+
+// Points of the grid around each circle of elevation, and circles from straight down to straight up.
+#define HRTF_AZIMUTH_CELLS (360 / HRTF_GRID_DEGREES)
+#define HRTF_ELEVATION_CELLS ((180 / HRTF_GRID_DEGREES) + 1)
+
+namespace Wazappy
+{
+	// A dataset of head related impulse responses (see HRTFDATASET), resampled to the device's rate and cut into
+	// partitions for uniformly partitioned overlap-save convolution: each partition is a block of the response
+	// followed by a block of zeros, kept as its packed RealFft spectrum, as in PartitionedConvolver.
+	// Directions are looked up on a grid HRTF_GRID_DEGREES apart, each point of which blends the spectra of the
+	// HRTF_NEIGHBOURS measurements nearest it, weighted by the inverse of the angle to them, so any direction has
+	// a response even where the dataset is sparse.
+	// Initialize allocates; once it has returned, everything is read only and safe on the audio thread.
+	class HrtfSet
+	{
+	public:
+		// The measurements blended for a point of the grid, and their weights (which sum to 1).
+		struct Blend
+		{
+			UINT32 Measurements[HRTF_NEIGHBOURS];
+			float Weights[HRTF_NEIGHBOURS];
+		};
+
+		// Partitions will be blockFrames long, a power of two.
+		HrtfSet(UINT32 blockFrames);
+
+		// Load the dataset, resampling it to sampleRate if need be.
+		HRESULT Initialize(const HRTFDATASET& dataset, UINT32 sampleRate);
+
+		UINT32 GetImpulseFrames() const { return m_ImpulseFrames; }
+		UINT32 GetPartitionCount() const { return m_PartitionCount; }
+
+		// Spectrum of one partition of one ear's response to a measurement, blockFrames packed bins.  Both ears'
+		// partitions follow each other, left then right, so (measurement, 0, 0) starts a run of
+		// 2 * GetPartitionCount() spectra.
+		const std::complex<float>* GetSpectrum(UINT32 measurement, UINT32 ear, UINT32 partition) const
+		{
+			return &m_Spectra[((((size_t)measurement * 2) + ear) * m_PartitionCount + partition) * m_BlockFrames];
+		}
+
+		// The grid point for a direction in head coordinates (x right, y up, -z ahead), and its blend.
+		static UINT32 GetCell(float x, float y, float z);
+		const Blend& GetBlend(UINT32 cell) const { return m_Cells[cell]; }
+
+	private:
+		// Fill m_Cells from the measurements' directions.
+		void BuildCells(const HRTFDATASET& dataset);
+
+		std::complex<float>* Spectrum(UINT32 measurement, UINT32 ear, UINT32 partition)
+		{
+			return &m_Spectra[((((size_t)measurement * 2) + ear) * m_PartitionCount + partition) * m_BlockFrames];
+		}
+
+	private:
+		const UINT32 m_BlockFrames;
+		UINT32 m_ImpulseFrames;
+		UINT32 m_PartitionCount;
+
+		RealFft m_Fft;
+
+		// [measurement][ear][partition][bin].
+		std::vector<std::complex<float>> m_Spectra;
+
+		// [elevation][azimuth].
+		std::vector<Blend> m_Cells;
+	};
+}
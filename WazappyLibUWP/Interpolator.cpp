@@ -0,0 +1,251 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <vector>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "Interpolator.h"
+
+using namespace Wazappy;
+
+namespace
+{
+	// The sinc kernel's weights for rates up to one stretch, at each tabulated phase ([phase][tap]), and the
+	// step from each phase's weights to the next's.
+	struct SincTable
+	{
+		float Stretch;
+		UINT32 Taps;
+		std::vector<float> Weights;
+		std::vector<float> Deltas;
+
+		SincTable(float stretch) :
+			Stretch(stretch),
+			Taps((UINT32)(INTERPOLATOR_SINC_TAPS * stretch)),
+			Weights((INTERPOLATOR_SINC_PHASES + 1) * (size_t)Taps),
+			Deltas(INTERPOLATOR_SINC_PHASES * (size_t)Taps)
+		{
+			const double halfWidth = Taps / 2;
+			const double cutoff = INTERPOLATOR_SINC_CUTOFF / stretch;
+			const int framesBefore = (int)(Taps / 2) - 1;
+			for (UINT32 phase = 0; phase <= INTERPOLATOR_SINC_PHASES; phase++)
+			{
+				double fraction = (double)phase / INTERPOLATOR_SINC_PHASES;
+				double sum = 0;
+				for (UINT32 tap = 0; tap < Taps; tap++)
+				{
+					// Distance from the position to the frame this tap reads, which runs from (1 - Taps / 2) to
+					// Taps / 2 frames away from the whole part of the position.
+					double x = ((double)tap - framesBefore) - fraction;
+					double sinc = (x == 0) ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+
+					// Blackman window over the kernel's width.
+					double window = (fabs(x) >= halfWidth) ? 0.0 :
+						0.42 + (0.5 * cos(M_PI * x / halfWidth)) + (0.08 * cos(2 * M_PI * x / halfWidth));
+					Weights[(phase * Taps) + tap] = (float)(sinc * window);
+					sum += sinc * window;
+				}
+
+				// Unity gain at DC, whatever the phase.
+				for (UINT32 tap = 0; tap < Taps; tap++)
+				{
+					Weights[(phase * Taps) + tap] = (float)(Weights[(phase * Taps) + tap] / sum);
+				}
+			}
+
+			for (UINT32 phase = 0; phase < INTERPOLATOR_SINC_PHASES; phase++)
+			{
+				for (UINT32 tap = 0; tap < Taps; tap++)
+				{
+					Deltas[(phase * Taps) + tap] = Weights[((phase + 1) * Taps) + tap] - Weights[(phase * Taps) + tap];
+				}
+			}
+		}
+	};
+
+	// A table per stretch, widest last, built once, when the library loads.
+	const SincTable s_SincTables[] =
+		{ SincTable(1.0f), SincTable(1.25f), SincTable(1.5f), SincTable(2.0f), SincTable(3.0f), SincTable(INTERPOLATOR_SINC_MAX_STRETCH) };
+	const UINT32 s_SincTableCount = sizeof(s_SincTables) / sizeof(s_SincTables[0]);
+
+	// The table for the given step: the narrowest which filters out everything the step would alias.
+	const SincTable& SelectSincTable(float step)
+	{
+		float rate = fabsf(step);
+		UINT32 index = 0;
+		while (index + 1 < s_SincTableCount && rate > s_SincTables[index].Stretch)
+		{
+			index++;
+		}
+		return s_SincTables[index];
+	}
+}
+
+void Interpolator::Interpolate(InterpolationQuality quality, const float* source, float first, float step, float* output, UINT32 frameCount)
+{
+	switch (quality)
+	{
+	case Interpolation_Linear:
+		Linear(source, first, step, output, frameCount);
+		break;
+
+	case Interpolation_Hermite:
+		Hermite(source, first, step, output, frameCount);
+		break;
+
+	default:
+		Sinc(source, first, step, output, frameCount);
+		break;
+	}
+}
+
+void Interpolator::Linear(const float* source, float first, float step, float* output, UINT32 frameCount)
+{
+	UINT32 frame = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	const __m128 ramp = _mm_set_ps(3, 2, 1, 0);
+	for (; frame + 4 <= frameCount; frame += 4)
+	{
+		// Each position from the first, rather than accumulated, so rounding never builds up.
+		__m128 positions = _mm_add_ps(_mm_set1_ps(first), _mm_mul_ps(_mm_set1_ps(step), _mm_add_ps(_mm_set1_ps((float)frame), ramp)));
+		__m128i wholes = _mm_cvttps_epi32(positions);
+		__m128 fractions = _mm_sub_ps(positions, _mm_cvtepi32_ps(wholes));
+
+		int whole[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(whole), wholes);
+		__m128 row0 = _mm_loadu_ps(source + whole[0]);
+		__m128 row1 = _mm_loadu_ps(source + whole[1]);
+		__m128 row2 = _mm_loadu_ps(source + whole[2]);
+		__m128 row3 = _mm_loadu_ps(source + whole[3]);
+
+		// Only the first two columns of the transpose are needed.
+		__m128 low = _mm_unpacklo_ps(row0, row1);
+		__m128 high = _mm_unpacklo_ps(row2, row3);
+		__m128 y0 = _mm_movelh_ps(low, high);
+		__m128 y1 = _mm_movehl_ps(high, low);
+
+		__m128 result = _mm_add_ps(y0, _mm_mul_ps(fractions, _mm_sub_ps(y1, y0)));
+		_mm_storeu_ps(output + frame, _mm_add_ps(_mm_loadu_ps(output + frame), result));
+	}
+#endif
+	for (; frame < frameCount; frame++)
+	{
+		float position = first + (step * frame);
+		int whole = (int)position;
+		float fraction = position - whole;
+		float y0 = source[whole];
+		float y1 = source[whole + 1];
+		output[frame] += y0 + (fraction * (y1 - y0));
+	}
+}
+
+void Interpolator::Hermite(const float* source, float first, float step, float* output, UINT32 frameCount)
+{
+	UINT32 frame = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	const __m128 ramp = _mm_set_ps(3, 2, 1, 0);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 oneAndHalf = _mm_set1_ps(1.5f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 twoAndHalf = _mm_set1_ps(2.5f);
+	for (; frame + 4 <= frameCount; frame += 4)
+	{
+		__m128 positions = _mm_add_ps(_mm_set1_ps(first), _mm_mul_ps(_mm_set1_ps(step), _mm_add_ps(_mm_set1_ps((float)frame), ramp)));
+		__m128i wholes = _mm_cvttps_epi32(positions);
+		__m128 t = _mm_sub_ps(positions, _mm_cvtepi32_ps(wholes));
+
+		// The frame before each position and the three from it, as rows, then transposed to columns.
+		int whole[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(whole), wholes);
+		__m128 y0 = _mm_loadu_ps(source + whole[0] - 1);
+		__m128 y1 = _mm_loadu_ps(source + whole[1] - 1);
+		__m128 y2 = _mm_loadu_ps(source + whole[2] - 1);
+		__m128 y3 = _mm_loadu_ps(source + whole[3] - 1);
+		_MM_TRANSPOSE4_PS(y0, y1, y2, y3);
+
+		__m128 c1 = _mm_mul_ps(half, _mm_sub_ps(y2, y0));
+		__m128 c2 = _mm_sub_ps(_mm_add_ps(y0, _mm_mul_ps(two, y2)), _mm_add_ps(_mm_mul_ps(twoAndHalf, y1), _mm_mul_ps(half, y3)));
+		__m128 c3 = _mm_add_ps(_mm_mul_ps(half, _mm_sub_ps(y3, y0)), _mm_mul_ps(oneAndHalf, _mm_sub_ps(y1, y2)));
+		__m128 result = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c3, t), c2), t), c1), t), y1);
+		_mm_storeu_ps(output + frame, _mm_add_ps(_mm_loadu_ps(output + frame), result));
+	}
+#endif
+	for (; frame < frameCount; frame++)
+	{
+		float position = first + (step * frame);
+		int whole = (int)position;
+		float t = position - whole;
+		float y0 = source[whole - 1], y1 = source[whole], y2 = source[whole + 1], y3 = source[whole + 2];
+
+		// As DriftResampler.
+		float c1 = 0.5f * (y2 - y0);
+		float c2 = y0 - 2.5f * y1 + 2.0f * y2 - 0.5f * y3;
+		float c3 = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+		output[frame] += ((c3 * t + c2) * t + c1) * t + y1;
+	}
+}
+
+void Interpolator::Sinc(const float* source, float first, float step, float* output, UINT32 frameCount)
+{
+	const SincTable& table = SelectSincTable(step);
+	const UINT32 taps = table.Taps;
+	const int framesBefore = (int)(taps / 2) - 1;
+
+	UINT32 frame = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	for (; frame + 4 <= frameCount; frame += 4)
+	{
+		// Each frame's taps, four to a vector, summed into a vector per frame.
+		__m128 sums[4];
+		for (UINT32 lane = 0; lane < 4; lane++)
+		{
+			float position = first + (step * (frame + lane));
+			int whole = (int)position;
+			float phasePosition = (position - whole) * INTERPOLATOR_SINC_PHASES;
+			int phase = (int)phasePosition;
+			__m128 between = _mm_set1_ps(phasePosition - phase);
+
+			const float* weights = &table.Weights[phase * taps];
+			const float* deltas = &table.Deltas[phase * taps];
+			const float* samples = source + whole - framesBefore;
+			__m128 sum = _mm_setzero_ps();
+			for (UINT32 tap = 0; tap < taps; tap += 4)
+			{
+				__m128 weight = _mm_add_ps(_mm_loadu_ps(weights + tap), _mm_mul_ps(between, _mm_loadu_ps(deltas + tap)));
+				sum = _mm_add_ps(sum, _mm_mul_ps(weight, _mm_loadu_ps(samples + tap)));
+			}
+			sums[lane] = sum;
+		}
+
+		// Transposed, the four sums' lanes line up by frame, so adding the rows finishes every frame at once.
+		_MM_TRANSPOSE4_PS(sums[0], sums[1], sums[2], sums[3]);
+		__m128 result = _mm_add_ps(_mm_add_ps(sums[0], sums[1]), _mm_add_ps(sums[2], sums[3]));
+		_mm_storeu_ps(output + frame, _mm_add_ps(_mm_loadu_ps(output + frame), result));
+	}
+#endif
+	for (; frame < frameCount; frame++)
+	{
+		float position = first + (step * frame);
+		int whole = (int)position;
+		float phasePosition = (position - whole) * INTERPOLATOR_SINC_PHASES;
+		int phase = (int)phasePosition;
+		float between = phasePosition - phase;
+
+		const float* weights = &table.Weights[phase * taps];
+		const float* deltas = &table.Deltas[phase * taps];
+		const float* samples = source + whole - framesBefore;
+		float sum = 0;
+		for (UINT32 tap = 0; tap < taps; tap++)
+		{
+			sum += (weights[tap] + (between * deltas[tap])) * samples[tap];
+		}
+		output[frame] += sum;
+	}
+}
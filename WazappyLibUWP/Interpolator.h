@@ -0,0 +1,51 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "WazappyDllInterface.h"
+
+// Taps of the windowed sinc kernel at rates up to 1: it reads half of them less one behind each position, and
+// half ahead.
+#define INTERPOLATOR_SINC_TAPS 16
+
+// Fractional positions the sinc kernel is tabulated at; weights between them are interpolated linearly.
+#define INTERPOLATOR_SINC_PHASES 256
+
+// The sinc kernel's cutoff at rates up to 1, as a fraction of the Nyquist frequency.
+#define INTERPOLATOR_SINC_CUTOFF 0.9
+
+// Above a rate of 1 the sinc kernel is stretched, its cutoff divided and its taps multiplied by the least of
+// 1.25, 1.5, 2, 3 and this which is at least the rate, so nothing above the output's Nyquist frequency gets
+// through to alias (between those rates, the cutoff is up to a third lower than it need be).  Rates above this
+// use this.
+#define INTERPOLATOR_SINC_MAX_STRETCH 4
+
+// Frames any kernel may read behind the whole part of a position, and ahead of it (the linear kernel loads four
+// frames at a time, so reads further ahead than it uses).
+#define INTERPOLATOR_FRAMES_BEFORE ((INTERPOLATOR_SINC_TAPS * INTERPOLATOR_SINC_MAX_STRETCH / 2) - 1)
+#define INTERPOLATOR_FRAMES_AFTER (INTERPOLATOR_SINC_TAPS * INTERPOLATOR_SINC_MAX_STRETCH / 2)
+
+namespace Wazappy
+{
+	// Reads one channel of planar float audio at evenly spaced fractional positions, for voices which play back at
+	// rates other than 1.  Nothing is gathered: linear and Hermite interpolation work on four output frames at
+	// once, loading the frames around each position as one vector and transposing the four, so each vector holds
+	// one tap for all four frames; the sinc kernel works along its taps instead, four to a vector, with weights
+	// from a polyphase table for the rate, and transposes the four frames' sums together at the end.
+	class Interpolator
+	{
+	public:
+		// Add frameCount frames into output, the frame'th interpolated from source at position
+		// first + step * frame, where position 0 is source[0].  step may be negative or 0.  Every position must be
+		// at least INTERPOLATOR_FRAMES_BEFORE, and source must hold INTERPOLATOR_FRAMES_AFTER frames beyond the
+		// whole part of every position.  Safe on the audio thread.
+		static void Interpolate(InterpolationQuality quality, const float* source, float first, float step, float* output, UINT32 frameCount);
+
+	private:
+		static void Linear(const float* source, float first, float step, float* output, UINT32 frameCount);
+		static void Hermite(const float* source, float first, float step, float* output, UINT32 frameCount);
+		static void Sinc(const float* source, float first, float step, float* output, UINT32 frameCount);
+	};
+}
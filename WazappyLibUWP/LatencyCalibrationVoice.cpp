@@ -0,0 +1,222 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "LatencyCalibrationVoice.h"
+#include "Fft.h"
+
+using namespace Wazappy;
+
+LatencyCalibrationVoice::LatencyCalibrationVoice(
+	VoiceId voiceId,
+	UINT32 renderSampleRate,
+	UINT32 captureChannelCount,
+	UINT32 captureSampleRate,
+	const UINT64* renderWritePosition,
+	LPCWSTR captureDeviceId) :
+	CaptureSinkVoice(voiceId),
+	m_RenderSampleRate(renderSampleRate),
+	m_CaptureChannelCount(captureChannelCount),
+	m_CaptureSampleRate(captureSampleRate),
+	m_RenderWritePosition(renderWritePosition),
+	m_CaptureDeviceId(captureDeviceId),
+	m_RenderedFrames(0),
+	m_EmitFrame(0),
+	m_HasStarted(false),
+	m_RecordedFrames(0),
+	m_RecordingStartQpc(0),
+	m_CaptureRateRatio(1.0),
+	m_IsCaptureComplete(false)
+{
+	Contract::Requires(renderWritePosition != nullptr, L"Render write position must be given");
+
+	m_HighHz = min(LATENCY_CALIBRATION_HIGH_HZ, 0.45 * min(renderSampleRate, captureSampleRate));
+	GenerateChirp(renderSampleRate, &m_Chirp);
+	m_Recording.assign((UINT64)captureSampleRate * (LATENCY_CALIBRATION_SIGNAL_MS + LATENCY_CALIBRATION_MAX_ROUND_TRIP_MS) / 1000, 0.0f);
+}
+
+void LatencyCalibrationVoice::GenerateChirp(UINT32 sampleRate, std::vector<float>* signal) const
+{
+	// Defined in continuous time, so the copy played at the render rate and the copy searched for at the
+	// capture rate are the same sound.
+	UINT32 frameCount = (UINT32)((UINT64)sampleRate * LATENCY_CALIBRATION_SIGNAL_MS / 1000);
+	UINT32 fadeFrames = sampleRate * LATENCY_CALIBRATION_FADE_MS / 1000;
+	double duration = LATENCY_CALIBRATION_SIGNAL_MS / 1000.0;
+	double sweepRate = (m_HighHz - LATENCY_CALIBRATION_LOW_HZ) / duration;
+
+	signal->resize(frameCount);
+	for (UINT32 i = 0; i < frameCount; i++)
+	{
+		double t = (double)i / sampleRate;
+		double phase = 2.0 * M_PI * (LATENCY_CALIBRATION_LOW_HZ * t + 0.5 * sweepRate * t * t);
+
+		double gain = 1.0;
+		UINT32 fromEdge = min(i, frameCount - 1 - i);
+		if (fromEdge < fadeFrames)
+		{
+			gain = 0.5 - 0.5 * cos(M_PI * fromEdge / fadeFrames);
+		}
+
+		(*signal)[i] = (float)(LATENCY_CALIBRATION_LEVEL * gain * sin(phase));
+	}
+}
+
+UINT32 LatencyCalibrationVoice::RenderVoice(const PlanarView& mix, UINT32 frameCount)
+{
+	if (m_IsCaptureComplete)
+	{
+		return 0;
+	}
+
+	if (!m_HasStarted)
+	{
+		m_EmitFrame = *m_RenderWritePosition;
+		m_HasStarted.store(true, std::memory_order_release);
+	}
+
+	// Play the chirp on every channel, then hold the voice (silently) until the recording is done, so the
+	// capture device keeps feeding it.
+	UINT64 chirpFrames = m_Chirp.size();
+	if (m_RenderedFrames >= chirpFrames)
+	{
+		MarkOutputSilent();
+	}
+	UINT32 chirpLeft = (m_RenderedFrames < chirpFrames) ? (UINT32)min((UINT64)frameCount, chirpFrames - m_RenderedFrames) : 0;
+	const float* chirp = m_Chirp.data() + min(m_RenderedFrames, chirpFrames);
+	for (UINT32 c = 0; c < mix.ChannelCount; c++)
+	{
+		float* destination = mix.Channel(c);
+		for (UINT32 i = 0; i < chirpLeft; i++)
+		{
+			destination[i] += chirp[i];
+		}
+	}
+	m_RenderedFrames += frameCount;
+
+	// Give up if the capture device is not running.
+	UINT64 timeoutFrames = (UINT64)m_RenderSampleRate *
+		(LATENCY_CALIBRATION_SIGNAL_MS + LATENCY_CALIBRATION_MAX_ROUND_TRIP_MS + LATENCY_CALIBRATION_TIMEOUT_MS) / 1000;
+	return (m_RenderedFrames < timeoutFrames) ? frameCount : 0;
+}
+
+void LatencyCalibrationVoice::WriteCapturedFrames(const PlanarView& frames, UINT32 frameCount, UINT64 qpcPosition, double captureRateRatio)
+{
+	// Nothing captured before the chirp starts can contain it.
+	if (m_IsCaptureComplete || !m_HasStarted.load(std::memory_order_acquire))
+	{
+		return;
+	}
+
+	if (m_RecordedFrames == 0)
+	{
+		m_RecordingStartQpc = qpcPosition;
+		m_CaptureRateRatio = captureRateRatio;
+	}
+
+	UINT32 count = min(frameCount, (UINT32)m_Recording.size() - m_RecordedFrames);
+	float scale = 1.0f / m_CaptureChannelCount;
+	float* recording = m_Recording.data() + m_RecordedFrames;
+	ZeroMemory(recording, count * sizeof(float));
+	for (UINT32 c = 0; c < m_CaptureChannelCount; c++)
+	{
+		const float* source = frames.Channel(c);
+		for (UINT32 i = 0; i < count; i++)
+		{
+			recording[i] += source[i];
+		}
+	}
+	for (UINT32 i = 0; i < count; i++)
+	{
+		recording[i] *= scale;
+	}
+	m_RecordedFrames += count;
+
+	if (m_RecordedFrames == m_Recording.size())
+	{
+		m_IsCaptureComplete.store(true, std::memory_order_release);
+	}
+}
+
+HRESULT LatencyCalibrationVoice::Analyze(const DeviceClock& renderClock, REFERENCE_TIME* roundTrip, float* peakRatio)
+{
+	Contract::Requires(IsCaptureComplete(), L"Recording must be complete");
+
+	std::vector<float> reference;
+	GenerateChirp(m_CaptureSampleRate, &reference);
+
+	// Cross correlate by multiplying the recording's spectrum by the conjugate of the chirp's; the result at
+	// lag k is how well the chirp matches the recording starting at frame k.
+	UINT32 recordingFrames = (UINT32)m_Recording.size();
+	UINT32 referenceFrames = (UINT32)reference.size();
+	Fft transform(Fft::RoundUpSize(recordingFrames + referenceFrames));
+
+	std::vector<std::complex<float>> recordingSpectrum(transform.GetSize());
+	std::vector<std::complex<float>> referenceSpectrum(transform.GetSize());
+	for (UINT32 i = 0; i < recordingFrames; i++)
+	{
+		recordingSpectrum[i] = m_Recording[i];
+	}
+	for (UINT32 i = 0; i < referenceFrames; i++)
+	{
+		referenceSpectrum[i] = reference[i];
+	}
+
+	transform.Forward(recordingSpectrum.data());
+	transform.Forward(referenceSpectrum.data());
+	for (UINT32 i = 0; i < transform.GetSize(); i++)
+	{
+		recordingSpectrum[i] *= std::conj(referenceSpectrum[i]);
+	}
+	transform.Inverse(recordingSpectrum.data());
+
+	// Only lags where the whole chirp fits in the recording are meaningful.
+	UINT32 lagCount = recordingFrames - referenceFrames + 1;
+	UINT32 peakLag = 0;
+	float peak = 0.0f;
+	double sumSquares = 0.0;
+	for (UINT32 lag = 0; lag < lagCount; lag++)
+	{
+		float value = std::abs(recordingSpectrum[lag].real());
+		sumSquares += (double)value * value;
+		if (value > peak)
+		{
+			peak = value;
+			peakLag = lag;
+		}
+	}
+
+	float rms = (float)sqrt(sumSquares / lagCount);
+	*peakRatio = (rms > 0.0f) ? peak / rms : 0.0f;
+	if (*peakRatio < LATENCY_CALIBRATION_MIN_PEAK_RATIO)
+	{
+		return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+	}
+
+	// Refine the peak to a fraction of a frame by fitting a parabola through it and its neighbours.
+	double lag = peakLag;
+	if (peakLag > 0 && peakLag + 1 < lagCount)
+	{
+		double before = std::abs(recordingSpectrum[peakLag - 1].real());
+		double after = std::abs(recordingSpectrum[peakLag + 1].real());
+		double curvature = before - 2.0 * peak + after;
+		if (curvature < 0.0)
+		{
+			lag += 0.5 * (before - after) / curvature;
+		}
+	}
+
+	double emitQpc;
+	if (!renderClock.QpcAtFrame((double)m_EmitFrame, &emitQpc))
+	{
+		return E_PENDING;
+	}
+
+	double arrivalQpc = m_RecordingStartQpc + lag * 10000000.0 / (m_CaptureSampleRate * m_CaptureRateRatio);
+	*roundTrip = (REFERENCE_TIME)floor(arrivalQpc - emitQpc + 0.5);
+	return S_OK;
+}
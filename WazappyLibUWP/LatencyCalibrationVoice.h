@@ -0,0 +1,102 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "CaptureSinkVoice.h"
+#include "DeviceClock.h"
+
+// Length of the test chirp.
+#define LATENCY_CALIBRATION_SIGNAL_MS 250
+
+// Longest round trip the calibration can measure; the capture window is the chirp plus this.
+#define LATENCY_CALIBRATION_MAX_ROUND_TRIP_MS 500
+
+// How long past the end of the capture window to wait for the capture device before giving up.
+#define LATENCY_CALIBRATION_TIMEOUT_MS 2000
+
+// Chirp sweep range; the top is also held below 45% of the lower of the two sample rates.
+#define LATENCY_CALIBRATION_LOW_HZ 100.0
+#define LATENCY_CALIBRATION_HIGH_HZ 16000.0
+
+// Chirp amplitude, and the raised-cosine fade at each end which keeps its edges from clicking.
+#define LATENCY_CALIBRATION_LEVEL 0.5f
+#define LATENCY_CALIBRATION_FADE_MS 5
+
+// Least ratio of the correlation peak to the correlation's RMS level that counts as finding the chirp.
+#define LATENCY_CALIBRATION_MIN_PEAK_RATIO 10.0f
+
+namespace Wazappy
+{
+	// Voice which measures the real round trip latency from a render device to a capture device: it plays a
+	// linear chirp, records the capture device's input, and finds the chirp in the recording by FFT cross
+	// correlation.  The round trip is the time from the render device's clock reaching the chirp's first frame
+	// to the capture device's clock recording it, so it covers both stream latencies plus whatever the
+	// drivers, converters and the acoustic (or cable) path add.
+	// The whole measurement takes LATENCY_CALIBRATION_SIGNAL_MS + LATENCY_CALIBRATION_MAX_ROUND_TRIP_MS of audio.
+	class LatencyCalibrationVoice : public CaptureSinkVoice
+	{
+	public:
+		// renderWritePosition is the render device's count of frames written to its stream, as of the period
+		// being rendered; it must outlive the voice.  captureDeviceId names the capture endpoint for the result.
+		LatencyCalibrationVoice(
+			VoiceId voiceId,
+			UINT32 renderSampleRate,
+			UINT32 captureChannelCount,
+			UINT32 captureSampleRate,
+			const UINT64* renderWritePosition,
+			LPCWSTR captureDeviceId);
+
+		virtual UINT32 RenderVoice(const PlanarView& mix, UINT32 frameCount);
+
+		virtual UINT32 GetCaptureChannelCount() const { return m_CaptureChannelCount; }
+
+		virtual void WriteCapturedFrames(const PlanarView& frames, UINT32 frameCount, UINT64 qpcPosition, double captureRateRatio);
+
+		const std::wstring& GetCaptureDeviceId() const { return m_CaptureDeviceId; }
+
+		// True once the capture window is full.  Any thread.
+		bool IsCaptureComplete() const { return m_IsCaptureComplete; }
+
+		// Find the chirp in the recording and work out the round trip, in 100ns units.  Call on a client thread
+		// once IsCaptureComplete.  Fails with HRESULT_FROM_WIN32(ERROR_NOT_FOUND) if the chirp cannot be told
+		// apart from the noise (e.g. the input does not hear the output), or E_PENDING if the render clock has
+		// not been observed yet.
+		HRESULT Analyze(const DeviceClock& renderClock, REFERENCE_TIME* roundTrip, float* peakRatio);
+
+	protected:
+		virtual ~LatencyCalibrationVoice() {}
+
+	private:
+		// Fill signal with the chirp at the given sample rate.
+		void GenerateChirp(UINT32 sampleRate, std::vector<float>* signal) const;
+
+	private:
+		const UINT32 m_RenderSampleRate;
+		const UINT32 m_CaptureChannelCount;
+		const UINT32 m_CaptureSampleRate;
+		const UINT64* m_RenderWritePosition;
+		const std::wstring m_CaptureDeviceId;
+
+		double m_HighHz;
+
+		// The chirp at the render rate, to play.
+		std::vector<float> m_Chirp;
+
+		// Render audio thread state; m_EmitFrame is published (with m_HasStarted) before recording starts.
+		UINT64 m_RenderedFrames;
+		UINT64 m_EmitFrame;
+		std::atomic<bool> m_HasStarted;
+
+		// Mono recording, filled by the capture audio thread until m_IsCaptureComplete.
+		std::vector<float> m_Recording;
+		UINT32 m_RecordedFrames;
+		UINT64 m_RecordingStartQpc;
+		double m_CaptureRateRatio;
+		std::atomic<bool> m_IsCaptureComplete;
+	};
+}
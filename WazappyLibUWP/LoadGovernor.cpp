@@ -0,0 +1,90 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include "LoadGovernor.h"
+
+using namespace Wazappy;
+
+LoadGovernor::LoadGovernor() :
+	m_IsEnabled(true),
+	m_SmoothedLoad(0.0),
+	m_Level(ShedLevel_None),
+	m_HoldPeriods(0),
+	m_QuietPeriods(0),
+	m_PublishedLoad(0.0f),
+	m_PeakLoad(0.0f),
+	m_PublishedLevel(ShedLevel_None),
+	m_ShedCount(0),
+	m_RestoreCount(0),
+	m_OverloadPeriods(0),
+	m_ShedPeriods(0)
+{
+}
+
+ShedLevel LoadGovernor::Update(double load)
+{
+	m_SmoothedLoad += ((load > m_SmoothedLoad) ? LOAD_GOVERNOR_ATTACK : LOAD_GOVERNOR_RELEASE) * (load - m_SmoothedLoad);
+
+	m_PublishedLoad.store((float)m_SmoothedLoad, std::memory_order_relaxed);
+	if (load > m_PeakLoad.load(std::memory_order_relaxed))
+	{
+		m_PeakLoad.store((float)load, std::memory_order_relaxed);
+	}
+	if (load > 1.0)
+	{
+		m_OverloadPeriods.store(m_OverloadPeriods.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	if (!m_IsEnabled)
+	{
+		m_Level = ShedLevel_None;
+		m_HoldPeriods = 0;
+		m_QuietPeriods = 0;
+	}
+	else if (load >= LOAD_GOVERNOR_PANIC_THRESHOLD || m_SmoothedLoad >= LOAD_GOVERNOR_SHED_THRESHOLD)
+	{
+		m_QuietPeriods = 0;
+		if (m_HoldPeriods > 0)
+		{
+			m_HoldPeriods--;
+		}
+		else if (m_Level < ShedLevel_QuarterVoices)
+		{
+			m_Level = (ShedLevel)(m_Level + 1);
+			m_HoldPeriods = LOAD_GOVERNOR_SHED_HOLD_PERIODS;
+			m_ShedCount.store(m_ShedCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+	}
+	else
+	{
+		m_HoldPeriods = 0;
+		m_QuietPeriods = (m_SmoothedLoad < LOAD_GOVERNOR_RESTORE_THRESHOLD) ? m_QuietPeriods + 1 : 0;
+		if (m_QuietPeriods >= LOAD_GOVERNOR_RESTORE_PERIODS && m_Level > ShedLevel_None)
+		{
+			m_Level = (ShedLevel)(m_Level - 1);
+			m_QuietPeriods = 0;
+			m_RestoreCount.store(m_RestoreCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+	}
+
+	m_PublishedLevel.store(m_Level, std::memory_order_relaxed);
+	if (m_Level != ShedLevel_None)
+	{
+		m_ShedPeriods.store(m_ShedPeriods.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	return m_Level;
+}
+
+void LoadGovernor::GetStatistics(LOADSTATS* stats) const
+{
+	stats->Load = m_PublishedLoad;
+	stats->PeakLoad = m_PeakLoad;
+	stats->Level = m_PublishedLevel;
+	stats->ShedCount = m_ShedCount;
+	stats->RestoreCount = m_RestoreCount;
+	stats->OverloadPeriods = m_OverloadPeriods;
+	stats->ShedPeriods = m_ShedPeriods;
+}
@@ -0,0 +1,69 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+
+#include "WazappyDllInterface.h"
+
+// Smoothed load (processing time over period) at which the governor sheds another level.
+#define LOAD_GOVERNOR_SHED_THRESHOLD 0.7
+
+// Load of a single period at which the governor sheds at once, without waiting for the smoothed load to rise.
+#define LOAD_GOVERNOR_PANIC_THRESHOLD 0.9
+
+// Smoothed load below which the governor starts counting towards restoring a level.
+#define LOAD_GOVERNOR_RESTORE_THRESHOLD 0.4
+
+// Weights of each period's load in the smoothed load, when it is rising and falling.  Rising fast means a
+// building overload is caught before the deadline; falling slowly means a lull is not mistaken for recovery.
+#define LOAD_GOVERNOR_ATTACK 0.5
+#define LOAD_GOVERNOR_RELEASE 0.02
+
+// Periods after shedding a level before the next may be shed, so each step has time to take effect.
+#define LOAD_GOVERNOR_SHED_HOLD_PERIODS 4
+
+// Periods the smoothed load must stay below the restore threshold before a level is restored.
+#define LOAD_GOVERNOR_RESTORE_PERIODS 200
+
+namespace Wazappy
+{
+	// Decides, from how long each audio callback takes against its deadline, how much work the next one should
+	// shed (see ShedLevel).  The gap between the shed and restore thresholds, together with the long quiet
+	// stretch restoring takes, keeps it from oscillating between levels as shedding brings the load down.
+	class LoadGovernor
+	{
+	public:
+		LoadGovernor();
+
+		// With the governor disabled the level stays at ShedLevel_None, though load is still measured.  Any thread.
+		void SetEnabled(bool isEnabled) { m_IsEnabled = isEnabled; }
+
+		// Note one period's processing time as a fraction of the period, and return the level for the next.
+		// Audio thread only.
+		ShedLevel Update(double load);
+
+		// Any thread.
+		void GetStatistics(LOADSTATS* stats) const;
+
+	private:
+		std::atomic<bool> m_IsEnabled;
+
+		// Audio thread state.
+		double m_SmoothedLoad;
+		ShedLevel m_Level;
+		UINT32 m_HoldPeriods;
+		UINT32 m_QuietPeriods;
+
+		// Written on the audio thread, read by GetStatistics.
+		std::atomic<float> m_PublishedLoad;
+		std::atomic<float> m_PeakLoad;
+		std::atomic<ShedLevel> m_PublishedLevel;
+		std::atomic<UINT32> m_ShedCount;
+		std::atomic<UINT32> m_RestoreCount;
+		std::atomic<UINT64> m_OverloadPeriods;
+		std::atomic<UINT64> m_ShedPeriods;
+	};
+}
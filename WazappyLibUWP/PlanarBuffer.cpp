@@ -0,0 +1,162 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#include "Contract.h"
+#include "PlanarBuffer.h"
+
+using namespace Wazappy;
+
+// 16-bit input uses the same scale as Media Foundation's conversion, so 16-bit sources round-trip exactly; output
+// scales full scale to the largest positive sample, so it never wraps.
+#define PLANAR_PCM16_INPUT_SCALE (1.0f / 32768.0f)
+#define PLANAR_PCM16_OUTPUT_SCALE 32767.0f
+
+void PlanarView::Zero(UINT32 frameCount) const
+{
+	for (UINT32 channel = 0; channel < ChannelCount; channel++)
+	{
+		ZeroMemory(Channel(channel), frameCount * sizeof(float));
+	}
+}
+
+PlanarBuffer::PlanarBuffer() :
+	m_MaxFrameCount(0)
+{
+}
+
+PlanarBuffer::~PlanarBuffer()
+{
+	_aligned_free(m_View.Data);
+}
+
+void PlanarBuffer::Allocate(UINT32 channelCount, UINT32 maxFrameCount)
+{
+	_aligned_free(m_View.Data);
+	m_View = PlanarView();
+	m_MaxFrameCount = 0;
+
+	// Always leave at least one aligned vector per channel, so an empty buffer still has valid channel pointers.
+	UINT32 stride = (max(maxFrameCount, 1u) + PLANAR_ALIGNMENT_FLOATS - 1) & ~(UINT32)(PLANAR_ALIGNMENT_FLOATS - 1);
+	size_t bytes = (size_t)stride * max(channelCount, 1u) * sizeof(float);
+	float* data = reinterpret_cast<float*>(_aligned_malloc(bytes, PLANAR_ALIGNMENT));
+	if (data == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	ZeroMemory(data, bytes);
+
+	m_View = PlanarView(data, channelCount, stride);
+	m_MaxFrameCount = maxFrameCount;
+}
+
+//
+//  Deinterleave()
+//
+//  Split interleaved float frames into the channels of a planar view
+//
+void Wazappy::Deinterleave(const float* source, UINT32 frameCount, const PlanarView& destination)
+{
+	const UINT32 channelCount = destination.ChannelCount;
+	UINT32 frame = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	if (channelCount == 2)
+	{
+		float* left = destination.Channel(0);
+		float* right = destination.Channel(1);
+		for (; frame + 4 <= frameCount; frame += 4)
+		{
+			__m128 first = _mm_loadu_ps(&source[frame * 2]);
+			__m128 second = _mm_loadu_ps(&source[(frame * 2) + 4]);
+			_mm_storeu_ps(&left[frame], _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(&right[frame], _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+	}
+#endif
+
+	for (UINT32 channel = 0; channel < channelCount; channel++)
+	{
+		float* out = destination.Channel(channel);
+		for (UINT32 i = frame; i < frameCount; i++)
+		{
+			out[i] = source[(i * channelCount) + channel];
+		}
+	}
+}
+
+//
+//  Deinterleave()
+//
+//  Split interleaved 16-bit frames into the channels of a planar view, converting to float
+//
+void Wazappy::Deinterleave(const INT16* source, UINT32 frameCount, const PlanarView& destination)
+{
+	const UINT32 channelCount = destination.ChannelCount;
+	for (UINT32 channel = 0; channel < channelCount; channel++)
+	{
+		float* out = destination.Channel(channel);
+		for (UINT32 i = 0; i < frameCount; i++)
+		{
+			out[i] = source[(i * channelCount) + channel] * PLANAR_PCM16_INPUT_SCALE;
+		}
+	}
+}
+
+//
+//  Interleave()
+//
+//  Merge the channels of a planar view into interleaved float frames
+//
+void Wazappy::Interleave(const PlanarView& source, UINT32 frameCount, float* destination)
+{
+	const UINT32 channelCount = source.ChannelCount;
+	UINT32 frame = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	if (channelCount == 2)
+	{
+		const float* left = source.Channel(0);
+		const float* right = source.Channel(1);
+		for (; frame + 4 <= frameCount; frame += 4)
+		{
+			__m128 l = _mm_loadu_ps(&left[frame]);
+			__m128 r = _mm_loadu_ps(&right[frame]);
+			_mm_storeu_ps(&destination[frame * 2], _mm_unpacklo_ps(l, r));
+			_mm_storeu_ps(&destination[(frame * 2) + 4], _mm_unpackhi_ps(l, r));
+		}
+	}
+#endif
+
+	for (UINT32 channel = 0; channel < channelCount; channel++)
+	{
+		const float* in = source.Channel(channel);
+		for (UINT32 i = frame; i < frameCount; i++)
+		{
+			destination[(i * channelCount) + channel] = in[i];
+		}
+	}
+}
+
+//
+//  Interleave()
+//
+//  Merge the channels of a planar view into interleaved 16-bit frames, saturating
+//
+void Wazappy::Interleave(const PlanarView& source, UINT32 frameCount, INT16* destination)
+{
+	const UINT32 channelCount = source.ChannelCount;
+	for (UINT32 channel = 0; channel < channelCount; channel++)
+	{
+		const float* in = source.Channel(channel);
+		for (UINT32 i = 0; i < frameCount; i++)
+		{
+			float value = min(max(in[i], -1.0f), 1.0f);
+			destination[(i * channelCount) + channel] = (INT16)(value * PLANAR_PCM16_OUTPUT_SCALE);
+		}
+	}
+}
@@ -0,0 +1,73 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+// Byte alignment of every channel of a PlanarBuffer; enough for aligned AVX loads.
+#define PLANAR_ALIGNMENT 32
+
+// Floats per PLANAR_ALIGNMENT; channel strides are a multiple of this, so a loop over a channel may run its last
+// vector past the frame count without touching the next channel.
+#define PLANAR_ALIGNMENT_FLOATS (PLANAR_ALIGNMENT / sizeof(float))
+
+namespace Wazappy
+{
+	// A window onto planar (deinterleaved) 32-bit float audio: each channel's samples are contiguous, and
+	// channel c starts Stride floats after channel c - 1.  This is the format all processing inside the engine
+	// works in; audio is only interleaved, and converted to or from the device's sample type, at the devices.
+	// Views are cheap to copy and never own their storage.
+	struct PlanarView
+	{
+		PlanarView() : Data(nullptr), ChannelCount(0), Stride(0) {}
+		PlanarView(float* data, UINT32 channelCount, UINT32 stride) : Data(data), ChannelCount(channelCount), Stride(stride) {}
+
+		float* Channel(UINT32 channel) const { return Data + ((size_t)channel * Stride); }
+
+		// The same channels, starting frameOffset frames in.
+		PlanarView Offset(UINT32 frameOffset) const { return PlanarView(Data + frameOffset, ChannelCount, Stride); }
+
+		// Zero the first frameCount frames of every channel.
+		void Zero(UINT32 frameCount) const;
+
+		float* Data;
+		UINT32 ChannelCount;
+		UINT32 Stride;
+	};
+
+	// Owns aligned planar storage for up to a fixed number of frames.  Every channel starts on a
+	// PLANAR_ALIGNMENT boundary, and the stride is padded up to a multiple of PLANAR_ALIGNMENT_FLOATS.
+	class PlanarBuffer
+	{
+	public:
+		PlanarBuffer();
+		~PlanarBuffer();
+
+		// Allocate zeroed storage for maxFrameCount frames of channelCount channels, dropping any previous
+		// contents.  Never call this on an audio thread.
+		void Allocate(UINT32 channelCount, UINT32 maxFrameCount);
+
+		UINT32 GetChannelCount() const { return m_View.ChannelCount; }
+		UINT32 GetMaxFrameCount() const { return m_MaxFrameCount; }
+
+		const PlanarView& GetView() const { return m_View; }
+		float* Channel(UINT32 channel) const { return m_View.Channel(channel); }
+
+	private:
+		PlanarBuffer(const PlanarBuffer&) = delete;
+		PlanarBuffer& operator=(const PlanarBuffer&) = delete;
+
+	private:
+		PlanarView m_View;
+		UINT32 m_MaxFrameCount;
+	};
+
+	// Conversions at the device edge, between interleaved device buffers and planar views.  The planar side has
+	// the channel count; all of them are safe on an audio thread.
+	void Deinterleave(const float* source, UINT32 frameCount, const PlanarView& destination);
+	void Deinterleave(const INT16* source, UINT32 frameCount, const PlanarView& destination);
+	void Interleave(const PlanarView& source, UINT32 frameCount, float* destination);
+
+	// Interleave to 16-bit, saturating anything beyond full scale.
+	void Interleave(const PlanarView& source, UINT32 frameCount, INT16* destination);
+}
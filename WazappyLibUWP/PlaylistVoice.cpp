@@ -0,0 +1,251 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include "PlaylistVoice.h"
+#include "StreamPrefetcher.h"
+
+using namespace Wazappy;
+
+PlaylistVoice::PlaylistVoice(VoiceId voiceId, UINT32 channelCount, UINT32 sampleRate, UINT32 prefetchFrames, UINT32 crossfadeFrames, UINT32 maxFrameCount) :
+	AudioVoice(voiceId),
+	m_ChannelCount(channelCount),
+	m_SampleRate(sampleRate),
+	m_PrefetchFrames(prefetchFrames),
+	m_CrossfadeFrames(crossfadeFrames),
+	m_MaxFrameCount(maxFrameCount),
+	m_NextTrack(nullptr),
+	m_TracksRemaining(0),
+	m_Current(nullptr),
+	m_Incoming(nullptr),
+	m_FadeFrames(0),
+	m_FadePosition(0)
+{
+	Contract::Requires(prefetchFrames > crossfadeFrames, L"Prefetch window must hold the whole crossfade");
+
+	if (crossfadeFrames > 0)
+	{
+		m_FadeOutBuffer.Allocate(channelCount, maxFrameCount);
+		m_FadeInBuffer.Allocate(channelCount, maxFrameCount);
+	}
+}
+
+void PlaylistVoice::Reserve(UINT32 maxFrameCount)
+{
+	if (maxFrameCount <= m_MaxFrameCount)
+	{
+		return;
+	}
+
+	m_MaxFrameCount = maxFrameCount;
+	if (m_CrossfadeFrames > 0)
+	{
+		m_FadeOutBuffer.Allocate(m_ChannelCount, maxFrameCount);
+		m_FadeInBuffer.Allocate(m_ChannelCount, maxFrameCount);
+	}
+}
+
+void PlaylistVoice::EnqueueTrack(LPCWSTR url)
+{
+	{
+		std::lock_guard<std::mutex> guard(m_QueueMutex);
+		m_PendingUrls.push_back(url);
+		m_TracksRemaining++;
+	}
+
+	StreamPrefetcher::Wake();
+}
+
+ComPtr<StreamingVoice> PlaylistVoice::PrepareNextTrack()
+{
+	if (IsFinished() || IsStopRequested())
+	{
+		return nullptr;
+	}
+
+	for (size_t i = 0; i < m_Tracks.size();)
+	{
+		if (m_Tracks[i]->IsFinished())
+		{
+			m_Tracks.erase(m_Tracks.begin() + i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	// Only the prefetch thread publishes m_NextTrack, so once it is seen empty it stays empty until we fill it.
+	// Keep at most one track decoding ahead of the one playing.
+	if (m_NextTrack != nullptr || m_Tracks.size() >= 2)
+	{
+		return nullptr;
+	}
+
+	for (;;)
+	{
+		std::wstring url;
+		{
+			std::lock_guard<std::mutex> guard(m_QueueMutex);
+			if (m_PendingUrls.empty())
+			{
+				return nullptr;
+			}
+
+			url = m_PendingUrls.front();
+			m_PendingUrls.pop_front();
+		}
+
+		ComPtr<StreamingVoice> track = Make<StreamingVoice>(GetVoiceId(), m_ChannelCount, m_SampleRate, m_PrefetchFrames);
+		if (track != nullptr && SUCCEEDED(track->Open(url.c_str())))
+		{
+			m_Tracks.push_back(track);
+			m_NextTrack.store(track.Get(), std::memory_order_release);
+			return track;
+		}
+
+		// A track that won't open is skipped, as if it had played.
+		m_TracksRemaining--;
+	}
+}
+
+void PlaylistVoice::ReleaseTracks()
+{
+	for (auto& track : m_Tracks)
+	{
+		track->Stop();
+	}
+	m_Tracks.clear();
+}
+
+void PlaylistVoice::MarkFinished()
+{
+	AudioVoice::MarkFinished();
+	StreamPrefetcher::Wake();
+}
+
+void PlaylistVoice::FinishCurrentTrack()
+{
+	m_Current->MarkFinished();
+	m_Current = nullptr;
+	m_TracksRemaining--;
+
+	// Let the prefetcher release the track and open the one after next.
+	StreamPrefetcher::Wake();
+}
+
+UINT32 PlaylistVoice::RenderCrossfade(const PlanarView& mix, UINT32 frameCount)
+{
+	UINT32 framesToMix = min(frameCount, m_FadeFrames - m_FadePosition);
+
+	m_FadeOutBuffer.GetView().Zero(framesToMix);
+	m_FadeInBuffer.GetView().Zero(framesToMix);
+	m_Current->RenderVoice(m_FadeOutBuffer.GetView(), framesToMix);
+	m_Incoming->RenderVoice(m_FadeInBuffer.GetView(), framesToMix);
+
+	// Equal-power gains are cos and sin of an angle sweeping a quarter turn over the fade.  Rather than calling
+	// cos and sin per frame, rotate the (cos, sin) pair by one frame's step each time; every channel runs the
+	// same rotation from the same start.
+	double step = M_PI_2 / m_FadeFrames;
+	double angle = step * m_FadePosition;
+	float stepCos = (float)cos(step);
+	float stepSin = (float)sin(step);
+
+	for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+	{
+		const float* fadeOut = m_FadeOutBuffer.Channel(channel);
+		const float* fadeIn = m_FadeInBuffer.Channel(channel);
+		float* destination = mix.Channel(channel);
+		float outGain = (float)cos(angle);
+		float inGain = (float)sin(angle);
+		for (UINT32 frame = 0; frame < framesToMix; frame++)
+		{
+			destination[frame] += (fadeOut[frame] * outGain) + (fadeIn[frame] * inGain);
+
+			float nextOutGain = (outGain * stepCos) - (inGain * stepSin);
+			inGain = (inGain * stepCos) + (outGain * stepSin);
+			outGain = nextOutGain;
+		}
+	}
+
+	m_FadePosition += framesToMix;
+	if (m_FadePosition == m_FadeFrames)
+	{
+		FinishCurrentTrack();
+		m_Current = m_Incoming;
+		m_Incoming = nullptr;
+	}
+
+	return framesToMix;
+}
+
+UINT32 PlaylistVoice::RenderVoice(const PlanarView& mix, UINT32 frameCount)
+{
+	Contract::Requires(mix.ChannelCount == m_ChannelCount, L"Playlist must be decoded in the device's channel count");
+	Contract::Requires(frameCount <= m_MaxFrameCount, L"Period must fit the crossfade buffers");
+
+	UINT32 framesRendered = 0;
+	while (framesRendered < frameCount)
+	{
+		if (m_Current == nullptr)
+		{
+			m_Current = m_NextTrack.exchange(nullptr, std::memory_order_acquire);
+			if (m_Current == nullptr)
+			{
+				if (m_TracksRemaining == 0)
+				{
+					// Everything has played; let the mixer retire us.
+					return framesRendered;
+				}
+
+				// The next track is still being opened; the rest of this period is silence.
+				StreamPrefetcher::Wake();
+				return frameCount;
+			}
+
+			// Start decoding the track after this one.
+			StreamPrefetcher::Wake();
+		}
+
+		PlanarView destination = mix.Offset(framesRendered);
+		UINT32 framesLeft = frameCount - framesRendered;
+
+		// Once the current track's whole tail is buffered, play it up to the last m_CrossfadeFrames frames, then fade
+		// into the next one over exactly that many, so the fade doesn't depend on where the period boundaries fall.
+		// A tail already shorter than that (a short track) fades over what is left.
+		UINT32 framesBeforeFade = framesLeft;
+		if (m_Incoming == nullptr && m_CrossfadeFrames > 0 && m_Current->IsEndOfStream())
+		{
+			UINT32 tailFrames = m_Current->GetBufferedFrames();
+			if (tailFrames > m_CrossfadeFrames)
+			{
+				framesBeforeFade = min(framesLeft, tailFrames - m_CrossfadeFrames);
+			}
+			else if (tailFrames > 0)
+			{
+				m_Incoming = m_NextTrack.exchange(nullptr, std::memory_order_acquire);
+				m_FadeFrames = tailFrames;
+				m_FadePosition = 0;
+			}
+		}
+
+		if (m_Incoming != nullptr)
+		{
+			framesRendered += RenderCrossfade(destination, framesLeft);
+			continue;
+		}
+
+		UINT32 trackFrames = m_Current->RenderVoice(destination, framesBeforeFade);
+		framesRendered += trackFrames;
+		if (trackFrames < framesBeforeFade)
+		{
+			// Gapless: the next track picks up on the very next frame of this period.
+			FinishCurrentTrack();
+		}
+	}
+
+	return frameCount;
+}
@@ -0,0 +1,87 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "StreamingVoice.h"
+
+namespace Wazappy
+{
+	// Voice which plays a queue of files back to back, with no gap or with an equal-power crossfade.
+	// Each track is a StreamingVoice; the StreamPrefetcher opens and starts decoding track N+1 as soon as
+	// track N starts playing, so the audio thread only ever splices two already-buffered rings.
+	// The voice finishes once every queued track has played.
+	class PlaylistVoice : public AudioVoice
+	{
+	public:
+		// maxFrameCount is the largest period the device will ask for; prefetchFrames must cover the crossfade.
+		PlaylistVoice(VoiceId voiceId, UINT32 channelCount, UINT32 sampleRate, UINT32 prefetchFrames, UINT32 crossfadeFrames, UINT32 maxFrameCount);
+
+		// Append a track to the end of the queue.  Any thread but the audio thread.
+		void EnqueueTrack(LPCWSTR url);
+
+		virtual UINT32 RenderVoice(const PlanarView& mix, UINT32 frameCount);
+
+		// Grow the crossfade buffers.
+		virtual void Reserve(UINT32 maxFrameCount);
+
+		// Release tracks that have played, and if the next track slot is empty, open the next queued track and
+		// return it so the caller can start prefetching it.  Returns nullptr if there is nothing to open.
+		// Prefetch thread only.
+		ComPtr<StreamingVoice> PrepareNextTrack();
+
+		// Stop and release every open track, once the mixer has retired this voice.  Prefetch thread only.
+		void ReleaseTracks();
+
+		// Wakes the prefetcher so it releases the tracks as soon as the mixer has let go of them.
+		virtual void MarkFinished();
+
+	protected:
+		virtual ~PlaylistVoice() {}
+
+	private:
+		// Retire the current track and count it as played.  Audio thread only.
+		void FinishCurrentTrack();
+
+		// Mix the current track fading out with the incoming track fading in, for at most frameCount frames.
+		// Returns the frames mixed.  Audio thread only.
+		UINT32 RenderCrossfade(const PlanarView& mix, UINT32 frameCount);
+
+	private:
+		const UINT32 m_ChannelCount;
+		const UINT32 m_SampleRate;
+		const UINT32 m_PrefetchFrames;
+		const UINT32 m_CrossfadeFrames;
+		UINT32 m_MaxFrameCount;
+
+		// URLs not yet opened, guarded by m_QueueMutex.
+		std::mutex m_QueueMutex;
+		std::deque<std::wstring> m_PendingUrls;
+
+		// Tracks opened and not yet released; owns them, so the audio thread never drops the last reference.
+		// Prefetch thread only.
+		std::vector<ComPtr<StreamingVoice>> m_Tracks;
+
+		// Opened and prefetching track waiting to play; published by the prefetch thread, taken by the audio thread.
+		std::atomic<StreamingVoice*> m_NextTrack;
+
+		// Tracks queued and not yet played out (or failed to open).
+		std::atomic<UINT32> m_TracksRemaining;
+
+		// Audio thread state: the track playing, and during a crossfade, the one fading in.
+		StreamingVoice* m_Current;
+		StreamingVoice* m_Incoming;
+		UINT32 m_FadeFrames;
+		UINT32 m_FadePosition;
+
+		// Scratch space for the two sides of a crossfade, m_MaxFrameCount frames each.
+		PlanarBuffer m_FadeOutBuffer;
+		PlanarBuffer m_FadeInBuffer;
+	};
+}
@@ -0,0 +1,440 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#include "Contract.h"
+#include "SampleAsset.h"
+#include "SampleDecoder.h"
+
+using namespace Wazappy;
+
+// One ADPCM packet of one channel.  Sample n decodes to Base + Scale * (Deltas[0] + ... + Deltas[n]); the encoder
+// runs the same sum as it goes, so quantization error never accumulates across the packet.
+struct AdpcmPacket
+{
+	float Base;
+	float Scale;
+	INT8 Deltas[SAMPLE_ASSET_PACKET_FRAMES];
+};
+
+#define ADPCM_PACKETS_PER_BLOCK (SAMPLE_ASSET_BLOCK_FRAMES / SAMPLE_ASSET_PACKET_FRAMES)
+
+// Largest delta the encoder emits.  One short of the INT8 limit, so rounding after a full-scale step never clips.
+#define ADPCM_MAX_DELTA 126
+
+// PCM16 uses the same scale as Media Foundation's 16-bit to float conversion, so 16-bit sources round-trip exactly.
+#define PCM16_SCALE 32768.0f
+
+//
+//  EncodeAdpcmPacket()
+//
+//  Encode one channel of one packet from SAMPLE_ASSET_PACKET_FRAMES contiguous floats
+//
+static void EncodeAdpcmPacket(const float* samples, AdpcmPacket* packet)
+{
+	float base = samples[0];
+	float maxStep = 0;
+	for (UINT32 i = 1; i < SAMPLE_ASSET_PACKET_FRAMES; i++)
+	{
+		maxStep = max(maxStep, fabsf(samples[i] - samples[i - 1]));
+	}
+
+	packet->Base = base;
+	packet->Scale = maxStep / ADPCM_MAX_DELTA;
+	packet->Deltas[0] = 0;
+
+	int sum = 0;
+	for (UINT32 i = 1; i < SAMPLE_ASSET_PACKET_FRAMES; i++)
+	{
+		int delta = 0;
+		if (packet->Scale > 0)
+		{
+			// Quantize against what the decoder will actually have reconstructed, not the previous source sample.
+			int target = (int)lrintf((samples[i] - base) / packet->Scale);
+			delta = min(max(target - sum, -ADPCM_MAX_DELTA - 1), ADPCM_MAX_DELTA + 1);
+		}
+
+		packet->Deltas[i] = (INT8)delta;
+		sum += delta;
+	}
+}
+
+//
+//  DecodeAdpcmPacket()
+//
+//  Decode one channel of one packet into SAMPLE_ASSET_PACKET_FRAMES contiguous floats
+//
+static void DecodeAdpcmPacket(const AdpcmPacket* packet, float* samples)
+{
+#if defined(_M_IX86) || defined(_M_X64)
+	// Running sums four lanes at a time: two shift-and-adds give the prefix sum within a vector, and the last lane
+	// carries into the next vector.
+	__m128 base = _mm_set1_ps(packet->Base);
+	__m128 scale = _mm_set1_ps(packet->Scale);
+	__m128i carry = _mm_setzero_si128();
+
+	for (UINT32 i = 0; i < SAMPLE_ASSET_PACKET_FRAMES; i += 16)
+	{
+		// Sign-extend sixteen INT8s to four vectors of four INT32s.
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&packet->Deltas[i]));
+		__m128i low16 = _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8);
+		__m128i high16 = _mm_srai_epi16(_mm_unpackhi_epi8(bytes, bytes), 8);
+		__m128i deltas[4] =
+		{
+			_mm_srai_epi32(_mm_unpacklo_epi16(low16, low16), 16),
+			_mm_srai_epi32(_mm_unpackhi_epi16(low16, low16), 16),
+			_mm_srai_epi32(_mm_unpacklo_epi16(high16, high16), 16),
+			_mm_srai_epi32(_mm_unpackhi_epi16(high16, high16), 16)
+		};
+
+		for (UINT32 j = 0; j < 4; j++)
+		{
+			__m128i sums = _mm_add_epi32(deltas[j], _mm_slli_si128(deltas[j], 4));
+			sums = _mm_add_epi32(sums, _mm_slli_si128(sums, 8));
+			sums = _mm_add_epi32(sums, carry);
+			carry = _mm_shuffle_epi32(sums, _MM_SHUFFLE(3, 3, 3, 3));
+
+			_mm_storeu_ps(&samples[i + (j * 4)], _mm_add_ps(base, _mm_mul_ps(scale, _mm_cvtepi32_ps(sums))));
+		}
+	}
+#else
+	int sum = 0;
+	for (UINT32 i = 0; i < SAMPLE_ASSET_PACKET_FRAMES; i++)
+	{
+		sum += packet->Deltas[i];
+		samples[i] = packet->Base + (packet->Scale * (float)sum);
+	}
+#endif
+}
+
+//
+//  MixFloat()
+//
+//  Add part of a decoded packet into the mix
+//
+static void MixFloat(const float* source, UINT32 sampleCount, float* mixBuffer)
+{
+	UINT32 i = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	// Runs are a packet or less, too short for the compiler's own vectorized loop to pay off.
+	for (; i + 4 <= sampleCount; i += 4)
+	{
+		_mm_storeu_ps(&mixBuffer[i], _mm_add_ps(_mm_loadu_ps(&mixBuffer[i]), _mm_loadu_ps(&source[i])));
+	}
+#endif
+
+	for (; i < sampleCount; i++)
+	{
+		mixBuffer[i] += source[i];
+	}
+}
+
+//
+//  MixPcm16()
+//
+//  Convert one channel's 16-bit samples to float and add them into the mix
+//
+static void MixPcm16(const INT16* source, UINT32 sampleCount, float* mixBuffer)
+{
+	UINT32 i = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	__m128 scale = _mm_set1_ps(1.0f / PCM16_SCALE);
+	for (; i + 8 <= sampleCount; i += 8)
+	{
+		__m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&source[i]));
+		__m128 low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16));
+		__m128 high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16));
+
+		_mm_storeu_ps(&mixBuffer[i], _mm_add_ps(_mm_loadu_ps(&mixBuffer[i]), _mm_mul_ps(low, scale)));
+		_mm_storeu_ps(&mixBuffer[i + 4], _mm_add_ps(_mm_loadu_ps(&mixBuffer[i + 4]), _mm_mul_ps(high, scale)));
+	}
+#endif
+
+	for (; i < sampleCount; i++)
+	{
+		mixBuffer[i] += source[i] / PCM16_SCALE;
+	}
+}
+
+SampleAsset::SampleAsset(UINT32 channelCount, UINT32 sampleRate, SampleStorageFormat storageFormat) :
+	m_ChannelCount(channelCount),
+	m_SampleRate(sampleRate),
+	m_StorageFormat(storageFormat),
+	m_FrameCount(0),
+	m_BlockPeak(0.0f)
+{
+	Contract::Requires(channelCount > 0, L"Asset must have at least one channel");
+
+	if (storageFormat != SampleStorage_Float)
+	{
+		m_Staging.assign(SAMPLE_ASSET_BLOCK_FRAMES * channelCount, 0.0f);
+	}
+}
+
+SampleAsset::~SampleAsset()
+{
+	for (BYTE* block : m_Blocks)
+	{
+		_aligned_free(block);
+	}
+	m_Blocks.clear();
+}
+
+size_t SampleAsset::GetBlockBytes() const
+{
+	switch (m_StorageFormat)
+	{
+	case SampleStorage_Pcm16:
+		return SAMPLE_ASSET_BLOCK_FRAMES * m_ChannelCount * sizeof(INT16);
+	case SampleStorage_Adpcm8:
+		return ADPCM_PACKETS_PER_BLOCK * m_ChannelCount * sizeof(AdpcmPacket);
+	default:
+		return SAMPLE_ASSET_BLOCK_FRAMES * m_ChannelCount * sizeof(float);
+	}
+}
+
+UINT64 SampleAsset::GetByteSize() const
+{
+	return (UINT64)m_Blocks.size() * GetBlockBytes();
+}
+
+UINT64 SampleAsset::GetBytesSaved() const
+{
+	return ((UINT64)m_Blocks.size() * SAMPLE_ASSET_BLOCK_FRAMES * m_ChannelCount * sizeof(float)) - GetByteSize();
+}
+
+UINT32 SampleAsset::MixFrames(UINT64 position, UINT32 frameCount, const PlanarView& mix, bool* isSilent) const
+{
+	*isSilent = true;
+
+	UINT32 framesMixed = 0;
+	while (framesMixed < frameCount && position < m_FrameCount)
+	{
+		UINT64 blockIndex = position >> SAMPLE_ASSET_BLOCK_FRAMES_LOG2;
+		UINT32 offsetInBlock = (UINT32)(position & (SAMPLE_ASSET_BLOCK_FRAMES - 1));
+		UINT32 framesToMix = (UINT32)min((UINT64)min(frameCount - framesMixed, (UINT32)SAMPLE_ASSET_BLOCK_FRAMES - offsetInBlock), m_FrameCount - position);
+
+		if (m_BlockPeaks[(size_t)blockIndex] <= SAMPLE_ASSET_SILENCE_THRESHOLD)
+		{
+			framesMixed += framesToMix;
+			position += framesToMix;
+			continue;
+		}
+		*isSilent = false;
+
+		const BYTE* block = m_Blocks[(size_t)blockIndex];
+		for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+		{
+			float* destination = mix.Channel(channel) + framesMixed;
+			switch (m_StorageFormat)
+			{
+			case SampleStorage_Float:
+			{
+				const float* source = reinterpret_cast<const float*>(block) + (channel * SAMPLE_ASSET_BLOCK_FRAMES) + offsetInBlock;
+				for (UINT32 i = 0; i < framesToMix; i++)
+				{
+					destination[i] += source[i];
+				}
+				break;
+			}
+
+			case SampleStorage_Pcm16:
+				MixPcm16(reinterpret_cast<const INT16*>(block) + (channel * SAMPLE_ASSET_BLOCK_FRAMES) + offsetInBlock, framesToMix, destination);
+				break;
+
+			case SampleStorage_Adpcm8:
+			{
+				const AdpcmPacket* packets = reinterpret_cast<const AdpcmPacket*>(block) + (channel * ADPCM_PACKETS_PER_BLOCK);
+				float samples[SAMPLE_ASSET_PACKET_FRAMES];
+
+				UINT32 endInBlock = offsetInBlock + framesToMix;
+				for (UINT32 packetStart = offsetInBlock & ~(SAMPLE_ASSET_PACKET_FRAMES - 1); packetStart < endInBlock; packetStart += SAMPLE_ASSET_PACKET_FRAMES)
+				{
+					UINT32 first = max(offsetInBlock, packetStart);
+					UINT32 last = min(endInBlock, packetStart + SAMPLE_ASSET_PACKET_FRAMES);
+
+					DecodeAdpcmPacket(&packets[packetStart / SAMPLE_ASSET_PACKET_FRAMES], samples);
+					MixFloat(samples + (first - packetStart), last - first, destination + (first - offsetInBlock));
+				}
+				break;
+			}
+			}
+		}
+
+		framesMixed += framesToMix;
+		position += framesToMix;
+	}
+
+	return framesMixed;
+}
+
+HRESULT SampleAsset::EncodeStagingBlock()
+{
+	BYTE* block = reinterpret_cast<BYTE*>(_aligned_malloc(GetBlockBytes(), SAMPLE_ASSET_ALIGNMENT));
+	if (block == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	const float* staging = m_Staging.data();
+	if (m_StorageFormat == SampleStorage_Pcm16)
+	{
+		INT16* samples = reinterpret_cast<INT16*>(block);
+		for (size_t i = 0; i < m_Staging.size(); i++)
+		{
+			float scaled = staging[i] * PCM16_SCALE;
+			samples[i] = (INT16)lrintf(min(max(scaled, -PCM16_SCALE), PCM16_SCALE - 1));
+		}
+	}
+	else
+	{
+		AdpcmPacket* packets = reinterpret_cast<AdpcmPacket*>(block);
+		for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+		{
+			for (UINT32 packetIndex = 0; packetIndex < ADPCM_PACKETS_PER_BLOCK; packetIndex++)
+			{
+				UINT32 start = (channel * SAMPLE_ASSET_BLOCK_FRAMES) + (packetIndex * SAMPLE_ASSET_PACKET_FRAMES);
+				EncodeAdpcmPacket(staging + start, &packets[(channel * ADPCM_PACKETS_PER_BLOCK) + packetIndex]);
+			}
+		}
+	}
+
+	m_Blocks.push_back(block);
+
+	// Zero the staging block so the tail of the last block reads as silence.
+	std::fill(m_Staging.begin(), m_Staging.end(), 0.0f);
+	return S_OK;
+}
+
+HRESULT SampleAsset::AppendFrames(const float* data, UINT32 frameCount)
+{
+	while (frameCount > 0)
+	{
+		UINT32 offsetInBlock = (UINT32)(m_FrameCount & (SAMPLE_ASSET_BLOCK_FRAMES - 1));
+		float* target = m_Staging.data();
+
+		if (m_StorageFormat == SampleStorage_Float)
+		{
+			if (offsetInBlock == 0)
+			{
+				size_t blockBytes = GetBlockBytes();
+				BYTE* block = reinterpret_cast<BYTE*>(_aligned_malloc(blockBytes, SAMPLE_ASSET_ALIGNMENT));
+				if (block == nullptr)
+				{
+					return E_OUTOFMEMORY;
+				}
+
+				// Zero the block so the tail of the last block reads as silence.
+				ZeroMemory(block, blockBytes);
+				m_Blocks.push_back(block);
+			}
+
+			target = reinterpret_cast<float*>(m_Blocks.back());
+		}
+
+		UINT32 framesToCopy = min(frameCount, (UINT32)SAMPLE_ASSET_BLOCK_FRAMES - offsetInBlock);
+		Deinterleave(data, framesToCopy, PlanarView(target + offsetInBlock, m_ChannelCount, SAMPLE_ASSET_BLOCK_FRAMES));
+
+		for (UINT32 i = 0; i < framesToCopy * m_ChannelCount; i++)
+		{
+			m_BlockPeak = max(m_BlockPeak, fabsf(data[i]));
+		}
+
+		data += framesToCopy * m_ChannelCount;
+		frameCount -= framesToCopy;
+		m_FrameCount += framesToCopy;
+
+		if (offsetInBlock + framesToCopy == SAMPLE_ASSET_BLOCK_FRAMES)
+		{
+			if (m_StorageFormat != SampleStorage_Float)
+			{
+				HRESULT hr = EncodeStagingBlock();
+				if (FAILED(hr))
+				{
+					return hr;
+				}
+			}
+
+			m_BlockPeaks.push_back(m_BlockPeak);
+			m_BlockPeak = 0.0f;
+		}
+	}
+
+	return S_OK;
+}
+
+HRESULT SampleAsset::FinishDecoding()
+{
+	HRESULT hr = S_OK;
+	if ((m_FrameCount & (SAMPLE_ASSET_BLOCK_FRAMES - 1)) != 0)
+	{
+		if (m_StorageFormat != SampleStorage_Float)
+		{
+			hr = EncodeStagingBlock();
+		}
+
+		m_BlockPeaks.push_back(m_BlockPeak);
+	}
+
+	m_Staging.clear();
+	m_Staging.shrink_to_fit();
+	return hr;
+}
+
+//
+//  DecodeFromUrl()
+//
+//  Synchronously decode the first audio stream of the given URL into a new asset
+//
+HRESULT SampleAsset::DecodeFromUrl(LPCWSTR url, UINT32 channelCount, UINT32 sampleRate, SampleStorageFormat storageFormat, SeekIndex* seekIndex, ComPtr<SampleAsset>* asset)
+{
+	ComPtr<SampleAsset> newAsset = Make<SampleAsset>(channelCount, sampleRate, storageFormat);
+	if (newAsset == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	SampleDecoder decoder;
+	HRESULT hr = decoder.Open(url, channelCount, sampleRate, seekIndex);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	for (;;)
+	{
+		const float* frames = nullptr;
+		UINT32 frameCount = 0;
+
+		hr = decoder.ReadFrames(&frames, &frameCount);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+		else if (hr == S_FALSE)
+		{
+			break;
+		}
+
+		hr = newAsset->AppendFrames(frames, frameCount);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+	}
+
+	hr = newAsset->FinishDecoding();
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	*asset = newAsset;
+	return S_OK;
+}
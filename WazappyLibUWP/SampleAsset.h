@@ -0,0 +1,107 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <vector>
+
+#include "WazappyDllInterface.h"
+#include "SeekIndex.h"
+#include "PlanarBuffer.h"
+
+using namespace Microsoft::WRL;
+
+// Frames in each block of a decoded SampleAsset.  Power of two, so positions split with shifts and masks.
+#define SAMPLE_ASSET_BLOCK_FRAMES_LOG2 12
+#define SAMPLE_ASSET_BLOCK_FRAMES (1 << SAMPLE_ASSET_BLOCK_FRAMES_LOG2)
+
+// Byte alignment of each decoded block; enough for aligned AVX loads.
+#define SAMPLE_ASSET_ALIGNMENT 32
+
+// Frames in each independently decodable ADPCM packet.  Playback starting mid-packet decodes from the packet start,
+// so this bounds the wasted work per period; must be a multiple of 16 for the SIMD decoder.
+#define SAMPLE_ASSET_PACKET_FRAMES 64
+
+// Blocks whose samples all lie within this of zero (half a 16-bit step) are marked silent and never mixed.
+#define SAMPLE_ASSET_SILENCE_THRESHOLD (1.0f / 65536)
+
+namespace Wazappy
+{
+	// A decoded audio asset: immutable planar audio, held as a list of aligned fixed-size blocks, each holding every
+	// channel's samples for its frames one channel after another.
+	// Blocks are stored as 32-bit float, or in a compact format (see SampleStorageFormat) which is decoded on the fly
+	// as voices mix it; every block covers the same number of frames, so any position is randomly accessible.
+	// Assets are reference counted, so any number of voices can play the same asset while the SampleCache
+	// is free to evict it; the memory goes away when the last voice lets go.
+	class SampleAsset :
+		public RuntimeClass<RuntimeClassFlags<ClassicCom>, IUnknown>
+	{
+	public:
+		SampleAsset(UINT32 channelCount, UINT32 sampleRate, SampleStorageFormat storageFormat);
+
+		// Decode the whole audio stream at the given URL into a new asset, converted to the given format.
+		// Blocks on the decoder; never call this from an audio thread.  If a seek index is given, it is filled
+		// in along the way, so streaming voices on the same file can later seek it accurately.
+		static HRESULT DecodeFromUrl(LPCWSTR url, UINT32 channelCount, UINT32 sampleRate, SampleStorageFormat storageFormat, SeekIndex* seekIndex, ComPtr<SampleAsset>* asset);
+
+		UINT32 GetChannelCount() const { return m_ChannelCount; }
+		UINT32 GetSampleRate() const { return m_SampleRate; }
+		UINT64 GetFrameCount() const { return m_FrameCount; }
+		SampleStorageFormat GetStorageFormat() const { return m_StorageFormat; }
+
+		// Total bytes of block storage held by this asset.
+		UINT64 GetByteSize() const;
+
+		// Bytes this asset would take as float blocks, less what it actually takes.
+		UINT64 GetBytesSaved() const;
+
+		// Decode up to frameCount frames starting at the given position and add them into mix, which has the asset's
+		// channel count.  Returns the frames mixed; fewer than asked for at the end of the asset.
+		// Silent blocks are skipped rather than decoded; isSilent is set if every frame in range was silent.
+		// Safe on the audio thread: never allocates or locks.
+		UINT32 MixFrames(UINT64 position, UINT32 frameCount, const PlanarView& mix, bool* isSilent) const;
+
+		// Largest absolute sample in the block holding the given frame, or 0 past the end.  A cheap loudness
+		// estimate for voice virtualization.  Safe on the audio thread.
+		float GetPeakAt(UINT64 position) const
+		{
+			UINT64 blockIndex = position >> SAMPLE_ASSET_BLOCK_FRAMES_LOG2;
+			return (blockIndex < m_BlockPeaks.size()) ? m_BlockPeaks[(size_t)blockIndex] : 0.0f;
+		}
+
+	private:
+		virtual ~SampleAsset();
+
+		// Bytes in one block in this asset's storage format.
+		size_t GetBlockBytes() const;
+
+		// Append decoded (interleaved) frames to the end of the asset; only used while decoding.
+		HRESULT AppendFrames(const float* data, UINT32 frameCount);
+
+		// Encode any partly filled staging block and release the staging memory; called once decoding is done.
+		HRESULT FinishDecoding();
+
+		// Encode m_Staging into a new compact block.
+		HRESULT EncodeStagingBlock();
+
+	private:
+		const UINT32 m_ChannelCount;
+		const UINT32 m_SampleRate;
+		const SampleStorageFormat m_StorageFormat;
+		UINT64 m_FrameCount;
+
+		std::vector<BYTE*> m_Blocks;
+
+		// Largest absolute sample in each block; filled in as blocks complete during decoding.  Blocks whose peak
+		// is within SAMPLE_ASSET_SILENCE_THRESHOLD of zero are silent.
+		std::vector<float> m_BlockPeaks;
+
+		// Largest absolute sample appended to the current block so far; only used while decoding.
+		float m_BlockPeak;
+
+		// One planar float block being filled by the decoder before it is encoded; compact formats only, empty once
+		// decoded.
+		std::vector<float> m_Staging;
+	};
+}
@@ -0,0 +1,169 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include "SampleCache.h"
+
+using namespace Wazappy;
+
+std::mutex SampleCache::s_mutex{};
+std::map<std::wstring, SampleCache::Entry> SampleCache::s_assets{};
+std::list<std::wstring> SampleCache::s_lruKeys{};
+std::map<std::wstring, ComPtr<SeekIndex>> SampleCache::s_seekIndexes{};
+SampleStorageFormat SampleCache::s_storageFormat{ SampleStorage_Float };
+UINT64 SampleCache::s_memoryBudget{ SAMPLE_CACHE_DEFAULT_BUDGET_BYTES };
+UINT64 SampleCache::s_bytesCached{};
+UINT64 SampleCache::s_bytesSaved{};
+UINT64 SampleCache::s_hits{};
+UINT64 SampleCache::s_misses{};
+UINT64 SampleCache::s_evictions{};
+
+std::wstring SampleCache::MakeKey(LPCWSTR url, UINT32 channelCount, UINT32 sampleRate)
+{
+	std::wstringstream key;
+	key << channelCount << L'|' << sampleRate << L'|' << url;
+	return key.str();
+}
+
+void SampleCache::Touch(Entry& entry)
+{
+	s_lruKeys.splice(s_lruKeys.begin(), s_lruKeys, entry.LruPosition);
+}
+
+void SampleCache::EvictToBudget(const std::wstring& keepKey)
+{
+	while (s_bytesCached > s_memoryBudget && !s_lruKeys.empty())
+	{
+		const std::wstring& victimKey = s_lruKeys.back();
+		if (victimKey == keepKey)
+		{
+			// The only thing left is the asset we were asked to keep; let it exceed the budget on its own.
+			break;
+		}
+
+		auto found = s_assets.find(victimKey);
+		Contract::Assert(found != s_assets.end(), L"LRU list and asset map must agree");
+
+		s_bytesCached -= found->second.Asset->GetByteSize();
+		s_bytesSaved -= found->second.Asset->GetBytesSaved();
+		s_evictions++;
+
+		s_assets.erase(found);
+		s_lruKeys.pop_back();
+	}
+}
+
+void SampleCache::SetMemoryBudget(UINT64 bytes)
+{
+	std::lock_guard<std::mutex> guard(s_mutex);
+	s_memoryBudget = bytes;
+	EvictToBudget(std::wstring());
+}
+
+void SampleCache::SetStorageFormat(SampleStorageFormat storageFormat)
+{
+	std::lock_guard<std::mutex> guard(s_mutex);
+	s_storageFormat = storageFormat;
+}
+
+bool SampleCache::TryGetAsset(LPCWSTR url, UINT32 channelCount, UINT32 sampleRate, ComPtr<SampleAsset>* asset)
+{
+	std::wstring key = MakeKey(url, channelCount, sampleRate);
+
+	std::lock_guard<std::mutex> guard(s_mutex);
+	auto found = s_assets.find(key);
+	if (found == s_assets.end())
+	{
+		s_misses++;
+		return false;
+	}
+
+	s_hits++;
+	Touch(found->second);
+	*asset = found->second.Asset;
+	return true;
+}
+
+HRESULT SampleCache::LoadAsset(LPCWSTR url, UINT32 channelCount, UINT32 sampleRate, ComPtr<SampleAsset>* asset)
+{
+	if (TryGetAsset(url, channelCount, sampleRate, asset))
+	{
+		return S_OK;
+	}
+
+	SampleStorageFormat storageFormat;
+	{
+		std::lock_guard<std::mutex> guard(s_mutex);
+		storageFormat = s_storageFormat;
+	}
+
+	// Decode outside the lock so other voices can keep hitting the cache meanwhile.
+	ComPtr<SeekIndex> seekIndex = GetSeekIndex(url, channelCount, sampleRate);
+	ComPtr<SampleAsset> decoded;
+	HRESULT hr = SampleAsset::DecodeFromUrl(url, channelCount, sampleRate, storageFormat, seekIndex.Get(), &decoded);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	std::wstring key = MakeKey(url, channelCount, sampleRate);
+
+	std::lock_guard<std::mutex> guard(s_mutex);
+	auto found = s_assets.find(key);
+	if (found != s_assets.end())
+	{
+		// Someone else decoded the same asset while we were; keep theirs so every voice shares one copy.
+		Touch(found->second);
+		*asset = found->second.Asset;
+		return S_OK;
+	}
+
+	s_lruKeys.push_front(key);
+	Entry& entry = s_assets[key];
+	entry.Asset = decoded;
+	entry.LruPosition = s_lruKeys.begin();
+	s_bytesCached += decoded->GetByteSize();
+	s_bytesSaved += decoded->GetBytesSaved();
+
+	EvictToBudget(key);
+
+	*asset = decoded;
+	return S_OK;
+}
+
+ComPtr<SeekIndex> SampleCache::GetSeekIndex(LPCWSTR url, UINT32 channelCount, UINT32 sampleRate)
+{
+	std::wstring key = MakeKey(url, channelCount, sampleRate);
+
+	std::lock_guard<std::mutex> guard(s_mutex);
+	ComPtr<SeekIndex>& seekIndex = s_seekIndexes[key];
+	if (seekIndex == nullptr)
+	{
+		seekIndex = Make<SeekIndex>();
+	}
+
+	return seekIndex;
+}
+
+void SampleCache::Clear()
+{
+	std::lock_guard<std::mutex> guard(s_mutex);
+	s_evictions += s_assets.size();
+	s_assets.clear();
+	s_lruKeys.clear();
+	s_bytesCached = 0;
+	s_bytesSaved = 0;
+}
+
+void SampleCache::GetStatistics(SAMPLECACHESTATS* stats)
+{
+	std::lock_guard<std::mutex> guard(s_mutex);
+	stats->Hits = s_hits;
+	stats->Misses = s_misses;
+	stats->Evictions = s_evictions;
+	stats->BytesCached = s_bytesCached;
+	stats->BytesSaved = s_bytesSaved;
+	stats->MemoryBudget = s_memoryBudget;
+	stats->AssetCount = (UINT32)s_assets.size();
+}
@@ -0,0 +1,86 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "WazappyDllInterface.h"
+#include "SampleAsset.h"
+
+using namespace Microsoft::WRL;
+
+// Default session-wide memory budget for decoded assets.
+#define SAMPLE_CACHE_DEFAULT_BUDGET_BYTES (128 * 1024 * 1024)
+
+namespace Wazappy
+{
+	// Session-scoped cache of decoded SampleAssets, keyed by URL and decoded format.
+	// Each asset is decoded once and shared by every voice which plays it.  When the total size of cached
+	// assets exceeds the memory budget, least-recently-used assets are dropped from the cache; voices
+	// still playing an evicted asset keep it alive until they finish.
+	class SampleCache
+	{
+	private:
+		struct Entry
+		{
+			ComPtr<SampleAsset> Asset;
+			std::list<std::wstring>::iterator LruPosition;
+		};
+
+		static std::mutex s_mutex;
+
+		// Key-to-asset mapping; owns the cache's reference to each asset.
+		static std::map<std::wstring, Entry> s_assets;
+
+		// Keys in recency order, most recently used first.
+		static std::list<std::wstring> s_lruKeys;
+
+		// Seek indexes for compressed assets, under the same keys.  These are tiny, so they are kept even after
+		// their asset is evicted (and exist for streamed files which are never cached whole).
+		static std::map<std::wstring, ComPtr<SeekIndex>> s_seekIndexes;
+
+		static SampleStorageFormat s_storageFormat;
+		static UINT64 s_memoryBudget;
+		static UINT64 s_bytesCached;
+		static UINT64 s_bytesSaved;
+		static UINT64 s_hits;
+		static UINT64 s_misses;
+		static UINT64 s_evictions;
+
+	public:
+		// Set the memory budget, evicting immediately if the cache is now over it.
+		static void SetMemoryBudget(UINT64 bytes);
+
+		// Set the format assets decoded from now on are stored in.  Assets already cached keep their format.
+		static void SetStorageFormat(SampleStorageFormat storageFormat);
+
+		// Look up an already-decoded asset; never touches the disk or a decoder.
+		// Counts a hit or a miss.
+		static bool TryGetAsset(LPCWSTR url, UINT32 channelCount, UINT32 sampleRate, ComPtr<SampleAsset>* asset);
+
+		// Look up an asset, decoding and caching it on a miss.  May block on decoding; never call from an audio thread.
+		static HRESULT LoadAsset(LPCWSTR url, UINT32 channelCount, UINT32 sampleRate, ComPtr<SampleAsset>* asset);
+
+		// Get the shared seek index for an asset, creating an empty one on first use.
+		static ComPtr<SeekIndex> GetSeekIndex(LPCWSTR url, UINT32 channelCount, UINT32 sampleRate);
+
+		// Drop every asset from the cache (voices still playing keep theirs alive).
+		static void Clear();
+
+		static void GetStatistics(SAMPLECACHESTATS* stats);
+
+	private:
+		static std::wstring MakeKey(LPCWSTR url, UINT32 channelCount, UINT32 sampleRate);
+
+		// Move the given entry to the front of the LRU list.  Lock must be held.
+		static void Touch(Entry& entry);
+
+		// Evict least-recently-used assets until under budget, never evicting the given key.  Lock must be held.
+		static void EvictToBudget(const std::wstring& keepKey);
+	};
+}
@@ -0,0 +1,344 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include <mferror.h>
+#include "SampleDecoder.h"
+
+using namespace Wazappy;
+
+//
+//  CreateFloatAudioType()
+//
+//  Create a 32-bit float PCM media type with the given channel count and sample rate
+//
+static HRESULT CreateFloatAudioType(UINT32 channelCount, UINT32 sampleRate, IMFMediaType **MediaType)
+{
+	HRESULT hr = S_OK;
+	IMFMediaType *MT = nullptr;
+	UINT32 blockAlign = channelCount * sizeof(float);
+
+	hr = MFCreateMediaType(&MT);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	hr = MT->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	hr = MT->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_Float);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	hr = MT->SetUINT32(MF_MT_AUDIO_NUM_CHANNELS, channelCount);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	hr = MT->SetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, sampleRate);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	hr = MT->SetUINT32(MF_MT_AUDIO_BLOCK_ALIGNMENT, blockAlign);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	hr = MT->SetUINT32(MF_MT_AUDIO_AVG_BYTES_PER_SECOND, blockAlign * sampleRate);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	hr = MT->SetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, sizeof(float) * 8);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	hr = MT->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, true);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	*MediaType = MT;
+	(*MediaType)->AddRef();
+
+exit:
+	SAFE_RELEASE(MT);
+	return hr;
+}
+
+SampleDecoder::SampleDecoder() :
+	m_SourceReader(nullptr),
+	m_ChannelCount(0),
+	m_SampleRate(0),
+	m_IsEndOfStream(false),
+	m_IsUncompressed(false),
+	m_NextFrame(0),
+	m_IsPositionExact(true),
+	m_FramesToSkip(0)
+{
+}
+
+SampleDecoder::~SampleDecoder()
+{
+	Close();
+}
+
+void SampleDecoder::Close()
+{
+	SAFE_RELEASE(m_SourceReader);
+	m_SeekIndex = nullptr;
+	m_Chunk.clear();
+	m_IsEndOfStream = false;
+	m_NextFrame = 0;
+	m_IsPositionExact = true;
+	m_FramesToSkip = 0;
+}
+
+LONGLONG SampleDecoder::FrameToTime(UINT64 frame) const
+{
+	// Presentation times are in 100ns units
+	return (LONGLONG)((frame * 10000000ULL) / m_SampleRate);
+}
+
+UINT64 SampleDecoder::TimeToFrame(LONGLONG time) const
+{
+	return ((UINT64)time * m_SampleRate + 5000000ULL) / 10000000ULL;
+}
+
+//
+//  Open()
+//
+//  Create a synchronous source reader on the URL, converting its first audio stream to float
+//
+HRESULT SampleDecoder::Open(LPCWSTR url, UINT32 channelCount, UINT32 sampleRate, SeekIndex* seekIndex)
+{
+	HRESULT hr = S_OK;
+	IMFMediaType *NativeMT = nullptr;
+	IMFMediaType *PartialMT = nullptr;
+	GUID nativeSubtype = GUID_NULL;
+
+	Close();
+	m_ChannelCount = channelCount;
+	m_SampleRate = sampleRate;
+	m_SeekIndex = seekIndex;
+
+	hr = MFCreateSourceReaderFromURL(url, nullptr, &m_SourceReader);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	hr = m_SourceReader->SetStreamSelection(MF_SOURCE_READER_ALL_STREAMS, false);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	hr = m_SourceReader->SetStreamSelection(MF_SOURCE_READER_FIRST_AUDIO_STREAM, true);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	// Find out whether the file itself is compressed, which decides how we seek
+	hr = m_SourceReader->GetNativeMediaType(MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, &NativeMT);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	hr = NativeMT->GetGUID(MF_MT_SUBTYPE, &nativeSubtype);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+	m_IsUncompressed = (nativeSubtype == MFAudioFormat_PCM) || (nativeSubtype == MFAudioFormat_Float);
+
+	hr = CreateFloatAudioType(channelCount, sampleRate, &PartialMT);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	// Set type on source reader so necessary converters / decoders will be added
+	hr = m_SourceReader->SetCurrentMediaType(MF_SOURCE_READER_FIRST_AUDIO_STREAM, nullptr, PartialMT);
+
+exit:
+	if (FAILED(hr))
+	{
+		SAFE_RELEASE(m_SourceReader);
+	}
+
+	SAFE_RELEASE(NativeMT);
+	SAFE_RELEASE(PartialMT);
+	return hr;
+}
+
+//
+//  SeekToFrame()
+//
+//  Reposition the source reader so decoding resumes exactly at the given frame
+//
+HRESULT SampleDecoder::SeekToFrame(UINT64 frame)
+{
+	if (m_SourceReader == nullptr)
+	{
+		return E_NOT_VALID_STATE;
+	}
+
+	SeekPoint point = { 0, 0 };
+	bool isPositionExact = true;
+
+	if (m_IsUncompressed)
+	{
+		// Every frame of a PCM stream is addressable, so this is plain arithmetic.
+		point.Frame = frame;
+		point.Time = FrameToTime(frame);
+	}
+	else if (m_SeekIndex == nullptr || !m_SeekIndex->FindPoint(frame, &point))
+	{
+		if (m_SeekIndex == nullptr && frame > 0)
+		{
+			// No index: trust the container's seek and the timestamps it hands back.
+			point.Time = FrameToTime(frame);
+			isPositionExact = false;
+		}
+		// Otherwise the target precedes the first indexed point, so decode forward from the very start.
+	}
+
+	PROPVARIANT position;
+	PropVariantInit(&position);
+	position.vt = VT_I8;
+	position.hVal.QuadPart = point.Time;
+
+	HRESULT hr = m_SourceReader->SetCurrentPosition(GUID_NULL, position);
+	PropVariantClear(&position);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	m_Chunk.clear();
+	m_IsEndOfStream = false;
+	m_IsPositionExact = isPositionExact;
+	m_NextFrame = point.Frame;
+
+	// Until an unindexed seek sees its first timestamp, m_FramesToSkip holds the absolute target frame.
+	m_FramesToSkip = isPositionExact ? frame - point.Frame : frame;
+	return S_OK;
+}
+
+//
+//  ReadFrames()
+//
+//  Decode samples until one carries audio data (past any frames being skipped) or the stream ends
+//
+HRESULT SampleDecoder::ReadFrames(const float** frames, UINT32* frameCount)
+{
+	*frames = nullptr;
+	*frameCount = 0;
+
+	if (m_SourceReader == nullptr)
+	{
+		return E_NOT_VALID_STATE;
+	}
+
+	while (!m_IsEndOfStream)
+	{
+		DWORD streamFlags = 0;
+		LONGLONG timestamp = 0;
+		IMFSample *Sample = nullptr;
+		IMFMediaBuffer *MediaBuffer = nullptr;
+		BYTE *AudioData = nullptr;
+		DWORD cbAudioData = 0;
+
+		HRESULT hr = m_SourceReader->ReadSample(MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, nullptr, &streamFlags, &timestamp, &Sample);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+
+		if (streamFlags & MF_SOURCE_READERF_CURRENTMEDIATYPECHANGED)
+		{
+			// The decoder changed format midstream; we cannot convert it after the fact.
+			SAFE_RELEASE(Sample);
+			return MF_E_INVALIDMEDIATYPE;
+		}
+
+		m_IsEndOfStream = (streamFlags & MF_SOURCE_READERF_ENDOFSTREAM) != 0;
+
+		if (m_IsEndOfStream && m_IsPositionExact && m_SeekIndex != nullptr)
+		{
+			m_SeekIndex->MarkComplete();
+		}
+
+		if (Sample == nullptr)
+		{
+			continue;
+		}
+
+		if (!m_IsPositionExact)
+		{
+			// After an unindexed seek, the first timestamp tells us where the container actually landed;
+			// skip the difference up to the target.
+			UINT64 landedFrame = TimeToFrame(timestamp);
+			UINT64 targetFrame = m_FramesToSkip;
+			m_NextFrame = landedFrame;
+			m_FramesToSkip = (targetFrame > landedFrame) ? targetFrame - landedFrame : 0;
+			m_IsPositionExact = true;
+		}
+		else if (m_SeekIndex != nullptr && !m_IsUncompressed)
+		{
+			m_SeekIndex->AddPoint(m_NextFrame, timestamp);
+		}
+
+		hr = Sample->ConvertToContiguousBuffer(&MediaBuffer);
+		if (SUCCEEDED(hr))
+		{
+			hr = MediaBuffer->Lock(&AudioData, nullptr, &cbAudioData);
+			if (SUCCEEDED(hr))
+			{
+				UINT32 decodedFrames = cbAudioData / (m_ChannelCount * sizeof(float));
+				UINT32 skippedFrames = (UINT32)min((UINT64)decodedFrames, m_FramesToSkip);
+				const float* decoded = reinterpret_cast<float*>(AudioData) + (skippedFrames * m_ChannelCount);
+
+				m_Chunk.assign(decoded, decoded + ((decodedFrames - skippedFrames) * m_ChannelCount));
+				m_FramesToSkip -= skippedFrames;
+				m_NextFrame += decodedFrames;
+				MediaBuffer->Unlock();
+			}
+		}
+
+		SAFE_RELEASE(MediaBuffer);
+		SAFE_RELEASE(Sample);
+
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+
+		if (!m_Chunk.empty())
+		{
+			*frames = m_Chunk.data();
+			*frameCount = (UINT32)(m_Chunk.size() / m_ChannelCount);
+			return S_OK;
+		}
+	}
+
+	return S_FALSE;
+}
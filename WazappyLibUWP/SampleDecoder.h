@@ -0,0 +1,69 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <mfidl.h>
+#include <mfreadwrite.h>
+#include <vector>
+
+#include "SeekIndex.h"
+
+namespace Wazappy
+{
+	// Synchronous Media Foundation decoder for the first audio stream of a URL, producing 32-bit float
+	// interleaved frames in a requested channel count and sample rate.
+	// Blocks on the disk and the decoder; only use it from client or I/O threads, never the audio thread.
+	class SampleDecoder
+	{
+	public:
+		SampleDecoder();
+		~SampleDecoder();
+
+		// Open the URL.  If a seek index is given, it is filled in by sequential decoding and used to seek
+		// compressed streams.
+		HRESULT Open(LPCWSTR url, UINT32 channelCount, UINT32 sampleRate, SeekIndex* seekIndex = nullptr);
+		void Close();
+
+		bool IsOpen() const { return m_SourceReader != nullptr; }
+
+		// True if the file holds uncompressed PCM or float, which seeks by plain arithmetic.
+		bool IsUncompressed() const { return m_IsUncompressed; }
+
+		// Reposition so the next frame returned by ReadFrames is exactly the given one.
+		// Uncompressed streams seek straight to the frame's time.  Compressed streams seek to the nearest
+		// indexed packet before it and decode forward, discarding the frames in between.
+		HRESULT SeekToFrame(UINT64 frame);
+
+		// Decode the next chunk of frames.  On success *frames points at *frameCount decoded frames, valid until
+		// the next call; returns S_FALSE (with zero frames) once the end of the stream has been reached.
+		HRESULT ReadFrames(const float** frames, UINT32* frameCount);
+
+	private:
+		LONGLONG FrameToTime(UINT64 frame) const;
+		UINT64 TimeToFrame(LONGLONG time) const;
+
+	private:
+		IMFSourceReader *m_SourceReader;
+		UINT32 m_ChannelCount;
+		UINT32 m_SampleRate;
+		bool m_IsEndOfStream;
+		bool m_IsUncompressed;
+
+		ComPtr<SeekIndex> m_SeekIndex;
+
+		// Decoded frame position of the next frame the source reader will deliver.
+		UINT64 m_NextFrame;
+
+		// True while m_NextFrame is known exactly (from the start of the stream or an index/PCM seek) rather
+		// than estimated from a timestamp; only exact positions are recorded in the seek index.
+		bool m_IsPositionExact;
+
+		// Frames still to be discarded to land exactly on the target of the last seek.
+		UINT64 m_FramesToSkip;
+
+		// Copy of the most recently decoded chunk.
+		std::vector<float> m_Chunk;
+	};
+}
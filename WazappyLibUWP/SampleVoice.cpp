@@ -0,0 +1,90 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include "SampleVoice.h"
+
+using namespace Wazappy;
+
+SampleVoice::SampleVoice(VoiceId voiceId, const ComPtr<SampleAsset>& asset) :
+	AudioVoice(voiceId),
+	m_Asset(asset),
+	m_Position(0),
+	m_PendingSeek(NO_PENDING_SEEK),
+	m_FramesRendered(0),
+	m_RenderTicks(0)
+{
+	Contract::Requires(asset != nullptr, L"Voice must have an asset to play");
+}
+
+HRESULT SampleVoice::Seek(UINT64 frame)
+{
+	if (frame >= m_Asset->GetFrameCount())
+	{
+		return E_INVALIDARG;
+	}
+
+	m_PendingSeek = frame;
+	return S_OK;
+}
+
+UINT32 SampleVoice::RenderVoice(const PlanarView& mix, UINT32 frameCount)
+{
+	Contract::Requires(mix.ChannelCount == m_Asset->GetChannelCount(), L"Asset must be decoded in the device's channel count");
+
+	UINT64 pendingSeek = m_PendingSeek.exchange(NO_PENDING_SEEK);
+	if (pendingSeek != NO_PENDING_SEEK)
+	{
+		m_Position = pendingSeek;
+	}
+
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+
+	// Fewer frames than asked for means we reached the end of the asset.
+	bool isSilent = false;
+	UINT32 framesRendered = m_Asset->MixFrames(m_Position, frameCount, mix, &isSilent);
+	m_Position += framesRendered;
+	if (isSilent)
+	{
+		MarkOutputSilent();
+	}
+
+	LARGE_INTEGER end;
+	QueryPerformanceCounter(&end);
+	m_RenderTicks.store(m_RenderTicks.load(std::memory_order_relaxed) + (end.QuadPart - start.QuadPart), std::memory_order_relaxed);
+	m_FramesRendered.store(m_FramesRendered.load(std::memory_order_relaxed) + framesRendered, std::memory_order_relaxed);
+
+	return framesRendered;
+}
+
+UINT32 SampleVoice::SkipVoice(const PlanarView& scratch, UINT32 frameCount)
+{
+	UINT64 pendingSeek = m_PendingSeek.exchange(NO_PENDING_SEEK);
+	if (pendingSeek != NO_PENDING_SEEK)
+	{
+		m_Position = pendingSeek;
+	}
+
+	UINT32 framesSkipped = (UINT32)min((UINT64)frameCount, m_Asset->GetFrameCount() - min(m_Position, m_Asset->GetFrameCount()));
+	m_Position += framesSkipped;
+	return framesSkipped;
+}
+
+float SampleVoice::GetAudibility()
+{
+	return m_Asset->GetPeakAt(m_Position);
+}
+
+void SampleVoice::GetStatistics(SAMPLEVOICESTATS* stats) const
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	stats->StorageFormat = m_Asset->GetStorageFormat();
+	stats->AssetBytes = m_Asset->GetByteSize();
+	stats->BytesSaved = m_Asset->GetBytesSaved();
+	stats->FramesRendered = m_FramesRendered;
+	stats->RenderNanoseconds = (UINT64)((m_RenderTicks * 1000000000.0) / frequency.QuadPart);
+}
@@ -0,0 +1,44 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "AudioVoice.h"
+#include "SampleAsset.h"
+
+namespace Wazappy
+{
+	// Voice which plays a decoded SampleAsset once, straight out of memory.
+	class SampleVoice : public AudioVoice
+	{
+	public:
+		SampleVoice(VoiceId voiceId, const ComPtr<SampleAsset>& asset);
+
+		virtual UINT32 RenderVoice(const PlanarView& mix, UINT32 frameCount);
+
+		// In memory, skipping ahead is just moving the position.
+		virtual UINT32 SkipVoice(const PlanarView& scratch, UINT32 frameCount);
+
+		// The peak of the asset block about to play.
+		virtual float GetAudibility();
+
+		// Seeking in memory is just a new position, applied at the start of the next period.
+		virtual HRESULT Seek(UINT64 frame);
+
+		void GetStatistics(SAMPLEVOICESTATS* stats) const;
+
+	private:
+		ComPtr<SampleAsset> m_Asset;
+
+		// Next frame of the asset to render.  Only touched on the audio thread.
+		UINT64 m_Position;
+
+		// Frame requested by the last Seek not yet applied, or NO_PENDING_SEEK.
+		std::atomic<UINT64> m_PendingSeek;
+
+		// Written on the audio thread, read by GetStatistics.
+		std::atomic<UINT64> m_FramesRendered;
+		std::atomic<UINT64> m_RenderTicks;
+	};
+}
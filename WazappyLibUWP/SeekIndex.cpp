@@ -0,0 +1,58 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include "SeekIndex.h"
+
+using namespace Wazappy;
+
+SeekIndex::SeekIndex() :
+	m_IsComplete(false)
+{
+}
+
+void SeekIndex::AddPoint(UINT64 frame, LONGLONG time)
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	if (!m_Points.empty() && frame < m_Points.back().Frame + SEEK_INDEX_INTERVAL_FRAMES)
+	{
+		return;
+	}
+
+	m_Points.push_back(SeekPoint{ frame, time });
+}
+
+void SeekIndex::MarkComplete()
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	m_IsComplete = true;
+}
+
+bool SeekIndex::FindPoint(UINT64 frame, SeekPoint* point)
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+
+	// First point strictly after the frame; the one before it is our answer.
+	auto after = std::upper_bound(m_Points.begin(), m_Points.end(), frame,
+		[](UINT64 target, const SeekPoint& candidate) { return target < candidate.Frame; });
+	if (after == m_Points.begin())
+	{
+		return false;
+	}
+
+	*point = *(after - 1);
+	return true;
+}
+
+bool SeekIndex::IsComplete()
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	return m_IsComplete;
+}
+
+size_t SeekIndex::GetPointCount()
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	return m_Points.size();
+}
@@ -0,0 +1,58 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+using namespace Microsoft::WRL;
+
+// Minimum spacing, in decoded frames, between points recorded in a SeekIndex.
+#define SEEK_INDEX_INTERVAL_FRAMES 4096
+
+namespace Wazappy
+{
+	// A decoder position which can be sought to directly: the presentation time of a compressed packet,
+	// and the exact decoded frame at which that packet starts.
+	struct SeekPoint
+	{
+		UINT64 Frame;
+		LONGLONG Time;
+	};
+
+	// Table of SeekPoints for one compressed asset, filled in as the asset is decoded sequentially and shared
+	// (through the SampleCache) by every decoder which opens the same asset.
+	// Seeking lands on the nearest point at or before the target and decodes forward, which is sample accurate
+	// even when the container's own timestamps or seek table are not.
+	class SeekIndex :
+		public RuntimeClass<RuntimeClassFlags<ClassicCom>, IUnknown>
+	{
+	public:
+		SeekIndex();
+
+		// Record a point reached by sequential decoding.  Points must arrive in increasing frame order;
+		// ones closer than SEEK_INDEX_INTERVAL_FRAMES to the last point, or already covered, are ignored.
+		void AddPoint(UINT64 frame, LONGLONG time);
+
+		// Mark the index complete: a sequential decode has run all the way to the end of the stream.
+		void MarkComplete();
+
+		// Find the last point at or before the given frame.  Returns false if no point precedes it
+		// (in which case the caller seeks to the start of the stream).
+		bool FindPoint(UINT64 frame, SeekPoint* point);
+
+		bool IsComplete();
+
+		size_t GetPointCount();
+
+	private:
+		virtual ~SeekIndex() {}
+
+	private:
+		std::mutex m_Mutex;
+		std::vector<SeekPoint> m_Points;
+		bool m_IsComplete;
+	};
+}
@@ -0,0 +1,142 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <math.h>
+
+#include "WazappyDllInterface.h"
+
+// Marks a spatial source which has no place in a spatializer.
+#define SPATIAL_NO_SLOT ((UINT32)-1)
+
+// Channels of an ambisonic field of the highest order.
+#define AMBISONIC_MAX_CHANNELS ((AMBISONIC_MAX_ORDER + 1) * (AMBISONIC_MAX_ORDER + 1))
+
+namespace Wazappy
+{
+	// Which way the listener's head is turned, for everything spatialized on a render device.
+	// Set may be called from any thread and never blocks; if two race, the last to finish wins.
+	class ListenerOrientation
+	{
+	public:
+		ListenerOrientation() : m_W(1), m_X(0), m_Y(0), m_Z(0), m_Generation(0) {}
+
+		// Any thread.
+		void Set(const LISTENERORIENTATION& orientation)
+		{
+			m_W = orientation.W;
+			m_X = orientation.X;
+			m_Y = orientation.Y;
+			m_Z = orientation.Z;
+			m_Generation.fetch_add(1, std::memory_order_release);
+		}
+
+		// Bumped by every Set.
+		UINT32 GetGeneration() const { return m_Generation.load(std::memory_order_acquire); }
+
+		// Turn a position given in the listener's space into head coordinates (x right, y up, -z ahead), in
+		// place.  Audio thread only.
+		void IntoHead(float* x, float* y, float* z) const
+		{
+			// Rotate by the inverse of the orientation, normalized in case a client's quaternion drifted.
+			float w = m_W, qx = -m_X, qy = -m_Y, qz = -m_Z;
+			float norm = sqrtf((w * w) + (qx * qx) + (qy * qy) + (qz * qz));
+			if (norm <= 0)
+			{
+				return;
+			}
+			w /= norm; qx /= norm; qy /= norm; qz /= norm;
+
+			// v + 2w(q x v) + 2q x (q x v)
+			float tx = 2 * ((qy * *z) - (qz * *y));
+			float ty = 2 * ((qz * *x) - (qx * *z));
+			float tz = 2 * ((qx * *y) - (qy * *x));
+			float rx = *x + (w * tx) + ((qy * tz) - (qz * ty));
+			float ry = *y + (w * ty) + ((qz * tx) - (qx * tz));
+			float rz = *z + (w * tz) + ((qx * ty) - (qy * tx));
+			*x = rx;
+			*y = ry;
+			*z = rz;
+		}
+
+	private:
+		std::atomic<float> m_W;
+		std::atomic<float> m_X;
+		std::atomic<float> m_Y;
+		std::atomic<float> m_Z;
+		std::atomic<UINT32> m_Generation;
+	};
+
+	// Where a voice is around the listener, for the render device's spatializer, and the voice's place in it.
+	// SetPosition may be called from any thread and never blocks; everything else is the spatializer's, on the
+	// audio thread.
+	class SpatialSource
+	{
+	public:
+		SpatialSource() :
+			m_IsEnabled(false),
+			m_X(0),
+			m_Y(0),
+			m_Z(-1),
+			m_Generation(0),
+			m_Rendering(SpatialRendering_Hrtf),
+			m_SpatializerSerial(0),
+			m_Slot(SPATIAL_NO_SLOT),
+			m_HasAmbisonicGains(false),
+			m_AmbisonicGeneration(0)
+		{
+		}
+
+		// Spatialize the voice at the given position, or if isEnabled is false play it straight into the mix
+		// again.  Any thread.
+		void SetPosition(bool isEnabled, const SPATIALPOSITION& position)
+		{
+			m_X = position.X;
+			m_Y = position.Y;
+			m_Z = position.Z;
+			m_IsEnabled = isEnabled;
+			m_Generation.fetch_add(1, std::memory_order_release);
+		}
+
+		bool IsEnabled() const { return m_IsEnabled; }
+
+		// Bumped by every SetPosition.
+		UINT32 GetGeneration() const { return m_Generation.load(std::memory_order_acquire); }
+
+		void GetPosition(float* x, float* y, float* z) const
+		{
+			*x = m_X;
+			*y = m_Y;
+			*z = m_Z;
+		}
+
+		// Which spatializer the voice goes through when the device has both.  Any thread.
+		void SetRendering(SpatialRendering rendering) { m_Rendering = rendering; }
+		SpatialRendering GetRendering() const { return m_Rendering; }
+
+	private:
+		friend class BinauralSpatializer;
+		friend class AmbisonicBus;
+
+		std::atomic<bool> m_IsEnabled;
+		std::atomic<float> m_X;
+		std::atomic<float> m_Y;
+		std::atomic<float> m_Z;
+		std::atomic<UINT32> m_Generation;
+		std::atomic<SpatialRendering> m_Rendering;
+
+		// The spatializer (by serial number, since one may be freed and another made at the same address) and
+		// slot this source was last given, if any.  Audio thread only.
+		UINT32 m_SpatializerSerial;
+		UINT32 m_Slot;
+
+		// The gains an ambisonic bus last encoded the source with, and the generation of the position they are
+		// for; the next period ramps from them.  Audio thread only.
+		bool m_HasAmbisonicGains;
+		UINT32 m_AmbisonicGeneration;
+		float m_AmbisonicGains[AMBISONIC_MAX_CHANNELS];
+	};
+}
@@ -0,0 +1,222 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include "StreamPrefetcher.h"
+
+using namespace Wazappy;
+
+std::mutex StreamPrefetcher::s_mutex{};
+ComPtr<StreamPrefetcher> StreamPrefetcher::s_instance{};
+std::atomic<HANDLE> StreamPrefetcher::s_wakeEvent{ nullptr };
+
+StreamPrefetcher::StreamPrefetcher() :
+	m_QueueId(0),
+	m_PrefetchKey(0),
+	m_PrefetchAsyncResult(nullptr)
+{
+}
+
+StreamPrefetcher::~StreamPrefetcher()
+{
+	SAFE_RELEASE(m_PrefetchAsyncResult);
+
+	if (m_QueueId != 0)
+	{
+		MFUnlockWorkQueue(m_QueueId);
+	}
+}
+
+HRESULT StreamPrefetcher::EnsureStarted()
+{
+	if (s_instance != nullptr)
+	{
+		return S_OK;
+	}
+
+	HRESULT hr = S_OK;
+	ComPtr<StreamPrefetcher> instance = Make<StreamPrefetcher>();
+	if (instance == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	HANDLE wakeEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	if (wakeEvent == nullptr)
+	{
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	// A private work queue gives the prefetcher a thread of its own, so a slow disk never holds up the shared queues.
+	hr = MFAllocateWorkQueue(&instance->m_QueueId);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+	instance->m_xPrefetch.SetQueueID(instance->m_QueueId);
+
+	hr = MFCreateAsyncResult(nullptr, &instance->m_xPrefetch, nullptr, &instance->m_PrefetchAsyncResult);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	hr = MFPutWaitingWorkItem(wakeEvent, 0, instance->m_PrefetchAsyncResult, &instance->m_PrefetchKey);
+	if (FAILED(hr))
+	{
+		goto exit;
+	}
+
+	s_wakeEvent = wakeEvent;
+	s_instance = instance;
+
+exit:
+	if (FAILED(hr))
+	{
+		CloseHandle(wakeEvent);
+	}
+
+	return hr;
+}
+
+HRESULT StreamPrefetcher::AddVoice(const ComPtr<StreamingVoice>& voice)
+{
+	std::lock_guard<std::mutex> guard(s_mutex);
+	HRESULT hr = EnsureStarted();
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	{
+		std::lock_guard<std::mutex> voicesGuard(s_instance->m_VoicesMutex);
+		s_instance->m_Voices.push_back(voice);
+	}
+
+	Wake();
+	return S_OK;
+}
+
+HRESULT StreamPrefetcher::AddPlaylist(const ComPtr<PlaylistVoice>& playlist)
+{
+	std::lock_guard<std::mutex> guard(s_mutex);
+	HRESULT hr = EnsureStarted();
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	{
+		std::lock_guard<std::mutex> voicesGuard(s_instance->m_VoicesMutex);
+		s_instance->m_Playlists.push_back(playlist);
+	}
+
+	Wake();
+	return S_OK;
+}
+
+void StreamPrefetcher::Wake()
+{
+	HANDLE wakeEvent = s_wakeEvent;
+	if (wakeEvent != nullptr)
+	{
+		SetEvent(wakeEvent);
+	}
+}
+
+StreamingVoice* StreamPrefetcher::FindLowestFillVoice()
+{
+	StreamingVoice* lowest = nullptr;
+	float lowestFill = 0;
+
+	for (auto& voice : m_PassVoices)
+	{
+		if (voice->NeedsPrefetch())
+		{
+			float fill = voice->GetFillRatio();
+			if (lowest == nullptr || fill < lowestFill)
+			{
+				lowest = voice.Get();
+				lowestFill = fill;
+			}
+		}
+	}
+
+	return lowest;
+}
+
+//
+//  OnPrefetch()
+//
+//  Called on the prefetch work queue whenever the wake event fires; tops up every voice, neediest first
+//
+HRESULT StreamPrefetcher::OnPrefetch(IMFAsyncResult* pResult)
+{
+	{
+		std::lock_guard<std::mutex> guard(m_VoicesMutex);
+
+		// Drop voices which will never need decoding again.
+		for (size_t i = 0; i < m_Voices.size();)
+		{
+			StreamingVoice* voice = m_Voices[i].Get();
+			if (voice->IsFinished() || voice->IsStopRequested())
+			{
+				m_Voices[i] = m_Voices.back();
+				m_Voices.pop_back();
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		// A stopped playlist may still be inside RenderVoice with raw pointers to its tracks until the mixer retires
+		// it, so its tracks are only released once it is finished; until then it just stops opening new ones.
+		for (size_t i = 0; i < m_Playlists.size();)
+		{
+			PlaylistVoice* playlist = m_Playlists[i].Get();
+			if (playlist->IsFinished())
+			{
+				playlist->ReleaseTracks();
+				m_Playlists[i] = m_Playlists.back();
+				m_Playlists.pop_back();
+			}
+			else
+			{
+				if (!playlist->IsStopRequested())
+				{
+					m_PassPlaylists.push_back(m_Playlists[i]);
+				}
+				i++;
+			}
+		}
+	}
+
+	// Open upcoming playlist tracks outside the lock, since opening a file can block on the disk.
+	for (auto& playlist : m_PassPlaylists)
+	{
+		ComPtr<StreamingVoice> track = playlist->PrepareNextTrack();
+		if (track != nullptr)
+		{
+			std::lock_guard<std::mutex> guard(m_VoicesMutex);
+			m_Voices.push_back(track);
+		}
+	}
+	m_PassPlaylists.clear();
+
+	{
+		std::lock_guard<std::mutex> guard(m_VoicesMutex);
+		m_PassVoices = m_Voices;
+	}
+
+	for (StreamingVoice* voice = FindLowestFillVoice(); voice != nullptr; voice = FindLowestFillVoice())
+	{
+		voice->Prefetch();
+	}
+
+	m_PassVoices.clear();
+
+	// Wait for the next wake
+	return MFPutWaitingWorkItem(s_wakeEvent, 0, m_PrefetchAsyncResult, &m_PrefetchKey);
+}
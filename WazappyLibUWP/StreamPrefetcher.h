@@ -0,0 +1,67 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "StreamingVoice.h"
+#include "PlaylistVoice.h"
+
+using namespace Microsoft::WRL;
+
+namespace Wazappy
+{
+	// Session-wide I/O worker which keeps every StreamingVoice's prefetch window topped up.
+	// Runs on its own dedicated MF work queue, waiting on a wake event which voices signal when they run low.
+	// Each pass serves the voice with the lowest fill first, one decoded chunk at a time, until all are full.
+	class StreamPrefetcher :
+		public RuntimeClass<RuntimeClassFlags<ClassicCom>, IUnknown>
+	{
+	public:
+		StreamPrefetcher();
+
+		// Hand a voice to the prefetcher; it is dropped once the mixer retires it or it is stopped.
+		static HRESULT AddVoice(const ComPtr<StreamingVoice>& voice);
+
+		// Hand a playlist to the prefetcher, which opens each of its tracks in turn and prefetches them like
+		// any other streaming voice.  Dropped once the mixer retires it or it is stopped.
+		static HRESULT AddPlaylist(const ComPtr<PlaylistVoice>& playlist);
+
+		// Ask the prefetcher to run a pass soon.  Cheap and non-blocking; safe from the audio thread.
+		static void Wake();
+
+		METHODASYNCCALLBACK(StreamPrefetcher, Prefetch, OnPrefetch);
+
+	private:
+		virtual ~StreamPrefetcher();
+
+		// Create the singleton, its work queue and its first waiting work item.  s_mutex must be held.
+		static HRESULT EnsureStarted();
+
+		HRESULT OnPrefetch(IMFAsyncResult* pResult);
+
+		// Pick the needy voice with the lowest fill, or nullptr if every voice is full.
+		StreamingVoice* FindLowestFillVoice();
+
+	private:
+		static std::mutex s_mutex;
+		static ComPtr<StreamPrefetcher> s_instance;
+		static std::atomic<HANDLE> s_wakeEvent;
+
+		DWORD m_QueueId;
+		MFWORKITEM_KEY m_PrefetchKey;
+		IMFAsyncResult *m_PrefetchAsyncResult;
+
+		// Guards m_Voices and m_Playlists.
+		std::mutex m_VoicesMutex;
+		std::vector<ComPtr<StreamingVoice>> m_Voices;
+		std::vector<ComPtr<PlaylistVoice>> m_Playlists;
+
+		// Snapshots of m_Voices and m_Playlists taken at the start of each pass, so decoding runs without the lock.
+		std::vector<ComPtr<StreamingVoice>> m_PassVoices;
+		std::vector<ComPtr<PlaylistVoice>> m_PassPlaylists;
+	};
+}
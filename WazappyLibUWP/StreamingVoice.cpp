@@ -0,0 +1,200 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include "StreamingVoice.h"
+#include "StreamPrefetcher.h"
+#include "SampleCache.h"
+
+using namespace Wazappy;
+
+StreamingVoice::StreamingVoice(VoiceId voiceId, UINT32 channelCount, UINT32 sampleRate, UINT32 prefetchFrames) :
+	AudioVoice(voiceId),
+	m_ChannelCount(channelCount),
+	m_SampleRate(sampleRate),
+	m_PrefetchFrames(prefetchFrames),
+	m_RingFrames(1),
+	m_WritePosition(0),
+	m_ReadPosition(0),
+	m_PendingFrames(nullptr),
+	m_PendingFrameCount(0),
+	m_IsEndOfStream(false),
+	m_PendingSeek(NO_PENDING_SEEK),
+	m_DiscardBefore(0),
+	m_HasStarted(false),
+	m_StarvationCount(0),
+	m_StarvedFrames(0)
+{
+	Contract::Requires(prefetchFrames > 0, L"Prefetch window must not be empty");
+
+	while (m_RingFrames < prefetchFrames)
+	{
+		m_RingFrames <<= 1;
+	}
+	m_Ring.Allocate(channelCount, m_RingFrames);
+}
+
+HRESULT StreamingVoice::Open(LPCWSTR url)
+{
+	// Share the file's seek index with every other voice on it, so only the first seek pays for building it.
+	ComPtr<SeekIndex> seekIndex = SampleCache::GetSeekIndex(url, m_ChannelCount, m_SampleRate);
+	return m_Decoder.Open(url, m_ChannelCount, m_SampleRate, seekIndex.Get());
+}
+
+HRESULT StreamingVoice::Seek(UINT64 frame)
+{
+	m_PendingSeek = frame;
+	StreamPrefetcher::Wake();
+	return S_OK;
+}
+
+float StreamingVoice::GetFillRatio() const
+{
+	return (float)GetBufferedFrames() / m_PrefetchFrames;
+}
+
+bool StreamingVoice::NeedsPrefetch() const
+{
+	if (IsFinished() || IsStopRequested())
+	{
+		return false;
+	}
+
+	return m_PendingSeek != NO_PENDING_SEEK
+		|| (!m_IsEndOfStream && GetBufferedFrames() < m_PrefetchFrames);
+}
+
+HRESULT StreamingVoice::Prefetch()
+{
+	UINT64 pendingSeek = m_PendingSeek.exchange(NO_PENDING_SEEK);
+	if (pendingSeek != NO_PENDING_SEEK)
+	{
+		HRESULT hr = m_Decoder.SeekToFrame(pendingSeek);
+		m_PendingFrameCount = 0;
+		if (FAILED(hr))
+		{
+			// Past the end, or the source can't seek; either way there is nothing more to play.
+			m_IsEndOfStream = true;
+			return hr;
+		}
+
+		// Clear end-of-stream before publishing the discard point, so the audio thread never sees the new
+		// position together with the old stream's end.
+		m_IsEndOfStream.store(false, std::memory_order_release);
+		m_DiscardBefore.store(m_WritePosition.load(std::memory_order_relaxed), std::memory_order_release);
+	}
+
+	if (m_IsEndOfStream)
+	{
+		return S_FALSE;
+	}
+
+	if (m_PendingFrameCount == 0)
+	{
+		HRESULT hr = m_Decoder.ReadFrames(&m_PendingFrames, &m_PendingFrameCount);
+		if (FAILED(hr) || hr == S_FALSE)
+		{
+			// Whatever is already in the ring still plays out; a decode error just ends the stream early.
+			m_IsEndOfStream = true;
+			return hr;
+		}
+	}
+
+	UINT64 writePosition = m_WritePosition.load(std::memory_order_relaxed);
+	UINT32 buffered = (UINT32)(writePosition - m_ReadPosition.load(std::memory_order_acquire));
+	UINT32 framesToWrite = min(m_PrefetchFrames - buffered, m_PendingFrameCount);
+
+	// Deinterleave in up to two pieces, around the end of the ring.
+	UINT32 ringOffset = (UINT32)(writePosition & (m_RingFrames - 1));
+	UINT32 firstPiece = min(framesToWrite, m_RingFrames - ringOffset);
+	Deinterleave(m_PendingFrames, firstPiece, m_Ring.GetView().Offset(ringOffset));
+	Deinterleave(m_PendingFrames + (firstPiece * m_ChannelCount), framesToWrite - firstPiece, m_Ring.GetView());
+
+	m_PendingFrames += framesToWrite * m_ChannelCount;
+	m_PendingFrameCount -= framesToWrite;
+
+	m_WritePosition.store(writePosition + framesToWrite, std::memory_order_release);
+	return S_OK;
+}
+
+UINT32 StreamingVoice::RenderVoice(const PlanarView& mix, UINT32 frameCount)
+{
+	Contract::Requires(mix.ChannelCount == m_ChannelCount, L"Stream must be decoded in the device's channel count");
+
+	// Skip whatever was buffered before the latest seek, and buffer a period from the new position before playing.
+	UINT64 readPosition = m_ReadPosition.load(std::memory_order_relaxed);
+	UINT64 discardBefore = m_DiscardBefore.load(std::memory_order_acquire);
+	if (readPosition < discardBefore)
+	{
+		readPosition = discardBefore;
+		m_ReadPosition.store(readPosition, std::memory_order_release);
+		m_HasStarted = false;
+	}
+
+	// Read end-of-stream before the write position, so that once it is set every decoded frame is visible.
+	bool isEndOfStream = m_IsEndOfStream.load(std::memory_order_acquire);
+	UINT32 buffered = (UINT32)(m_WritePosition.load(std::memory_order_acquire) - readPosition);
+
+	if (!m_HasStarted)
+	{
+		if (buffered < frameCount && !isEndOfStream)
+		{
+			// Still buffering the first period; stay alive but silent.
+			StreamPrefetcher::Wake();
+			MarkOutputSilent();
+			return frameCount;
+		}
+
+		m_HasStarted = true;
+	}
+
+	UINT32 framesToMix = min(buffered, frameCount);
+	UINT32 ringOffset = (UINT32)(readPosition & (m_RingFrames - 1));
+	UINT32 firstPiece = min(framesToMix, m_RingFrames - ringOffset);
+
+	for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+	{
+		const float* source = m_Ring.Channel(channel);
+		float* destination = mix.Channel(channel);
+		for (UINT32 i = 0; i < firstPiece; i++)
+		{
+			destination[i] += source[ringOffset + i];
+		}
+		for (UINT32 i = firstPiece; i < framesToMix; i++)
+		{
+			destination[i] += source[i - firstPiece];
+		}
+	}
+
+	m_ReadPosition.store(readPosition + framesToMix, std::memory_order_release);
+
+	if (framesToMix < frameCount)
+	{
+		if (isEndOfStream)
+		{
+			// Played out; let the mixer retire us.
+			return framesToMix;
+		}
+
+		// The prefetcher fell behind; the rest of this period is silence.
+		m_StarvationCount++;
+		m_StarvedFrames += frameCount - framesToMix;
+	}
+
+	if (!isEndOfStream && (buffered - framesToMix) * 2 < m_PrefetchFrames)
+	{
+		StreamPrefetcher::Wake();
+	}
+
+	return frameCount;
+}
+
+void StreamingVoice::GetStatistics(STREAMINGVOICESTATS* stats) const
+{
+	stats->PrefetchFrames = m_PrefetchFrames;
+	stats->BufferedFrames = GetBufferedFrames();
+	stats->StarvationCount = m_StarvationCount;
+	stats->StarvedFrames = m_StarvedFrames;
+	stats->IsEndOfStream = m_IsEndOfStream;
+}
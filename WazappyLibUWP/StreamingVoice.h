@@ -0,0 +1,91 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <vector>
+
+#include "AudioVoice.h"
+#include "SampleDecoder.h"
+#include "PlanarBuffer.h"
+
+// Default prefetch window for streaming voices, in milliseconds.
+#define STREAMING_VOICE_DEFAULT_PREFETCH_MS 100
+
+namespace Wazappy
+{
+	// Voice which plays a file straight from disk.  A small ring buffer (the prefetch window) is kept topped up by
+	// the shared StreamPrefetcher I/O thread; the audio thread only ever copies out of the ring.
+	// Playback starts as soon as one period of audio is buffered.
+	class StreamingVoice : public AudioVoice
+	{
+	public:
+		StreamingVoice(VoiceId voiceId, UINT32 channelCount, UINT32 sampleRate, UINT32 prefetchFrames);
+
+		// Open the decoder on the given URL; does not decode anything yet.  Client thread, before the voice is
+		// handed to the prefetcher.
+		HRESULT Open(LPCWSTR url);
+
+		virtual UINT32 RenderVoice(const PlanarView& mix, UINT32 frameCount);
+
+		// Hands the seek to the prefetcher, which repositions the decoder; the voice goes quiet until one period
+		// from the new position is buffered.  Works even after the end of the stream has been reached.
+		virtual HRESULT Seek(UINT64 frame);
+
+		// Fraction of the prefetch window currently buffered, from 0 (starved) to 1 (full).  Any thread.
+		float GetFillRatio() const;
+
+		// True once the whole stream has been decoded into the ring.  Any thread.
+		bool IsEndOfStream() const { return m_IsEndOfStream; }
+
+		// True if the prefetcher still has work to do for this voice.  Any thread.
+		bool NeedsPrefetch() const;
+
+		// Apply any pending seek, then decode into the ring until it is full or one decoded chunk is consumed.
+		// Prefetch thread only.
+		HRESULT Prefetch();
+
+		// Frames buffered and not yet rendered.  Any thread.
+		UINT32 GetBufferedFrames() const { return (UINT32)(m_WritePosition - m_ReadPosition); }
+
+		void GetStatistics(STREAMINGVOICESTATS* stats) const;
+
+	protected:
+		virtual ~StreamingVoice() {}
+
+	private:
+		const UINT32 m_ChannelCount;
+		const UINT32 m_SampleRate;
+		const UINT32 m_PrefetchFrames;
+
+		// Ring of planar frames, deinterleaved as they are decoded; m_RingFrames is a power of two no smaller than
+		// m_PrefetchFrames.
+		PlanarBuffer m_Ring;
+		UINT32 m_RingFrames;
+
+		// Total frames ever written by the prefetcher / read by the audio thread.
+		std::atomic<UINT64> m_WritePosition;
+		std::atomic<UINT64> m_ReadPosition;
+
+		// Decoder state; only touched on the prefetch thread after Open.
+		SampleDecoder m_Decoder;
+		const float* m_PendingFrames;
+		UINT32 m_PendingFrameCount;
+
+		// Set once the decoder has run dry and everything decoded has been written to the ring.
+		std::atomic<bool> m_IsEndOfStream;
+
+		// Frame requested by the last Seek not yet applied by the prefetcher, or NO_PENDING_SEEK.
+		std::atomic<UINT64> m_PendingSeek;
+
+		// Ring position at which audio from the latest seek begins; the audio thread skips anything before it.
+		std::atomic<UINT64> m_DiscardBefore;
+
+		// Set once the first period has been buffered; before that the voice renders nothing.
+		bool m_HasStarted;
+
+		std::atomic<UINT32> m_StarvationCount;
+		std::atomic<UINT64> m_StarvedFrames;
+	};
+}
@@ -0,0 +1,136 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include "StretchVoice.h"
+
+using namespace Wazappy;
+
+StretchVoice::StretchVoice(VoiceId voiceId, const ComPtr<SampleAsset>& asset, float loopBeatsPerMinute, StretchQuality quality) :
+	AudioVoice(voiceId),
+	m_Asset(asset),
+	m_Source(asset.Get()),
+	m_Stretcher(asset->GetChannelCount(), quality),
+	m_LoopBeatsPerMinute(loopBeatsPerMinute),
+	m_Rate(1.0f),
+	m_FramesPerBeat(0),
+	m_PendingSeek(NO_PENDING_SEEK),
+	m_LastRate(1.0f),
+	m_FramesRendered(0),
+	m_RenderTicks(0)
+{
+	Contract::Requires(asset->GetFrameCount() > 0, L"Loop must not be empty");
+	Contract::Requires(loopBeatsPerMinute >= 0, L"Loop tempo must not be negative");
+}
+
+void StretchVoice::LoopSource::ReadSource(INT64 position, UINT32 frameCount, const PlanarView& destination)
+{
+	destination.Zero(frameCount);
+
+	INT64 loopFrames = (INT64)m_Asset->GetFrameCount();
+	INT64 loopPosition = position % loopFrames;
+	if (loopPosition < 0)
+	{
+		loopPosition += loopFrames;
+	}
+
+	UINT32 frame = 0;
+	while (frame < frameCount)
+	{
+		UINT32 framesToRead = (UINT32)min((INT64)(frameCount - frame), loopFrames - loopPosition);
+		bool isSilent;
+		m_Asset->MixFrames((UINT64)loopPosition, framesToRead, destination.Offset(frame), &isSilent);
+		frame += framesToRead;
+		loopPosition = 0;
+	}
+}
+
+void StretchVoice::SetStretch(float loopBeatsPerMinute, float rate)
+{
+	Contract::Requires(loopBeatsPerMinute >= 0, L"Loop tempo must not be negative");
+
+	m_Rate = rate;
+	m_LoopBeatsPerMinute = loopBeatsPerMinute;
+}
+
+float StretchVoice::GetRate() const
+{
+	float loopBeatsPerMinute = m_LoopBeatsPerMinute;
+	if (loopBeatsPerMinute > 0 && m_FramesPerBeat > 0)
+	{
+		// Source frames per beat of the loop, over output frames per beat of the device.
+		return (60.0f * m_Asset->GetSampleRate() / loopBeatsPerMinute) / m_FramesPerBeat;
+	}
+	return (loopBeatsPerMinute > 0) ? 1.0f : (float)m_Rate;
+}
+
+void StretchVoice::ApplyPendingSeek()
+{
+	UINT64 pendingSeek = m_PendingSeek.exchange(NO_PENDING_SEEK);
+	if (pendingSeek != NO_PENDING_SEEK)
+	{
+		m_Stretcher.Reset((double)pendingSeek);
+	}
+}
+
+HRESULT StretchVoice::Seek(UINT64 frame)
+{
+	if (frame >= m_Asset->GetFrameCount())
+	{
+		return E_INVALIDARG;
+	}
+
+	m_PendingSeek = frame;
+	return S_OK;
+}
+
+UINT32 StretchVoice::RenderVoice(const PlanarView& mix, UINT32 frameCount)
+{
+	Contract::Requires(mix.ChannelCount == m_Asset->GetChannelCount(), L"Asset must be decoded in the device's channel count");
+
+	ApplyPendingSeek();
+
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+
+	// A loop never ends; only Stop retires the voice.
+	float rate = GetRate();
+	m_Stretcher.Render(m_Source, mix, frameCount, rate);
+
+	LARGE_INTEGER end;
+	QueryPerformanceCounter(&end);
+	m_RenderTicks.store(m_RenderTicks.load(std::memory_order_relaxed) + (end.QuadPart - start.QuadPart), std::memory_order_relaxed);
+	m_FramesRendered.store(m_FramesRendered.load(std::memory_order_relaxed) + frameCount, std::memory_order_relaxed);
+	m_LastRate.store(rate, std::memory_order_relaxed);
+
+	return frameCount;
+}
+
+UINT32 StretchVoice::SkipVoice(const PlanarView& scratch, UINT32 frameCount)
+{
+	ApplyPendingSeek();
+
+	float rate = GetRate();
+	m_Stretcher.Skip(frameCount, rate);
+	m_LastRate.store(rate, std::memory_order_relaxed);
+	return frameCount;
+}
+
+float StretchVoice::GetAudibility()
+{
+	UINT64 loopFrames = m_Asset->GetFrameCount();
+	double position = fmod(m_Stretcher.GetSourcePosition(), (double)loopFrames);
+	return m_Asset->GetPeakAt((position < 0) ? (UINT64)(position + loopFrames) : (UINT64)position);
+}
+
+void StretchVoice::GetStatistics(STRETCHVOICESTATS* stats) const
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	stats->Quality = m_Stretcher.GetQuality();
+	stats->Rate = m_LastRate;
+	stats->FramesRendered = m_FramesRendered;
+	stats->RenderNanoseconds = (UINT64)((m_RenderTicks * 1000000000.0) / frequency.QuadPart);
+}
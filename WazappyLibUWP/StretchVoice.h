@@ -0,0 +1,80 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "AudioVoice.h"
+#include "SampleAsset.h"
+#include "TimeStretcher.h"
+
+namespace Wazappy
+{
+	// Voice which loops a decoded SampleAsset forever, changing its tempo without changing its pitch: either to
+	// follow the device's tempo, given the loop's own, or at a fixed rate.
+	class StretchVoice : public AudioVoice
+	{
+	public:
+		// The voice follows the device's tempo if loopBeatsPerMinute is positive, and plays at the natural rate
+		// until SetStretch says otherwise if it is 0.  Allocates, so never call this on an audio thread.
+		StretchVoice(VoiceId voiceId, const ComPtr<SampleAsset>& asset, float loopBeatsPerMinute, StretchQuality quality);
+
+		virtual UINT32 RenderVoice(const PlanarView& mix, UINT32 frameCount);
+
+		// Skipping just moves the stretcher on; it starts afresh when the voice is next rendered.
+		virtual UINT32 SkipVoice(const PlanarView& scratch, UINT32 frameCount);
+
+		// The peak of the asset block about to play.
+		virtual float GetAudibility();
+
+		// Start the loop again from the given frame, at the start of the next period.
+		virtual HRESULT Seek(UINT64 frame);
+
+		virtual void SetFramesPerBeat(float framesPerBeat) { m_FramesPerBeat = framesPerBeat; }
+
+		// Follow the device's tempo, for a loop at loopBeatsPerMinute, or if that is 0 play at rate source frames
+		// per output frame (within TIME_STRETCH_MIN_RATE and TIME_STRETCH_MAX_RATE).  Any thread.
+		void SetStretch(float loopBeatsPerMinute, float rate);
+
+		void GetStatistics(STRETCHVOICESTATS* stats) const;
+
+	private:
+		// Reads the asset as an endless loop.
+		class LoopSource : public StretchSource
+		{
+		public:
+			LoopSource(SampleAsset* asset) : m_Asset(asset) {}
+
+			virtual void ReadSource(INT64 position, UINT32 frameCount, const PlanarView& destination);
+
+		private:
+			SampleAsset* m_Asset;
+		};
+
+		// The rate to stretch at this period.
+		float GetRate() const;
+
+		// Apply any seek requested since the last period.
+		void ApplyPendingSeek();
+
+	private:
+		ComPtr<SampleAsset> m_Asset;
+		LoopSource m_Source;
+		TimeStretcher m_Stretcher;
+
+		// Set by SetStretch.
+		std::atomic<float> m_LoopBeatsPerMinute;
+		std::atomic<float> m_Rate;
+
+		// The device's tempo, from the mixer.  Audio thread only.
+		float m_FramesPerBeat;
+
+		// Frame requested by the last Seek not yet applied, or NO_PENDING_SEEK.
+		std::atomic<UINT64> m_PendingSeek;
+
+		// Written on the audio thread, read by GetStatistics.
+		std::atomic<float> m_LastRate;
+		std::atomic<UINT64> m_FramesRendered;
+		std::atomic<UINT64> m_RenderTicks;
+	};
+}
@@ -0,0 +1,492 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <float.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "TimeStretcher.h"
+
+using namespace Wazappy;
+
+// Sum of a periodic Hann window over positions a quarter of its length apart, and of its square.
+#define HANN_OVERLAP_SUM 2.0f
+#define HANN_SQUARED_OVERLAP_SUM 1.5f
+
+// Spectral power below which a bin is taken to hold nothing, so has no phase worth keeping.
+#define VOCODER_POWER_FLOOR 1e-20f
+
+// Bins quieter than this fraction of the loudest (60dB down) are never taken as peaks; they are window sidelobes
+// or noise, and locking them separately would only cost time.
+#define VOCODER_PEAK_FLOOR 1e-6f
+
+// x wrapped into [-pi, pi].
+static float WrapPhase(float x)
+{
+	return x - (float)(2 * M_PI) * floorf(x / (float)(2 * M_PI) + 0.5f);
+}
+
+// Sum of a[i] * b[i] for i < count.
+static float Dot(const float* a, const float* b, UINT32 count)
+{
+	float sum = 0;
+	UINT32 i = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	__m128 sums = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4)
+	{
+		sums = _mm_add_ps(sums, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+	}
+	sums = _mm_add_ps(sums, _mm_movehl_ps(sums, sums));
+	sums = _mm_add_ss(sums, _mm_shuffle_ps(sums, sums, 1));
+	sum = _mm_cvtss_f32(sums);
+#endif
+	for (; i < count; i++)
+	{
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+// How well a candidate matches, by normalized cross-correlation; squared, keeping its sign, to save a root.
+static float MatchScore(float dot, float energy)
+{
+	return dot * fabsf(dot) / (energy + 1e-12f);
+}
+
+TimeStretcher::TimeStretcher(UINT32 channelCount, StretchQuality quality) :
+	m_ChannelCount(channelCount),
+	m_Quality(quality),
+	m_SegmentFrames((Stretch_Wsola == quality) ? TIME_STRETCH_WSOLA_FRAMES : TIME_STRETCH_VOCODER_FRAMES),
+	m_Hop((Stretch_Wsola == quality) ? TIME_STRETCH_WSOLA_HOP : TIME_STRETCH_VOCODER_HOP),
+	m_SourcePosition(0),
+	m_LastSegmentPosition(0),
+	m_IsFresh(true),
+	m_OutputRead(0)
+{
+	m_Output.Allocate(channelCount, m_SegmentFrames);
+	m_OutputRead = m_Hop;
+
+	// Periodic Hann windows, which overlap-add to a constant at a quarter segment hop.
+	m_Window.resize(m_SegmentFrames);
+	for (UINT32 i = 0; i < m_SegmentFrames; i++)
+	{
+		m_Window[i] = (float)(0.5 - 0.5 * cos(2 * M_PI * i / m_SegmentFrames));
+	}
+
+	if (Stretch_Wsola == quality)
+	{
+		for (float& weight : m_Window)
+		{
+			weight /= HANN_OVERLAP_SUM;
+		}
+
+		m_Segment.Allocate(channelCount, TIME_STRETCH_WSOLA_FRAMES + (2 * TIME_STRETCH_WSOLA_TOLERANCE));
+		m_Continuation.Allocate(channelCount, TIME_STRETCH_WSOLA_MATCH_FRAMES);
+		m_SegmentMono.resize(TIME_STRETCH_WSOLA_MATCH_FRAMES + (2 * TIME_STRETCH_WSOLA_TOLERANCE));
+		m_Match.resize(TIME_STRETCH_WSOLA_MATCH_FRAMES);
+		m_SegmentCoarse.resize(m_SegmentMono.size() / TIME_STRETCH_WSOLA_DECIMATION);
+		m_MatchCoarse.resize(m_Match.size() / TIME_STRETCH_WSOLA_DECIMATION);
+	}
+	else
+	{
+		m_SynthesisWindow.resize(m_SegmentFrames);
+		for (UINT32 i = 0; i < m_SegmentFrames; i++)
+		{
+			m_SynthesisWindow[i] = m_Window[i] / HANN_SQUARED_OVERLAP_SUM;
+		}
+
+		UINT32 binCount = m_SegmentFrames / 2;
+		m_Segment.Allocate(channelCount, m_SegmentFrames);
+		m_Fft.reset(new RealFft(m_SegmentFrames));
+		m_FftBuffer.resize(m_SegmentFrames);
+		m_Spectrum.resize(binCount);
+		m_LastAnalysis.assign(channelCount, std::vector<std::complex<float>>(binCount));
+		m_LastSynthesis.assign(channelCount, std::vector<std::complex<float>>(binCount));
+		m_Power.resize(binCount);
+		m_Peaks.resize(binCount);
+		m_Rotations.resize(binCount);
+	}
+}
+
+void TimeStretcher::Reset(double sourcePosition)
+{
+	m_SourcePosition = sourcePosition;
+	m_IsFresh = true;
+	m_OutputRead = m_Hop;
+}
+
+void TimeStretcher::Skip(UINT32 frameCount, float rate)
+{
+	rate = max(TIME_STRETCH_MIN_RATE, min(TIME_STRETCH_MAX_RATE, rate));
+	Reset(m_SourcePosition + ((double)rate * frameCount));
+}
+
+void TimeStretcher::Render(StretchSource& source, const PlanarView& mix, UINT32 frameCount, float rate)
+{
+	rate = max(TIME_STRETCH_MIN_RATE, min(TIME_STRETCH_MAX_RATE, rate));
+
+	UINT32 frame = 0;
+	while (frame < frameCount)
+	{
+		if (m_OutputRead == m_Hop)
+		{
+			Hop(source, rate);
+		}
+
+		UINT32 framesToMix = min(frameCount - frame, m_Hop - m_OutputRead);
+		for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+		{
+			const float* output = m_Output.Channel(channel) + m_OutputRead;
+			float* destination = mix.Channel(channel) + frame;
+			for (UINT32 i = 0; i < framesToMix; i++)
+			{
+				destination[i] += output[i];
+			}
+		}
+		m_OutputRead += framesToMix;
+		frame += framesToMix;
+	}
+}
+
+void TimeStretcher::Hop(StretchSource& source, float rate)
+{
+	// Retire the hop just rendered, making room at the end for the new segment's tail.
+	for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+	{
+		float* output = m_Output.Channel(channel);
+		if (m_IsFresh)
+		{
+			memset(output, 0, m_SegmentFrames * sizeof(float));
+		}
+		else
+		{
+			memmove(output, output + m_Hop, (m_SegmentFrames - m_Hop) * sizeof(float));
+			memset(output + (m_SegmentFrames - m_Hop), 0, m_Hop * sizeof(float));
+		}
+	}
+
+	INT64 position = (INT64)floor(m_SourcePosition + 0.5);
+	if (Stretch_Wsola == m_Quality)
+	{
+		HopWsola(source, position);
+	}
+	else
+	{
+		HopVocoder(source, position);
+	}
+
+	m_IsFresh = false;
+	m_SourcePosition += (double)rate * m_Hop;
+	m_OutputRead = 0;
+}
+
+void TimeStretcher::HopWsola(StretchSource& source, INT64 position)
+{
+	const UINT32 tolerance = TIME_STRETCH_WSOLA_TOLERANCE;
+	const PlanarView& segment = m_Segment.GetView();
+	source.ReadSource(position - tolerance, m_Segment.GetMaxFrameCount(), segment);
+
+	// With nothing to continue from, take the segment where asked.
+	UINT32 offset = tolerance;
+	if (!m_IsFresh)
+	{
+		// The natural continuation of the last segment is what would have followed it in the source.
+		const PlanarView& continuation = m_Continuation.GetView();
+		source.ReadSource(m_LastSegmentPosition + m_Hop, TIME_STRETCH_WSOLA_MATCH_FRAMES, continuation);
+
+		UINT32 monoFrames = (UINT32)m_SegmentMono.size();
+		memcpy(m_SegmentMono.data(), segment.Channel(0), monoFrames * sizeof(float));
+		memcpy(m_Match.data(), continuation.Channel(0), TIME_STRETCH_WSOLA_MATCH_FRAMES * sizeof(float));
+		for (UINT32 channel = 1; channel < m_ChannelCount; channel++)
+		{
+			const float* samples = segment.Channel(channel);
+			for (UINT32 i = 0; i < monoFrames; i++)
+			{
+				m_SegmentMono[i] += samples[i];
+			}
+			samples = continuation.Channel(channel);
+			for (UINT32 i = 0; i < TIME_STRETCH_WSOLA_MATCH_FRAMES; i++)
+			{
+				m_Match[i] += samples[i];
+			}
+		}
+
+		offset = FindBestOffset();
+	}
+
+	for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+	{
+		const float* samples = segment.Channel(channel) + offset;
+		float* output = m_Output.Channel(channel);
+		UINT32 i = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+		for (; i + 4 <= m_SegmentFrames; i += 4)
+		{
+			__m128 windowed = _mm_mul_ps(_mm_loadu_ps(samples + i), _mm_loadu_ps(&m_Window[i]));
+			_mm_storeu_ps(output + i, _mm_add_ps(_mm_loadu_ps(output + i), windowed));
+		}
+#endif
+		for (; i < m_SegmentFrames; i++)
+		{
+			output[i] += samples[i] * m_Window[i];
+		}
+	}
+
+	m_LastSegmentPosition = position - tolerance + offset;
+}
+
+UINT32 TimeStretcher::FindBestOffset()
+{
+	const UINT32 decimation = TIME_STRETCH_WSOLA_DECIMATION;
+	const UINT32 candidates = (2 * TIME_STRETCH_WSOLA_TOLERANCE) / decimation + 1;
+	const UINT32 matchFrames = TIME_STRETCH_WSOLA_MATCH_FRAMES / decimation;
+
+	// Decimate by summing each run of frames; crude, but only the best candidate's neighbourhood is kept.
+	for (size_t i = 0; i < m_SegmentCoarse.size(); i++)
+	{
+		const float* samples = &m_SegmentMono[i * decimation];
+		m_SegmentCoarse[i] = samples[0] + samples[1] + samples[2] + samples[3];
+	}
+	for (size_t i = 0; i < m_MatchCoarse.size(); i++)
+	{
+		const float* samples = &m_Match[i * decimation];
+		m_MatchCoarse[i] = samples[0] + samples[1] + samples[2] + samples[3];
+	}
+
+	// Energy of each candidate's window, sliding.
+	float energy = 0;
+	for (UINT32 i = 0; i < matchFrames; i++)
+	{
+		energy += m_SegmentCoarse[i] * m_SegmentCoarse[i];
+	}
+
+	UINT32 bestCoarse = 0;
+	float bestScore = -FLT_MAX;
+	UINT32 candidate = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	// Four neighbouring candidates to a vector: each step multiplies one frame of the match by the frame at that
+	// point in each candidate's window.
+	for (; candidate + 4 <= candidates; candidate += 4)
+	{
+		const float* windows = &m_SegmentCoarse[candidate];
+		__m128 dots = _mm_setzero_ps();
+		for (UINT32 i = 0; i < matchFrames; i++)
+		{
+			dots = _mm_add_ps(dots, _mm_mul_ps(_mm_set1_ps(m_MatchCoarse[i]), _mm_loadu_ps(windows + i)));
+		}
+
+		float dot[4];
+		_mm_storeu_ps(dot, dots);
+		for (UINT32 lane = 0; lane < 4; lane++)
+		{
+			float score = MatchScore(dot[lane], energy);
+			if (score > bestScore)
+			{
+				bestScore = score;
+				bestCoarse = candidate + lane;
+			}
+			float leaving = windows[lane];
+			float entering = windows[lane + matchFrames];
+			energy += (entering * entering) - (leaving * leaving);
+		}
+	}
+#endif
+	for (; candidate < candidates; candidate++)
+	{
+		const float* window = &m_SegmentCoarse[candidate];
+		float score = MatchScore(Dot(m_MatchCoarse.data(), window, matchFrames), energy);
+		if (score > bestScore)
+		{
+			bestScore = score;
+			bestCoarse = candidate;
+		}
+		if (candidate + 1 < candidates)
+		{
+			energy += (window[matchFrames] * window[matchFrames]) - (window[0] * window[0]);
+		}
+	}
+
+	// Refine at the full rate, within a coarse step either side.
+	UINT32 first = (bestCoarse * decimation >= decimation - 1) ? (bestCoarse * decimation - (decimation - 1)) : 0;
+	UINT32 last = min(bestCoarse * decimation + (decimation - 1), (UINT32)(2 * TIME_STRETCH_WSOLA_TOLERANCE));
+	UINT32 bestOffset = bestCoarse * decimation;
+	bestScore = -FLT_MAX;
+	for (UINT32 offset = first; offset <= last; offset++)
+	{
+		const float* window = &m_SegmentMono[offset];
+		float score = MatchScore(Dot(m_Match.data(), window, TIME_STRETCH_WSOLA_MATCH_FRAMES), Dot(window, window, TIME_STRETCH_WSOLA_MATCH_FRAMES));
+		if (score > bestScore)
+		{
+			bestScore = score;
+			bestOffset = offset;
+		}
+	}
+
+	return bestOffset;
+}
+
+void TimeStretcher::HopVocoder(StretchSource& source, INT64 position)
+{
+	const PlanarView& segment = m_Segment.GetView();
+	source.ReadSource(position, m_SegmentFrames, segment);
+
+	INT64 analysisHop = m_IsFresh ? 0 : (position - m_LastSegmentPosition);
+	UINT32 binCount = m_SegmentFrames / 2;
+	for (UINT32 channel = 0; channel < m_ChannelCount; channel++)
+	{
+		const float* samples = segment.Channel(channel);
+		for (UINT32 i = 0; i < m_SegmentFrames; i++)
+		{
+			m_FftBuffer[i] = samples[i] * m_Window[i];
+		}
+		m_Fft->Forward(m_FftBuffer.data(), m_Spectrum.data());
+
+		if (analysisHop > 0)
+		{
+			LockPhases(channel, analysisHop);
+		}
+		else
+		{
+			// Start from the analysis phases as they are.
+			memcpy(m_LastAnalysis[channel].data(), m_Spectrum.data(), binCount * sizeof(std::complex<float>));
+		}
+		memcpy(m_LastSynthesis[channel].data(), m_Spectrum.data(), binCount * sizeof(std::complex<float>));
+
+		m_Fft->Inverse(m_Spectrum.data(), m_FftBuffer.data());
+		float* output = m_Output.Channel(channel);
+		for (UINT32 i = 0; i < m_SegmentFrames; i++)
+		{
+			output[i] += m_FftBuffer[i] * m_SynthesisWindow[i];
+		}
+	}
+
+	m_LastSegmentPosition = position;
+}
+
+void TimeStretcher::LockPhases(UINT32 channel, INT64 analysisHop)
+{
+	const UINT32 binCount = m_SegmentFrames / 2;
+	std::complex<float>* spectrum = m_Spectrum.data();
+	std::vector<std::complex<float>>& lastAnalysis = m_LastAnalysis[channel];
+	const std::vector<std::complex<float>>& lastSynthesis = m_LastSynthesis[channel];
+
+	// Power of each bin; bin 0 packs the real DC and Nyquist terms, which keep their phases.
+	const float* bins = reinterpret_cast<const float*>(spectrum);
+	UINT32 bin = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	for (; bin + 4 <= binCount; bin += 4)
+	{
+		__m128 low = _mm_loadu_ps(bins + (bin * 2));
+		__m128 high = _mm_loadu_ps(bins + (bin * 2) + 4);
+		__m128 real = _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 imaginary = _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(&m_Power[bin], _mm_add_ps(_mm_mul_ps(real, real), _mm_mul_ps(imaginary, imaginary)));
+	}
+#endif
+	for (; bin < binCount; bin++)
+	{
+		m_Power[bin] = std::norm(spectrum[bin]);
+	}
+	m_Power[0] = 0;
+
+	float loudest = 0;
+	for (bin = 1; bin < binCount; bin++)
+	{
+		loudest = max(loudest, m_Power[bin]);
+	}
+	float peakFloor = max(VOCODER_POWER_FLOOR, loudest * VOCODER_PEAK_FLOOR);
+
+	// Peaks: bins louder than the two either side.
+	UINT32 peakCount = 0;
+	for (bin = 1; bin < binCount; bin++)
+	{
+		float power = m_Power[bin];
+		if (power > peakFloor &&
+			power > m_Power[bin - 1] && (bin < 2 || power > m_Power[bin - 2]) &&
+			(bin + 1 >= binCount || power >= m_Power[bin + 1]) && (bin + 2 >= binCount || power >= m_Power[bin + 2]))
+		{
+			m_Peaks[peakCount++] = bin;
+		}
+	}
+
+	// Each peak's phase moves on by its measured frequency over the output hop; the rotation taking its analysis
+	// phase there is applied to every bin around it, so they keep their phases relative to it.
+	const float binFrequency = (float)(2 * M_PI) / m_SegmentFrames;
+	const float hopRatio = (float)m_Hop / analysisHop;
+	UINT32 regionStart = 1;
+	for (UINT32 peak = 0; peak < peakCount; peak++)
+	{
+		UINT32 peakBin = m_Peaks[peak];
+		std::complex<float> current = spectrum[peakBin];
+		std::complex<float> change = current * std::conj(lastAnalysis[peakBin]);
+		float expected = binFrequency * peakBin * (float)analysisHop;
+		float deviation = WrapPhase(atan2f(change.imag(), change.real()) - expected);
+		float advance = WrapPhase((expected + deviation) * hopRatio);
+
+		float lastPower = std::norm(lastSynthesis[peakBin]);
+		std::complex<float> rotation;
+		if (lastPower > 0)
+		{
+			// The new phase relative to the analysis phase, as a unit phasor.
+			std::complex<float> synthesis = lastSynthesis[peakBin] * std::complex<float>(cosf(advance), sinf(advance));
+			rotation = synthesis * std::conj(current) / sqrtf(lastPower * m_Power[peakBin]);
+		}
+		else
+		{
+			rotation = 1.0f;
+		}
+
+		// The peak's region runs to the quietest bin before the next peak.
+		UINT32 regionEnd = binCount;
+		if (peak + 1 < peakCount)
+		{
+			regionEnd = peakBin + 1;
+			for (UINT32 between = peakBin + 1; between < m_Peaks[peak + 1]; between++)
+			{
+				if (m_Power[between] < m_Power[regionEnd])
+				{
+					regionEnd = between;
+				}
+			}
+		}
+		for (bin = regionStart; bin < regionEnd; bin++)
+		{
+			m_Rotations[bin] = rotation;
+		}
+		regionStart = regionEnd;
+	}
+	for (bin = regionStart; bin < binCount; bin++)
+	{
+		m_Rotations[bin] = 1.0f;
+	}
+
+	memcpy(lastAnalysis.data(), spectrum, binCount * sizeof(std::complex<float>));
+
+	// Rotate every bin but the packed bin 0.
+	bin = 1;
+	float* samples = reinterpret_cast<float*>(spectrum);
+	const float* rotations = reinterpret_cast<const float*>(m_Rotations.data());
+#if defined(_M_IX86) || defined(_M_X64)
+	const __m128 crossSigns = _mm_castsi128_ps(_mm_set_epi32(0, 0x80000000, 0, 0x80000000));
+	for (; bin + 2 <= binCount; bin += 2)
+	{
+		__m128 x = _mm_loadu_ps(samples + (bin * 2));
+		__m128 y = _mm_loadu_ps(rotations + (bin * 2));
+		__m128 real = _mm_shuffle_ps(y, y, _MM_SHUFFLE(2, 2, 0, 0));
+		__m128 imaginary = _mm_xor_ps(_mm_shuffle_ps(y, y, _MM_SHUFFLE(3, 3, 1, 1)), crossSigns);
+		__m128 swapped = _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1));
+		_mm_storeu_ps(samples + (bin * 2), _mm_add_ps(_mm_mul_ps(x, real), _mm_mul_ps(swapped, imaginary)));
+	}
+#endif
+	for (; bin < binCount; bin++)
+	{
+		spectrum[bin] *= m_Rotations[bin];
+	}
+}
@@ -0,0 +1,153 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <complex>
+#include <memory>
+#include <vector>
+
+#include "WazappyDllInterface.h"
+#include "PlanarBuffer.h"
+#include "Fft.h"
+
+// Range of stretch rates (source frames per output frame); rates outside it are held within it.
+#define TIME_STRETCH_MIN_RATE 0.25f
+#define TIME_STRETCH_MAX_RATE 4.0f
+
+// WSOLA: frames in each windowed segment, and output frames between segments (a quarter of a segment, so four
+// segments overlap at any frame).
+#define TIME_STRETCH_WSOLA_FRAMES 1024
+#define TIME_STRETCH_WSOLA_HOP 256
+
+// WSOLA: how far either side of its nominal position a segment may be taken from, and how many frames at its
+// start are compared with the natural continuation of the last one.
+#define TIME_STRETCH_WSOLA_TOLERANCE 256
+#define TIME_STRETCH_WSOLA_MATCH_FRAMES 512
+
+// WSOLA: the search first compares every candidate at this fraction of the sample rate, then refines the best
+// at the full rate.
+#define TIME_STRETCH_WSOLA_DECIMATION 4
+
+// Phase vocoder: FFT size, and output frames between frames (four frames overlap at any frame).
+#define TIME_STRETCH_VOCODER_FRAMES 2048
+#define TIME_STRETCH_VOCODER_HOP 512
+
+namespace Wazappy
+{
+	// Where a TimeStretcher reads its input from.
+	class StretchSource
+	{
+	public:
+		// Overwrite the first frameCount frames of destination, which has the stretcher's channel count, with
+		// the source's frames from position on.  Positions before the start or past the end of the source read
+		// as whatever the source likes (silence, or the other end of a loop).  Called on the audio thread; must
+		// not allocate or block.
+		virtual void ReadSource(INT64 position, UINT32 frameCount, const PlanarView& destination) = 0;
+	};
+
+	// Changes the tempo of audio without changing its pitch, as it streams.  Output is built by overlap-adding
+	// windowed segments a fixed hop apart, each taken from the source a hop times the rate further on than the
+	// last; the work for a period is the few hops it covers, each of fixed cost whatever the source or position.
+	// The rate may change at any hop, and just moves the next segment on by more or less, so it never clicks.
+	// Two qualities:
+	// - Stretch_Wsola takes each segment from within TIME_STRETCH_WSOLA_TOLERANCE of its nominal position, at the
+	//   offset where it best matches the continuation of the previous segment: a coarse search by normalized
+	//   cross-correlation of decimated mono, four candidates to a vector, then a fine one around the best.  Cheap,
+	//   and sharp on drums, but can warble on sustained chords.
+	// - Stretch_PhaseVocoder takes each segment's spectrum (by SIMD FFT) and advances each spectral peak's phase
+	//   by its measured frequency over the output hop, locking the bins around each peak to it (identity phase
+	//   locking), so sustained tones stay clean; transients soften a little.  Only the peaks need trigonometry;
+	//   every other bin is a complex multiply.
+	// Audio thread only once constructed.
+	class TimeStretcher
+	{
+	public:
+		// Allocates, so never call this on an audio thread.
+		TimeStretcher(UINT32 channelCount, StretchQuality quality);
+
+		StretchQuality GetQuality() const { return m_Quality; }
+
+		// Output frames between segments.
+		UINT32 GetHopFrames() const { return m_Hop; }
+
+		// The source position the next segment is nominally taken from.
+		double GetSourcePosition() const { return m_SourcePosition; }
+
+		// Start again from the given source position, dropping any output in flight.
+		void Reset(double sourcePosition);
+
+		// Add frameCount stretched frames into mix, which has the stretcher's channel count, reading from source
+		// at rate source frames per output frame.
+		void Render(StretchSource& source, const PlanarView& mix, UINT32 frameCount, float rate);
+
+		// Move on by frameCount output frames at the given rate without producing output; the next Render starts
+		// again from there.
+		void Skip(UINT32 frameCount, float rate);
+
+	private:
+		// Overlap-add the next segment into m_Output, taking it from source, and move on.
+		void Hop(StretchSource& source, float rate);
+
+		// Add the next WSOLA segment, nominally from position, into m_Output.
+		void HopWsola(StretchSource& source, INT64 position);
+
+		// Choose the offset (within twice the tolerance) into m_Segment which best matches the mono continuation
+		// in m_Match.
+		UINT32 FindBestOffset();
+
+		// Add the next phase vocoder frame, from position, into m_Output.
+		void HopVocoder(StretchSource& source, INT64 position);
+
+		// Phase-lock one channel's spectrum in m_Spectrum to the previous frame's, into m_Spectrum.
+		void LockPhases(UINT32 channel, INT64 analysisHop);
+
+	private:
+		const UINT32 m_ChannelCount;
+		const StretchQuality m_Quality;
+
+		// Frames per segment, and output frames between segments.
+		const UINT32 m_SegmentFrames;
+		const UINT32 m_Hop;
+
+		// Next nominal source position, and the actual position the last segment was taken from.
+		double m_SourcePosition;
+		INT64 m_LastSegmentPosition;
+
+		// True until the first segment after a reset; it is taken exactly where asked, with nothing to match.
+		bool m_IsFresh;
+
+		// Overlap-add accumulator, a segment long: the first m_Hop frames are finished once a segment has been
+		// added, and m_OutputRead of them have been rendered.
+		PlanarBuffer m_Output;
+		UINT32 m_OutputRead;
+
+		// Analysis window, with the overlap-add gain folded in, and (for the vocoder) the synthesis window.
+		std::vector<float> m_Window;
+		std::vector<float> m_SynthesisWindow;
+
+		// Source frames read for a segment: for WSOLA the whole search range, for the vocoder just the segment.
+		PlanarBuffer m_Segment;
+
+		// WSOLA scratch: the search range and the natural continuation in mono, at the full and decimated rates.
+		PlanarBuffer m_Continuation;
+		std::vector<float> m_SegmentMono;
+		std::vector<float> m_Match;
+		std::vector<float> m_SegmentCoarse;
+		std::vector<float> m_MatchCoarse;
+
+		// Vocoder state.  Each channel's previous analysis and synthesis spectra, whose phases the next frame
+		// continues from.
+		std::unique_ptr<RealFft> m_Fft;
+		std::vector<float> m_FftBuffer;
+		std::vector<std::complex<float>> m_Spectrum;
+		std::vector<std::vector<std::complex<float>>> m_LastAnalysis;
+		std::vector<std::vector<std::complex<float>>> m_LastSynthesis;
+
+		// Vocoder scratch: each bin's power, the peak bins, and the rotation locked to each bin's peak.
+		std::vector<float> m_Power;
+		std::vector<UINT32> m_Peaks;
+		std::vector<std::complex<float>> m_Rotations;
+	};
+}
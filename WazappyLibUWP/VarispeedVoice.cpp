@@ -0,0 +1,203 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include "VarispeedVoice.h"
+
+using namespace Wazappy;
+
+VarispeedVoice::VarispeedVoice(VoiceId voiceId, const ComPtr<SampleAsset>& asset, float rate, InterpolationQuality quality, bool isLooping) :
+	AudioVoice(voiceId),
+	m_Asset(asset),
+	m_IsLooping(isLooping),
+	m_Position((rate < 0) ? (double)(asset->GetFrameCount() - 1) : 0.0),
+	m_Rate(rate),
+	m_Quality(quality),
+	m_IsShedding(false),
+	m_PendingSeek(NO_PENDING_SEEK),
+	m_LastQuality(quality),
+	m_FramesRendered(0),
+	m_RenderTicks(0)
+{
+	Contract::Requires(asset->GetFrameCount() > 0, L"Asset must not be empty");
+	Contract::Requires(fabsf(rate) <= VARISPEED_MAX_RATE, L"Rate must be within VARISPEED_MAX_RATE");
+
+	// The frames a chunk's positions span, plus the kernel's reach either side and a frame of rounding slack each
+	// way.
+	m_Window.Allocate(asset->GetChannelCount(),
+		(UINT32)(VARISPEED_CHUNK_FRAMES * VARISPEED_MAX_RATE) + INTERPOLATOR_FRAMES_BEFORE + INTERPOLATOR_FRAMES_AFTER + 4);
+}
+
+void VarispeedVoice::SetVarispeed(float rate, InterpolationQuality quality)
+{
+	Contract::Requires(fabsf(rate) <= VARISPEED_MAX_RATE, L"Rate must be within VARISPEED_MAX_RATE");
+
+	m_Rate = rate;
+	m_Quality = quality;
+}
+
+HRESULT VarispeedVoice::Seek(UINT64 frame)
+{
+	if (frame >= m_Asset->GetFrameCount())
+	{
+		return E_INVALIDARG;
+	}
+
+	m_PendingSeek = frame;
+	return S_OK;
+}
+
+void VarispeedVoice::ApplyPendingSeek()
+{
+	UINT64 pendingSeek = m_PendingSeek.exchange(NO_PENDING_SEEK);
+	if (pendingSeek != NO_PENDING_SEEK)
+	{
+		m_Position = (double)pendingSeek;
+	}
+}
+
+UINT32 VarispeedVoice::GetFramesLeft(UINT32 frameCount, float rate) const
+{
+	if (m_IsLooping || rate == 0)
+	{
+		return frameCount;
+	}
+
+	double loopFrames = (double)m_Asset->GetFrameCount();
+	double framesLeft;
+	if (rate > 0)
+	{
+		// Frames whose positions are still short of the end.
+		framesLeft = (m_Position < loopFrames) ? ceil((loopFrames - m_Position) / rate) : 0;
+	}
+	else
+	{
+		// Frames whose positions are still at or after the start.
+		framesLeft = (m_Position >= 0) ? (floor(m_Position / -rate) + 1) : 0;
+	}
+	return (UINT32)min((double)frameCount, framesLeft);
+}
+
+void VarispeedVoice::Advance(UINT32 frameCount, float rate)
+{
+	m_Position += (double)rate * frameCount;
+	if (m_IsLooping)
+	{
+		double loopFrames = (double)m_Asset->GetFrameCount();
+		m_Position = fmod(m_Position, loopFrames);
+		if (m_Position < 0)
+		{
+			m_Position += loopFrames;
+		}
+	}
+}
+
+void VarispeedVoice::ReadWindow(INT64 position, UINT32 frameCount)
+{
+	const PlanarView& window = m_Window.GetView();
+	window.Zero(frameCount);
+
+	INT64 assetFrames = (INT64)m_Asset->GetFrameCount();
+	bool isSilent;
+	if (!m_IsLooping)
+	{
+		INT64 first = max(position, 0LL);
+		INT64 last = min(position + frameCount, assetFrames);
+		if (first < last)
+		{
+			m_Asset->MixFrames((UINT64)first, (UINT32)(last - first), window.Offset((UINT32)(first - position)), &isSilent);
+		}
+		return;
+	}
+
+	INT64 loopPosition = position % assetFrames;
+	if (loopPosition < 0)
+	{
+		loopPosition += assetFrames;
+	}
+
+	UINT32 frame = 0;
+	while (frame < frameCount)
+	{
+		UINT32 framesToRead = (UINT32)min((INT64)(frameCount - frame), assetFrames - loopPosition);
+		m_Asset->MixFrames((UINT64)loopPosition, framesToRead, window.Offset(frame), &isSilent);
+		frame += framesToRead;
+		loopPosition = 0;
+	}
+}
+
+UINT32 VarispeedVoice::RenderVoice(const PlanarView& mix, UINT32 frameCount)
+{
+	Contract::Requires(mix.ChannelCount == m_Asset->GetChannelCount(), L"Asset must be decoded in the device's channel count");
+
+	ApplyPendingSeek();
+
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+
+	float rate = m_Rate;
+	InterpolationQuality quality = m_Quality;
+	if (m_IsShedding && quality == Interpolation_Sinc)
+	{
+		quality = Interpolation_Hermite;
+	}
+
+	// Fewer frames than asked for means the position ran off an end of the asset.
+	UINT32 framesRendered = GetFramesLeft(frameCount, rate);
+	UINT32 frame = 0;
+	while (frame < framesRendered)
+	{
+		UINT32 chunkFrames = min(framesRendered - frame, (UINT32)VARISPEED_CHUNK_FRAMES);
+
+		// The window runs from the kernel's reach behind the lowest position the chunk reads to its reach ahead of
+		// the highest, either of which may be the first, with a frame of slack either side for rounding.
+		double last = m_Position + ((double)rate * (chunkFrames - 1));
+		INT64 windowStart = (INT64)floor(min(m_Position, last)) - INTERPOLATOR_FRAMES_BEFORE - 1;
+		UINT32 windowFrames = (UINT32)((INT64)floor(max(m_Position, last)) - windowStart) + INTERPOLATOR_FRAMES_AFTER + 2;
+		ReadWindow(windowStart, windowFrames);
+
+		float first = (float)(m_Position - windowStart);
+		for (UINT32 channel = 0; channel < mix.ChannelCount; channel++)
+		{
+			Interpolator::Interpolate(quality, m_Window.Channel(channel), first, rate, mix.Channel(channel) + frame, chunkFrames);
+		}
+
+		Advance(chunkFrames, rate);
+		frame += chunkFrames;
+	}
+
+	LARGE_INTEGER end;
+	QueryPerformanceCounter(&end);
+	m_RenderTicks.store(m_RenderTicks.load(std::memory_order_relaxed) + (end.QuadPart - start.QuadPart), std::memory_order_relaxed);
+	m_FramesRendered.store(m_FramesRendered.load(std::memory_order_relaxed) + framesRendered, std::memory_order_relaxed);
+	m_LastQuality.store(quality, std::memory_order_relaxed);
+
+	return framesRendered;
+}
+
+UINT32 VarispeedVoice::SkipVoice(const PlanarView& scratch, UINT32 frameCount)
+{
+	ApplyPendingSeek();
+
+	float rate = m_Rate;
+	UINT32 framesSkipped = GetFramesLeft(frameCount, rate);
+	Advance(framesSkipped, rate);
+	return framesSkipped;
+}
+
+float VarispeedVoice::GetAudibility()
+{
+	return (m_Position >= 0) ? m_Asset->GetPeakAt((UINT64)m_Position) : 0.0f;
+}
+
+void VarispeedVoice::GetStatistics(VARISPEEDVOICESTATS* stats) const
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	stats->Quality = m_LastQuality;
+	stats->Rate = m_Rate;
+	stats->FramesRendered = m_FramesRendered;
+	stats->RenderNanoseconds = (UINT64)((m_RenderTicks * 1000000000.0) / frequency.QuadPart);
+}
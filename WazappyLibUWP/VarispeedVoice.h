@@ -0,0 +1,88 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "AudioVoice.h"
+#include "SampleAsset.h"
+#include "Interpolator.h"
+
+// Fastest a varispeed voice plays, forwards or backwards, in source frames per output frame.
+#define VARISPEED_MAX_RATE 4.0f
+
+// Most output frames interpolated from one read of the asset.
+#define VARISPEED_CHUNK_FRAMES 256
+
+namespace Wazappy
+{
+	// Voice which plays a decoded SampleAsset at any rate from -VARISPEED_MAX_RATE to VARISPEED_MAX_RATE source
+	// frames per output frame, changing its pitch with its speed like tape; negative rates play it backwards.
+	// Plays once, or loops forever until stopped.  For each chunk of output the frames it covers are read out of
+	// the asset into a planar window, and each channel is interpolated from there (see Interpolator).
+	class VarispeedVoice : public AudioVoice
+	{
+	public:
+		// Starts at the beginning for a positive rate, at the end for a negative one.  Allocates, so never call this
+		// on an audio thread.
+		VarispeedVoice(VoiceId voiceId, const ComPtr<SampleAsset>& asset, float rate, InterpolationQuality quality, bool isLooping);
+
+		virtual UINT32 RenderVoice(const PlanarView& mix, UINT32 frameCount);
+
+		// In memory, skipping ahead is just moving the position.
+		virtual UINT32 SkipVoice(const PlanarView& scratch, UINT32 frameCount);
+
+		// The peak of the asset block about to play.
+		virtual float GetAudibility();
+
+		// Seeking in memory is just a new position, applied at the start of the next period.
+		virtual HRESULT Seek(UINT64 frame);
+
+		// From ShedLevel_Quality up, sinc interpolation drops to Hermite.
+		virtual void SetShedLevel(ShedLevel level) { m_IsShedding = (level >= ShedLevel_Quality); }
+
+		// Change the rate and interpolation, from the next period.  Any thread.
+		void SetVarispeed(float rate, InterpolationQuality quality);
+
+		void GetStatistics(VARISPEEDVOICESTATS* stats) const;
+
+	private:
+		// Apply any seek requested since the last period.
+		void ApplyPendingSeek();
+
+		// Frames, up to frameCount, until the position leaves the asset at the given rate; all of them for a loop.
+		UINT32 GetFramesLeft(UINT32 frameCount, float rate) const;
+
+		// Move the position on by frameCount frames at the given rate, wrapping it into the loop.
+		void Advance(UINT32 frameCount, float rate);
+
+		// Read frameCount frames of the asset from position on into m_Window; frames outside the asset are silent,
+		// or wrap around a loop.
+		void ReadWindow(INT64 position, UINT32 frameCount);
+
+	private:
+		ComPtr<SampleAsset> m_Asset;
+		const bool m_IsLooping;
+
+		// The frames the chunk being interpolated reads.  Audio thread only.
+		PlanarBuffer m_Window;
+
+		// Position of the next frame to render, in source frames.  Only touched on the audio thread.
+		double m_Position;
+
+		// Set by SetVarispeed.
+		std::atomic<float> m_Rate;
+		std::atomic<InterpolationQuality> m_Quality;
+
+		// Audio thread only.
+		bool m_IsShedding;
+
+		// Frame requested by the last Seek not yet applied, or NO_PENDING_SEEK.
+		std::atomic<UINT64> m_PendingSeek;
+
+		// Written on the audio thread, read by GetStatistics.
+		std::atomic<InterpolationQuality> m_LastQuality;
+		std::atomic<UINT64> m_FramesRendered;
+		std::atomic<UINT64> m_RenderTicks;
+	};
+}
@@ -0,0 +1,756 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#include "pch.h"
+#include "VoiceMixer.h"
+
+#include <algorithm>
+
+using namespace Wazappy;
+
+std::atomic<VoiceId> VoiceMixer::s_nextVoiceId{};
+
+VoiceMixer::VoiceMixer() :
+	m_ReservedFrames(0),
+	m_RealVoiceBudget(0),
+	m_IsActiveCapacityPending(false),
+	m_ActiveCapacity(VOICE_MIXER_INITIAL_CAPACITY),
+	m_AddedVoices(0),
+	m_RetiredVoices(0),
+	m_ShedLevel(ShedLevel_None),
+	m_IsReverbPending(false),
+	m_IsSpatializerPending(false),
+	m_IsAmbisonicBusPending(false),
+	m_BusDelay(nullptr),
+	m_FramesPerBeat(0),
+	m_VoiceFramesPerBeat(0),
+	m_MixPeriods(0),
+	m_SilentMixPeriods(0),
+	m_VoicePeriods(0),
+	m_SilentVoicePeriods(0),
+	m_SkippedVoicePeriods(0),
+	m_LiveInputPeriods(0),
+	m_VirtualVoicePeriods(0),
+	m_StolenVoices(0)
+{
+	m_PendingVoices.reserve(VOICE_MIXER_INITIAL_CAPACITY);
+	m_ActiveVoices.reserve(VOICE_MIXER_INITIAL_CAPACITY);
+	m_Ranks.reserve(VOICE_MIXER_INITIAL_CAPACITY);
+
+	// The audio thread retires at most one reverb between client calls, which purge them.
+	m_RetiredReverbs.reserve(2);
+	m_RetiredSpatializers.reserve(2);
+	m_RetiredAmbisonicBuses.reserve(2);
+}
+
+VoiceMixer::~VoiceMixer()
+{
+	PurgeRetiredReverbs();
+	if (m_PendingReverb != nullptr)
+	{
+		m_PendingReverb->Shutdown();
+	}
+	if (m_Reverb != nullptr)
+	{
+		m_Reverb->Shutdown();
+	}
+	delete m_BusDelay.load();
+}
+
+VoiceId VoiceMixer::GetNextVoiceId()
+{
+	return ++s_nextVoiceId;
+}
+
+void VoiceMixer::PurgeFinishedVoices()
+{
+	for (auto iter = m_Voices.begin(); iter != m_Voices.end();)
+	{
+		if (iter->second->IsFinished())
+		{
+			iter = m_Voices.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+}
+
+void VoiceMixer::PurgeRetiredReverbs()
+{
+	for (auto& reverb : m_RetiredReverbs)
+	{
+		reverb->Shutdown();
+	}
+	m_RetiredReverbs.clear();
+}
+
+void VoiceMixer::PurgeRetiredSpatializers()
+{
+	m_RetiredSpatializers.clear();
+	m_RetiredAmbisonicBuses.clear();
+}
+
+void VoiceMixer::SetReverb(const ComPtr<ConvolutionReverb>& reverb)
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	PurgeRetiredReverbs();
+
+	// A reverb the audio thread never picked up can be shut down straight away.
+	if (m_PendingReverb != nullptr)
+	{
+		m_PendingReverb->Shutdown();
+	}
+
+	m_PendingReverb = reverb;
+	m_CurrentReverb = reverb;
+	m_IsReverbPending = true;
+}
+
+void VoiceMixer::SetSpatializer(const ComPtr<BinauralSpatializer>& spatializer)
+{
+	if (spatializer != nullptr)
+	{
+		spatializer->Reserve(m_ReservedFrames);
+	}
+
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	PurgeRetiredSpatializers();
+
+	m_PendingSpatializer = spatializer;
+	m_CurrentSpatializer = spatializer;
+	m_IsSpatializerPending = true;
+}
+
+void VoiceMixer::GetSpatializerStatistics(SPATIALIZERSTATS* stats)
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	PurgeRetiredSpatializers();
+
+	if (m_CurrentSpatializer != nullptr)
+	{
+		m_CurrentSpatializer->GetStatistics(stats);
+	}
+	else
+	{
+		*stats = SPATIALIZERSTATS{};
+	}
+}
+
+void VoiceMixer::SetAmbisonicBus(const ComPtr<AmbisonicBus>& bus)
+{
+	if (bus != nullptr)
+	{
+		bus->Reserve(m_ReservedFrames);
+	}
+
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	PurgeRetiredSpatializers();
+
+	m_PendingAmbisonicBus = bus;
+	m_CurrentAmbisonicBus = bus;
+	m_IsAmbisonicBusPending = true;
+}
+
+void VoiceMixer::GetAmbisonicStatistics(AMBISONICSTATS* stats)
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	PurgeRetiredSpatializers();
+
+	if (m_CurrentAmbisonicBus != nullptr)
+	{
+		m_CurrentAmbisonicBus->GetStatistics(stats);
+	}
+	else
+	{
+		*stats = AMBISONICSTATS{};
+	}
+}
+
+DelayLine* VoiceMixer::EnsureBusDelay(UINT32 channelCount, UINT32 maxDelayFrames)
+{
+	DelayLine* delayLine = m_BusDelay.load(std::memory_order_acquire);
+	if (delayLine == nullptr)
+	{
+		DelayLine* newDelayLine = new DelayLine(channelCount, maxDelayFrames);
+		if (m_BusDelay.compare_exchange_strong(delayLine, newDelayLine, std::memory_order_acq_rel))
+		{
+			delayLine = newDelayLine;
+		}
+		else
+		{
+			delete newDelayLine;
+		}
+	}
+	return delayLine;
+}
+
+void VoiceMixer::GetReverbStatistics(REVERBSTATS* stats)
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	PurgeRetiredReverbs();
+
+	if (m_CurrentReverb != nullptr)
+	{
+		m_CurrentReverb->GetStatistics(stats);
+	}
+	else
+	{
+		*stats = REVERBSTATS{};
+	}
+}
+
+void VoiceMixer::AddVoice(const ComPtr<AudioVoice>& voice)
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	PurgeFinishedVoices();
+
+	Contract::Requires(m_Voices.find(voice->GetVoiceId()) == m_Voices.end(), L"Must not add the same voice twice");
+	// Sized before the audio thread can see it, in case the period grew after the voice was made.
+	voice->Reserve(m_ReservedFrames);
+
+	// Make room for it among the active voices here, so the audio thread never has to.
+	m_AddedVoices++;
+	size_t liveVoices = (size_t)(m_AddedVoices - m_RetiredVoices.load(std::memory_order_acquire));
+	if (liveVoices > m_ActiveCapacity)
+	{
+		m_ActiveCapacity = max(liveVoices, m_ActiveCapacity * 2);
+		std::vector<ComPtr<AudioVoice>> grownActiveVoices;
+		std::vector<VoiceRank> grownRanks;
+		grownActiveVoices.reserve(m_ActiveCapacity);
+		grownRanks.reserve(m_ActiveCapacity);
+		m_GrownActiveVoices.swap(grownActiveVoices);
+		m_GrownRanks.swap(grownRanks);
+		m_IsActiveCapacityPending = true;
+	}
+	else if (!m_IsActiveCapacityPending)
+	{
+		m_GrownActiveVoices.clear();
+	}
+
+	m_Voices.emplace(voice->GetVoiceId(), voice);
+	m_PendingVoices.push_back(voice);
+}
+
+bool VoiceMixer::StopVoice(VoiceId voiceId)
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	auto found = m_Voices.find(voiceId);
+	if (found == m_Voices.end() || found->second->IsFinished())
+	{
+		return false;
+	}
+
+	found->second->Stop();
+	return true;
+}
+
+ComPtr<AudioVoice> VoiceMixer::GetVoice(VoiceId voiceId)
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	auto found = m_Voices.find(voiceId);
+	if (found == m_Voices.end() || found->second->IsFinished())
+	{
+		return nullptr;
+	}
+
+	return found->second;
+}
+
+void VoiceMixer::Flush()
+{
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	for (auto& voice : m_ActiveVoices)
+	{
+		if (m_Spatializer != nullptr)
+		{
+			m_Spatializer->Detach(voice->GetSpatialSource());
+		}
+		voice->MarkFinished();
+	}
+	for (auto& voice : m_PendingVoices)
+	{
+		voice->MarkFinished();
+	}
+
+	m_ActiveVoices.clear();
+	m_PendingVoices.clear();
+	m_Voices.clear();
+	m_AddedVoices = m_RetiredVoices.load(std::memory_order_acquire);
+}
+
+void VoiceMixer::GetStatistics(MIXERSTATS* stats) const
+{
+	stats->MixPeriods = m_MixPeriods;
+	stats->SilentMixPeriods = m_SilentMixPeriods;
+	stats->VoicePeriods = m_VoicePeriods;
+	stats->SilentVoicePeriods = m_SilentVoicePeriods;
+	stats->SkippedVoicePeriods = m_SkippedVoicePeriods;
+	stats->LiveInputPeriods = m_LiveInputPeriods;
+	stats->VirtualVoicePeriods = m_VirtualVoicePeriods;
+	stats->StolenVoices = m_StolenVoices;
+}
+
+void VoiceMixer::Reserve(UINT32 maxFrameCount, UINT32 channelCount)
+{
+	m_VoiceBuffer.Allocate(channelCount, maxFrameCount);
+
+	// A renegotiated period may be longer than the one voices already playing were made for.
+	std::lock_guard<std::mutex> guard(m_Mutex);
+	m_ReservedFrames = maxFrameCount;
+	for (auto& entry : m_Voices)
+	{
+		entry.second->Reserve(maxFrameCount);
+	}
+	if (m_Spatializer != nullptr)
+	{
+		m_Spatializer->Reserve(maxFrameCount);
+	}
+	if (m_PendingSpatializer != nullptr)
+	{
+		m_PendingSpatializer->Reserve(maxFrameCount);
+	}
+	if (m_AmbisonicBus != nullptr)
+	{
+		m_AmbisonicBus->Reserve(maxFrameCount);
+	}
+	if (m_PendingAmbisonicBus != nullptr)
+	{
+		m_PendingAmbisonicBus->Reserve(maxFrameCount);
+	}
+}
+
+void VoiceMixer::SetShedLevel(ShedLevel level)
+{
+	if (level == m_ShedLevel)
+	{
+		return;
+	}
+
+	m_ShedLevel = level;
+	for (auto& voice : m_ActiveVoices)
+	{
+		voice->SetShedLevel(level);
+	}
+	if (m_Reverb != nullptr)
+	{
+		m_Reverb->SetShedLevel(level);
+	}
+}
+
+UINT64 VoiceMixer::SelectRealVoices()
+{
+	UINT32 budget = m_RealVoiceBudget;
+	if (m_ShedLevel >= ShedLevel_HalfVoices)
+	{
+		UINT32 voiceCount = (UINT32)m_ActiveVoices.size();
+		UINT32 realCount = (0 == budget) ? voiceCount : min(budget, voiceCount);
+		budget = max(1u, realCount / ((m_ShedLevel >= ShedLevel_QuarterVoices) ? 4 : 2));
+	}
+
+	if (0 == budget || m_ActiveVoices.size() <= budget)
+	{
+		for (auto& voice : m_ActiveVoices)
+		{
+			voice->SetWantedReal(true);
+			if (voice->GetRealFade() < 0.0f)
+			{
+				voice->GetRealFade() = 1.0f;
+			}
+		}
+		return 0;
+	}
+
+	// Never allocates: AddVoice has made room for every active voice.
+	m_Ranks.clear();
+	for (auto& voice : m_ActiveVoices)
+	{
+		float audibility = voice->GetAudibility() * voice->GetGainStage().GetGain();
+		if (voice->IsWantedReal())
+		{
+			audibility *= VOICE_MIXER_REAL_BIAS;
+		}
+		m_Ranks.push_back(VoiceRank{ voice->GetPriority(), audibility, voice.Get() });
+	}
+
+	// Only the split matters, not the order on either side of it.
+	std::nth_element(m_Ranks.begin(), m_Ranks.begin() + budget, m_Ranks.end(),
+		[](const VoiceRank& a, const VoiceRank& b)
+		{
+			return (a.Priority != b.Priority) ? (a.Priority > b.Priority) : (a.Audibility > b.Audibility);
+		});
+
+	UINT64 stolen = 0;
+	for (size_t i = 0; i < m_Ranks.size(); i++)
+	{
+		AudioVoice* voice = m_Ranks[i].Voice;
+		bool isWantedReal = (i < budget);
+		float& fade = voice->GetRealFade();
+		if (fade < 0.0f)
+		{
+			// A new voice starts where it belongs, rather than fading in from its first frame
+			fade = isWantedReal ? 1.0f : 0.0f;
+		}
+		else if (!isWantedReal && voice->IsWantedReal() && fade > 0.0f)
+		{
+			stolen++;
+		}
+		voice->SetWantedReal(isWantedReal);
+	}
+
+	return stolen;
+}
+
+// Move a voice's real fade on by frameCount frames, towards 1 if the voice is wanted real and towards 0 if not,
+// applying it to buffer unless that is null.
+static void StepRealFade(AudioVoice* voice, const PlanarView* buffer, UINT32 frameCount)
+{
+	float& fade = voice->GetRealFade();
+	float step = (voice->IsWantedReal() ? 1.0f : -1.0f) / VOICE_MIXER_REAL_FADE_FRAMES;
+
+	if (nullptr == buffer)
+	{
+		fade = max(0.0f, min(1.0f, fade + (step * frameCount)));
+		return;
+	}
+
+	// Every channel follows the same fade, so each one starts from where the voice's fade stood.
+	float start = fade;
+	for (UINT32 channel = 0; channel < buffer->ChannelCount; channel++)
+	{
+		float* samples = buffer->Channel(channel);
+		fade = start;
+		for (UINT32 frame = 0; frame < frameCount; frame++)
+		{
+			fade = max(0.0f, min(1.0f, fade + step));
+			samples[frame] *= fade;
+		}
+	}
+	fade = max(0.0f, min(1.0f, start + (step * frameCount)));
+}
+
+bool VoiceMixer::Render(const PlanarView& mix, UINT32 frameCount)
+{
+	mix.Zero(frameCount);
+
+	// Pick up newly added voices, unless a client holds the lock; they will be picked up next period.
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex, std::try_to_lock);
+		if (lock.owns_lock())
+		{
+			// Switch to the room AddVoice grew, which holds every active and pending voice; the storage left
+			// behind is released by a client thread.
+			if (m_IsActiveCapacityPending)
+			{
+				m_GrownActiveVoices.assign(m_ActiveVoices.begin(), m_ActiveVoices.end());
+				m_ActiveVoices.swap(m_GrownActiveVoices);
+				m_Ranks.swap(m_GrownRanks);
+				m_IsActiveCapacityPending = false;
+			}
+
+			for (auto& voice : m_PendingVoices)
+			{
+				if (m_ShedLevel != ShedLevel_None)
+				{
+					voice->SetShedLevel(m_ShedLevel);
+				}
+				if (m_VoiceFramesPerBeat > 0)
+				{
+					voice->SetFramesPerBeat(m_VoiceFramesPerBeat);
+				}
+				m_ActiveVoices.push_back(voice);
+			}
+			m_PendingVoices.clear();
+
+			// The reverb being replaced is shut down by a client thread, not here.
+			if (m_IsReverbPending)
+			{
+				if (m_Reverb != nullptr)
+				{
+					m_RetiredReverbs.push_back(std::move(m_Reverb));
+				}
+				m_Reverb = std::move(m_PendingReverb);
+				m_IsReverbPending = false;
+				if (m_Reverb != nullptr && m_ShedLevel != ShedLevel_None)
+				{
+					m_Reverb->SetShedLevel(m_ShedLevel);
+				}
+			}
+
+			// Voices placed in the spatializer being replaced just lose their places with it.
+			if (m_IsSpatializerPending)
+			{
+				if (m_Spatializer != nullptr)
+				{
+					m_RetiredSpatializers.push_back(std::move(m_Spatializer));
+				}
+				m_Spatializer = std::move(m_PendingSpatializer);
+				m_IsSpatializerPending = false;
+			}
+
+			// Voices encoded into the bus being replaced carry on from where they were in the new one.
+			if (m_IsAmbisonicBusPending)
+			{
+				if (m_AmbisonicBus != nullptr)
+				{
+					m_RetiredAmbisonicBuses.push_back(std::move(m_AmbisonicBus));
+				}
+				m_AmbisonicBus = std::move(m_PendingAmbisonicBus);
+				m_IsAmbisonicBusPending = false;
+			}
+		}
+	}
+
+	Contract::Requires(m_VoiceBuffer.GetMaxFrameCount() >= frameCount, L"Mixer must have been reserved for the period");
+	Contract::Requires(m_VoiceBuffer.GetChannelCount() == mix.ChannelCount, L"Mix must have the reserved channel count");
+	const PlanarView& voiceBuffer = m_VoiceBuffer.GetView();
+
+	// With the bus muted nothing is audible, so every voice just keeps time.
+	bool isBusSilent = m_BusGain.IsSilent();
+
+	float framesPerBeat = m_FramesPerBeat.load(std::memory_order_relaxed);
+	if (framesPerBeat != m_VoiceFramesPerBeat)
+	{
+		m_VoiceFramesPerBeat = framesPerBeat;
+		for (auto& voice : m_ActiveVoices)
+		{
+			voice->SetFramesPerBeat(framesPerBeat);
+		}
+	}
+
+	UINT64 stolenVoices = SelectRealVoices();
+
+	bool anyRendered = false;
+	bool anyLiveInput = false;
+	UINT64 voicePeriods = 0;
+	UINT64 silentVoices = 0;
+	UINT64 skippedVoices = 0;
+	UINT64 virtualVoices = 0;
+	size_t i = 0;
+	while (i < m_ActiveVoices.size())
+	{
+		AudioVoice* voice = m_ActiveVoices[i].Get();
+
+		// A spatialized voice renders into the spatializer or the ambisonic bus instead of the mix: into the bus
+		// if it asks to, or if the spatializer has no place free for it; with neither, it is silent this period.
+		SpatialSource& spatialSource = voice->GetSpatialSource();
+		bool isSpatialized = spatialSource.IsEnabled() && (m_Spatializer != nullptr || m_AmbisonicBus != nullptr);
+		bool isPlaced = false;
+		bool isAmbisonic = false;
+		if (isSpatialized && m_Spatializer != nullptr
+			&& (m_AmbisonicBus == nullptr || spatialSource.GetRendering() == SpatialRendering_Hrtf))
+		{
+			isPlaced = m_Spatializer->Attach(spatialSource);
+		}
+		if (isSpatialized && !isPlaced && m_AmbisonicBus != nullptr)
+		{
+			isPlaced = true;
+			isAmbisonic = true;
+		}
+		if (m_Spatializer != nullptr && (!isSpatialized || isAmbisonic))
+		{
+			m_Spatializer->Detach(spatialSource);
+		}
+
+		UINT32 framesRendered = 0;
+		if (!voice->IsStopRequested())
+		{
+			GainStage& gainStage = voice->GetGainStage();
+			FilterBank& filters = voice->GetFilterBank();
+			DelayLine* delayLine = voice->GetDelayLine();
+			bool isSilent = false;
+			voicePeriods++;
+			if (isBusSilent || gainStage.IsSilent())
+			{
+				framesRendered = voice->SkipVoice(voiceBuffer, frameCount);
+				gainStage.Advance(frameCount);
+				filters.Skip(frameCount);
+				if (delayLine != nullptr)
+				{
+					delayLine->Skip(frameCount, framesPerBeat);
+				}
+				skippedVoices++;
+			}
+			else if (!voice->IsWantedReal() && voice->GetRealFade() <= 0.0f)
+			{
+				// Virtual: keep time as cheaply as the voice can.
+				framesRendered = voice->SkipVoice(voiceBuffer, frameCount);
+				gainStage.Advance(frameCount);
+				filters.Skip(frameCount);
+				if (delayLine != nullptr)
+				{
+					delayLine->Skip(frameCount, framesPerBeat);
+				}
+				virtualVoices++;
+			}
+			else if (gainStage.IsUnity() && filters.IsBypassed() && (delayLine == nullptr || delayLine->IsBypassed())
+				&& voice->IsWantedReal() && voice->GetRealFade() >= 1.0f && !isSpatialized)
+			{
+				framesRendered = voice->RenderPeriod(mix, frameCount, &isSilent);
+				if (delayLine != nullptr)
+				{
+					delayLine->Skip(frameCount, framesPerBeat);
+				}
+				silentVoices += isSilent ? 1 : 0;
+				anyRendered |= (framesRendered > 0) && !isSilent;
+				anyLiveInput |= (framesRendered > 0) && !isSilent && voice->IsLiveInput();
+			}
+			else
+			{
+				voiceBuffer.Zero(frameCount);
+				framesRendered = voice->RenderPeriod(voiceBuffer, frameCount, &isSilent);
+				if (isSilent && filters.IsQuiet() && (delayLine == nullptr || delayLine->IsQuiet()))
+				{
+					StepRealFade(voice, nullptr, frameCount);
+					gainStage.Advance(frameCount);
+					filters.Skip(frameCount);
+					if (delayLine != nullptr)
+					{
+						delayLine->Skip(frameCount, framesPerBeat);
+					}
+					silentVoices++;
+				}
+				else
+				{
+					// A silent voice whose filters or delay are still ringing plays their tail out.
+					filters.Process(voiceBuffer, frameCount);
+					if (delayLine != nullptr)
+					{
+						delayLine->Process(voiceBuffer, frameCount, framesPerBeat);
+					}
+					if (!voice->IsWantedReal() || voice->GetRealFade() < 1.0f)
+					{
+						StepRealFade(voice, &voiceBuffer, frameCount);
+					}
+					if (!isSpatialized)
+					{
+						gainStage.MixInto(voiceBuffer, mix, frameCount);
+					}
+					else if (isPlaced)
+					{
+						gainStage.ApplyInPlace(voiceBuffer, frameCount);
+						if (isAmbisonic)
+						{
+							m_AmbisonicBus->AddSource(spatialSource, voiceBuffer, frameCount);
+						}
+						else
+						{
+							m_Spatializer->AddSource(spatialSource, voiceBuffer, frameCount, m_Listener);
+						}
+					}
+					else
+					{
+						gainStage.Advance(frameCount);
+					}
+					anyRendered |= (framesRendered > 0) && !isSpatialized;
+					anyLiveInput |= (framesRendered > 0) && !isSilent && voice->IsLiveInput();
+				}
+			}
+		}
+
+		if (framesRendered < frameCount)
+		{
+			// Retire the voice by swapping it with the last one; m_Voices still holds a reference,
+			// so this never frees the voice here.
+			if (m_Spatializer != nullptr)
+			{
+				m_Spatializer->Detach(spatialSource);
+			}
+			voice->MarkFinished();
+			m_ActiveVoices[i] = m_ActiveVoices.back();
+			m_ActiveVoices.pop_back();
+			m_RetiredVoices.fetch_add(1, std::memory_order_release);
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	// Spatialized voices come out a block late, and their responses ring on after them.
+	if (m_Spatializer != nullptr && m_Spatializer->Render(mix, frameCount))
+	{
+		anyRendered = true;
+	}
+
+	// The ambisonic bus is rotated and decoded once for all its voices; a binaural decode, like the
+	// spatializer, comes out a block late.
+	if (m_AmbisonicBus != nullptr && m_AmbisonicBus->Render(mix, frameCount, m_Listener))
+	{
+		anyRendered = true;
+	}
+
+	// The bus delay's echoes ring on after the voices have fallen silent, and feed the reverb.
+	DelayLine* busDelay = m_BusDelay.load(std::memory_order_acquire);
+	if (busDelay != nullptr)
+	{
+		if (!busDelay->IsBypassed() && (anyRendered || !busDelay->IsQuiet()))
+		{
+			busDelay->Process(mix, frameCount, framesPerBeat);
+			anyRendered = true;
+		}
+		else
+		{
+			busDelay->Skip(frameCount, framesPerBeat);
+		}
+	}
+
+	// The reverb hears the mix so far, and its tail rings on after the voices have fallen silent.
+	if (m_Reverb != nullptr)
+	{
+		bool isWetAudible = m_Reverb->Process(mix, voiceBuffer, frameCount, !anyRendered);
+		if (isWetAudible && !m_ReverbGain.IsSilent())
+		{
+			m_ReverbGain.MixInto(voiceBuffer, mix, frameCount);
+			anyRendered = true;
+		}
+		else
+		{
+			m_ReverbGain.Advance(frameCount);
+		}
+	}
+	else
+	{
+		m_ReverbGain.Advance(frameCount);
+	}
+
+	// The bus filters may still be ringing after the voices have fallen silent.
+	if (!anyRendered && !m_BusFilters.IsQuiet())
+	{
+		anyRendered = true;
+	}
+
+	if (anyRendered)
+	{
+		m_BusFilters.Process(mix, frameCount);
+		if (!m_BusGain.IsUnity())
+		{
+			m_BusGain.ApplyInPlace(mix, frameCount);
+		}
+	}
+	else
+	{
+		// The buffer is still all zeros; just keep the bus ramps in time.
+		m_BusFilters.Skip(frameCount);
+		m_BusGain.Advance(frameCount);
+	}
+
+	m_MixPeriods.store(m_MixPeriods.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	if (!anyRendered)
+	{
+		m_SilentMixPeriods.store(m_SilentMixPeriods.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+	m_VoicePeriods.store(m_VoicePeriods.load(std::memory_order_relaxed) + voicePeriods, std::memory_order_relaxed);
+	m_SilentVoicePeriods.store(m_SilentVoicePeriods.load(std::memory_order_relaxed) + silentVoices, std::memory_order_relaxed);
+	m_SkippedVoicePeriods.store(m_SkippedVoicePeriods.load(std::memory_order_relaxed) + skippedVoices, std::memory_order_relaxed);
+	m_VirtualVoicePeriods.store(m_VirtualVoicePeriods.load(std::memory_order_relaxed) + virtualVoices, std::memory_order_relaxed);
+	m_StolenVoices.store(m_StolenVoices.load(std::memory_order_relaxed) + stolenVoices, std::memory_order_relaxed);
+	if (anyLiveInput)
+	{
+		m_LiveInputPeriods.store(m_LiveInputPeriods.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	return anyRendered;
+}
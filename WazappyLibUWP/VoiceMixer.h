@@ -0,0 +1,251 @@
+// The Wazappy project implements a WASAPI-based sound engine for Windows UWP and desktop apps.
+// https://github.com/RobJellinghaus/Wazappy
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "AudioVoice.h"
+#include "GainStage.h"
+#include "FilterBank.h"
+#include "DelayLine.h"
+#include "ConvolutionReverb.h"
+#include "AmbisonicBus.h"
+#include "BinauralSpatializer.h"
+#include "PlanarBuffer.h"
+
+// Voices the mixer has room for up front; AddVoice grows the room, on the client thread, past that.
+#define VOICE_MIXER_INITIAL_CAPACITY 256
+
+// Frames over which a voice fades out when it is virtualized, and back in when it becomes real again.
+#define VOICE_MIXER_REAL_FADE_FRAMES 256
+
+// Factor by which a real voice's audibility is favored over virtual ones when ranking, so voices of nearly
+// equal loudness do not trade places every period.
+#define VOICE_MIXER_REAL_BIAS 1.5f
+
+namespace Wazappy
+{
+	// Sums a set of AudioVoices into a single planar float buffer, once per device period.
+	// Voices are added and stopped from client threads; the audio thread picks up new voices with a
+	// try-lock, so it never blocks on a client.
+	// With a real voice budget, only that many voices are rendered each period: the highest priority ones,
+	// loudest first (by AudioVoice::GetAudibility times gain).  The rest are virtual; they skip ahead in time
+	// without rendering, and fade back in where they would have been when they win a place again.  A voice
+	// losing its place fades out before it goes virtual, so stealing never clicks.
+	class VoiceMixer
+	{
+	public:
+		VoiceMixer();
+		~VoiceMixer();
+
+		// Get next unallocated voice ID (unique across the session).
+		static VoiceId GetNextVoiceId();
+
+		// Add a voice; it starts playing at the next period.  Any thread.
+		void AddVoice(const ComPtr<AudioVoice>& voice);
+
+		// Stop the voice with the given ID.  Any thread.  Returns false if there is no such live voice.
+		bool StopVoice(VoiceId voiceId);
+
+		// Get the live voice with the given ID, or nullptr.  Any thread.
+		ComPtr<AudioVoice> GetVoice(VoiceId voiceId);
+
+		// Stop and drop every voice.  Must not be called concurrently with Render.
+		void Flush();
+
+		// Size the scratch buffer voices with gain or pan render into, and every voice's own scratch (see
+		// AudioVoice::Reserve).  Must be called before Render, and not concurrently with it.
+		void Reserve(UINT32 maxFrameCount, UINT32 channelCount);
+
+		// Gain and pan applied to the whole mix.
+		GainStage& GetBusGain() { return m_BusGain; }
+
+		// Filters applied to the whole mix, before the bus gain.
+		FilterBank& GetBusFilters() { return m_BusFilters; }
+
+		// The delay line on the whole mix, after the voices and before the reverb; nullptr until a client first
+		// sets one up.  Any thread.
+		DelayLine* GetBusDelay() const { return m_BusDelay.load(std::memory_order_acquire); }
+
+		// Get the bus delay line, allocating it (with the given size) if there is none yet.  Never call this on
+		// an audio thread.
+		DelayLine* EnsureBusDelay(UINT32 channelCount, UINT32 maxDelayFrames);
+
+		// The tempo delays in beats and tempo-following voices follow, in frames per beat; 0 (the default) for
+		// none.  Any thread.
+		void SetFramesPerBeat(float framesPerBeat) { m_FramesPerBeat.store(framesPerBeat, std::memory_order_relaxed); }
+
+		// Convolve the whole mix with the given reverb, which must have the mix's channel count, from the next
+		// period; or stop if it is nullptr.  The reverb's output is added to the mix through the reverb gain,
+		// before the bus filters.  Any thread; the reverb this replaces is shut down on a later call.
+		void SetReverb(const ComPtr<ConvolutionReverb>& reverb);
+
+		// Gain and pan of the reverb's output.
+		GainStage& GetReverbGain() { return m_ReverbGain; }
+
+		// Statistics of the reverb last set; all zero if there is none.  Any thread.
+		void GetReverbStatistics(REVERBSTATS* stats);
+
+		// Render voices whose spatial source is enabled through the given spatializer, from the next period; or
+		// mix them in directly if it is nullptr.  Its output is added to the first two channels of the mix, before
+		// the bus delay.  Any thread; the spatializer this replaces is released on a later call.
+		void SetSpatializer(const ComPtr<BinauralSpatializer>& spatializer);
+
+		// Encode spatialized voices into the given ambisonic bus, from the next period, when they ask for
+		// SpatialRendering_Ambisonic or the spatializer has no place for them (or there is no spatializer); or
+		// leave them all to the spatializer if it is nullptr.  Its decode is added to the mix after the
+		// spatializer's, before the bus delay.  Any thread; the bus this replaces is released on a later call.
+		void SetAmbisonicBus(const ComPtr<AmbisonicBus>& bus);
+
+		// Which way the listener's head is turned, for the spatializer and the ambisonic bus.
+		ListenerOrientation& GetListener() { return m_Listener; }
+
+		// Statistics of the spatializer last set; all zero if there is none.  Any thread.
+		void GetSpatializerStatistics(SPATIALIZERSTATS* stats);
+
+		// Statistics of the ambisonic bus last set; all zero if there is none.  Any thread.
+		void GetAmbisonicStatistics(AMBISONICSTATS* stats);
+
+		// Render at most this many voices each period, or all of them if 0 (the default).  Any thread.
+		void SetRealVoiceBudget(UINT32 maxRealVoices) { m_RealVoiceBudget = maxRealVoices; }
+
+		// Shed work as the given level says, from the next period: voices and the reverb are told of the level,
+		// and from ShedLevel_HalfVoices up the real voice budget shrinks to a fraction of what it would otherwise
+		// be.  Audio thread only.
+		void SetShedLevel(ShedLevel level);
+
+		// Zero the first frameCount frames of mix, then mix every active voice (or the real voice budget's worth)
+		// into it, through its filters, delay and gain stage (and the spatializer or ambisonic bus, for spatialized
+		// voices), run the mix through the bus delay, add in the reverb, and apply the bus filters and gain.  mix
+		// must have the reserved channel count.
+		// Silence is carried through rather than processed: voices which report a silent period are not passed
+		// through their gain stage (or their filters, once those have rung out), inaudible voices (zero gain, or
+		// a muted bus) are skipped ahead without being rendered at all, and a silent mix gets no bus processing
+		// once the bus delay, the reverb and the bus filters have rung out.  A voice which finishes cuts its
+		// filters' and delay's tails short.
+		// Audio thread only.  Returns false if nothing audible was rendered (the buffer is silent).
+		bool Render(const PlanarView& mix, UINT32 frameCount);
+
+		// Any thread.
+		void GetStatistics(MIXERSTATS* stats) const;
+
+		// Mix periods so far in which live input was audible; see AudioVoice::IsLiveInput.  Any thread.
+		UINT64 GetLiveInputPeriods() const { return m_LiveInputPeriods; }
+
+	private:
+		// Forget voices which the audio thread has retired.  Lock must be held.
+		void PurgeFinishedVoices();
+
+		// Shut down reverbs which the audio thread has let go of.  Lock must be held.
+		void PurgeRetiredReverbs();
+
+		// Release spatializers and ambisonic buses which the audio thread has let go of.  Lock must be held.
+		void PurgeRetiredSpatializers();
+
+		// Mark which active voices are wanted real this period.  Audio thread only.  Returns the number of real
+		// voices stolen (newly unwanted).
+		UINT64 SelectRealVoices();
+
+	private:
+		// A voice's place in the ranking for the real voice budget.
+		struct VoiceRank
+		{
+			INT32 Priority;
+			float Audibility;
+			AudioVoice* Voice;
+		};
+
+	private:
+		static std::atomic<VoiceId> s_nextVoiceId;
+
+		// Guards m_PendingVoices, m_Voices, the reverbs other than m_Reverb, the spatializers other than
+		// m_Spatializer and the ambisonic buses other than m_AmbisonicBus.
+		std::mutex m_Mutex;
+
+		// Voices added since the audio thread last picked them up.
+		std::vector<ComPtr<AudioVoice>> m_PendingVoices;
+
+		// Every voice not yet purged, for lookup by ID.  Holding a reference here means voices are never
+		// destroyed on the audio thread.
+		std::map<VoiceId, ComPtr<AudioVoice>> m_Voices;
+
+		// Voices currently being rendered.  Only touched by the audio thread (and Flush).
+		std::vector<ComPtr<AudioVoice>> m_ActiveVoices;
+
+		// Where voices whose gain stage is not at unity render before being mixed in.  Audio thread only.
+		PlanarBuffer m_VoiceBuffer;
+
+		// The period size last reserved, for spatializers and ambisonic buses set later.
+		UINT32 m_ReservedFrames;
+
+		std::atomic<UINT32> m_RealVoiceBudget;
+
+		// Scratch for ranking the active voices.  Audio thread only.
+		std::vector<VoiceRank> m_Ranks;
+
+		// Room for the active voices and their ranks which AddVoice has grown, for the audio thread to switch to
+		// when it next picks up voices, if m_IsActiveCapacityPending; after that, the storage it switched from,
+		// whose references are released on a client thread.  Guarded by m_Mutex.
+		std::vector<ComPtr<AudioVoice>> m_GrownActiveVoices;
+		std::vector<VoiceRank> m_GrownRanks;
+		bool m_IsActiveCapacityPending;
+
+		// Room for active voices once any growth is picked up, and the voices added (guarded by m_Mutex) and
+		// retired by the audio thread, whose difference bounds the active and pending voices.
+		size_t m_ActiveCapacity;
+		UINT64 m_AddedVoices;
+		std::atomic<UINT64> m_RetiredVoices;
+
+		// Audio thread only.
+		ShedLevel m_ShedLevel;
+
+		// The reverb last set, for statistics; the one set since the audio thread last picked one up, if
+		// m_IsReverbPending; the one being rendered (audio thread only); and those the audio thread has
+		// replaced, which still need shutting down.
+		ComPtr<ConvolutionReverb> m_CurrentReverb;
+		ComPtr<ConvolutionReverb> m_PendingReverb;
+		bool m_IsReverbPending;
+		ComPtr<ConvolutionReverb> m_Reverb;
+		std::vector<ComPtr<ConvolutionReverb>> m_RetiredReverbs;
+		GainStage m_ReverbGain;
+
+		// The spatializer last set, the one pending, the one in use and those replaced, as for the reverb.
+		ComPtr<BinauralSpatializer> m_CurrentSpatializer;
+		ComPtr<BinauralSpatializer> m_PendingSpatializer;
+		bool m_IsSpatializerPending;
+		ComPtr<BinauralSpatializer> m_Spatializer;
+		std::vector<ComPtr<BinauralSpatializer>> m_RetiredSpatializers;
+		ListenerOrientation m_Listener;
+
+		// Likewise for the ambisonic bus.
+		ComPtr<AmbisonicBus> m_CurrentAmbisonicBus;
+		ComPtr<AmbisonicBus> m_PendingAmbisonicBus;
+		bool m_IsAmbisonicBusPending;
+		ComPtr<AmbisonicBus> m_AmbisonicBus;
+		std::vector<ComPtr<AmbisonicBus>> m_RetiredAmbisonicBuses;
+
+		// Owned by the mixer once set.
+		std::atomic<DelayLine*> m_BusDelay;
+		std::atomic<float> m_FramesPerBeat;
+
+		// The tempo the active voices were last told of.  Audio thread only.
+		float m_VoiceFramesPerBeat;
+
+		FilterBank m_BusFilters;
+		GainStage m_BusGain;
+
+		// Written on the audio thread, read by GetStatistics.
+		std::atomic<UINT64> m_MixPeriods;
+		std::atomic<UINT64> m_SilentMixPeriods;
+		std::atomic<UINT64> m_VoicePeriods;
+		std::atomic<UINT64> m_SilentVoicePeriods;
+		std::atomic<UINT64> m_SkippedVoicePeriods;
+		std::atomic<UINT64> m_LiveInputPeriods;
+		std::atomic<UINT64> m_VirtualVoicePeriods;
+		std::atomic<UINT64> m_StolenVoices;
+	};
+}
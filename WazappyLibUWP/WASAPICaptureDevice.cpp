@@ -15,7 +15,8 @@ using namespace Wazappy;
 //
 //  WASAPICapture()
 //
-WASAPICaptureDevice::WASAPICaptureDevice() :
+WASAPICaptureDevice::WASAPICaptureDevice( Platform::String^ deviceId ) :
+    WASAPIDevice( deviceId ),
     m_cbDataSize( 0 ),
     m_cbHeaderSize( 0 ),
     m_cbFlushCounter( 0 ),
@@ -25,7 +26,8 @@ WASAPICaptureDevice::WASAPICaptureDevice() :
     m_OutputStream( nullptr ),
     m_WAVDataWriter( nullptr ),
     m_PlotData( nullptr ),
-    m_fWriting( false )
+    m_fWriting( false ),
+    m_CapturedFrames( 0 )
 {
     // Register MMCSS work queue
     DWORD dwTaskID = 0;
@@ -136,6 +138,9 @@ HRESULT WASAPICaptureDevice::ActivateCompletedInternal()
         goto exit;
     }
 
+    // Packets never exceed the buffer, so this is all the conversion space capture links will need
+    m_LinkBuffer.Allocate( m_MixFormat->nChannels, m_BufferFrames );
+
 	// Create the visualization array
 	/* B4CR:
     hr = InitializeScopeData();
@@ -356,11 +361,10 @@ HRESULT WASAPICaptureDevice::OnStartCapture( IMFAsyncResult* ignore )
     HRESULT hr = S_OK;
 
     // Start the capture
-    hr = m_AudioClient->Start();
+    hr = StartClient();
     if (SUCCEEDED( hr ))
     {
-        SetDeviceStateAndNotifyCallbacks(DeviceState::Capturing, true);
-        CreateWorkItemWaitingForSampleReadyEvent();
+        OnClientStarted();
     }
     else
     {
@@ -370,6 +374,32 @@ HRESULT WASAPICaptureDevice::OnStartCapture( IMFAsyncResult* ignore )
     return S_OK;
 }
 
+//
+//  PrepareToStart()
+//
+HRESULT WASAPICaptureDevice::PrepareToStart()
+{
+    if (GetDeviceState() != DeviceState::Initialized)
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    SetDeviceStateAndNotifyCallbacks(DeviceState::Starting, true);
+    return S_OK;
+}
+
+//
+//  OnClientStarted()
+//
+HRESULT WASAPICaptureDevice::OnClientStarted()
+{
+    m_DeviceClock.Reset( m_MixFormat->nSamplesPerSec );
+    m_Timeline.Reset( m_MixFormat->nSamplesPerSec );
+    m_CapturedFrames = 0;
+    SetDeviceStateAndNotifyCallbacks(DeviceState::Capturing, true);
+    return StartSampleReadyDispatch();
+}
+
 //
 //  StopCaptureAsync()
 //
@@ -395,7 +425,7 @@ HRESULT WASAPICaptureDevice::StopCaptureAsync()
 //
 HRESULT WASAPICaptureDevice::OnStopCapture( IMFAsyncResult* pResult )
 {
-	CancelWorkItemWaitingForSampleReadyEvent();
+	StopSampleReadyDispatch();
 
     m_AudioClient->Stop();
     SAFE_RELEASE( m_SampleReadyAsyncResult );
@@ -521,6 +551,15 @@ HRESULT WASAPICaptureDevice::OnAudioSampleRequested( Platform::Boolean IsSilence
             // Pass down a discontinuity flag in case the app is interested and reset back to capturing
             SetDeviceStateAndNotifyCallbacks(DeviceState::Discontinuity, true);
             SetDeviceStateAndNotifyCallbacks(DeviceState::Capturing, false);
+
+            // Frames were lost, so positions before this point say nothing about the clock rate
+            m_DeviceClock.Reset( m_MixFormat->nSamplesPerSec );
+        }
+
+        if (!(dwCaptureFlags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR))
+        {
+            m_DeviceClock.AddObservation( u64DevicePosition, u64QPCPosition );
+            m_Timeline.RecordPacket( m_CapturedFrames, u64DevicePosition, u64QPCPosition );
         }
 
         // Zero out sample if silence
@@ -529,6 +568,10 @@ HRESULT WASAPICaptureDevice::OnAudioSampleRequested( Platform::Boolean IsSilence
             memset( Data, 0, FramesAvailable * m_MixFormat->nBlockAlign );
         }
 
+        // Feed any capture links before the buffer goes back to the engine
+        WriteCaptureLinks( Data, FramesAvailable, u64QPCPosition, (dwCaptureFlags & AUDCLNT_BUFFERFLAGS_SILENT) || IsSilence );
+        m_CapturedFrames += FramesAvailable;
+
         // Store data in array
         auto dataByte = ref new Platform::Array<BYTE, 1>( Data, cbBytesToCapture );
 
@@ -580,6 +623,81 @@ exit:
     return hr;
 }
 
+//
+//  AddCaptureLink()
+//
+HRESULT WASAPICaptureDevice::AddCaptureLink( const ComPtr<CaptureSinkVoice>& link )
+{
+    if (link->GetCaptureChannelCount() != m_MixFormat->nChannels)
+    {
+        return E_INVALIDARG;
+    }
+
+    std::lock_guard<std::mutex> Guard( m_LinkMutex );
+
+    // Links the audio thread has let go of are released here, off the audio thread
+    m_RetiredLinks.clear();
+    m_PendingLinks.push_back( link );
+    return S_OK;
+}
+
+//
+//  WriteCaptureLinks()
+//
+//  Converts a captured packet to planar float and appends it to every live capture link
+//
+void WASAPICaptureDevice::WriteCaptureLinks( BYTE* pData, UINT32 FramesAvailable, UINT64 QPCPosition, bool IsSilent )
+{
+    // Pick up new links and drop retired ones, without ever waiting on a client thread
+    std::unique_lock<std::mutex> Lock( m_LinkMutex, std::try_to_lock );
+    if (Lock.owns_lock())
+    {
+        for (size_t i = 0; i < m_ActiveLinks.size(); )
+        {
+            if (m_ActiveLinks[i]->IsFinished())
+            {
+                m_RetiredLinks.push_back( m_ActiveLinks[i] );
+                m_ActiveLinks.erase( m_ActiveLinks.begin() + i );
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        m_ActiveLinks.insert( m_ActiveLinks.end(), m_PendingLinks.begin(), m_PendingLinks.end() );
+        m_PendingLinks.clear();
+        Lock.unlock();
+    }
+
+    if (m_ActiveLinks.empty())
+    {
+        return;
+    }
+
+    UINT32 FrameCount = min( FramesAvailable, m_BufferFrames );
+    RenderSampleType SampleType = CalculateMixFormatType( m_MixFormat );
+
+    if (IsSilent || (SampleType == RenderSampleType::SampleTypeUnknown))
+    {
+        m_LinkBuffer.GetView().Zero( FrameCount );
+    }
+    else if (SampleType == RenderSampleType::SampleTypeFloat)
+    {
+        Deinterleave( reinterpret_cast<const float *>( pData ), FrameCount, m_LinkBuffer.GetView() );
+    }
+    else
+    {
+        Deinterleave( reinterpret_cast<const INT16 *>( pData ), FrameCount, m_LinkBuffer.GetView() );
+    }
+
+    double RateRatio = m_DeviceClock.GetRateRatio();
+    for (const ComPtr<CaptureSinkVoice>& Link : m_ActiveLinks)
+    {
+        Link->WriteCapturedFrames( m_LinkBuffer.GetView(), FrameCount, QPCPosition, RateRatio );
+    }
+}
+
 //
 //  ProcessScopeData()
 //
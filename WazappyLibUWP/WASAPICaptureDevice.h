@@ -3,7 +3,13 @@
 // Licensed under the MIT License.
 // This file based on WindowsAudioSession sample from https://github.com/Microsoft/Windows-universal-samples
 
+#include <mutex>
+#include <vector>
+
 #include "WASAPIDevice.h"
+#include "CaptureSinkVoice.h"
+#include "CaptureTimeline.h"
+#include "PlanarBuffer.h"
 
 using namespace Microsoft::WRL;
 using namespace Windows::Media::Devices;
@@ -21,7 +27,7 @@ namespace Wazappy
     class WASAPICaptureDevice : public WASAPIDevice
     {
     public:
-        WASAPICaptureDevice();
+        WASAPICaptureDevice( Platform::String^ deviceId = nullptr );
 
 		virtual Platform::String^ GetDeviceId();
 
@@ -30,10 +36,22 @@ namespace Wazappy
 
 		HRESULT SetProperties(CAPTUREDEVICEPROPS props);
 
+		virtual HRESULT PrepareToStart();
+		virtual HRESULT OnClientStarted();
+		virtual HRESULT StopAsync() { return StopCaptureAsync(); }
+
         HRESULT StartCaptureAsync();
         HRESULT StopCaptureAsync();
         HRESULT FinishCaptureAsync();
 
+        // Start feeding this device's input to the given link.  Any thread; the link is dropped once its voice
+        // has been retired by the render device's mixer.
+        HRESULT AddCaptureLink( const ComPtr<CaptureSinkVoice>& link );
+
+        // When each frame captured since the device last started was recorded.  Frames are counted as delivered,
+        // so frame N here is frame N of the recorded WAV data.
+        CaptureTimeline& GetCaptureTimeline() { return m_Timeline; }
+
         METHODASYNCCALLBACK( WASAPICaptureDevice, StartCapture, OnStartCapture );
         METHODASYNCCALLBACK( WASAPICaptureDevice, StopCapture, OnStopCapture );
         METHODASYNCCALLBACK( WASAPICaptureDevice, FinishCapture, OnFinishCapture );
@@ -56,6 +74,9 @@ namespace Wazappy
 
         HRESULT InitializeScopeData();
         HRESULT ProcessScopeData( BYTE* pData, DWORD cbBytes );
+
+        // Hand a captured packet to every live link.  Audio thread only.
+        void WriteCaptureLinks( BYTE* pData, UINT32 FramesAvailable, UINT64 QPCPosition, bool IsSilent );
         
     private:
         DWORD m_dwQueueID;
@@ -76,5 +97,18 @@ namespace Wazappy
         UINT32 m_cPlotDataFilled;
 
         CAPTUREDEVICEPROPS m_DeviceProps;
+
+        // Guards m_PendingLinks and m_RetiredLinks; the audio thread only ever try-locks it.
+        std::mutex m_LinkMutex;
+        std::vector<ComPtr<CaptureSinkVoice>> m_PendingLinks;
+        std::vector<ComPtr<CaptureSinkVoice>> m_RetiredLinks;
+
+        // Links being fed, and the planar float buffer packets are converted into for them.  Audio thread only.
+        std::vector<ComPtr<CaptureSinkVoice>> m_ActiveLinks;
+        PlanarBuffer m_LinkBuffer;
+
+        // Frames delivered since capture started, and when they were recorded.
+        UINT64 m_CapturedFrames;
+        CaptureTimeline m_Timeline;
     };
 }
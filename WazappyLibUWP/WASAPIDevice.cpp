@@ -10,12 +10,24 @@
 using namespace Windows::System::Threading;
 using namespace Wazappy;
 
-WASAPIDevice::WASAPIDevice() :
+WASAPIDevice::WASAPIDevice(Platform::String^ deviceId) :
 	m_nodeId(WASAPISession::GetNextNodeId()),
+	m_DeviceIdString(deviceId),
 	m_BufferFrames(0),
 	m_DeviceState(DeviceState::Uninitialized),
 	m_AudioClient(nullptr),
-	m_SampleReadyAsyncResult(nullptr)
+	m_SampleReadyKey(0),
+	m_SampleReadyAsyncResult(nullptr),
+	m_IsDispatchStopping(false),
+	m_PeriodInFrames(0),
+	m_EngineThreadProps{ FALSE, 0, THREAD_PRIORITY_TIME_CRITICAL },
+	m_EngineThread(nullptr),
+	m_PeriodTicks(0),
+	m_LastDispatchTicks(0),
+	m_DispatchCount(0),
+	m_TotalJitterTicks(0),
+	m_MaxJitterTicks(0),
+	m_LateDispatchCount(0)
 {
 	// Create events for sample ready or user stop
 	m_SampleReadyEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
@@ -24,6 +36,13 @@ WASAPIDevice::WASAPIDevice() :
 		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
 	}
 
+	// Manual reset, so it stays signaled until the engine thread has seen it
+	m_EngineStopEvent = CreateEventEx(nullptr, nullptr, CREATE_EVENT_MANUAL_RESET, EVENT_ALL_ACCESS);
+	if (nullptr == m_EngineStopEvent)
+	{
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+	}
+
 	if (!InitializeCriticalSectionEx(&m_CritSec, 0, 0))
 	{
 		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
@@ -32,6 +51,8 @@ WASAPIDevice::WASAPIDevice() :
 
 WASAPIDevice::~WASAPIDevice()
 {
+	StopSampleReadyDispatch();
+
 	SAFE_RELEASE(m_AudioClient);
 	SAFE_RELEASE(m_SampleReadyAsyncResult);
 
@@ -41,6 +62,12 @@ WASAPIDevice::~WASAPIDevice()
 		m_SampleReadyEvent = INVALID_HANDLE_VALUE;
 	}
 
+	if (nullptr != m_EngineStopEvent)
+	{
+		CloseHandle(m_EngineStopEvent);
+		m_EngineStopEvent = nullptr;
+	}
+
 	DeleteCriticalSection(&m_CritSec);
 }
 
@@ -55,8 +82,11 @@ HRESULT WASAPIDevice::InitializeAudioDeviceAsync()
 	IActivateAudioInterfaceAsyncOperation *asyncOp;
 	HRESULT hr = S_OK;
 
-	// Get a string representing the Default Audio Device Renderer
-	m_DeviceIdString = GetDeviceId();
+	// Use the default endpoint unless we were opened on a specific one
+	if (nullptr == m_DeviceIdString)
+	{
+		m_DeviceIdString = GetDeviceId();
+	}
 
 	// This call must be made on the main UI thread.  Async operation will call back to 
 	// IActivateAudioInterfaceCompletionHandler::ActivateCompleted, which must be an agile interface implementation
@@ -111,9 +141,11 @@ HRESULT WASAPIDevice::ActivateCompleted(IActivateAudioInterfaceAsyncOperation *o
 			goto exit;
 		}
 
+		m_PeriodInFrames = ChoosePeriodInFrames();
+
 		hr = m_AudioClient->InitializeSharedAudioStream(
 			AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
-			m_MinPeriodInFrames,
+			m_PeriodInFrames,
 			m_MixFormat,
 			nullptr);
 
@@ -129,7 +161,13 @@ HRESULT WASAPIDevice::ActivateCompleted(IActivateAudioInterfaceAsyncOperation *o
 			goto exit;
 		}
 
-		// Create Async callback for sample events
+		// The engine signals the sample ready event once per period we asked for above
+		LARGE_INTEGER qpcFrequency;
+		QueryPerformanceFrequency(&qpcFrequency);
+		m_PeriodTicks = (LONGLONG)m_PeriodInFrames * qpcFrequency.QuadPart / m_MixFormat->nSamplesPerSec;
+
+		// Create Async callback for sample events (replacing the one from any earlier activation)
+		SAFE_RELEASE(m_SampleReadyAsyncResult);
 		hr = MFCreateAsyncResult(nullptr, &m_xSampleReady, nullptr, &m_SampleReadyAsyncResult);
 		if (FAILED(hr))
 		{
@@ -161,6 +199,26 @@ exit:
 	return S_OK;
 }
 
+//
+//  ClampPeriodInFrames()
+//
+UINT32 WASAPIDevice::ClampPeriodInFrames(UINT32 frames) const
+{
+	if (frames <= m_MinPeriodInFrames || 0 == m_FundamentalPeriodInFrames)
+	{
+		return m_MinPeriodInFrames;
+	}
+
+	if (frames >= m_MaxPeriodInFrames)
+	{
+		return m_MaxPeriodInFrames;
+	}
+
+	UINT32 steps = (frames - m_MinPeriodInFrames + (m_FundamentalPeriodInFrames / 2)) / m_FundamentalPeriodInFrames;
+	UINT32 period = m_MinPeriodInFrames + (steps * m_FundamentalPeriodInFrames);
+	return (period > m_MaxPeriodInFrames) ? m_MaxPeriodInFrames : period;
+}
+
 //
 //  SetVolumeOnSession()
 //
@@ -191,20 +249,224 @@ exit:
 	return hr;
 }
 
-HRESULT WASAPIDevice::CreateWorkItemWaitingForSampleReadyEvent()
+//
+//  SetEngineThreadProperties()
+//
+HRESULT WASAPIDevice::SetEngineThreadProperties(ENGINETHREADPROPS props)
 {
-	return MFPutWaitingWorkItem(m_SampleReadyEvent, 0, m_SampleReadyAsyncResult, &m_SampleReadyKey);
+	if (props.Priority < THREAD_PRIORITY_IDLE || props.Priority > THREAD_PRIORITY_TIME_CRITICAL)
+	{
+		return E_INVALIDARG;
+	}
+
+	m_EngineThreadProps = props;
+	return S_OK;
 }
 
-HRESULT WASAPIDevice::CancelWorkItemWaitingForSampleReadyEvent()
+//
+//  GetDispatchStatistics()
+//
+void WASAPIDevice::GetDispatchStatistics(DISPATCHSTATS* stats)
 {
-	// Stop playback by cancelling Work Item
-	// Cancel the queued work item (if any)
+	LARGE_INTEGER qpcFrequency;
+	QueryPerformanceFrequency(&qpcFrequency);
+	double microsecondsPerTick = 1000000.0 / qpcFrequency.QuadPart;
+
+	UINT64 dispatchCount = m_DispatchCount;
+	UINT64 intervalCount = (dispatchCount > 1) ? dispatchCount - 1 : 1;
+
+	stats->IsDedicatedThread = m_EngineThreadProps.IsDedicatedThread;
+	stats->CallbackCount = dispatchCount;
+	stats->NominalPeriodMicroseconds = (UINT32)(m_PeriodTicks * microsecondsPerTick);
+	stats->MeanJitterMicroseconds = (UINT32)((m_TotalJitterTicks / intervalCount) * microsecondsPerTick);
+	stats->MaxJitterMicroseconds = (UINT32)(m_MaxJitterTicks * microsecondsPerTick);
+	stats->LateCallbackCount = m_LateDispatchCount;
+}
+
+//
+//  RecordDispatch()
+//
+//  Measure how far this callback's entry is from one period after the previous one
+//
+void WASAPIDevice::RecordDispatch()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+
+	if (m_LastDispatchTicks != 0)
+	{
+		LONGLONG interval = now.QuadPart - m_LastDispatchTicks;
+		UINT64 jitter = (UINT64)((interval > m_PeriodTicks) ? interval - m_PeriodTicks : m_PeriodTicks - interval);
+
+		m_TotalJitterTicks.store(m_TotalJitterTicks.load(std::memory_order_relaxed) + jitter, std::memory_order_relaxed);
+		if (jitter > m_MaxJitterTicks.load(std::memory_order_relaxed))
+		{
+			m_MaxJitterTicks.store(jitter, std::memory_order_relaxed);
+		}
+
+		if (interval > m_PeriodTicks + (m_PeriodTicks / 2))
+		{
+			m_LateDispatchCount.store(m_LateDispatchCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+	}
+
+	m_LastDispatchTicks = now.QuadPart;
+	m_DispatchCount.store(m_DispatchCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+//
+//  CompleteGroupStartAsync()
+//
+HRESULT WASAPIDevice::CompleteGroupStartAsync()
+{
+	return MFPutWorkItem2(MFASYNC_CALLBACK_QUEUE_MULTITHREADED, 0, &m_xGroupStarted, nullptr);
+}
+
+//
+//  OnGroupStarted()
+//
+//  Callback method to finish a group start
+//
+HRESULT WASAPIDevice::OnGroupStarted(IMFAsyncResult* pResult)
+{
+	HRESULT hr = OnClientStarted();
+	if (FAILED(hr))
+	{
+		SetDeviceStateAndNotifyCallbacks(DeviceState::InError, true);
+	}
+
+	return S_OK;
+}
+
+//
+//  AbortGroupStart()
+//
+void WASAPIDevice::AbortGroupStart(DeviceState previousState)
+{
+	if (nullptr != m_AudioClient)
+	{
+		m_AudioClient->Stop();
+		m_AudioClient->Reset();
+	}
+
+	if (GetDeviceState() != DeviceState::InError)
+	{
+		SetDeviceStateAndNotifyCallbacks(previousState, true);
+	}
+}
+
+//
+//  StartSampleReadyDispatch()
+//
+HRESULT WASAPIDevice::StartSampleReadyDispatch()
+{
+	// Reap the thread from any earlier run
+	StopSampleReadyDispatch();
+
+	m_LastDispatchTicks = 0;
+	m_DispatchCount = 0;
+	m_TotalJitterTicks = 0;
+	m_MaxJitterTicks = 0;
+	m_LateDispatchCount = 0;
+
+	if (!m_EngineThreadProps.IsDedicatedThread)
+	{
+		// A fresh async result per run, so a waiting work item from an earlier run which fires after this point
+		// can tell it is stale
+		EnterCriticalSection(&m_CritSec);
+		m_IsDispatchStopping = false;
+		SAFE_RELEASE(m_SampleReadyAsyncResult);
+		HRESULT hr = MFCreateAsyncResult(nullptr, &m_xSampleReady, nullptr, &m_SampleReadyAsyncResult);
+		if (SUCCEEDED(hr))
+		{
+			hr = MFPutWaitingWorkItem(m_SampleReadyEvent, 0, m_SampleReadyAsyncResult, &m_SampleReadyKey);
+		}
+		LeaveCriticalSection(&m_CritSec);
+		return hr;
+	}
+
+	ResetEvent(m_EngineStopEvent);
+
+	m_EngineThread = CreateThread(nullptr, 0, EngineThreadProc, this, CREATE_SUSPENDED, nullptr);
+	if (nullptr == m_EngineThread)
+	{
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	SetThreadPriority(m_EngineThread, m_EngineThreadProps.Priority);
+
+#if WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
+	if (0 != m_EngineThreadProps.AffinityMask)
+	{
+		SetThreadAffinityMask(m_EngineThread, (DWORD_PTR)m_EngineThreadProps.AffinityMask);
+	}
+#endif
+
+	ResumeThread(m_EngineThread);
+	return S_OK;
+}
+
+//
+//  StopSampleReadyDispatch()
+//
+HRESULT WASAPIDevice::StopSampleReadyDispatch()
+{
+	// OnSampleReady holds the lock while it runs and re-queues itself, so once we have it no callback is running,
+	// and any that the cancel is too late for sees the stop and returns without touching the buffer
+	EnterCriticalSection(&m_CritSec);
+	m_IsDispatchStopping = true;
 	if (0 != m_SampleReadyKey)
 	{
 		MFCancelWorkItem(m_SampleReadyKey);
 		m_SampleReadyKey = 0;
 	}
+	LeaveCriticalSection(&m_CritSec);
+
+	if (nullptr != m_EngineThread)
+	{
+		SetEvent(m_EngineStopEvent);
+		WaitForSingleObjectEx(m_EngineThread, INFINITE, FALSE);
+		CloseHandle(m_EngineThread);
+		m_EngineThread = nullptr;
+	}
+
+	return S_OK;
+}
+
+DWORD WINAPI WASAPIDevice::EngineThreadProc(LPVOID parameter)
+{
+	return reinterpret_cast<WASAPIDevice*>(parameter)->EngineThreadLoop();
+}
+
+//
+//  EngineThreadLoop()
+//
+//  Dedicated engine thread: services every sample ready event directly, with no work queue dispatch in between
+//
+DWORD WASAPIDevice::EngineThreadLoop()
+{
+	HANDLE waitHandles[2] = { m_EngineStopEvent, m_SampleReadyEvent };
+
+	while (IsDeviceActive(GetDeviceState()))
+	{
+		DWORD waitResult = WaitForMultipleObjectsEx(2, waitHandles, FALSE, INFINITE, FALSE);
+		if (WAIT_OBJECT_0 + 1 != waitResult)
+		{
+			// Asked to stop, or the wait itself failed
+			break;
+		}
+
+		RecordDispatch();
+
+		HRESULT hr = OnAudioSampleRequested(false);
+		if (FAILED(hr))
+		{
+			SetDeviceStateAndNotifyCallbacks(DeviceState::InError, true);
+			break;
+		}
+	}
+
+	return 0;
 }
 
 //
@@ -216,12 +478,21 @@ HRESULT WASAPIDevice::OnSampleReady(IMFAsyncResult* pResult)
 {
 	HRESULT hr = S_OK;
 
+	EnterCriticalSection(&m_CritSec);
+	if (m_IsDispatchStopping || pResult != m_SampleReadyAsyncResult)
+	{
+		LeaveCriticalSection(&m_CritSec);
+		return S_OK;
+	}
+
+	RecordDispatch();
+
 	hr = OnAudioSampleRequested(false);
 
 	if (SUCCEEDED(hr))
 	{
-		// Re-queue work item for next sample
-		if (IsDeviceActive(GetDeviceState()))
+		// Re-queue work item for next sample, unless the callbacks stopped it from under us
+		if (IsDeviceActive(GetDeviceState()) && !m_IsDispatchStopping)
 		{
 			hr = MFPutWaitingWorkItem(m_SampleReadyEvent, 0, m_SampleReadyAsyncResult, &m_SampleReadyKey);
 		}
@@ -231,6 +502,7 @@ HRESULT WASAPIDevice::OnSampleReady(IMFAsyncResult* pResult)
 		SetDeviceStateAndNotifyCallbacks(DeviceState::InError, true);
 	}
 
+	LeaveCriticalSection(&m_CritSec);
 	return hr;
 }
 
@@ -269,10 +541,18 @@ void WASAPIDevice::UnregisterDeviceStateCallback(NodeId node, CallbackId callbac
 
 void WASAPIDevice::SetDeviceStateAndNotifyCallbacks(DeviceState newDeviceState, bool fireEvent)
 {
+	// The engine thread and the sample ready work item both decide whether to keep running from this state
+	m_DeviceState = newDeviceState;
+
 	std::lock_guard<std::mutex> guard(s_deviceStateChangedCallbackMutex);
-	if (fireEvent)
+	if (fireEvent && s_deviceStateCallbackHook != nullptr)
 	{
 		auto& iter = s_deviceStateChangedCallbacks.find(m_nodeId);
+		if (iter == s_deviceStateChangedCallbacks.end())
+		{
+			return;
+		}
+
 		for (auto& callback : iter->second)
 		{
 			s_deviceStateCallbackHook(callback.first, newDeviceState);
@@ -3,9 +3,11 @@
 // Licensed under the MIT License.
 // This file based on WindowsAudioSession sample from https://github.com/Microsoft/Windows-universal-samples
 
+#include <atomic>
+
 #include "WazappyDllInterface.h"
 #include "ToneSampleGenerator.h"
-#include "MFSampleGenerator.h"
+#include "DeviceClock.h"
 
 using namespace Microsoft::WRL;
 using namespace Windows::Media::Devices;
@@ -20,21 +22,78 @@ namespace Wazappy
 		public RuntimeClass< RuntimeClassFlags< ClassicCom >, FtmBase, IActivateAudioInterfaceCompletionHandler >
 	{
 	public:
-		WASAPIDevice();
+		// Open the endpoint with the given ID, or the device type's default endpoint if deviceId is null.
+		WASAPIDevice(Platform::String^ deviceId = nullptr);
 
 		virtual HRESULT InitializeAudioDeviceAsync();
 		
 		bool IsInitialized() { return m_DeviceState >= DeviceState::Initialized; }
 
+		// The ID of the default endpoint for this device type; used when no explicit ID was given.
 		virtual Platform::String^ GetDeviceId() = 0;
 		virtual HRESULT ConfigureDeviceInternal() = 0;
 
+		// The ID of the endpoint this device opened; null until InitializeAudioDeviceAsync has been called.
+		Platform::String^ GetEndpointId() const { return m_DeviceIdString; }
+
 		HRESULT SetVolumeOnSession(UINT32 volume);
 
+		// Choose how sample-ready events are dispatched; takes effect the next time the device starts.
+		HRESULT SetEngineThreadProperties(ENGINETHREADPROPS props);
+
+		void GetDispatchStatistics(DISPATCHSTATS* stats);
+
+		// Estimate of how fast this device's sample clock really runs; updated while the device is running.
+		const DeviceClock& GetDeviceClock() const { return m_DeviceClock; }
+
+		// Valid once the device has been configured.
+		const WAVEFORMATEX* GetMixFormat() const { return m_MixFormat; }
+
+		UINT32 GetDefaultPeriodInFrames() const { return m_DefaultPeriodInFrames; }
+
+		// The period the stream was initialized with, or 0 before the device is initialized.
+		UINT32 GetPeriodInFrames() const { return m_PeriodInFrames; }
+
+		// The same, in QPC ticks: the deadline each audio callback has.
+		LONGLONG GetPeriodTicks() const { return m_PeriodTicks; }
+
+		// Latency the audio engine adds beyond the buffer, or 0 before the device is initialized.
+		REFERENCE_TIME GetStreamLatency()
+		{
+			REFERENCE_TIME latency = 0;
+			if (m_AudioClient != nullptr)
+			{
+				m_AudioClient->GetStreamLatency(&latency);
+			}
+			return latency;
+		}
+
+		// Group start support for WASAPISession::StartDeviceGroup, which starts several devices' audio clients
+		// back to back on one thread so they begin as close together as possible.
+		// Get ready to start (check state, configure and pre-roll) without starting the audio client.
+		virtual HRESULT PrepareToStart() = 0;
+
+		HRESULT StartClient() { return m_AudioClient->Start(); }
+
+		// The audio client has just been started; begin servicing the device.
+		virtual HRESULT OnClientStarted() = 0;
+
+		// Call OnClientStarted on the device's own work item, as a single device's start does; a failure there
+		// puts the device in error.
+		HRESULT CompleteGroupStartAsync();
+
+		// Undo a group start which failed before CompleteGroupStartAsync: stop and reset the audio client, and put
+		// the device back in the state it had before PrepareToStart (unless that put it in error).
+		void AbortGroupStart(DeviceState previousState);
+
+		// Stop the device asynchronously, as its own stop method does.
+		virtual HRESULT StopAsync() = 0;
+
 		NodeId GetNodeId() { return m_nodeId; }
 		DeviceState GetDeviceState() { return m_DeviceState; }
 
 		METHODASYNCCALLBACK(WASAPIDevice, SampleReady, OnSampleReady);
+		METHODASYNCCALLBACK(WASAPIDevice, GroupStarted, OnGroupStarted);
 
 		// IActivateAudioInterfaceCompletionHandler
 		STDMETHOD(ActivateCompleted)(IActivateAudioInterfaceAsyncOperation *operation);
@@ -54,6 +113,7 @@ namespace Wazappy
 
 	private:
 		HRESULT OnSampleReady(IMFAsyncResult* pResult);
+		HRESULT OnGroupStarted(IMFAsyncResult* pResult);
 
 		// An audio sample is requested by the device.
 		virtual HRESULT OnAudioSampleRequested(Platform::Boolean IsSilence = false) = 0;
@@ -68,11 +128,30 @@ namespace Wazappy
 		// from the client.
 		void SetDeviceStateAndNotifyCallbacks(DeviceState newState, bool fireEvent);
 
-		// Create a work item waiting for the sample ready event.
-		HRESULT CreateWorkItemWaitingForSampleReadyEvent();
+		// Start servicing the sample ready event: either queue a work item waiting for it, or start the dedicated
+		// engine thread, depending on the engine thread properties.
+		HRESULT StartSampleReadyDispatch();
+
+		// Stop servicing the sample ready event, cancelling the waiting work item and waiting for one already
+		// running to finish, or joining the engine thread.  Never call this from the audio thread itself.
+		HRESULT StopSampleReadyDispatch();
 
-		// Cancel the work item (if any) which was waiting for the sample ready event.
-		HRESULT CancelWorkItemWaitingForSampleReadyEvent();
+		// The period to initialize the stream with, called once the device is configured.  Defaults to the
+		// smallest period the engine allows.
+		virtual UINT32 ChoosePeriodInFrames() { return m_MinPeriodInFrames; }
+
+		// The nearest period to the given one which the engine supports: a whole number of fundamental periods
+		// above the minimum, no larger than the maximum.
+		UINT32 ClampPeriodInFrames(UINT32 frames) const;
+
+	private:
+		static DWORD WINAPI EngineThreadProc(LPVOID parameter);
+
+		// Body of the dedicated engine thread: wait for each sample ready event and service it until stopped.
+		DWORD EngineThreadLoop();
+
+		// Note the entry of one audio callback in the dispatch statistics.  Audio thread only.
+		void RecordDispatch();
 
 	private:
 		// The single callback for all DeviceState-changed events.
@@ -98,7 +177,25 @@ namespace Wazappy
 		UINT32 m_MaxPeriodInFrames;
 		UINT32 m_MinPeriodInFrames;
 
+		// The period the stream was initialized with.
+		UINT32 m_PeriodInFrames;
+
+		// Fed with position observations by the subclass's audio callback.
+		DeviceClock m_DeviceClock;
+
 	private:
+		ENGINETHREADPROPS m_EngineThreadProps;
+		HANDLE m_EngineThread;
+		HANDLE m_EngineStopEvent;
+
+		// Dispatch timing, in QPC ticks.  Written only on the audio thread; read by GetDispatchStatistics.
+		LONGLONG m_PeriodTicks;
+		LONGLONG m_LastDispatchTicks;
+		std::atomic<UINT64> m_DispatchCount;
+		std::atomic<UINT64> m_TotalJitterTicks;
+		std::atomic<UINT64> m_MaxJitterTicks;
+		std::atomic<UINT32> m_LateDispatchCount;
+
 		const NodeId m_nodeId;
 		Platform::String^ m_DeviceIdString;
 
@@ -106,9 +203,14 @@ namespace Wazappy
 		MFWORKITEM_KEY m_SampleReadyKey;
 		IMFAsyncResult *m_SampleReadyAsyncResult;
 
+		// Set by StopSampleReadyDispatch, under m_CritSec, so a waiting work item it was too late to cancel
+		// returns without rendering; one left from an earlier run also finds m_SampleReadyAsyncResult replaced.
+		std::atomic<bool> m_IsDispatchStopping;
+
+		// Held by OnSampleReady while it runs, so StopSampleReadyDispatch can wait it out.
 		CRITICAL_SECTION m_CritSec;
 
-		DeviceState m_DeviceState;
+		std::atomic<DeviceState> m_DeviceState;
 	};
 }
 
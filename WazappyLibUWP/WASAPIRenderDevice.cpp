@@ -4,7 +4,16 @@
 // This file based on WindowsAudioSession sample from https://github.com/Microsoft/Windows-universal-samples
 
 #include "pch.h"
+#include <cmath>
 #include "WASAPIRenderDevice.h"
+#include "SampleCache.h"
+#include "SampleVoice.h"
+#include "StretchVoice.h"
+#include "VarispeedVoice.h"
+#include "StreamPrefetcher.h"
+#include "PlaylistVoice.h"
+#include "CaptureLinkVoice.h"
+#include "WASAPISession.h"
 
 using namespace Windows::System::Threading;
 using namespace Wazappy;
@@ -12,10 +21,28 @@ using namespace Wazappy;
 //
 //  WASAPIRenderer()
 //
-WASAPIRenderDevice::WASAPIRenderDevice() :
+WASAPIRenderDevice::WASAPIRenderDevice( Platform::String^ deviceId ) :
+    WASAPIDevice( deviceId ),
     m_AudioRenderClient( nullptr ),
+    m_AudioClock( nullptr ),
+    m_AudioClockFrequency( 0 ),
+    m_FramesWritten( 0 ),
     m_ToneSource( nullptr ),
-    m_MFSource( nullptr )
+    m_BeatsPerMinute( DELAY_LINE_DEFAULT_TEMPO ),
+    m_CalibrationStreamLatency( 0 ),
+    m_PeriodMode( PeriodMode_LowLatency ),
+    m_PowerSavingPeriodMilliseconds( 0 ),
+    m_IdleTimeoutMilliseconds( PERIOD_POLICY_DEFAULT_IDLE_TIMEOUT_MS ),
+    m_IsActive( true ),
+    m_IsActivityPending( false ),
+    m_LastLiveInputPeriods( 0 ),
+    m_LastActivityFrame( 0 ),
+    m_RenegotiationRetryFrames( 0 ),
+    m_IsRenegotiating( false ),
+    m_IsResumeAfterActivation( false ),
+    m_RenegotiationCount( 0 ),
+    m_WakeupCount( 0 ),
+    m_WakeupFrames( 0 )
 {
 }
 
@@ -25,7 +52,7 @@ WASAPIRenderDevice::WASAPIRenderDevice() :
 WASAPIRenderDevice::~WASAPIRenderDevice()
 {
     SAFE_RELEASE( m_AudioRenderClient );
-    SAFE_RELEASE( m_MFSource );
+    SAFE_RELEASE( m_AudioClock );
     SAFE_DELETE( m_ToneSource );
 }
 
@@ -46,9 +73,32 @@ HRESULT WASAPIRenderDevice::ActivateCompletedInternal()
         goto exit;
     }
 
+    // And the clock, which tells us where the device really is for drift estimation
+    hr = m_AudioClient->GetService( __uuidof(IAudioClock), (void**) &m_AudioClock );
+    if (FAILED( hr ))
+    {
+        goto exit;
+    }
+
+    hr = m_AudioClock->GetFrequency( &m_AudioClockFrequency );
+    if (FAILED( hr ))
+    {
+        goto exit;
+    }
+
+    // A new stream starts at position 0
+    m_FramesWritten = 0;
+
     // Everything succeeded
     SetDeviceStateAndNotifyCallbacks(DeviceState::Initialized, true);
 
+    // Pick up where we were if this stream replaces one which was playing
+    if (m_IsResumeAfterActivation)
+    {
+        m_IsResumeAfterActivation = false;
+        hr = StartPlaybackAsync();
+    }
+
 exit:
     return hr;
 }
@@ -212,15 +262,11 @@ HRESULT WASAPIRenderDevice::ConfigureSource()
     }
     else
     {
-        m_MFSource = new MFSampleGenerator();
-        if (m_MFSource)
-        {
-            hr = m_MFSource->Initialize( /*B4CR: m_DeviceProps.ContentStream*/nullptr, FramesPerPeriod, m_MixFormat );
-        }
-        else
-        {
-            hr = E_OUTOFMEMORY;
-        }
+        // File playback goes through the voice mixer; size its buffer for the largest possible request
+        m_MixBuffer.Allocate( m_MixFormat->nChannels, m_BufferFrames );
+        m_Mixer.Reserve( m_BufferFrames, m_MixFormat->nChannels );
+        m_Dynamics.Reserve( m_MixFormat->nChannels, m_MixFormat->nSamplesPerSec );
+        UpdateMixerTempo();
     }
 
     return hr;
@@ -276,22 +322,11 @@ HRESULT WASAPIRenderDevice::OnStartPlayback( IMFAsyncResult* pResult )
         goto exit;
     }
 
-    // For MF Source playback, need to start the source reader
-    if (!m_DeviceProps.IsTonePlayback)
-    {
-        hr = m_MFSource->StartSource();
-        if (FAILED( hr ))
-        {
-            goto exit;
-        }
-    }
-
     // Actually start the playback
-    hr = m_AudioClient->Start();
+    hr = StartClient();
     if (SUCCEEDED( hr ))
     {
-		SetDeviceStateAndNotifyCallbacks(DeviceState::Playing, true);
-		hr = CreateWorkItemWaitingForSampleReadyEvent();
+        hr = OnClientStarted();
     }
 
 exit:
@@ -303,6 +338,52 @@ exit:
     return S_OK;
 }
 
+//
+//  PrepareToStart()
+//
+//  Synchronous equivalent of StartPlaybackAsync up to (not including) starting the audio client, for group starts
+//
+HRESULT WASAPIRenderDevice::PrepareToStart()
+{
+    HRESULT hr = S_OK;
+
+    if ( (GetDeviceState() == DeviceState::Stopped) ||
+         (GetDeviceState() == DeviceState::Initialized) )
+    {
+        hr = ConfigureSource();
+        if (FAILED( hr ))
+        {
+            SetDeviceStateAndNotifyCallbacks(DeviceState::InError, true);
+            return hr;
+        }
+
+        SetDeviceStateAndNotifyCallbacks(DeviceState::Starting, true);
+    }
+    else if (GetDeviceState() != DeviceState::Paused)
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    // Pre-Roll the buffer with silence
+    return OnAudioSampleRequested( true );
+}
+
+//
+//  OnClientStarted()
+//
+HRESULT WASAPIRenderDevice::OnClientStarted()
+{
+    m_DeviceClock.Reset( m_MixFormat->nSamplesPerSec );
+
+    // The idle timeout runs from the start of each stream
+    m_LastLiveInputPeriods = m_Mixer.GetLiveInputPeriods();
+    m_LastActivityFrame = m_FramesWritten;
+    m_RenegotiationRetryFrames = 0;
+
+    SetDeviceStateAndNotifyCallbacks(DeviceState::Playing, true);
+    return StartSampleReadyDispatch();
+}
+
 //
 //  StopPlaybackAsync()
 //
@@ -329,6 +410,8 @@ HRESULT WASAPIRenderDevice::StopPlaybackAsync()
 //
 HRESULT WASAPIRenderDevice::OnStopPlayback( IMFAsyncResult* pResult )
 {
+    // Make sure no callback is still running before we touch the buffer from here
+    StopSampleReadyDispatch();
 
     // Flush anything left in buffer with silence
     OnAudioSampleRequested( true );
@@ -343,9 +426,8 @@ HRESULT WASAPIRenderDevice::OnStopPlayback( IMFAsyncResult* pResult )
     }
     else
     {
-        // Stop Source and Flush remaining buffers
-        m_MFSource->StopSource();
-        m_MFSource->Shutdown();
+        // Drop any voices still playing
+        m_Mixer.Flush();
     }
 
     SetDeviceStateAndNotifyCallbacks(DeviceState::Stopped, true);
@@ -379,6 +461,7 @@ HRESULT WASAPIRenderDevice::PausePlaybackAsync()
 //
 HRESULT WASAPIRenderDevice::OnPausePlayback( IMFAsyncResult* pResult )
 {
+    StopSampleReadyDispatch();
     m_AudioClient->Stop();
     SetDeviceStateAndNotifyCallbacks(DeviceState::Paused, true);
     return S_OK;
@@ -434,6 +517,10 @@ HRESULT WASAPIRenderDevice::OnAudioSampleRequested( Platform::Boolean IsSilence
             }
 
             hr = m_AudioRenderClient->ReleaseBuffer( FramesAvailable, AUDCLNT_BUFFERFLAGS_SILENT );
+            if (SUCCEEDED( hr ))
+            {
+                m_FramesWritten += FramesAvailable;
+            }
             goto exit;
         }
 
@@ -442,6 +529,8 @@ HRESULT WASAPIRenderDevice::OnAudioSampleRequested( Platform::Boolean IsSilence
         // the process of stopping or stopped
         if (GetDeviceState() == DeviceState::Playing)
         {
+            UpdateDeviceClock();
+
             // Fill the buffer with a playback sample
             if (m_DeviceProps.IsTonePlayback)
             {
@@ -449,7 +538,12 @@ HRESULT WASAPIRenderDevice::OnAudioSampleRequested( Platform::Boolean IsSilence
             }
             else
             {
-                hr = GetMFSample( FramesAvailable );
+                hr = GetMixerSample( FramesAvailable );
+            }
+
+            if (SUCCEEDED( hr ))
+            {
+                UpdatePeriodPolicy();
             }
         }
     }
@@ -462,9 +556,7 @@ exit:
     {
 		// TODO: "false" here (no callbacks) is from original sample logic
         SetDeviceStateAndNotifyCallbacks(DeviceState::Uninitialized, false);
-        SAFE_RELEASE( m_AudioClient );
-        SAFE_RELEASE( m_AudioRenderClient );
-        SAFE_RELEASE( m_SampleReadyAsyncResult );
+        ReleaseAudioClient();
 
         hr = InitializeAudioDeviceAsync();
     }
@@ -472,6 +564,29 @@ exit:
     return hr;
 }
 
+//
+//  UpdateDeviceClock()
+//
+//  Feeds the device's current position to the drift estimate
+//
+void WASAPIRenderDevice::UpdateDeviceClock()
+{
+    UINT64 Position = 0;
+    UINT64 QPCPosition = 0;
+
+    if ( (nullptr == m_AudioClock) || (0 == m_AudioClockFrequency) )
+    {
+        return;
+    }
+
+    if (SUCCEEDED( m_AudioClock->GetPosition( &Position, &QPCPosition ) ))
+    {
+        // The position is in the clock's own units; convert it to frames
+        UINT64 Frames = static_cast<UINT64>( (double)Position * m_MixFormat->nSamplesPerSec / m_AudioClockFrequency );
+        m_DeviceClock.AddObservation( Frames, QPCPosition );
+    }
+}
+
 //
 //  GetToneSample()
 //
@@ -490,6 +605,10 @@ HRESULT WASAPIRenderDevice::GetToneSample( UINT32 FramesAvailable )
         {
             // Ignore the return
             hr = m_AudioRenderClient->ReleaseBuffer( FramesAvailable, AUDCLNT_BUFFERFLAGS_SILENT );
+            if (SUCCEEDED( hr ))
+            {
+                m_FramesWritten += FramesAvailable;
+            }
         }
 
         StopPlaybackAsync();
@@ -507,6 +626,10 @@ HRESULT WASAPIRenderDevice::GetToneSample( UINT32 FramesAvailable )
             {
                 hr = m_AudioRenderClient->ReleaseBuffer( ActualFramesToRead, 0 );
             }
+            if (SUCCEEDED( hr ))
+            {
+                m_FramesWritten += ActualFramesToRead;
+            }
         }
     }
 
@@ -514,57 +637,1549 @@ HRESULT WASAPIRenderDevice::GetToneSample( UINT32 FramesAvailable )
 }
 
 //
-//  GetMFSample()
+//  ConvertMixBuffer()
+//
+//  Interleaves the planar float mix into the device mix format, saturating 16-bit output
+//
+static void ConvertMixBuffer( const PlanarView& Source, BYTE *Data, UINT32 FrameCount, RenderSampleType SampleType )
+{
+    if (SampleType == RenderSampleType::SampleTypeFloat)
+    {
+        Interleave( Source, FrameCount, reinterpret_cast<float *>(Data) );
+    }
+    else
+    {
+        Interleave( Source, FrameCount, reinterpret_cast<INT16 *>(Data) );
+    }
+}
+
+//
+//  GetMixerSample()
 //
-//  Fills buffer with a MF sample
+//  Fills buffer with the sum of all voices playing on this device
 //
-HRESULT WASAPIRenderDevice::GetMFSample( UINT32 FramesAvailable )
+HRESULT WASAPIRenderDevice::GetMixerSample( UINT32 FramesAvailable )
 {
     HRESULT hr = S_OK;
     BYTE *Data = nullptr;
+    LARGE_INTEGER Start;
+    LARGE_INTEGER End;
 
-    // Post-Roll Silence
-    if (m_MFSource->IsEOF())
+    QueryPerformanceCounter( &Start );
+
+    hr = m_AudioRenderClient->GetBuffer( FramesAvailable, &Data );
+    if (FAILED( hr ))
     {
-        hr = m_AudioRenderClient->GetBuffer( FramesAvailable, &Data );
-        if (SUCCEEDED( hr ))
-        {
-            // Ignore the return
-            hr = m_AudioRenderClient->ReleaseBuffer( FramesAvailable, AUDCLNT_BUFFERFLAGS_SILENT );
-        }
+        return hr;
+    }
 
-        StopPlaybackAsync();
+    // The dynamics play out the lookahead they hold after the mix falls silent
+    bool IsAudible = m_Mixer.Render( m_MixBuffer.GetView(), FramesAvailable );
+    IsAudible = m_Dynamics.Process( m_MixBuffer.GetView(), FramesAvailable, !IsAudible );
+    if (IsAudible)
+    {
+        ConvertMixBuffer( m_MixBuffer.GetView(), Data, FramesAvailable, CalculateMixFormatType( m_MixFormat ) );
+        hr = m_AudioRenderClient->ReleaseBuffer( FramesAvailable, 0 );
     }
     else
     {
-        UINT32 ActualBytesRead = 0;
-        UINT32 ActualBytesToRead = FramesAvailable * m_MixFormat->nBlockAlign;
+        // Nothing is playing, let the audio engine fill in silence
+        hr = m_AudioRenderClient->ReleaseBuffer( FramesAvailable, AUDCLNT_BUFFERFLAGS_SILENT );
+    }
 
-        hr = m_AudioRenderClient->GetBuffer( FramesAvailable, &Data );
-        if (SUCCEEDED( hr ))
-        {
-            hr = m_MFSource->FillSampleBuffer( ActualBytesToRead, Data, &ActualBytesRead );
-            if (hr == S_FALSE)
-            {
-                // Hit EOS
-                hr = m_AudioRenderClient->ReleaseBuffer( FramesAvailable, AUDCLNT_BUFFERFLAGS_SILENT );
-                StopPlaybackAsync();
-            }
-            else if (SUCCEEDED( hr ))
-            {
-                // This can happen if we are pre-rolling so just insert silence
-                if (0 == ActualBytesRead)
-                {
-                    hr = m_AudioRenderClient->ReleaseBuffer( FramesAvailable, AUDCLNT_BUFFERFLAGS_SILENT );
-                }
-                else
-                {
-                    hr = m_AudioRenderClient->ReleaseBuffer( ( ActualBytesRead / m_MixFormat->nBlockAlign ), 0 );
-                }
-            }
-        }
+    if (SUCCEEDED( hr ))
+    {
+        m_FramesWritten += FramesAvailable;
+    }
+
+    // Judge the load against the deadline, and shed (or restore) work from the next period on
+    QueryPerformanceCounter( &End );
+    if (GetPeriodTicks() > 0)
+    {
+        m_Mixer.SetShedLevel( m_LoadGovernor.Update( (double)(End.QuadPart - Start.QuadPart) / GetPeriodTicks() ) );
     }
 
     return hr;
 }
 
+//
+//  LoadCachedSample()
+//
+//  Decodes a file into the session sample cache in this device's mix format
+//
+HRESULT WASAPIRenderDevice::LoadCachedSample( LPCWSTR url )
+{
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    ComPtr<SampleAsset> Asset;
+    return SampleCache::LoadAsset( url, m_MixFormat->nChannels, m_MixFormat->nSamplesPerSec, &Asset );
+}
+
+//
+//  PlayCachedSample()
+//
+//  Starts a one-shot voice on an already-decoded sample; never decodes
+//
+HRESULT WASAPIRenderDevice::PlayCachedSample( LPCWSTR url, VoiceId *pVoiceId )
+{
+    if (nullptr == pVoiceId)
+    {
+        return E_POINTER;
+    }
+
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    ComPtr<SampleAsset> Asset;
+    if (!SampleCache::TryGetAsset( url, m_MixFormat->nChannels, m_MixFormat->nSamplesPerSec, &Asset ))
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    ComPtr<SampleVoice> Voice = Make<SampleVoice>( VoiceMixer::GetNextVoiceId(), Asset );
+    if (nullptr == Voice)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    m_Mixer.AddVoice( Voice );
+    *pVoiceId = Voice->GetVoiceId();
+    return S_OK;
+}
+
+//
+//  PlayStreamingSample()
+//
+//  Starts a voice streaming from disk, decoded ahead by the shared prefetcher
+//
+HRESULT WASAPIRenderDevice::PlayStreamingSample( LPCWSTR url, UINT32 prefetchMilliseconds, VoiceId *pVoiceId )
+{
+    if (nullptr == pVoiceId)
+    {
+        return E_POINTER;
+    }
+
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    // Never prefetch less than two periods, or the voice would starve every time the prefetcher is a little late
+    UINT32 PrefetchFrames = static_cast<UINT32>( (UINT64)prefetchMilliseconds * m_MixFormat->nSamplesPerSec / 1000 );
+    PrefetchFrames = max( PrefetchFrames, 2 * GetBufferFramesPerPeriod() );
+
+    ComPtr<StreamingVoice> Voice = Make<StreamingVoice>( VoiceMixer::GetNextVoiceId(), m_MixFormat->nChannels, m_MixFormat->nSamplesPerSec, PrefetchFrames );
+    if (nullptr == Voice)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = Voice->Open( url );
+    if (FAILED( hr ))
+    {
+        return hr;
+    }
+
+    hr = StreamPrefetcher::AddVoice( Voice );
+    if (FAILED( hr ))
+    {
+        return hr;
+    }
+
+    m_Mixer.AddVoice( Voice );
+    *pVoiceId = Voice->GetVoiceId();
+    return S_OK;
+}
+
+//
+//  GetStreamingVoiceStatistics()
+//
+HRESULT WASAPIRenderDevice::GetStreamingVoiceStatistics( VoiceId voiceId, STREAMINGVOICESTATS *pStats )
+{
+    if (nullptr == pStats)
+    {
+        return E_POINTER;
+    }
+
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    StreamingVoice *Streaming = dynamic_cast<StreamingVoice *>( Voice.Get() );
+    if (nullptr == Streaming)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    Streaming->GetStatistics( pStats );
+    return S_OK;
+}
+
+//
+//  GetSampleVoiceStatistics()
+//
+HRESULT WASAPIRenderDevice::GetSampleVoiceStatistics( VoiceId voiceId, SAMPLEVOICESTATS *pStats )
+{
+    if (nullptr == pStats)
+    {
+        return E_POINTER;
+    }
+
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    SampleVoice *Sample = dynamic_cast<SampleVoice *>( Voice.Get() );
+    if (nullptr == Sample)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    Sample->GetStatistics( pStats );
+    return S_OK;
+}
+
+//
+//  PlayStretchedLoop()
+//
+//  Starts a voice looping an already-decoded sample, stretched to the device's tempo without changing its pitch
+//
+HRESULT WASAPIRenderDevice::PlayStretchedLoop( LPCWSTR url, float loopBeatsPerMinute, StretchQuality quality, VoiceId *pVoiceId )
+{
+    if (nullptr == pVoiceId)
+    {
+        return E_POINTER;
+    }
+
+    // Written so a NaN or infinite tempo fails too
+    if (!std::isfinite( loopBeatsPerMinute ) || !(loopBeatsPerMinute >= 0) ||
+        (quality != Stretch_Wsola && quality != Stretch_PhaseVocoder))
+    {
+        return E_INVALIDARG;
+    }
+
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    ComPtr<SampleAsset> Asset;
+    if (!SampleCache::TryGetAsset( url, m_MixFormat->nChannels, m_MixFormat->nSamplesPerSec, &Asset ))
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    if (0 == Asset->GetFrameCount())
+    {
+        return E_INVALIDARG;
+    }
+
+    ComPtr<StretchVoice> Voice = Make<StretchVoice>( VoiceMixer::GetNextVoiceId(), Asset, loopBeatsPerMinute, quality );
+    if (nullptr == Voice)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    m_Mixer.AddVoice( Voice );
+    *pVoiceId = Voice->GetVoiceId();
+    return S_OK;
+}
+
+//
+//  SetVoiceStretch()
+//
+HRESULT WASAPIRenderDevice::SetVoiceStretch( VoiceId voiceId, float loopBeatsPerMinute, float rate )
+{
+    // Written so a NaN or infinite tempo or rate fails too
+    if (!std::isfinite( loopBeatsPerMinute ) || !(loopBeatsPerMinute >= 0) || !std::isfinite( rate ))
+    {
+        return E_INVALIDARG;
+    }
+
+    // A fixed rate must be one the stretcher can play at
+    if (0 == loopBeatsPerMinute && !(rate >= TIME_STRETCH_MIN_RATE && rate <= TIME_STRETCH_MAX_RATE))
+    {
+        return E_INVALIDARG;
+    }
+
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    StretchVoice *Stretch = dynamic_cast<StretchVoice *>( Voice.Get() );
+    if (nullptr == Stretch)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    Stretch->SetStretch( loopBeatsPerMinute, rate );
+    return S_OK;
+}
+
+//
+//  GetStretchVoiceStatistics()
+//
+HRESULT WASAPIRenderDevice::GetStretchVoiceStatistics( VoiceId voiceId, STRETCHVOICESTATS *pStats )
+{
+    if (nullptr == pStats)
+    {
+        return E_POINTER;
+    }
+
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    StretchVoice *Stretch = dynamic_cast<StretchVoice *>( Voice.Get() );
+    if (nullptr == Stretch)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    Stretch->GetStatistics( pStats );
+    return S_OK;
+}
+
+//
+//  IsValidVarispeed()
+//
+static bool IsValidVarispeed( float rate, InterpolationQuality quality )
+{
+    // Written so a NaN rate fails too
+    if (!(rate >= -VARISPEED_MAX_RATE && rate <= VARISPEED_MAX_RATE))
+    {
+        return false;
+    }
+
+    return (quality == Interpolation_Linear || quality == Interpolation_Hermite || quality == Interpolation_Sinc);
+}
+
+//
+//  PlayVarispeedSample()
+//
+//  Starts a voice playing an already-decoded sample at a fractional rate, backwards for a negative one
+//
+HRESULT WASAPIRenderDevice::PlayVarispeedSample( LPCWSTR url, float rate, InterpolationQuality quality, BOOL isLooping, VoiceId *pVoiceId )
+{
+    if (nullptr == pVoiceId)
+    {
+        return E_POINTER;
+    }
+
+    if (!IsValidVarispeed( rate, quality ))
+    {
+        return E_INVALIDARG;
+    }
+
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    ComPtr<SampleAsset> Asset;
+    if (!SampleCache::TryGetAsset( url, m_MixFormat->nChannels, m_MixFormat->nSamplesPerSec, &Asset ))
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    if (0 == Asset->GetFrameCount())
+    {
+        return E_INVALIDARG;
+    }
+
+    ComPtr<VarispeedVoice> Voice = Make<VarispeedVoice>( VoiceMixer::GetNextVoiceId(), Asset, rate, quality, !!isLooping );
+    if (nullptr == Voice)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    m_Mixer.AddVoice( Voice );
+    *pVoiceId = Voice->GetVoiceId();
+    return S_OK;
+}
+
+//
+//  SetVoiceVarispeed()
+//
+HRESULT WASAPIRenderDevice::SetVoiceVarispeed( VoiceId voiceId, float rate, InterpolationQuality quality )
+{
+    if (!IsValidVarispeed( rate, quality ))
+    {
+        return E_INVALIDARG;
+    }
+
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    VarispeedVoice *Varispeed = dynamic_cast<VarispeedVoice *>( Voice.Get() );
+    if (nullptr == Varispeed)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    Varispeed->SetVarispeed( rate, quality );
+    return S_OK;
+}
+
+//
+//  GetVarispeedVoiceStatistics()
+//
+HRESULT WASAPIRenderDevice::GetVarispeedVoiceStatistics( VoiceId voiceId, VARISPEEDVOICESTATS *pStats )
+{
+    if (nullptr == pStats)
+    {
+        return E_POINTER;
+    }
+
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    VarispeedVoice *Varispeed = dynamic_cast<VarispeedVoice *>( Voice.Get() );
+    if (nullptr == Varispeed)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    Varispeed->GetStatistics( pStats );
+    return S_OK;
+}
+
+
+//
+//  PlayPlaylist()
+//
+//  Starts a voice playing a queue of files with no gap between them, or with an equal-power crossfade
+//
+HRESULT WASAPIRenderDevice::PlayPlaylist( const LPCWSTR *urls, UINT32 urlCount, UINT32 crossfadeMilliseconds, VoiceId *pVoiceId )
+{
+    if (nullptr == urls || nullptr == pVoiceId)
+    {
+        return E_POINTER;
+    }
+
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    // Each track's prefetch window has to hold its whole crossfade tail on top of the usual streaming margin
+    UINT32 CrossfadeFrames = static_cast<UINT32>( (UINT64)crossfadeMilliseconds * m_MixFormat->nSamplesPerSec / 1000 );
+    UINT32 PrefetchFrames = STREAMING_VOICE_DEFAULT_PREFETCH_MS * m_MixFormat->nSamplesPerSec / 1000;
+    PrefetchFrames = max( PrefetchFrames, 2 * GetBufferFramesPerPeriod() ) + CrossfadeFrames;
+
+    ComPtr<PlaylistVoice> Voice = Make<PlaylistVoice>( VoiceMixer::GetNextVoiceId(), m_MixFormat->nChannels, m_MixFormat->nSamplesPerSec, PrefetchFrames, CrossfadeFrames, m_BufferFrames );
+    if (nullptr == Voice)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    for (UINT32 i = 0; i < urlCount; i++)
+    {
+        Voice->EnqueueTrack( urls[i] );
+    }
+
+    HRESULT hr = StreamPrefetcher::AddPlaylist( Voice );
+    if (FAILED( hr ))
+    {
+        return hr;
+    }
+
+    m_Mixer.AddVoice( Voice );
+    *pVoiceId = Voice->GetVoiceId();
+    return S_OK;
+}
+
+//
+//  EnqueuePlaylistTrack()
+//
+HRESULT WASAPIRenderDevice::EnqueuePlaylistTrack( VoiceId voiceId, LPCWSTR url )
+{
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    PlaylistVoice *Playlist = dynamic_cast<PlaylistVoice *>( Voice.Get() );
+    if (nullptr == Playlist)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    Playlist->EnqueueTrack( url );
+    return S_OK;
+}
+
+//
+//  SeekVoice()
+//
+HRESULT WASAPIRenderDevice::SeekVoice( VoiceId voiceId, UINT64 frame )
+{
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    if (nullptr == Voice)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    return Voice->Seek( frame );
+}
+
+//
+//  StopVoice()
+//
+HRESULT WASAPIRenderDevice::StopVoice( VoiceId voiceId )
+{
+    return m_Mixer.StopVoice( voiceId ) ? S_OK : HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+}
+
+//
+//  RampMillisecondsToFrames()
+//
+UINT32 WASAPIRenderDevice::RampMillisecondsToFrames( UINT32 rampMilliseconds )
+{
+    return static_cast<UINT32>( (UINT64)rampMilliseconds * m_MixFormat->nSamplesPerSec / 1000 );
+}
+
+//
+//  SetVoiceGain()
+//
+HRESULT WASAPIRenderDevice::SetVoiceGain( VoiceId voiceId, float gain, UINT32 rampMilliseconds, GainRampShape shape )
+{
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    if (nullptr == Voice)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    Voice->GetGainStage().SetGain( gain, RampMillisecondsToFrames( rampMilliseconds ), shape );
+    return S_OK;
+}
+
+//
+//  SetVoicePan()
+//
+HRESULT WASAPIRenderDevice::SetVoicePan( VoiceId voiceId, float pan, UINT32 rampMilliseconds )
+{
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    if (nullptr == Voice)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    Voice->GetGainStage().SetPan( pan, RampMillisecondsToFrames( rampMilliseconds ) );
+    return S_OK;
+}
+
+//
+//  SetVoiceFilter()
+//
+HRESULT WASAPIRenderDevice::SetVoiceFilter( VoiceId voiceId, UINT32 stage, FilterType type, float frequency, float q, float gainDb, UINT32 rampMilliseconds )
+{
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    // Written so a NaN or infinite frequency, q or gain fails too
+    if (stage >= FILTER_BANK_MAX_STAGES || type < Filter_None || type > Filter_Peak ||
+        !std::isfinite( frequency ) || !(frequency > 0) || !std::isfinite( q ) || !(q > 0) || !std::isfinite( gainDb ))
+    {
+        return E_INVALIDARG;
+    }
+
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    if (nullptr == Voice)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    Voice->GetFilterBank().SetStage( stage, type, frequency / m_MixFormat->nSamplesPerSec, q, gainDb, RampMillisecondsToFrames( rampMilliseconds ) );
+    return S_OK;
+}
+
+//
+//  GetMaxDelayFrames()
+//
+UINT32 WASAPIRenderDevice::GetMaxDelayFrames()
+{
+    return DELAY_LINE_MAX_SECONDS * m_MixFormat->nSamplesPerSec;
+}
+
+//
+//  IsValidDelay()
+//
+static bool IsValidDelay( const DELAYPARAMS& params )
+{
+    // Written so a NaN or infinite field fails too; a NaN fed back into the line would never leave it
+    if (!std::isfinite( params.DelayMilliseconds ) || !std::isfinite( params.Beats ) || !std::isfinite( params.Feedback ) ||
+        !std::isfinite( params.WetGain ) || !std::isfinite( params.ModulationHz ) || !std::isfinite( params.ModulationMilliseconds ))
+    {
+        return false;
+    }
+
+    return params.DelayMilliseconds >= 0 && params.Beats >= 0 && params.ModulationHz >= 0 && params.ModulationMilliseconds >= 0
+        && params.Interpolation >= Delay_Linear && params.Interpolation <= Delay_Allpass;
+}
+
+//
+//  ApplyDelayParams()
+//
+void WASAPIRenderDevice::ApplyDelayParams( DelayLine* delayLine, const DELAYPARAMS& params )
+{
+    float FramesPerMillisecond = m_MixFormat->nSamplesPerSec / 1000.0f;
+    delayLine->SetParameters(
+        params.DelayMilliseconds * FramesPerMillisecond,
+        params.Beats,
+        params.Feedback,
+        params.WetGain,
+        params.ModulationHz / m_MixFormat->nSamplesPerSec,
+        params.ModulationMilliseconds * FramesPerMillisecond,
+        params.Interpolation,
+        RampMillisecondsToFrames( params.RampMilliseconds ) );
+}
+
+//
+//  SetVoiceDelay()
+//
+HRESULT WASAPIRenderDevice::SetVoiceDelay( VoiceId voiceId, const DELAYPARAMS& params )
+{
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    if (!IsValidDelay( params ))
+    {
+        return E_INVALIDARG;
+    }
+
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    if (nullptr == Voice)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    ApplyDelayParams( Voice->EnsureDelayLine( m_MixFormat->nChannels, GetMaxDelayFrames() ), params );
+    return S_OK;
+}
+
+//
+//  SetVoicePriority()
+//
+HRESULT WASAPIRenderDevice::SetVoicePriority( VoiceId voiceId, INT32 priority )
+{
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    if (nullptr == Voice)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    Voice->SetPriority( priority );
+    return S_OK;
+}
+
+//
+//  SetRealVoiceBudget()
+//
+HRESULT WASAPIRenderDevice::SetRealVoiceBudget( UINT32 maxRealVoices )
+{
+    m_Mixer.SetRealVoiceBudget( maxRealVoices );
+    return S_OK;
+}
+
+//
+//  SetBusGain()
+//
+HRESULT WASAPIRenderDevice::SetBusGain( float gain, UINT32 rampMilliseconds, GainRampShape shape )
+{
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    m_Mixer.GetBusGain().SetGain( gain, RampMillisecondsToFrames( rampMilliseconds ), shape );
+    return S_OK;
+}
+
+//
+//  SetBusPan()
+//
+HRESULT WASAPIRenderDevice::SetBusPan( float pan, UINT32 rampMilliseconds )
+{
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    m_Mixer.GetBusGain().SetPan( pan, RampMillisecondsToFrames( rampMilliseconds ) );
+    return S_OK;
+}
+
+//
+//  SetBusFilter()
+//
+HRESULT WASAPIRenderDevice::SetBusFilter( UINT32 stage, FilterType type, float frequency, float q, float gainDb, UINT32 rampMilliseconds )
+{
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    // Written so a NaN or infinite frequency, q or gain fails too
+    if (stage >= FILTER_BANK_MAX_STAGES || type < Filter_None || type > Filter_Peak ||
+        !std::isfinite( frequency ) || !(frequency > 0) || !std::isfinite( q ) || !(q > 0) || !std::isfinite( gainDb ))
+    {
+        return E_INVALIDARG;
+    }
+
+    m_Mixer.GetBusFilters().SetStage( stage, type, frequency / m_MixFormat->nSamplesPerSec, q, gainDb, RampMillisecondsToFrames( rampMilliseconds ) );
+    return S_OK;
+}
+
+//
+//  SetBusDelay()
+//
+HRESULT WASAPIRenderDevice::SetBusDelay( const DELAYPARAMS& params )
+{
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    if (!IsValidDelay( params ))
+    {
+        return E_INVALIDARG;
+    }
+
+    ApplyDelayParams( m_Mixer.EnsureBusDelay( m_MixFormat->nChannels, GetMaxDelayFrames() ), params );
+    return S_OK;
+}
+
+//
+//  SetTempo()
+//
+HRESULT WASAPIRenderDevice::SetTempo( float beatsPerMinute )
+{
+    // Written so a NaN or infinite tempo fails too
+    if (!std::isfinite( beatsPerMinute ) || !(beatsPerMinute > 0))
+    {
+        return E_INVALIDARG;
+    }
+
+    m_BeatsPerMinute = beatsPerMinute;
+    if (IsInitialized())
+    {
+        UpdateMixerTempo();
+    }
+    return S_OK;
+}
+
+//
+//  UpdateMixerTempo()
+//
+void WASAPIRenderDevice::UpdateMixerTempo()
+{
+    m_Mixer.SetFramesPerBeat( 60.0f * m_MixFormat->nSamplesPerSec / m_BeatsPerMinute );
+}
+
+//
+//  LoadBusReverb()
+//
+//  Builds a convolution reverb from an impulse response and hands it to the mixer
+//
+HRESULT WASAPIRenderDevice::LoadBusReverb( LPCWSTR impulseUrl )
+{
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    if (nullptr == impulseUrl)
+    {
+        m_Mixer.SetReverb( nullptr );
+        return S_OK;
+    }
+
+    ComPtr<SampleAsset> Impulse;
+    HRESULT hr = SampleCache::LoadAsset( impulseUrl, m_MixFormat->nChannels, m_MixFormat->nSamplesPerSec, &Impulse );
+    if (FAILED( hr ))
+    {
+        return hr;
+    }
+
+    ComPtr<ConvolutionReverb> Reverb = Make<ConvolutionReverb>();
+    if (nullptr == Reverb)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    hr = Reverb->Initialize( Impulse );
+    if (FAILED( hr ))
+    {
+        // Workers may have started before the failure.
+        Reverb->Shutdown();
+        return hr;
+    }
+
+    m_Mixer.SetReverb( Reverb );
+    return S_OK;
+}
+
+//
+//  SetBusReverbGain()
+//
+HRESULT WASAPIRenderDevice::SetBusReverbGain( float gain, UINT32 rampMilliseconds, GainRampShape shape )
+{
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    m_Mixer.GetReverbGain().SetGain( gain, RampMillisecondsToFrames( rampMilliseconds ), shape );
+    return S_OK;
+}
+
+//
+//  GetReverbStatistics()
+//
+HRESULT WASAPIRenderDevice::GetReverbStatistics( REVERBSTATS *pStats )
+{
+    if (nullptr == pStats)
+    {
+        return E_POINTER;
+    }
+
+    m_Mixer.GetReverbStatistics( pStats );
+    return S_OK;
+}
+
+//
+//  LoadHrtfDataset()
+//
+//  Builds a binaural spatializer from a dataset of head related impulse responses and hands it to the mixer
+//
+HRESULT WASAPIRenderDevice::LoadHrtfDataset( const HRTFDATASET *pDataset, UINT32 maxSources )
+{
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    if (nullptr == pDataset)
+    {
+        m_Mixer.SetSpatializer( nullptr );
+        return S_OK;
+    }
+
+    if (m_MixFormat->nChannels < 2)
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    ComPtr<BinauralSpatializer> Spatializer = Make<BinauralSpatializer>();
+    if (nullptr == Spatializer)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = Spatializer->Initialize( *pDataset, m_MixFormat->nSamplesPerSec, maxSources );
+    if (FAILED( hr ))
+    {
+        return hr;
+    }
+
+    m_Mixer.SetSpatializer( Spatializer );
+    return S_OK;
+}
+
+//
+//  SetVoiceSpatialPosition()
+//
+HRESULT WASAPIRenderDevice::SetVoiceSpatialPosition( VoiceId voiceId, bool isSpatialized, const SPATIALPOSITION& position )
+{
+    if (!std::isfinite( position.X ) || !std::isfinite( position.Y ) || !std::isfinite( position.Z ))
+    {
+        return E_INVALIDARG;
+    }
+
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    if (nullptr == Voice)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    Voice->GetSpatialSource().SetPosition( isSpatialized, position );
+    return S_OK;
+}
+
+//
+//  SetListenerOrientation()
+//
+HRESULT WASAPIRenderDevice::SetListenerOrientation( const LISTENERORIENTATION& orientation )
+{
+    if (!std::isfinite( orientation.W ) || !std::isfinite( orientation.X ) || !std::isfinite( orientation.Y ) || !std::isfinite( orientation.Z ))
+    {
+        return E_INVALIDARG;
+    }
+
+    m_Mixer.GetListener().Set( orientation );
+    return S_OK;
+}
+
+//
+//  GetSpatializerStatistics()
+//
+HRESULT WASAPIRenderDevice::GetSpatializerStatistics( SPATIALIZERSTATS *pStats )
+{
+    if (nullptr == pStats)
+    {
+        return E_POINTER;
+    }
+
+    m_Mixer.GetSpatializerStatistics( pStats );
+    return S_OK;
+}
+
+//
+//  LoadAmbisonicBus()
+//
+HRESULT WASAPIRenderDevice::LoadAmbisonicBus( const AMBISONICPARAMS *pParams )
+{
+    if (!IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    if (nullptr == pParams)
+    {
+        m_Mixer.SetAmbisonicBus( nullptr );
+        return S_OK;
+    }
+
+    ComPtr<AmbisonicBus> Bus = Make<AmbisonicBus>();
+    if (nullptr == Bus)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = Bus->Initialize( *pParams, m_MixFormat->nChannels, m_MixFormat->nSamplesPerSec );
+    if (FAILED( hr ))
+    {
+        return hr;
+    }
+
+    m_Mixer.SetAmbisonicBus( Bus );
+    return S_OK;
+}
+
+//
+//  SetVoiceSpatialRendering()
+//
+HRESULT WASAPIRenderDevice::SetVoiceSpatialRendering( VoiceId voiceId, SpatialRendering rendering )
+{
+    if (rendering != SpatialRendering_Hrtf && rendering != SpatialRendering_Ambisonic)
+    {
+        return E_INVALIDARG;
+    }
+
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    if (nullptr == Voice)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    Voice->GetSpatialSource().SetRendering( rendering );
+    return S_OK;
+}
+
+//
+//  GetAmbisonicStatistics()
+//
+HRESULT WASAPIRenderDevice::GetAmbisonicStatistics( AMBISONICSTATS *pStats )
+{
+    if (nullptr == pStats)
+    {
+        return E_POINTER;
+    }
+
+    m_Mixer.GetAmbisonicStatistics( pStats );
+    return S_OK;
+}
+
+//
+//  GetMixerStatistics()
+//
+HRESULT WASAPIRenderDevice::GetMixerStatistics( MIXERSTATS *pStats )
+{
+    if (nullptr == pStats)
+    {
+        return E_POINTER;
+    }
+
+    m_Mixer.GetStatistics( pStats );
+    return S_OK;
+}
+
+//
+//  SetOverloadProtection()
+//
+HRESULT WASAPIRenderDevice::SetOverloadProtection( bool isEnabled )
+{
+    m_LoadGovernor.SetEnabled( isEnabled );
+    return S_OK;
+}
+
+//
+//  SetDynamics()
+//
+HRESULT WASAPIRenderDevice::SetDynamics( const DYNAMICSPARAMS& params )
+{
+    // Written so a NaN or infinite field fails too
+    if (!std::isfinite( params.ThresholdDb ) || !std::isfinite( params.Ratio ) || !std::isfinite( params.KneeDb ) ||
+        !std::isfinite( params.AttackMilliseconds ) || !std::isfinite( params.ReleaseMilliseconds ) ||
+        !std::isfinite( params.MakeupGainDb ) || !std::isfinite( params.CeilingDb ) ||
+        !std::isfinite( params.LimiterReleaseMilliseconds ))
+    {
+        return E_INVALIDARG;
+    }
+
+    if (!(params.Ratio >= 1.0f) || !(params.KneeDb >= 0) || !(params.AttackMilliseconds >= 0) ||
+        !(params.ReleaseMilliseconds >= 0) || !(params.CeilingDb <= 0) || !(params.LimiterReleaseMilliseconds >= 0))
+    {
+        return E_INVALIDARG;
+    }
+
+    m_Dynamics.SetParameters( params );
+    return S_OK;
+}
+
+//
+//  GetDynamicsStatistics()
+//
+HRESULT WASAPIRenderDevice::GetDynamicsStatistics( DYNAMICSSTATS *pStats )
+{
+    if (nullptr == pStats)
+    {
+        return E_POINTER;
+    }
+
+    m_Dynamics.GetStatistics( pStats );
+    return S_OK;
+}
+
+//
+//  GetLoadStatistics()
+//
+HRESULT WASAPIRenderDevice::GetLoadStatistics( LOADSTATS *pStats )
+{
+    if (nullptr == pStats)
+    {
+        return E_POINTER;
+    }
+
+    m_LoadGovernor.GetStatistics( pStats );
+    return S_OK;
+}
+
+//
+//  SetPeriodPolicy()
+//
+HRESULT WASAPIRenderDevice::SetPeriodPolicy( PERIODPOLICY policy )
+{
+    if ( (policy.Mode != PeriodMode_LowLatency) &&
+         (policy.Mode != PeriodMode_PowerSaving) &&
+         (policy.Mode != PeriodMode_Adaptive) )
+    {
+        return E_INVALIDARG;
+    }
+
+    m_PowerSavingPeriodMilliseconds = policy.PowerSavingPeriodMilliseconds;
+    m_IdleTimeoutMilliseconds = (0 == policy.IdleTimeoutMilliseconds) ? PERIOD_POLICY_DEFAULT_IDLE_TIMEOUT_MS : policy.IdleTimeoutMilliseconds;
+
+    // An adaptive policy starts out active, so it only gives up the minimum period after a full idle timeout
+    m_IsActive = true;
+    m_PeriodMode = policy.Mode;
+
+    if ( (GetPeriodInFrames() == 0) || (ChoosePeriodInFrames() == GetPeriodInFrames()) )
+    {
+        return S_OK;
+    }
+
+    return RequestPeriodRenegotiation();
+}
+
+//
+//  GetPeriodStatistics()
+//
+HRESULT WASAPIRenderDevice::GetPeriodStatistics( PERIODSTATS *pStats )
+{
+    if (nullptr == pStats)
+    {
+        return E_POINTER;
+    }
+
+    UINT32 PeriodFrames = GetPeriodInFrames();
+    if (0 == PeriodFrames)
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    UINT32 SampleRate = m_MixFormat->nSamplesPerSec;
+    UINT32 MinimumWakeupsPerSecond = (SampleRate + (m_MinPeriodInFrames / 2)) / m_MinPeriodInFrames;
+
+    pStats->PeriodFrames = PeriodFrames;
+    pStats->MinimumPeriodFrames = m_MinPeriodInFrames;
+    pStats->RenegotiationCount = m_RenegotiationCount;
+    pStats->WakeupsPerSecond = (SampleRate + (PeriodFrames / 2)) / PeriodFrames;
+    pStats->WakeupsPerSecondSaved = (MinimumWakeupsPerSecond > pStats->WakeupsPerSecond) ? MinimumWakeupsPerSecond - pStats->WakeupsPerSecond : 0;
+
+    // Running at the minimum period, the same frames would have taken this many callbacks
+    UINT64 WakeupCount = m_WakeupCount;
+    UINT64 MinimumWakeups = m_WakeupFrames / m_MinPeriodInFrames;
+    pStats->WakeupsSaved = (MinimumWakeups > WakeupCount) ? MinimumWakeups - WakeupCount : 0;
+
+    return S_OK;
+}
+
+//
+//  ChoosePeriodInFrames()
+//
+UINT32 WASAPIRenderDevice::ChoosePeriodInFrames()
+{
+    // The tone generator is sized for a single period and restarts with the stream, so it keeps the minimum
+    if ( m_DeviceProps.IsTonePlayback ||
+         (m_PeriodMode == PeriodMode_LowLatency) ||
+         ((m_PeriodMode == PeriodMode_Adaptive) && m_IsActive) )
+    {
+        return m_MinPeriodInFrames;
+    }
+
+    UINT32 PowerSavingMilliseconds = m_PowerSavingPeriodMilliseconds;
+    if (0 == PowerSavingMilliseconds)
+    {
+        return ClampPeriodInFrames( m_DefaultPeriodInFrames );
+    }
+
+    return ClampPeriodInFrames( static_cast<UINT32>( (UINT64)PowerSavingMilliseconds * m_MixFormat->nSamplesPerSec / 1000 ) );
+}
+
+//
+//  RequestPeriodRenegotiation()
+//
+HRESULT WASAPIRenderDevice::RequestPeriodRenegotiation()
+{
+    bool IsRenegotiating = false;
+    if (!m_IsRenegotiating.compare_exchange_strong( IsRenegotiating, true ))
+    {
+        // The queued work item will pick up the latest policy
+        return S_OK;
+    }
+
+    HRESULT hr = MFPutWorkItem2( MFASYNC_CALLBACK_QUEUE_MULTITHREADED, 0, &m_xRenegotiatePeriod, nullptr );
+    if (FAILED( hr ))
+    {
+        m_IsRenegotiating = false;
+    }
+
+    return hr;
+}
+
+//
+//  OnRenegotiatePeriod()
+//
+//  Reinitializes the stream with the period the policy chooses.  Shared mode streams cannot change period once
+//  initialized, so this reactivates the audio client, as when the device is lost; the mixer is left alone, so
+//  every voice carries on where it was once the new stream starts.
+//
+HRESULT WASAPIRenderDevice::OnRenegotiatePeriod( IMFAsyncResult* pResult )
+{
+    HRESULT hr = S_OK;
+    DeviceState State = GetDeviceState();
+    bool IsPlaying = (State == DeviceState::Playing);
+
+    // Only from a steady state; a device in the middle of anything else picks the period up when it next starts
+    if ( !IsPlaying &&
+         (State != DeviceState::Initialized) &&
+         (State != DeviceState::Stopped) )
+    {
+        goto exit;
+    }
+
+    if (ChoosePeriodInFrames() == GetPeriodInFrames())
+    {
+        goto exit;
+    }
+
+    // A calibration measures against the stream's clock, which starts over with the new stream
+    if (IsCalibrating())
+    {
+        goto exit;
+    }
+
+    // Out of service without telling clients, as for a lost device; this also stops the audio callbacks
+    SetDeviceStateAndNotifyCallbacks( DeviceState::Uninitialized, false );
+
+    if (IsPlaying)
+    {
+        StopSampleReadyDispatch();
+        m_AudioClient->Stop();
+    }
+
+    ReleaseAudioClient();
+
+    m_IsResumeAfterActivation = IsPlaying;
+    m_RenegotiationCount++;
+
+    // Voices already playing are sized for the new period when ConfigureSource reserves the mixer, before the
+    // stream restarts
+    hr = InitializeAudioDeviceAsync();
+    if (FAILED( hr ))
+    {
+        // Nothing will bring the stream back, so let clients see it failed
+        m_IsResumeAfterActivation = false;
+        if (GetDeviceState() != DeviceState::InError)
+        {
+            SetDeviceStateAndNotifyCallbacks( DeviceState::InError, true );
+        }
+    }
+
+exit:
+    m_IsRenegotiating = false;
+    return hr;
+}
+
+//
+//  UpdatePeriodPolicy()
+//
+void WASAPIRenderDevice::UpdatePeriodPolicy()
+{
+    UINT32 PeriodFrames = GetPeriodInFrames();
+
+    m_WakeupCount.store( m_WakeupCount.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    m_WakeupFrames.store( m_WakeupFrames.load( std::memory_order_relaxed ) + PeriodFrames, std::memory_order_relaxed );
+
+    if (m_PeriodMode == PeriodMode_Adaptive)
+    {
+        UINT64 LiveInputPeriods = m_Mixer.GetLiveInputPeriods();
+        if (m_IsActivityPending.exchange( false ) || (LiveInputPeriods != m_LastLiveInputPeriods))
+        {
+            m_LastLiveInputPeriods = LiveInputPeriods;
+            m_LastActivityFrame = m_FramesWritten;
+            m_IsActive = true;
+        }
+        else if ( m_IsActive &&
+                  ((m_FramesWritten - m_LastActivityFrame) >= (UINT64)m_IdleTimeoutMilliseconds * m_MixFormat->nSamplesPerSec / 1000) )
+        {
+            m_IsActive = false;
+        }
+    }
+
+    if (m_RenegotiationRetryFrames > PeriodFrames)
+    {
+        m_RenegotiationRetryFrames -= PeriodFrames;
+        return;
+    }
+    m_RenegotiationRetryFrames = 0;
+
+    if (ChoosePeriodInFrames() != PeriodFrames)
+    {
+        RequestPeriodRenegotiation();
+        m_RenegotiationRetryFrames = PERIOD_RENEGOTIATION_RETRY_MS * m_MixFormat->nSamplesPerSec / 1000;
+    }
+}
+
+//
+//  ReleaseAudioClient()
+//
+void WASAPIRenderDevice::ReleaseAudioClient()
+{
+    SAFE_RELEASE( m_AudioClient );
+    SAFE_RELEASE( m_AudioRenderClient );
+    SAFE_RELEASE( m_AudioClock );
+    SAFE_RELEASE( m_SampleReadyAsyncResult );
+}
+
+//
+//  IsCalibrating()
+//
+bool WASAPIRenderDevice::IsCalibrating()
+{
+    std::lock_guard<std::mutex> Guard( m_CalibrationMutex );
+    return (nullptr != m_Calibration) && !m_Calibration->IsFinished();
+}
+
+//
+//  ConnectCaptureDevice()
+//
+//  Starts a voice playing a capture device's live input, resampled to follow the drift between the two clocks
+//
+HRESULT WASAPIRenderDevice::ConnectCaptureDevice( WASAPICaptureDevice *captureDevice, UINT32 latencyMilliseconds, VoiceId *pVoiceId )
+{
+    if ( (nullptr == captureDevice) || (nullptr == pVoiceId) )
+    {
+        return E_POINTER;
+    }
+
+    if (!IsInitialized() || !captureDevice->IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    const WAVEFORMATEX *CaptureFormat = captureDevice->GetMixFormat();
+
+    // Never hold less than a capture packet plus two render periods, or ordinary scheduling jitter would run the link dry.
+    // Adaptive links start at a capture packet plus one render period, the least that can work at all, and grow
+    // only as far as the jitter they measure calls for.
+    bool IsAdaptive = (latencyMilliseconds == CAPTURE_LINK_ADAPTIVE_LATENCY);
+    UINT32 RenderPeriods = IsAdaptive ? 1 : 2;
+    UINT32 TargetFrames = static_cast<UINT32>( (UINT64)latencyMilliseconds * CaptureFormat->nSamplesPerSec / 1000 );
+    UINT32 MinimumFrames = captureDevice->GetDefaultPeriodInFrames() +
+        static_cast<UINT32>( (UINT64)RenderPeriods * GetBufferFramesPerPeriod() * CaptureFormat->nSamplesPerSec / m_MixFormat->nSamplesPerSec );
+    TargetFrames = max( TargetFrames, max( MinimumFrames, 1u ) );
+
+    // Audio reaches the ring one capture packet, plus the capture stream latency, after it reaches the input
+    UINT32 InputLatencyMicroseconds = static_cast<UINT32>( captureDevice->GetStreamLatency() / 10 +
+        (UINT64)captureDevice->GetDefaultPeriodInFrames() * 1000000 / CaptureFormat->nSamplesPerSec );
+
+    ComPtr<CaptureLinkVoice> Voice = Make<CaptureLinkVoice>(
+        VoiceMixer::GetNextVoiceId(),
+        CaptureFormat->nChannels,
+        CaptureFormat->nSamplesPerSec,
+        m_MixFormat->nChannels,
+        m_MixFormat->nSamplesPerSec,
+        TargetFrames,
+        m_BufferFrames,
+        &m_DeviceClock,
+        IsAdaptive,
+        InputLatencyMicroseconds );
+    if (nullptr == Voice)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = captureDevice->AddCaptureLink( Voice );
+    if (FAILED( hr ))
+    {
+        return hr;
+    }
+
+    m_Mixer.AddVoice( Voice );
+    *pVoiceId = Voice->GetVoiceId();
+
+    // Someone is about to perform; an adaptive period policy goes to the minimum period now, not on the first sound
+    m_IsActivityPending = true;
+    return S_OK;
+}
+
+//
+//  GetCaptureLinkStatistics()
+//
+HRESULT WASAPIRenderDevice::GetCaptureLinkStatistics( VoiceId voiceId, CAPTURELINKSTATS *pStats )
+{
+    if (nullptr == pStats)
+    {
+        return E_POINTER;
+    }
+
+    ComPtr<AudioVoice> Voice = m_Mixer.GetVoice( voiceId );
+    CaptureLinkVoice *Link = dynamic_cast<CaptureLinkVoice *>( Voice.Get() );
+    if (nullptr == Link)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    Link->GetStatistics( pStats );
+
+    // Add the output side: what is queued in the render buffer, plus the render stream latency.  There is no
+    // audio client while the stream is renegotiated or the device is lost, and then nothing is queued
+    UINT32 PaddingFrames = 0;
+    IAudioClient3 *AudioClient = m_AudioClient;
+    if ( IsInitialized() && (nullptr != AudioClient) && (nullptr != m_MixFormat) &&
+         SUCCEEDED( AudioClient->GetCurrentPadding( &PaddingFrames ) ) )
+    {
+        pStats->RoundTripMicroseconds += static_cast<UINT32>( (UINT64)PaddingFrames * 1000000 / m_MixFormat->nSamplesPerSec );
+    }
+    pStats->RoundTripMicroseconds += static_cast<UINT32>( GetOutputLatency() / 10 );
+    return S_OK;
+}
+
+//
+//  MapCaptureFrame()
+//
+//  Finds the render frame that was audible when a captured frame was played into the input
+//
+HRESULT WASAPIRenderDevice::MapCaptureFrame( WASAPICaptureDevice *captureDevice, UINT64 capturedFrame, INT64 *pRenderFrame )
+{
+    if ( (nullptr == captureDevice) || (nullptr == pRenderFrame) )
+    {
+        return E_POINTER;
+    }
+
+    if (!IsInitialized() || !captureDevice->IsInitialized())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    // When the capture device recorded the frame, by its own clock
+    double CaptureQpc = 0;
+    if (!captureDevice->GetCaptureTimeline().GetQpcOfFrame( capturedFrame, captureDevice->GetDeviceClock().GetRateRatio(), &CaptureQpc ))
+    {
+        return E_PENDING;
+    }
+
+    // The sound reached the input one capture stream latency before the device recorded it, and the render
+    // frame being heard then left this device one render stream latency before that; a calibration measures
+    // the whole round trip instead
+    bool IsCalibrated = false;
+    double HeardQpc = CaptureQpc - (double)GetRoundTripLatency( captureDevice, &IsCalibrated );
+
+    double RenderFrame = 0;
+    if (!m_DeviceClock.FrameAtQpc( HeardQpc, &RenderFrame ))
+    {
+        return E_PENDING;
+    }
+
+    *pRenderFrame = static_cast<INT64>( floor( RenderFrame + 0.5 ) );
+    return S_OK;
+}
+
+//
+//  GetTimelineOffsets()
+//
+HRESULT WASAPIRenderDevice::GetTimelineOffsets( WASAPICaptureDevice *captureDevice, TIMELINEOFFSETS *pOffsets )
+{
+    if ( (nullptr == captureDevice) || (nullptr == pOffsets) )
+    {
+        return E_POINTER;
+    }
+
+    HRESULT hr = MapCaptureFrame( captureDevice, 0, &pOffsets->CaptureStartRenderFrame );
+    if (FAILED( hr ))
+    {
+        return hr;
+    }
+
+    pOffsets->InputLatencyMicroseconds = static_cast<UINT32>( captureDevice->GetStreamLatency() / 10 );
+    pOffsets->OutputLatencyMicroseconds = static_cast<UINT32>( GetOutputLatency() / 10 );
+
+    bool IsCalibrated = false;
+    pOffsets->RoundTripMicroseconds = static_cast<UINT32>( GetRoundTripLatency( captureDevice, &IsCalibrated ) / 10 );
+    pOffsets->IsCalibrated = IsCalibrated;
+
+    double Drift = captureDevice->GetDeviceClock().GetRateRatio() / m_DeviceClock.GetRateRatio() - 1.0;
+    pOffsets->CaptureClockDriftPartsPerMillion = static_cast<INT32>( floor( Drift * 1000000.0 + 0.5 ) );
+    return S_OK;
+}
+
+//
+//  GetOutputLatency()
+//
+REFERENCE_TIME WASAPIRenderDevice::GetOutputLatency()
+{
+    REFERENCE_TIME Latency = GetStreamLatency();
+    if (nullptr != m_MixFormat)
+    {
+        Latency += (REFERENCE_TIME)m_Dynamics.GetLatencyFrames() * 10000000 / m_MixFormat->nSamplesPerSec;
+    }
+    return Latency;
+}
+
+//
+//  GetRoundTripLatency()
+//
+REFERENCE_TIME WASAPIRenderDevice::GetRoundTripLatency( WASAPICaptureDevice *captureDevice, bool *pIsCalibrated )
+{
+    REFERENCE_TIME RoundTrip = 0;
+    *pIsCalibrated = WASAPISession::GetLatencyCalibration( GetEndpointId()->Data(), captureDevice->GetEndpointId()->Data(), &RoundTrip );
+    if (!*pIsCalibrated)
+    {
+        RoundTrip = captureDevice->GetStreamLatency() + GetOutputLatency();
+    }
+
+    return RoundTrip;
+}
+
+//
+//  StartLatencyCalibration()
+//
+//  Starts a voice which plays a chirp and finds it in the capture device's input
+//
+HRESULT WASAPIRenderDevice::StartLatencyCalibration( WASAPICaptureDevice *captureDevice )
+{
+    if (nullptr == captureDevice)
+    {
+        return E_POINTER;
+    }
+
+    if ( (GetDeviceState() != DeviceState::Playing) || (captureDevice->GetDeviceState() != DeviceState::Capturing) )
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    std::lock_guard<std::mutex> Guard( m_CalibrationMutex );
+    if ( (nullptr != m_Calibration) && !m_Calibration->IsFinished() )
+    {
+        return E_PENDING;
+    }
+
+    const WAVEFORMATEX *CaptureFormat = captureDevice->GetMixFormat();
+    ComPtr<LatencyCalibrationVoice> Voice = Make<LatencyCalibrationVoice>(
+        VoiceMixer::GetNextVoiceId(),
+        m_MixFormat->nSamplesPerSec,
+        CaptureFormat->nChannels,
+        CaptureFormat->nSamplesPerSec,
+        &m_FramesWritten,
+        captureDevice->GetEndpointId()->Data() );
+    if (nullptr == Voice)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = captureDevice->AddCaptureLink( Voice );
+    if (FAILED( hr ))
+    {
+        return hr;
+    }
+
+    m_Mixer.AddVoice( Voice );
+    m_Calibration = Voice;
+    m_CalibrationStreamLatency = captureDevice->GetStreamLatency() + GetOutputLatency();
+    return S_OK;
+}
+
+//
+//  GetLatencyCalibration()
+//
+HRESULT WASAPIRenderDevice::GetLatencyCalibration( LATENCYCALIBRATION *pCalibration )
+{
+    if (nullptr == pCalibration)
+    {
+        return E_POINTER;
+    }
+
+    std::lock_guard<std::mutex> Guard( m_CalibrationMutex );
+    if (nullptr == m_Calibration)
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    if (!m_Calibration->IsCaptureComplete())
+    {
+        // The voice gives up, and is retired, if the capture device never delivers the recording
+        return m_Calibration->IsFinished() ? HRESULT_FROM_WIN32( ERROR_TIMEOUT ) : E_PENDING;
+    }
+
+    REFERENCE_TIME RoundTrip = 0;
+    float PeakRatio = 0.0f;
+    HRESULT hr = m_Calibration->Analyze( m_DeviceClock, &RoundTrip, &PeakRatio );
+    pCalibration->PeakRatio = PeakRatio;
+    pCalibration->StreamLatencyMicroseconds = static_cast<INT32>( m_CalibrationStreamLatency / 10 );
+    if (FAILED( hr ))
+    {
+        return hr;
+    }
+
+    // A chirp found "before" it was played was really something else in the input
+    if (RoundTrip <= 0)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_FOUND );
+    }
+
+    pCalibration->RoundTripMicroseconds = static_cast<INT32>( RoundTrip / 10 );
+    WASAPISession::SetLatencyCalibration( GetEndpointId()->Data(), m_Calibration->GetCaptureDeviceId().c_str(), RoundTrip );
+    return S_OK;
+}
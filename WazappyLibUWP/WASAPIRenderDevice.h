@@ -5,7 +5,12 @@
 
 #include "WASAPIDevice.h"
 #include "ToneSampleGenerator.h"
-#include "MFSampleGenerator.h"
+#include "VoiceMixer.h"
+#include "WASAPICaptureDevice.h"
+#include "CaptureLinkVoice.h"
+#include "LatencyCalibrationVoice.h"
+#include "LoadGovernor.h"
+#include "DynamicsStage.h"
 
 using namespace Microsoft::WRL;
 using namespace Windows::Media::Devices;
@@ -13,13 +18,17 @@ using namespace Windows::Storage::Streams;
 
 #pragma once
 
+// Least time between the audio thread's requests to renegotiate the period, while a request cannot be honored
+// (e.g. during a latency calibration).
+#define PERIOD_RENEGOTIATION_RETRY_MS 1000
+
 namespace Wazappy
 {
     // Primary WASAPI Renderering Class
     class WASAPIRenderDevice : public WASAPIDevice
 	{
     public:
-        WASAPIRenderDevice();
+        WASAPIRenderDevice( Platform::String^ deviceId = nullptr );
 
 		virtual Platform::String^ GetDeviceId();
 
@@ -27,14 +36,161 @@ namespace Wazappy
 		virtual HRESULT ActivateCompletedInternal();
 
 		HRESULT SetProperties(DEVICEPROPS props);
+
+		virtual HRESULT PrepareToStart();
+		virtual HRESULT OnClientStarted();
+		virtual HRESULT StopAsync() { return StopPlaybackAsync(); }
 		
 		HRESULT StartPlaybackAsync();
         HRESULT StopPlaybackAsync();
         HRESULT PausePlaybackAsync();
 
+		// Decode the given URL into the session sample cache, in this device's mix format.
+		HRESULT LoadCachedSample(LPCWSTR url);
+
+		// Start a one-shot voice playing an already-cached sample.
+		HRESULT PlayCachedSample(LPCWSTR url, VoiceId* voiceId);
+
+		// Start a voice streaming the given URL from disk with the given prefetch window.
+		HRESULT PlayStreamingSample(LPCWSTR url, UINT32 prefetchMilliseconds, VoiceId* voiceId);
+
+		HRESULT GetStreamingVoiceStatistics(VoiceId voiceId, STREAMINGVOICESTATS* stats);
+
+		HRESULT GetSampleVoiceStatistics(VoiceId voiceId, SAMPLEVOICESTATS* stats);
+
+		// Start a voice looping an already-cached sample, stretched to the device's tempo.
+		HRESULT PlayStretchedLoop(LPCWSTR url, float loopBeatsPerMinute, StretchQuality quality, VoiceId* voiceId);
+
+		HRESULT SetVoiceStretch(VoiceId voiceId, float loopBeatsPerMinute, float rate);
+
+		HRESULT GetStretchVoiceStatistics(VoiceId voiceId, STRETCHVOICESTATS* stats);
+
+		// Start a voice playing an already-cached sample at a fractional rate, backwards if it is negative.
+		HRESULT PlayVarispeedSample(LPCWSTR url, float rate, InterpolationQuality quality, BOOL isLooping, VoiceId* voiceId);
+
+		HRESULT SetVoiceVarispeed(VoiceId voiceId, float rate, InterpolationQuality quality);
+
+		HRESULT GetVarispeedVoiceStatistics(VoiceId voiceId, VARISPEEDVOICESTATS* stats);
+
+		// Start a voice playing the given files back to back, crossfading for crossfadeMilliseconds (0 for gapless).
+		HRESULT PlayPlaylist(const LPCWSTR* urls, UINT32 urlCount, UINT32 crossfadeMilliseconds, VoiceId* voiceId);
+
+		// Append a file to a playlist voice which is still playing.
+		HRESULT EnqueuePlaylistTrack(VoiceId voiceId, LPCWSTR url);
+
+		// Move a playing voice to the given frame of its source.
+		HRESULT SeekVoice(VoiceId voiceId, UINT64 frame);
+
+		HRESULT StopVoice(VoiceId voiceId);
+
+		// Ramp a playing voice's gain or pan; see GainStage.
+		HRESULT SetVoiceGain(VoiceId voiceId, float gain, UINT32 rampMilliseconds, GainRampShape shape);
+		HRESULT SetVoicePan(VoiceId voiceId, float pan, UINT32 rampMilliseconds);
+
+		// Move one stage of a playing voice's filters to a new response; see FilterBank.  frequency is in Hz.
+		HRESULT SetVoiceFilter(VoiceId voiceId, UINT32 stage, FilterType type, float frequency, float q, float gainDb, UINT32 rampMilliseconds);
+
+		// Rank a playing voice for the real voice budget; see VoiceMixer.
+		HRESULT SetVoicePriority(VoiceId voiceId, INT32 priority);
+
+		// Render at most maxRealVoices voices each period (0 for no limit), virtualizing the rest.
+		HRESULT SetRealVoiceBudget(UINT32 maxRealVoices);
+
+		// Ramp the gain or pan of this device's whole mix.
+		HRESULT SetBusGain(float gain, UINT32 rampMilliseconds, GainRampShape shape);
+		HRESULT SetBusPan(float pan, UINT32 rampMilliseconds);
+
+		// Move one stage of the filters on this device's whole mix to a new response.
+		HRESULT SetBusFilter(UINT32 stage, FilterType type, float frequency, float q, float gainDb, UINT32 rampMilliseconds);
+
+		// Run a playing voice, or this device's whole mix, through a delay line with the given settings; see
+		// DelayLine.  The line is allocated on first use.
+		HRESULT SetVoiceDelay(VoiceId voiceId, const DELAYPARAMS& params);
+		HRESULT SetBusDelay(const DELAYPARAMS& params);
+
+		// Set the tempo delays in beats follow; DELAY_LINE_DEFAULT_TEMPO until set.
+		HRESULT SetTempo(float beatsPerMinute);
+
+		// Decode the given impulse response in this device's mix format (through the sample cache) and convolve
+		// the whole mix with it, replacing any reverb already there; nullptr removes the reverb.  Blocks while
+		// decoding and partitioning.
+		HRESULT LoadBusReverb(LPCWSTR impulseUrl);
+
+		// Ramp the gain or pan of the reverb's output.
+		HRESULT SetBusReverbGain(float gain, UINT32 rampMilliseconds, GainRampShape shape);
+
+		HRESULT GetReverbStatistics(REVERBSTATS* stats);
+
+		// Load a dataset of head related impulse responses and render spatialized voices binaurally through it,
+		// with room for maxSources of them at once, replacing any dataset already loaded; nullptr removes it, and
+		// spatialized voices play straight into the mix again.  Needs at least two channels.  Blocks while
+		// transforming the responses.
+		HRESULT LoadHrtfDataset(const HRTFDATASET* dataset, UINT32 maxSources);
+
+		// Spatialize a playing voice at the given position relative to the listener (meters; x right, y up, -z
+		// ahead), or stop spatializing it.
+		HRESULT SetVoiceSpatialPosition(VoiceId voiceId, bool isSpatialized, const SPATIALPOSITION& position);
+
+		// Turn the listener's head; every spatialized voice's direction follows, crossfading to its new response.
+		HRESULT SetListenerOrientation(const LISTENERORIENTATION& orientation);
+
+		HRESULT GetSpatializerStatistics(SPATIALIZERSTATS* stats);
+
+		// Set up an ambisonic bus (see AMBISONICPARAMS), replacing any already loaded; nullptr removes it.  Blocks
+		// while building the decoder.
+		HRESULT LoadAmbisonicBus(const AMBISONICPARAMS* params);
+
+		// Choose which of the spatializer and the ambisonic bus a playing voice goes through when both are loaded.
+		HRESULT SetVoiceSpatialRendering(VoiceId voiceId, SpatialRendering rendering);
+
+		HRESULT GetAmbisonicStatistics(AMBISONICSTATS* stats);
+
+		HRESULT GetMixerStatistics(MIXERSTATS* stats);
+
+		// Set up the compressor and limiter on this device's output; see DynamicsStage.  On by default, limiting
+		// at DYNAMICS_DEFAULT_CEILING_DB.
+		HRESULT SetDynamics(const DYNAMICSPARAMS& params);
+
+		HRESULT GetDynamicsStatistics(DYNAMICSSTATS* stats);
+
+		// Turn shedding work under load on or off; on by default.
+		HRESULT SetOverloadProtection(bool isEnabled);
+
+		HRESULT GetLoadStatistics(LOADSTATS* stats);
+
+		// Choose how the stream period is picked.  If that means a new period, the stream is reinitialized with it
+		// on a work item: the audio client is stopped, reactivated and (if it was playing) restarted, keeping the
+		// mixer and its voices, so the output has a gap of a few periods.  A device which is not playing, stopped
+		// or initialized picks the new period up when it next starts.
+		HRESULT SetPeriodPolicy(PERIODPOLICY policy);
+
+		HRESULT GetPeriodStatistics(PERIODSTATS* stats);
+
+		// Start a voice playing the given capture device's input, latencyMilliseconds behind it, or as close
+		// behind it as jitter allows if latencyMilliseconds is CAPTURE_LINK_ADAPTIVE_LATENCY.
+		HRESULT ConnectCaptureDevice(WASAPICaptureDevice* captureDevice, UINT32 latencyMilliseconds, VoiceId* voiceId);
+
+		HRESULT GetCaptureLinkStatistics(VoiceId voiceId, CAPTURELINKSTATS* stats);
+
+		// Place a frame captured by the given device on this device's output timeline, compensating for both
+		// stream latencies and the drift between the clocks.
+		HRESULT MapCaptureFrame(WASAPICaptureDevice* captureDevice, UINT64 capturedFrame, INT64* renderFrame);
+
+		HRESULT GetTimelineOffsets(WASAPICaptureDevice* captureDevice, TIMELINEOFFSETS* offsets);
+
+		// Play a test chirp to the given capture device and measure the round trip.
+		HRESULT StartLatencyCalibration(WASAPICaptureDevice* captureDevice);
+
+		// E_PENDING until the calibration finishes; on success the result is stored in the session.
+		HRESULT GetLatencyCalibration(LATENCYCALIBRATION* calibration);
+
         METHODASYNCCALLBACK( WASAPIRenderDevice, StartPlayback, OnStartPlayback );
         METHODASYNCCALLBACK( WASAPIRenderDevice, StopPlayback, OnStopPlayback );
         METHODASYNCCALLBACK( WASAPIRenderDevice, PausePlayback, OnPausePlayback );
+        METHODASYNCCALLBACK( WASAPIRenderDevice, RenegotiatePeriod, OnRenegotiatePeriod );
+
+    protected:
+        virtual UINT32 ChoosePeriodInFrames();
 
     private:
         virtual ~WASAPIRenderDevice();
@@ -42,6 +198,20 @@ namespace Wazappy
         HRESULT OnStartPlayback( IMFAsyncResult* pResult );
         HRESULT OnStopPlayback( IMFAsyncResult* pResult );
         HRESULT OnPausePlayback( IMFAsyncResult* pResult );
+        HRESULT OnRenegotiatePeriod( IMFAsyncResult* pResult );
+
+        // Queue a work item to reinitialize the stream with the period the policy now chooses, unless one is
+        // already queued.  Any thread, including the audio thread.
+        HRESULT RequestPeriodRenegotiation();
+
+        // Note activity for an adaptive period policy, and ask for a new period if the policy now wants one.
+        // Audio thread only.
+        void UpdatePeriodPolicy();
+
+        // Drop the audio client and its services, as when the device is lost.
+        void ReleaseAudioClient();
+
+        bool IsCalibrating();
 
         HRESULT ValidateBufferValue();
 
@@ -50,18 +220,87 @@ namespace Wazappy
 
         HRESULT ConfigureSource();
         UINT32 GetBufferFramesPerPeriod();
+        UINT32 RampMillisecondsToFrames( UINT32 rampMilliseconds );
+        UINT32 GetMaxDelayFrames();
+        void ApplyDelayParams( DelayLine* delayLine, const DELAYPARAMS& params );
+
+        // Hand the tempo to the mixer in frames per beat, at the mix format's sample rate.
+        void UpdateMixerTempo();
 
         HRESULT GetToneSample( UINT32 FramesAvailable );
-        HRESULT GetMFSample( UINT32 FramesAvailable );
+        HRESULT GetMixerSample( UINT32 FramesAvailable );
+
+        void UpdateDeviceClock();
+
+        // Latency from the mix to the output (100ns units): the render stream latency, plus the output dynamics'
+        // lookahead.
+        REFERENCE_TIME GetOutputLatency();
+
+        // Round trip from this device to the given capture device (100ns units): measured, if the pair has
+        // been calibrated, otherwise the sum of the stream latencies.
+        REFERENCE_TIME GetRoundTripLatency( WASAPICaptureDevice* captureDevice, bool* isCalibrated );
 
     private:
         IAudioRenderClient *m_AudioRenderClient;
+        IAudioClock *m_AudioClock;
+        UINT64 m_AudioClockFrequency;
+
+        // Frames released to the stream since it was created, i.e. the stream position of the next frame
+        // written.  Audio thread only.
+        UINT64 m_FramesWritten;
         IMFAsyncResult *m_SampleReadyAsyncResult;
 
 		DEVICEPROPS m_DeviceProps;
 		
 		ToneSampleGenerator *m_ToneSource;
-        MFSampleGenerator *m_MFSource;
+
+		// Voices playing on this device, and the planar float buffer they are mixed into each period.
+		VoiceMixer m_Mixer;
+		PlanarBuffer m_MixBuffer;
+
+		// Tempo for delays in beats, in beats per minute.
+		std::atomic<float> m_BeatsPerMinute;
+
+		// Keeps the mix under the ceiling on its way to the device.
+		DynamicsStage m_Dynamics;
+
+		// Measures how long each mix takes against the period, and sets the mixer's shed level.
+		LoadGovernor m_LoadGovernor;
+
+		// The last latency calibration started, if any.
+		std::mutex m_CalibrationMutex;
+		ComPtr<LatencyCalibrationVoice> m_Calibration;
+		REFERENCE_TIME m_CalibrationStreamLatency;
+
+		// The period policy; see SetPeriodPolicy.  Read on the audio thread.
+		std::atomic<PeriodMode> m_PeriodMode;
+		std::atomic<UINT32> m_PowerSavingPeriodMilliseconds;
+		std::atomic<UINT32> m_IdleTimeoutMilliseconds;
+
+		// Whether an adaptive policy wants the minimum period; written by the audio thread once playing.
+		std::atomic<bool> m_IsActive;
+
+		// Set by clients to tell the audio thread someone is about to perform.
+		std::atomic<bool> m_IsActivityPending;
+
+		// Audio thread state for the adaptive policy: the live input count last seen, the stream position of the
+		// last activity, and frames until the audio thread may ask for a renegotiation again.
+		UINT64 m_LastLiveInputPeriods;
+		UINT64 m_LastActivityFrame;
+		UINT32 m_RenegotiationRetryFrames;
+
+		// A renegotiation work item is queued or running.
+		std::atomic<bool> m_IsRenegotiating;
+
+		// Restart playback once the reactivated stream is initialized.
+		bool m_IsResumeAfterActivation;
+
+		std::atomic<UINT32> m_RenegotiationCount;
+
+		// Audio callbacks since the device was created, and the frames of period they covered; written on the
+		// audio thread, read by GetPeriodStatistics.
+		std::atomic<UINT64> m_WakeupCount;
+		std::atomic<UINT64> m_WakeupFrames;
     };
 }
 
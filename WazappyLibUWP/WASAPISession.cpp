@@ -6,12 +6,18 @@
 #include "pch.h"
 #include "WASAPISession.h"
 
+using namespace concurrency;
+using namespace Windows::Devices::Enumeration;
 using namespace Windows::System::Threading;
 using namespace Wazappy;
 
 NodeId WASAPISession::s_nextNodeId{};
 std::mutex WASAPISession::s_mutex{};
 std::map<NodeId, ComPtr<WASAPIDevice>> WASAPISession::s_deviceMap{};
+std::vector<DEVICEINFO> WASAPISession::s_enumeratedDevices{};
+bool WASAPISession::s_isEnumerating{};
+HRESULT WASAPISession::s_enumerationResult{};
+std::map<std::pair<std::wstring, std::wstring>, REFERENCE_TIME> WASAPISession::s_latencyCalibrations{};
 
 void WASAPISession::RegisterDevice(const ComPtr<WASAPIDevice>& device)
 {
@@ -38,4 +44,198 @@ NodeId WASAPISession::GetNextNodeId()
 {
 	std::lock_guard<std::mutex> guard(s_mutex);
 	return ++s_nextNodeId;
-}
\ No newline at end of file
+}
+
+HRESULT WASAPISession::EnumerateDevicesAsync()
+{
+	{
+		std::lock_guard<std::mutex> guard(s_mutex);
+		if (s_isEnumerating)
+		{
+			return E_PENDING;
+		}
+		s_isEnumerating = true;
+		s_enumerationResult = S_OK;
+	}
+
+	std::shared_ptr<std::vector<DEVICEINFO>> found = std::make_shared<std::vector<DEVICEINFO>>();
+
+	create_task(DeviceInformation::FindAllAsync(MediaDevice::GetAudioRenderSelector()))
+		.then([found](DeviceInformationCollection^ renderDevices)
+	{
+		AddEnumeratedDevices(renderDevices, WazappyNodeType::NodeType_RenderDevice,
+			MediaDevice::GetDefaultAudioRenderId(AudioDeviceRole::Default), found.get());
+		return DeviceInformation::FindAllAsync(MediaDevice::GetAudioCaptureSelector());
+	})
+		.then([found](DeviceInformationCollection^ captureDevices)
+	{
+		AddEnumeratedDevices(captureDevices, WazappyNodeType::NodeType_CaptureDevice,
+			MediaDevice::GetDefaultAudioCaptureId(AudioDeviceRole::Default), found.get());
+	})
+		.then([found](task<void> previous)
+	{
+		HRESULT hr = S_OK;
+		try
+		{
+			previous.get();
+		}
+		catch (Platform::Exception^ e)
+		{
+			hr = e->HResult;
+		}
+
+		std::lock_guard<std::mutex> guard(s_mutex);
+		if (SUCCEEDED(hr))
+		{
+			s_enumeratedDevices.swap(*found);
+		}
+		s_enumerationResult = hr;
+		s_isEnumerating = false;
+	});
+
+	return S_OK;
+}
+
+void WASAPISession::AddEnumeratedDevices(
+	DeviceInformationCollection^ devices,
+	WazappyNodeType nodeType,
+	Platform::String^ defaultId,
+	std::vector<DEVICEINFO>* found)
+{
+	for (DeviceInformation^ device : devices)
+	{
+		DEVICEINFO info{};
+		info.NodeType = nodeType;
+		wcsncpy_s(info.Id, device->Id->Data(), _TRUNCATE);
+		wcsncpy_s(info.Name, device->Name->Data(), _TRUNCATE);
+		info.IsDefault = (defaultId != nullptr) && (device->Id == defaultId);
+		found->push_back(info);
+	}
+}
+
+HRESULT WASAPISession::GetEnumeratedDevices(DEVICEINFO* devices, UINT32 capacity, UINT32* deviceCount)
+{
+	if (deviceCount == nullptr || (devices == nullptr && capacity > 0))
+	{
+		return E_POINTER;
+	}
+
+	std::lock_guard<std::mutex> guard(s_mutex);
+	if (s_isEnumerating)
+	{
+		return E_PENDING;
+	}
+	if (FAILED(s_enumerationResult))
+	{
+		return s_enumerationResult;
+	}
+
+	UINT32 count = (UINT32)s_enumeratedDevices.size();
+	for (UINT32 i = 0; i < count && i < capacity; i++)
+	{
+		devices[i] = s_enumeratedDevices[i];
+	}
+	*deviceCount = count;
+	return S_OK;
+}
+
+HRESULT WASAPISession::StartDeviceGroup(const std::vector<WASAPIDevice*>& devices)
+{
+	HRESULT hr = S_OK;
+	std::vector<DeviceState> previousStates;
+	size_t prepared = 0;
+	size_t handedOver = 0;
+
+	for (WASAPIDevice* device : devices)
+	{
+		previousStates.push_back(device->GetDeviceState());
+	}
+
+	// Do all the slow work (configuration, pre-roll) first, so nothing separates the client starts below.
+	for (; prepared < devices.size(); prepared++)
+	{
+		hr = devices[prepared]->PrepareToStart();
+		if (FAILED(hr))
+		{
+			// It may have got as far as Starting before failing; if it was in the wrong state, leave it alone
+			if (devices[prepared]->GetDeviceState() == DeviceState::Starting)
+			{
+				prepared++;
+			}
+			goto exit;
+		}
+	}
+
+	for (WASAPIDevice* device : devices)
+	{
+		hr = device->StartClient();
+		if (FAILED(hr))
+		{
+			goto exit;
+		}
+	}
+
+	// The rest of each start runs on the device's own work item, serialized with its other work as a single
+	// start is; from here on a failure puts just that device in error.
+	for (; handedOver < devices.size(); handedOver++)
+	{
+		hr = devices[handedOver]->CompleteGroupStartAsync();
+		if (FAILED(hr))
+		{
+			goto exit;
+		}
+	}
+
+exit:
+	if (FAILED(hr))
+	{
+		// Leave none of the devices not yet handed over running unserviced
+		for (size_t i = handedOver; i < prepared; i++)
+		{
+			devices[i]->AbortGroupStart(previousStates[i]);
+		}
+	}
+
+	return hr;
+}
+
+HRESULT WASAPISession::StopDeviceGroup(const std::vector<WASAPIDevice*>& devices)
+{
+	HRESULT result = S_OK;
+	for (WASAPIDevice* device : devices)
+	{
+		HRESULT hr = device->StopAsync();
+		if (FAILED(hr) && SUCCEEDED(result))
+		{
+			result = hr;
+		}
+	}
+	return result;
+}
+
+void WASAPISession::SetLatencyCalibration(LPCWSTR renderDeviceId, LPCWSTR captureDeviceId, REFERENCE_TIME roundTrip)
+{
+	std::lock_guard<std::mutex> guard(s_mutex);
+	auto key = std::make_pair(std::wstring(renderDeviceId), std::wstring(captureDeviceId));
+	if (roundTrip == 0)
+	{
+		s_latencyCalibrations.erase(key);
+	}
+	else
+	{
+		s_latencyCalibrations[key] = roundTrip;
+	}
+}
+
+bool WASAPISession::GetLatencyCalibration(LPCWSTR renderDeviceId, LPCWSTR captureDeviceId, REFERENCE_TIME* roundTrip)
+{
+	std::lock_guard<std::mutex> guard(s_mutex);
+	const auto& found = s_latencyCalibrations.find(std::make_pair(std::wstring(renderDeviceId), std::wstring(captureDeviceId)));
+	if (found == s_latencyCalibrations.end())
+	{
+		return false;
+	}
+
+	*roundTrip = found->second;
+	return true;
+}
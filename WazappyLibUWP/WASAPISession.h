@@ -25,6 +25,20 @@ namespace Wazappy
 
 		static NodeId s_nextNodeId;
 
+		// Endpoints found by the last EnumerateDevicesAsync; guarded by s_mutex.
+		static std::vector<DEVICEINFO> s_enumeratedDevices;
+		static bool s_isEnumerating;
+		static HRESULT s_enumerationResult;
+
+		// Measured round trip latencies, keyed by render endpoint ID and capture endpoint ID; guarded by s_mutex.
+		static std::map<std::pair<std::wstring, std::wstring>, REFERENCE_TIME> s_latencyCalibrations;
+
+		static void AddEnumeratedDevices(
+			Windows::Devices::Enumeration::DeviceInformationCollection^ devices,
+			WazappyNodeType nodeType,
+			Platform::String^ defaultId,
+			std::vector<DEVICEINFO>* found);
+
 	public: 
 		// Get next unallocated node ID.
 		static NodeId GetNextNodeId();
@@ -37,6 +51,27 @@ namespace Wazappy
 
 		// Get the device with the given ID; it must exist.
 		static WASAPIDevice* GetDevice(NodeId nodeId);
+
+		// Begin listing render and capture endpoints on a background task.
+		static HRESULT EnumerateDevicesAsync();
+
+		// Copy out the last enumeration's results; E_PENDING while it is running.
+		static HRESULT GetEnumeratedDevices(DEVICEINFO* devices, UINT32 capacity, UINT32* deviceCount);
+
+		// Prepare all the devices, then start their audio clients back to back, then have each device begin
+		// servicing its client on its own work item.  If preparing or starting any device fails, every device
+		// already prepared is stopped and reset to its earlier state.  If handing a device over to its work item
+		// fails, only the devices not yet handed over are; stop the group to stop the rest.
+		static HRESULT StartDeviceGroup(const std::vector<WASAPIDevice*>& devices);
+
+		static HRESULT StopDeviceGroup(const std::vector<WASAPIDevice*>& devices);
+
+		// Remember the measured round trip latency (in 100ns units) from the given render endpoint to the given
+		// capture endpoint; a roundTrip of 0 forgets it.
+		static void SetLatencyCalibration(LPCWSTR renderDeviceId, LPCWSTR captureDeviceId, REFERENCE_TIME roundTrip);
+
+		// False if the pair has not been calibrated.
+		static bool GetLatencyCalibration(LPCWSTR renderDeviceId, LPCWSTR captureDeviceId, REFERENCE_TIME* roundTrip);
 	};
 }
 
@@ -8,6 +8,7 @@
 #include "WASAPICaptureDevice.h"
 #include "WASAPIRenderDevice.h"
 #include "WASAPISession.h"
+#include "SampleCache.h"
 
 using namespace Wazappy;
 
@@ -29,6 +30,34 @@ WazappyNodeHandle WASAPISessionInterop::WASAPISession_GetDefaultRenderDevice()
 	return WazappyNodeHandle(WazappyNodeType::NodeType_RenderDevice, device->GetNodeId());
 }
 
+WazappyNodeHandle WASAPISessionInterop::WASAPISession_OpenRenderDevice(LPCWSTR deviceId)
+{
+	Contract::Requires(deviceId != nullptr, L"Device ID must be given");
+	ComPtr<WASAPIRenderDevice> device = Make<WASAPIRenderDevice>(ref new Platform::String(deviceId));
+	Contract::Assert(device != nullptr);
+	WASAPISession::RegisterDevice(device);
+	return WazappyNodeHandle(WazappyNodeType::NodeType_RenderDevice, device->GetNodeId());
+}
+
+WazappyNodeHandle WASAPISessionInterop::WASAPISession_OpenCaptureDevice(LPCWSTR deviceId)
+{
+	Contract::Requires(deviceId != nullptr, L"Device ID must be given");
+	ComPtr<WASAPICaptureDevice> device = Make<WASAPICaptureDevice>(ref new Platform::String(deviceId));
+	Contract::Assert(device != nullptr);
+	WASAPISession::RegisterDevice(device);
+	return WazappyNodeHandle(WazappyNodeType::NodeType_CaptureDevice, device->GetNodeId());
+}
+
+HRESULT WASAPISessionInterop::WASAPISession_EnumerateDevicesAsync()
+{
+	return WASAPISession::EnumerateDevicesAsync();
+}
+
+HRESULT WASAPISessionInterop::WASAPISession_GetEnumeratedDevices(DEVICEINFO* devices, UINT32 capacity, UINT32* deviceCount)
+{
+	return WASAPISession::GetEnumeratedDevices(devices, capacity, deviceCount);
+}
+
 template <typename TNode>
 TNode* ResolveDevice(WazappyNodeHandle handle, WazappyNodeType expectedType)
 {
@@ -43,6 +72,60 @@ TNode* ResolveDevice(WazappyNodeHandle handle)
 	return dynamic_cast<TNode*>(device.Get());
 }
 
+static std::vector<WASAPIDevice*> ResolveDeviceGroup(const WazappyNodeHandle* handles, UINT32 handleCount)
+{
+	std::vector<WASAPIDevice*> devices;
+	for (UINT32 i = 0; i < handleCount; i++)
+	{
+		devices.push_back(ResolveDevice<WASAPIDevice>(handles[i]));
+	}
+	return devices;
+}
+
+HRESULT WASAPISessionInterop::WASAPISession_StartDeviceGroup(const WazappyNodeHandle* handles, UINT32 handleCount)
+{
+	if (handles == nullptr && handleCount > 0)
+	{
+		return E_POINTER;
+	}
+
+	return WASAPISession::StartDeviceGroup(ResolveDeviceGroup(handles, handleCount));
+}
+
+HRESULT WASAPISessionInterop::WASAPISession_StopDeviceGroup(const WazappyNodeHandle* handles, UINT32 handleCount)
+{
+	if (handles == nullptr && handleCount > 0)
+	{
+		return E_POINTER;
+	}
+
+	return WASAPISession::StopDeviceGroup(ResolveDeviceGroup(handles, handleCount));
+}
+
+HRESULT WASAPISessionInterop::WASAPISession_SetLatencyCalibration(LPCWSTR renderDeviceId, LPCWSTR captureDeviceId, INT32 roundTripMicroseconds)
+{
+	if (renderDeviceId == nullptr || captureDeviceId == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	WASAPISession::SetLatencyCalibration(renderDeviceId, captureDeviceId, (REFERENCE_TIME)roundTripMicroseconds * 10);
+	return S_OK;
+}
+
+HRESULT WASAPISessionInterop::WASAPISession_GetLatencyCalibration(LPCWSTR renderDeviceId, LPCWSTR captureDeviceId, INT32* roundTripMicroseconds)
+{
+	if (renderDeviceId == nullptr || captureDeviceId == nullptr || roundTripMicroseconds == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	REFERENCE_TIME roundTrip = 0;
+	bool isCalibrated = WASAPISession::GetLatencyCalibration(renderDeviceId, captureDeviceId, &roundTrip);
+	*roundTripMicroseconds = (INT32)(roundTrip / 10);
+	return isCalibrated ? S_OK : S_FALSE;
+}
+
 HRESULT WASAPIDeviceInterop::WASAPIDevice_SetVolumeOnSession(WazappyNodeHandle handle, UINT32 volume)
 {
 	WASAPIDevice* device = ResolveDevice<WASAPIDevice>(handle);
@@ -61,6 +144,24 @@ BOOL WASAPIDeviceInterop::WASAPIDevice_IsInitialized(WazappyNodeHandle handle)
 	return device->IsInitialized();
 }
 
+HRESULT WASAPIDeviceInterop::WASAPIDevice_SetEngineThreadProperties(WazappyNodeHandle handle, ENGINETHREADPROPS props)
+{
+	WASAPIDevice* device = ResolveDevice<WASAPIDevice>(handle);
+	return device->SetEngineThreadProperties(props);
+}
+
+HRESULT WASAPIDeviceInterop::WASAPIDevice_GetDispatchStatistics(WazappyNodeHandle handle, DISPATCHSTATS* stats)
+{
+	if (stats == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	WASAPIDevice* device = ResolveDevice<WASAPIDevice>(handle);
+	device->GetDispatchStatistics(stats);
+	return S_OK;
+}
+
 DeviceState WASAPIDeviceInterop::WASAPIDevice_GetDeviceState(WazappyNodeHandle handle)
 {
 	WASAPIDevice* device = ResolveDevice<WASAPIDevice>(handle);
@@ -109,6 +210,311 @@ HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_PausePlaybackAsync(Wazappy
 	return device->PausePlaybackAsync();
 }
 
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_LoadCachedSample(WazappyNodeHandle handle, LPCWSTR url)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->LoadCachedSample(url);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_PlayCachedSample(WazappyNodeHandle handle, LPCWSTR url, VoiceId* voiceId)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->PlayCachedSample(url, voiceId);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_PlayStreamingSample(WazappyNodeHandle handle, LPCWSTR url, UINT32 prefetchMilliseconds, VoiceId* voiceId)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->PlayStreamingSample(url, prefetchMilliseconds, voiceId);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_GetStreamingVoiceStatistics(WazappyNodeHandle handle, VoiceId voiceId, STREAMINGVOICESTATS* stats)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->GetStreamingVoiceStatistics(voiceId, stats);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_GetSampleVoiceStatistics(WazappyNodeHandle handle, VoiceId voiceId, SAMPLEVOICESTATS* stats)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->GetSampleVoiceStatistics(voiceId, stats);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_PlayStretchedLoop(WazappyNodeHandle handle, LPCWSTR url, float loopBeatsPerMinute, StretchQuality quality, VoiceId* voiceId)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->PlayStretchedLoop(url, loopBeatsPerMinute, quality, voiceId);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetVoiceStretch(WazappyNodeHandle handle, VoiceId voiceId, float loopBeatsPerMinute, float rate)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetVoiceStretch(voiceId, loopBeatsPerMinute, rate);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_GetStretchVoiceStatistics(WazappyNodeHandle handle, VoiceId voiceId, STRETCHVOICESTATS* stats)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->GetStretchVoiceStatistics(voiceId, stats);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_PlayVarispeedSample(WazappyNodeHandle handle, LPCWSTR url, float rate, InterpolationQuality quality, BOOL isLooping, VoiceId* voiceId)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->PlayVarispeedSample(url, rate, quality, isLooping, voiceId);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetVoiceVarispeed(WazappyNodeHandle handle, VoiceId voiceId, float rate, InterpolationQuality quality)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetVoiceVarispeed(voiceId, rate, quality);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_GetVarispeedVoiceStatistics(WazappyNodeHandle handle, VoiceId voiceId, VARISPEEDVOICESTATS* stats)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->GetVarispeedVoiceStatistics(voiceId, stats);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_PlayPlaylist(WazappyNodeHandle handle, const LPCWSTR* urls, UINT32 urlCount, UINT32 crossfadeMilliseconds, VoiceId* voiceId)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->PlayPlaylist(urls, urlCount, crossfadeMilliseconds, voiceId);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_EnqueuePlaylistTrack(WazappyNodeHandle handle, VoiceId voiceId, LPCWSTR url)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->EnqueuePlaylistTrack(voiceId, url);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SeekVoice(WazappyNodeHandle handle, VoiceId voiceId, UINT64 frame)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SeekVoice(voiceId, frame);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_StopVoice(WazappyNodeHandle handle, VoiceId voiceId)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->StopVoice(voiceId);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetVoiceGain(WazappyNodeHandle handle, VoiceId voiceId, float gain, UINT32 rampMilliseconds, GainRampShape shape)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetVoiceGain(voiceId, gain, rampMilliseconds, shape);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetVoicePan(WazappyNodeHandle handle, VoiceId voiceId, float pan, UINT32 rampMilliseconds)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetVoicePan(voiceId, pan, rampMilliseconds);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetVoiceFilter(WazappyNodeHandle handle, VoiceId voiceId, UINT32 stage, FilterType type, float frequency, float q, float gainDb, UINT32 rampMilliseconds)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetVoiceFilter(voiceId, stage, type, frequency, q, gainDb, rampMilliseconds);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetVoicePriority(WazappyNodeHandle handle, VoiceId voiceId, INT32 priority)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetVoicePriority(voiceId, priority);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetRealVoiceBudget(WazappyNodeHandle handle, UINT32 maxRealVoices)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetRealVoiceBudget(maxRealVoices);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetBusGain(WazappyNodeHandle handle, float gain, UINT32 rampMilliseconds, GainRampShape shape)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetBusGain(gain, rampMilliseconds, shape);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetBusPan(WazappyNodeHandle handle, float pan, UINT32 rampMilliseconds)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetBusPan(pan, rampMilliseconds);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetBusFilter(WazappyNodeHandle handle, UINT32 stage, FilterType type, float frequency, float q, float gainDb, UINT32 rampMilliseconds)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetBusFilter(stage, type, frequency, q, gainDb, rampMilliseconds);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetVoiceDelay(WazappyNodeHandle handle, VoiceId voiceId, DELAYPARAMS params)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetVoiceDelay(voiceId, params);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetBusDelay(WazappyNodeHandle handle, DELAYPARAMS params)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetBusDelay(params);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetTempo(WazappyNodeHandle handle, float beatsPerMinute)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetTempo(beatsPerMinute);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_LoadBusReverb(WazappyNodeHandle handle, LPCWSTR impulseUrl)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->LoadBusReverb(impulseUrl);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetBusReverbGain(WazappyNodeHandle handle, float gain, UINT32 rampMilliseconds, GainRampShape shape)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetBusReverbGain(gain, rampMilliseconds, shape);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_GetReverbStatistics(WazappyNodeHandle handle, REVERBSTATS* stats)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->GetReverbStatistics(stats);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_LoadHrtfDataset(WazappyNodeHandle handle, const HRTFDATASET* dataset, UINT32 maxSources)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->LoadHrtfDataset(dataset, maxSources);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetVoiceSpatialPosition(WazappyNodeHandle handle, VoiceId voiceId, BOOL isSpatialized, SPATIALPOSITION position)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetVoiceSpatialPosition(voiceId, isSpatialized != FALSE, position);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetListenerOrientation(WazappyNodeHandle handle, LISTENERORIENTATION orientation)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetListenerOrientation(orientation);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_GetSpatializerStatistics(WazappyNodeHandle handle, SPATIALIZERSTATS* stats)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->GetSpatializerStatistics(stats);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_LoadAmbisonicBus(WazappyNodeHandle handle, const AMBISONICPARAMS* params)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->LoadAmbisonicBus(params);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetVoiceSpatialRendering(WazappyNodeHandle handle, VoiceId voiceId, SpatialRendering rendering)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetVoiceSpatialRendering(voiceId, rendering);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_GetAmbisonicStatistics(WazappyNodeHandle handle, AMBISONICSTATS* stats)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->GetAmbisonicStatistics(stats);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_GetMixerStatistics(WazappyNodeHandle handle, MIXERSTATS* stats)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->GetMixerStatistics(stats);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetDynamics(WazappyNodeHandle handle, DYNAMICSPARAMS params)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetDynamics(params);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_GetDynamicsStatistics(WazappyNodeHandle handle, DYNAMICSSTATS* stats)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->GetDynamicsStatistics(stats);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetOverloadProtection(WazappyNodeHandle handle, BOOL isEnabled)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetOverloadProtection(isEnabled != FALSE);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_GetLoadStatistics(WazappyNodeHandle handle, LOADSTATS* stats)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->GetLoadStatistics(stats);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_SetPeriodPolicy(WazappyNodeHandle handle, PERIODPOLICY policy)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->SetPeriodPolicy(policy);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_GetPeriodStatistics(WazappyNodeHandle handle, PERIODSTATS* stats)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->GetPeriodStatistics(stats);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_ConnectCaptureDevice(WazappyNodeHandle handle, WazappyNodeHandle captureHandle, UINT32 latencyMilliseconds, VoiceId* voiceId)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	WASAPICaptureDevice* captureDevice = ResolveDevice<WASAPICaptureDevice>(captureHandle, WazappyNodeType::NodeType_CaptureDevice);
+	return device->ConnectCaptureDevice(captureDevice, latencyMilliseconds, voiceId);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_StartInputMonitoring(WazappyNodeHandle handle, WazappyNodeHandle captureHandle, VoiceId* voiceId)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	WASAPICaptureDevice* captureDevice = ResolveDevice<WASAPICaptureDevice>(captureHandle, WazappyNodeType::NodeType_CaptureDevice);
+	return device->ConnectCaptureDevice(captureDevice, CAPTURE_LINK_ADAPTIVE_LATENCY, voiceId);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_GetCaptureLinkStatistics(WazappyNodeHandle handle, VoiceId voiceId, CAPTURELINKSTATS* stats)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->GetCaptureLinkStatistics(voiceId, stats);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_MapCaptureFrame(WazappyNodeHandle handle, WazappyNodeHandle captureHandle, UINT64 capturedFrame, INT64* renderFrame)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	WASAPICaptureDevice* captureDevice = ResolveDevice<WASAPICaptureDevice>(captureHandle, WazappyNodeType::NodeType_CaptureDevice);
+	return device->MapCaptureFrame(captureDevice, capturedFrame, renderFrame);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_GetTimelineOffsets(WazappyNodeHandle handle, WazappyNodeHandle captureHandle, TIMELINEOFFSETS* offsets)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	WASAPICaptureDevice* captureDevice = ResolveDevice<WASAPICaptureDevice>(captureHandle, WazappyNodeType::NodeType_CaptureDevice);
+	return device->GetTimelineOffsets(captureDevice, offsets);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_StartLatencyCalibration(WazappyNodeHandle handle, WazappyNodeHandle captureHandle)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	WASAPICaptureDevice* captureDevice = ResolveDevice<WASAPICaptureDevice>(captureHandle, WazappyNodeType::NodeType_CaptureDevice);
+	return device->StartLatencyCalibration(captureDevice);
+}
+
+HRESULT WASAPIRenderDeviceInterop::WASAPIRenderDevice_GetLatencyCalibration(WazappyNodeHandle handle, LATENCYCALIBRATION* calibration)
+{
+	WASAPIRenderDevice* device = ResolveDevice<WASAPIRenderDevice>(handle, WazappyNodeType::NodeType_RenderDevice);
+	return device->GetLatencyCalibration(calibration);
+}
+
 HRESULT WASAPICaptureDeviceInterop::WASAPICaptureDevice_SetProperties(WazappyNodeHandle handle, CAPTUREDEVICEPROPS props)
 {
 	WASAPICaptureDevice* device = ResolveDevice<WASAPICaptureDevice>(handle, WazappyNodeType::NodeType_CaptureDevice);
@@ -132,3 +538,37 @@ HRESULT WASAPICaptureDeviceInterop::WASAPICaptureDevice_FinishCaptureAsync(Wazap
 	WASAPICaptureDevice* device = ResolveDevice<WASAPICaptureDevice>(handle, WazappyNodeType::NodeType_CaptureDevice);
 	return device->FinishCaptureAsync();
 }
+
+HRESULT SampleCacheInterop::SampleCache_SetMemoryBudget(UINT64 bytes)
+{
+	SampleCache::SetMemoryBudget(bytes);
+	return S_OK;
+}
+
+HRESULT SampleCacheInterop::SampleCache_SetStorageFormat(SampleStorageFormat storageFormat)
+{
+	if (storageFormat != SampleStorage_Float && storageFormat != SampleStorage_Pcm16 && storageFormat != SampleStorage_Adpcm8)
+	{
+		return E_INVALIDARG;
+	}
+
+	SampleCache::SetStorageFormat(storageFormat);
+	return S_OK;
+}
+
+HRESULT SampleCacheInterop::SampleCache_Clear()
+{
+	SampleCache::Clear();
+	return S_OK;
+}
+
+HRESULT SampleCacheInterop::SampleCache_GetStatistics(SAMPLECACHESTATS* stats)
+{
+	if (stats == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	SampleCache::GetStatistics(stats);
+	return S_OK;
+}
@@ -39,12 +39,173 @@ namespace Wazappy
 			BOOL IsLowLatency;
 		};
 
+		// How a device's audio callback is dispatched each period.
+		struct ENGINETHREADPROPS
+		{
+			// Run the device on a dedicated thread which waits on the sample-ready event in a loop, instead of
+			// re-queuing a Media Foundation waiting work item every period.
+			BOOL IsDedicatedThread;
+			// Processors the dedicated thread may run on; zero leaves the affinity to the scheduler.
+			// Only honored in desktop builds, since UWP apps cannot set thread affinity.
+			UINT64 AffinityMask;
+			// Win32 priority of the dedicated thread.  A device's default is THREAD_PRIORITY_TIME_CRITICAL, the
+			// highest a thread can ask for without MMCSS; note that a zeroed struct asks for THREAD_PRIORITY_NORMAL.
+			INT32 Priority;
+		};
+
+		// Timing of a device's audio callbacks since it last started.
+		struct DISPATCHSTATS
+		{
+			BOOL IsDedicatedThread;
+			UINT64 CallbackCount;
+			UINT32 NominalPeriodMicroseconds;
+			// Jitter is how far each callback's entry lands from one nominal period after the previous entry.
+			UINT32 MeanJitterMicroseconds;
+			UINT32 MaxJitterMicroseconds;
+			// Callbacks entered more than half a period late.
+			UINT32 LateCallbackCount;
+		};
+
 		enum ContentType
 		{
 			ContentType_Tone,
 			ContentType_File
 		};
 
+		// How decoded samples are held in memory by the sample cache.
+		enum SampleStorageFormat
+		{
+			// 32-bit float; no decoding at play time.
+			SampleStorage_Float,
+
+			// 16-bit PCM; half the memory, and lossless for 16-bit sources.
+			SampleStorage_Pcm16,
+
+			// 8-bit delta ADPCM in fixed-size packets; about a quarter of the memory, near-lossless.
+			SampleStorage_Adpcm8
+		};
+
+		// How a gain change moves from the old gain to the new one.
+		enum GainRampShape
+		{
+			// Straight line in linear gain; the usual choice for short de-zippering ramps.
+			GainRamp_Linear,
+
+			// Constant rate in decibels; sounds even over long fades.
+			GainRamp_Exponential
+		};
+
+		// Response of one stage of a filter bank; each is a second order (biquad) filter.
+		enum FilterType
+		{
+			// The stage passes audio through unchanged.
+			Filter_None,
+
+			// 12dB/octave above (LowPass) or below (HighPass) the frequency; q sets the resonance at it.
+			Filter_LowPass,
+			Filter_HighPass,
+
+			// Passes a band q wide around the frequency, at unity gain at its centre.
+			Filter_BandPass,
+
+			// Boost or cut by the gain below (LowShelf) or above (HighShelf) the frequency; q sets the slope,
+			// with 0.707 the steepest which does not overshoot.
+			Filter_LowShelf,
+			Filter_HighShelf,
+
+			// Boost or cut by the gain in a band q wide around the frequency.
+			Filter_Peak
+		};
+
+		// How a delay line reads between samples, for delays which are not a whole number of frames.
+		enum DelayInterpolation
+		{
+			// Two samples; cheapest, with a little high frequency loss which varies as the delay moves.
+			Delay_Linear,
+
+			// Four samples (Catmull-Rom); flatter, for chorus and pitch wobble.
+			Delay_Cubic,
+
+			// First order allpass; flat response, but smears fast modulation, so best for steady delays.
+			Delay_Allpass
+		};
+
+		// How a stretched voice changes tempo; see WASAPIRenderDevice_PlayStretchedLoop.
+		enum StretchQuality
+		{
+			// Overlap-add of segments chosen to match each other (WSOLA); cheap, and crisp on percussion.
+			Stretch_Wsola,
+
+			// Phase vocoder with phase locking; costlier, and cleaner on sustained tones.
+			Stretch_PhaseVocoder
+		};
+
+		// How a varispeed voice reads its sample between frames; see WASAPIRenderDevice_PlayVarispeedSample.
+		enum InterpolationQuality
+		{
+			// Straight lines between frames; cheapest, and dulls and aliases the top octave.
+			Interpolation_Linear,
+
+			// 4-point cubic Hermite curves; much cleaner for little more.
+			Interpolation_Hermite,
+
+			// 16-tap windowed sinc; flat and alias free to 90% of the Nyquist frequency at rates up to 1.  Above
+			// that the kernel widens, up to 64 taps at a rate of 4, and its cutoff falls to match, so nothing aliases.
+			Interpolation_Sinc
+		};
+
+		// What a render device decodes its ambisonic bus to; see WASAPIRenderDevice_LoadAmbisonicBus.
+		enum AmbisonicDecoder
+		{
+			// One feed per output channel, for speakers around the listener.
+			AmbisonicDecoder_Speakers,
+
+			// Two ears, through head related impulse responses, into the first two channels.
+			AmbisonicDecoder_Binaural
+		};
+
+		// Which spatializer a spatialized voice goes through when a render device has both; see
+		// WASAPIRenderDevice_SetVoiceSpatialRendering.
+		enum SpatialRendering
+		{
+			// Its own head related impulse response; the most precise, at a cost per voice.
+			SpatialRendering_Hrtf,
+
+			// Encoded into the ambisonic bus; nearly free per voice, and as precise as the bus's order allows.
+			SpatialRendering_Ambisonic
+		};
+
+		// How much work a render device is shedding to keep up with its deadline.  Each level includes the ones
+		// before it.
+		enum ShedLevel
+		{
+			ShedLevel_None,
+
+			// Voices drop optional processing, such as resampling with cheaper interpolation, and the bus reverb
+			// drops its tail, keeping only the first 40ms or so of its impulse.
+			ShedLevel_Quality,
+
+			// Half the voices which would otherwise be real are virtualized, lowest priority and quietest first.
+			ShedLevel_HalfVoices,
+
+			// Only a quarter of them stay real.
+			ShedLevel_QuarterVoices
+		};
+
+		// How a render device chooses its stream period.
+		enum PeriodMode
+		{
+			// Always the smallest period the engine allows, for the lowest latency.  The default.
+			PeriodMode_LowLatency,
+
+			// Always the power saving period, for the fewest wakeups.
+			PeriodMode_PowerSaving,
+
+			// The smallest period while someone is performing (live input is audible, or a capture device has just
+			// been connected), the power saving period once it has been quiet for the idle timeout.
+			PeriodMode_Adaptive
+		};
+
 		// Types of Wazappy nodes, corresponding to concrete subclasses.
 		enum WazappyNodeType
 		{
@@ -58,9 +219,360 @@ namespace Wazappy
 			NodeType_RenderDevice
 		};
 
+#define DEVICEINFO_MAX_ID 256
+#define DEVICEINFO_MAX_NAME 128
+
+		// One audio endpoint found by WASAPISession_EnumerateDevicesAsync.
+		struct DEVICEINFO
+		{
+			// NodeType_RenderDevice or NodeType_CaptureDevice.
+			WazappyNodeType NodeType;
+			// Endpoint ID to pass to WASAPISession_OpenRenderDevice / WASAPISession_OpenCaptureDevice.
+			WCHAR Id[DEVICEINFO_MAX_ID];
+			WCHAR Name[DEVICEINFO_MAX_NAME];
+			BOOL IsDefault;
+		};
+
 		// The ID of a WASAPI node object; avoids issues with marshaling object references.
 		typedef int NodeId;
 
+		// The ID of a voice playing on a render device; avoids issues with marshaling object references.
+		typedef int VoiceId;
+
+		// Counters describing the session-wide decoded sample cache.
+		struct SAMPLECACHESTATS
+		{
+			UINT64 Hits;
+			UINT64 Misses;
+			UINT64 Evictions;
+			UINT64 BytesCached;
+			// Bytes the cached assets' storage formats save, compared with holding them all as float.
+			UINT64 BytesSaved;
+			UINT64 MemoryBudget;
+			UINT32 AssetCount;
+		};
+
+		// Counters describing one voice playing a cached sample.
+		struct SAMPLEVOICESTATS
+		{
+			SampleStorageFormat StorageFormat;
+			UINT64 AssetBytes;
+			// Bytes the asset's storage format saves, compared with holding it as float.
+			UINT64 BytesSaved;
+			UINT64 FramesRendered;
+			// Total audio thread time spent decoding and mixing this voice.
+			UINT64 RenderNanoseconds;
+		};
+
+		// State and cost of one time-stretched loop voice.
+		struct STRETCHVOICESTATS
+		{
+			StretchQuality Quality;
+			// Source frames per output frame last period.
+			float Rate;
+			UINT64 FramesRendered;
+			// Total audio thread time spent stretching and mixing this voice.
+			UINT64 RenderNanoseconds;
+		};
+
+		// State and cost of one varispeed voice.
+		struct VARISPEEDVOICESTATS
+		{
+			// The interpolation last used, which is Interpolation_Hermite in place of Interpolation_Sinc while the
+			// device sheds quality.
+			InterpolationQuality Quality;
+			// Source frames per output frame; negative when playing backwards.
+			float Rate;
+			UINT64 FramesRendered;
+			// Total audio thread time spent interpolating and mixing this voice.
+			UINT64 RenderNanoseconds;
+		};
+
+		// Counters describing one streaming (disk-backed) voice.
+		struct STREAMINGVOICESTATS
+		{
+			UINT32 PrefetchFrames;
+			UINT32 BufferedFrames;
+			// Periods in which the prefetcher fell behind and the voice rendered partial silence.
+			UINT32 StarvationCount;
+			UINT64 StarvedFrames;
+			BOOL IsEndOfStream;
+		};
+
+		// Counters describing one capture link (a capture device's input playing on a render device).
+		struct CAPTURELINKSTATS
+		{
+			// Fill level the link holds its buffer at, in capture frames; this is the link's added latency.
+			UINT32 TargetFrames;
+			UINT32 BufferedFrames;
+			// Measured rate of the capture clock relative to the render clock, less one, in parts per million.
+			INT32 ClockDriftPartsPerMillion;
+			// Ratio trim the fill controller is currently applying on top of the measured drift.
+			INT32 CorrectionPartsPerMillion;
+			// Times the buffer filled up (capture frames dropped) or ran dry (render went silent to refill).
+			UINT32 OverrunCount;
+			UINT32 UnderrunCount;
+			// True for input monitoring links, whose target follows the measured scheduling jitter.
+			BOOL IsAdaptive;
+			// Smallest gap, over the last adaptation window, between what was buffered and what a period needed.
+			UINT32 HeadroomFrames;
+			// Estimated time from sound reaching the input to it leaving the output: capture stream latency and
+			// period, time in the link, and the render device's queued frames and stream latency.
+			UINT32 RoundTripMicroseconds;
+		};
+
+		// Counters describing how much of a render device's mixing work was skipped as silent.
+		struct MIXERSTATS
+		{
+			// Periods mixed, and those in which nothing audible played (the device was handed a silent buffer).
+			UINT64 MixPeriods;
+			UINT64 SilentMixPeriods;
+			// Voice periods: one per voice per mix period.
+			UINT64 VoicePeriods;
+			// Voice periods in which the voice reported it had nothing to play, so its output was not processed.
+			UINT64 SilentVoicePeriods;
+			// Voice periods skipped without rendering because the voice was inaudible (zero gain or a muted bus).
+			UINT64 SkippedVoicePeriods;
+			// Mix periods in which live input from a capture device was audible.
+			UINT64 LiveInputPeriods;
+			// Voice periods in which the voice was virtual (skipped ahead because it missed the real voice budget).
+			UINT64 VirtualVoicePeriods;
+			// Times a real voice lost its place in the budget to a higher ranked one and was faded out.
+			UINT64 StolenVoices;
+		};
+
+		// Settings for a delay line (echo, chorus or flanger) on a voice or a render device's whole mix.  The
+		// delayed signal is fed back into the line and added to the dry signal.
+		struct DELAYPARAMS
+		{
+			// Delay, used when Beats is 0.
+			float DelayMilliseconds;
+			// If above 0, the delay is this many beats at the device's tempo, and follows it.
+			float Beats;
+			// Part of the delayed signal fed back into the line, held within +-0.98; negative values
+			// invert it (a hollower flanger).
+			float Feedback;
+			// Gain of the delayed signal added to the dry one; 0 takes the delay out once its tail has died away.
+			float WetGain;
+			// Sine modulation of the delay: its rate, and how far either side of the delay it swings.
+			float ModulationHz;
+			float ModulationMilliseconds;
+			DelayInterpolation Interpolation;
+			// Time the delay, feedback and wet gain glide to their new values over.  A gliding delay bends pitch,
+			// like tape.
+			UINT32 RampMilliseconds;
+		};
+
+		// Settings for the compressor and limiter on a render device's output.
+		struct DYNAMICSPARAMS
+		{
+			// Off passes the mix straight through, with no latency.
+			BOOL IsEnabled;
+			// The compressor works on levels above ThresholdDb (dBFS), reducing them by Ratio (1 for no
+			// compression) and easing in across a knee KneeDb wide, centred on the threshold.
+			float ThresholdDb;
+			float Ratio;
+			float KneeDb;
+			// Times the compressor takes to clamp down on a louder level, and to let go after it.
+			float AttackMilliseconds;
+			float ReleaseMilliseconds;
+			// Gain added after compression.
+			float MakeupGainDb;
+			// Level (dBFS, true peak) the limiter keeps the output under, at most 0.
+			float CeilingDb;
+			// Time the limiter takes to let go after a peak.
+			float LimiterReleaseMilliseconds;
+		};
+
+		// State of a render device's output compressor and limiter.
+		struct DYNAMICSSTATS
+		{
+			// Frames the output is delayed by, for the limiter's lookahead; 0 while it is off.
+			UINT32 LatencyFrames;
+			// Deepest gain reduction of the last period, by each.
+			float CompressorReductionDb;
+			float LimiterReductionDb;
+			// Periods in which the limiter reduced the gain at all.
+			UINT64 LimitedPeriods;
+			// Periods skipped because the mix and everything held in the lookahead were silent.
+			UINT64 RestingPeriods;
+		};
+
+		// State of a render device's bus reverb.
+		struct REVERBSTATS
+		{
+			// Frames in the impulse response (0 if there is no reverb), and how far the reverb runs behind its input.
+			UINT32 ImpulseFrames;
+			UINT32 LatencyFrames;
+			// Blocks of tail partitions convolved on the worker threads, and those which missed their deadline and
+			// played as silence.
+			UINT64 TailBlocks;
+			UINT64 LateTailBlocks;
+		};
+
+		// Where a voice is relative to the listener's head position, in meters: x to the right, y up and -z ahead
+		// while the listener faces forward (as in Windows.Perception).
+		struct SPATIALPOSITION
+		{
+			float X;
+			float Y;
+			float Z;
+		};
+
+		// Which way the listener's head is turned: a unit quaternion rotating head coordinates (x right, y up, -z
+		// ahead) into the coordinates voice positions are given in.
+		struct LISTENERORIENTATION
+		{
+			float W;
+			float X;
+			float Y;
+			float Z;
+		};
+
+		// A set of head related impulse responses, laid out as in a SOFA SimpleFreeFieldHRIR file, so clients can
+		// pass its variables straight through.
+		struct HRTFDATASET
+		{
+			// Measurements (SOFA's M) and frames in each impulse response (N).
+			UINT32 MeasurementCount;
+			UINT32 ImpulseFrames;
+			// Data.SamplingRate; impulses at other rates than the device's are resampled when loaded.
+			UINT32 SampleRate;
+			// SourcePosition: MeasurementCount triples of azimuth (degrees counterclockwise from straight ahead),
+			// elevation (degrees up from the horizontal) and distance (ignored).
+			const float* SourcePositions;
+			// Data.IR: for each measurement, the left ear's ImpulseFrames frames, then the right's.
+			const float* Impulses;
+		};
+
+		// State and cost of a render device's binaural spatializer.
+		struct SPATIALIZERSTATS
+		{
+			// Sources the spatializer was loaded with room for, and those spatializing a voice (or playing out
+			// the tail of one) now.
+			UINT32 MaxSources;
+			UINT32 ActiveSources;
+			// Impulse partitions convolved per source and ear, and how far spatialized voices run behind the rest.
+			UINT32 PartitionCount;
+			UINT32 LatencyFrames;
+			// Blocks processed, those which crossfaded any source to a new impulse response, and the impulse
+			// responses built for sources which moved.
+			UINT64 Blocks;
+			UINT64 CrossfadeBlocks;
+			UINT64 FilterUpdates;
+			// Periods in which some spatialized voice found no free source, and went through the ambisonic bus
+			// instead, or if there is none played silent.
+			UINT64 OverflowPeriods;
+			// Total audio thread time spent spatializing.
+			UINT64 ProcessNanoseconds;
+		};
+
+#define AMBISONIC_MAX_ORDER 3
+
+		// Settings of a render device's ambisonic bus.
+		struct AMBISONICPARAMS
+		{
+			// 1 to AMBISONIC_MAX_ORDER; the field has (Order + 1) squared channels.
+			UINT32 Order;
+			AmbisonicDecoder Decoder;
+			// Speakers: for each of the device's channels, the azimuth (degrees counterclockwise from straight
+			// ahead) and elevation (degrees up) of its speaker, with an elevation beyond 90 for a channel (an LFE,
+			// say) which should get nothing.  nullptr for the usual layout of 2 (stereo), 4 (quad), 6 (5.1) or 8
+			// (7.1) channels.
+			const float* SpeakerPositions;
+			// Binaural: the head related impulse responses the field is decoded through, into the first two
+			// channels; voices through the bus then run 128 frames behind the rest.
+			const HRTFDATASET* Hrtf;
+		};
+
+		// State and cost of a render device's ambisonic bus.
+		struct AMBISONICSTATS
+		{
+			UINT32 Order;
+			UINT32 FieldChannels;
+			// How far voices through the bus run behind the rest.
+			UINT32 LatencyFrames;
+			// Periods the field was decoded in, voice periods encoded into it, and orientations it was rotated to.
+			UINT64 Periods;
+			UINT64 EncodedSources;
+			UINT64 RotationUpdates;
+			// Total audio thread time spent encoding voices, and rotating and decoding the field.
+			UINT64 EncodeNanoseconds;
+			UINT64 DecodeNanoseconds;
+		};
+
+#define PERIOD_POLICY_DEFAULT_IDLE_TIMEOUT_MS 5000
+
+		// How a render device picks its stream period; see PeriodMode.
+		struct PERIODPOLICY
+		{
+			PeriodMode Mode;
+			// Period to use when saving power, or 0 for the engine's default period.  Rounded to a period the
+			// engine supports.
+			UINT32 PowerSavingPeriodMilliseconds;
+			// How long an adaptive policy waits without activity before moving to the power saving period, or 0
+			// for PERIOD_POLICY_DEFAULT_IDLE_TIMEOUT_MS.
+			UINT32 IdleTimeoutMilliseconds;
+		};
+
+		// How heavily a render device's audio callback is loaded, and what it has shed to keep up.
+		struct LOADSTATS
+		{
+			// Time spent mixing each period as a fraction of the period: smoothed, and the worst single period.
+			float Load;
+			float PeakLoad;
+			ShedLevel Level;
+			// Times the level went up, and came back down.
+			UINT32 ShedCount;
+			UINT32 RestoreCount;
+			// Periods whose mixing took longer than the period itself.
+			UINT64 OverloadPeriods;
+			// Periods mixed at a level above ShedLevel_None.
+			UINT64 ShedPeriods;
+		};
+
+		// A render device's current period, and the wakeups its period policy has saved.
+		struct PERIODSTATS
+		{
+			UINT32 PeriodFrames;
+			UINT32 MinimumPeriodFrames;
+			// Times the stream has been reinitialized with a new period.
+			UINT32 RenegotiationCount;
+			// Audio callbacks per second at the current period, and how many fewer that is than at the minimum.
+			UINT32 WakeupsPerSecond;
+			UINT32 WakeupsPerSecondSaved;
+			// Callbacks avoided since the device was created, compared to running at the minimum period throughout.
+			UINT64 WakeupsSaved;
+		};
+
+		// Measured alignment between a capture device's recording and a render device's output.
+		struct TIMELINEOFFSETS
+		{
+			// Render frame which was audible when the first captured frame was played into the input, i.e. where
+			// the start of the recording lines up with the render device's output.
+			INT64 CaptureStartRenderFrame;
+			// Stream latencies the devices report.
+			UINT32 InputLatencyMicroseconds;
+			UINT32 OutputLatencyMicroseconds;
+			// Round trip being compensated for: the devices' pair's measured latency if it has been calibrated,
+			// otherwise the sum of the two stream latencies.
+			UINT32 RoundTripMicroseconds;
+			BOOL IsCalibrated;
+			// Measured rate of the capture clock relative to the render clock, less one, in parts per million.
+			INT32 CaptureClockDriftPartsPerMillion;
+		};
+
+		// Result of a round trip latency calibration between a render device and a capture device.
+		struct LATENCYCALIBRATION
+		{
+			// Time from the render device's clock reaching the test signal to the capture device's clock recording it.
+			INT32 RoundTripMicroseconds;
+			// What would be assumed without calibration: the sum of the two devices' reported stream latencies.
+			INT32 StreamLatencyMicroseconds;
+			// Height of the correlation peak over the correlation's RMS level; the higher, the cleaner the measurement.
+			float PeakRatio;
+		};
+
 		// A handle to a Wazappy node. 
 		// No reference counting or even tracking is done over this interface; it works purely at the raw pointer level.
 		// On the Wazappy side, debug builds never delete nodes, only mark them as tombstoned, with contracts catching
@@ -97,7 +609,7 @@ namespace Wazappy
 		// Top-level methods which affect the entire session.
 		// The session is semantically a singleton; that is, there is no WazappyNodeHandle for a session,
 		// and these methods require no context.
-		// TODO: make this actually be a thing, by figuring out how to support multiple devices, by refactoring device state into session.
+		// Any number of devices may be open at once; each has its own buffers, mixer and audio callback.
 		class __declspec(dllexport) WASAPISessionInterop
 		{
 		public:
@@ -108,6 +620,49 @@ namespace Wazappy
 			// Get a node handle for the default render device.
 			// Can be called before IsInitialized().
 			static WazappyNodeHandle WASAPISession_GetDefaultRenderDevice();
+
+			// Get a node handle for the render or capture endpoint with the given ID (from WASAPISession_GetEnumeratedDevices).
+			static WazappyNodeHandle WASAPISession_OpenRenderDevice(LPCWSTR deviceId);
+			static WazappyNodeHandle WASAPISession_OpenCaptureDevice(LPCWSTR deviceId);
+
+			// Begin listing the system's render and capture endpoints.
+			static HRESULT WASAPISession_EnumerateDevicesAsync();
+
+			// Copy out up to capacity endpoints from the last enumeration; deviceCount receives the total found.
+			// Returns E_PENDING while the enumeration is still running.
+			static HRESULT WASAPISession_GetEnumeratedDevices(DEVICEINFO* devices, UINT32 capacity, UINT32* deviceCount);
+
+			// Start several initialized devices together: every device is configured and pre-rolled first,
+			// then all their audio clients are started back to back, so they begin within microseconds of each other.
+			// If any device fails to prepare or start, the devices already prepared are stopped and reset.
+			static HRESULT WASAPISession_StartDeviceGroup(const WazappyNodeHandle* handles, UINT32 handleCount);
+
+			// Stop several devices; returns the first failure, if any, after asking all of them to stop.
+			static HRESULT WASAPISession_StopDeviceGroup(const WazappyNodeHandle* handles, UINT32 handleCount);
+
+			// Set the round trip latency from a render endpoint to a capture endpoint, e.g. to restore one saved from
+			// WASAPIRenderDevice_GetLatencyCalibration in an earlier run.  0 forgets the pair's calibration.
+			static HRESULT WASAPISession_SetLatencyCalibration(LPCWSTR renderDeviceId, LPCWSTR captureDeviceId, INT32 roundTripMicroseconds);
+
+			// Get the round trip latency calibrated for a pair of endpoints; S_FALSE if the pair has not been calibrated.
+			static HRESULT WASAPISession_GetLatencyCalibration(LPCWSTR renderDeviceId, LPCWSTR captureDeviceId, INT32* roundTripMicroseconds);
+		};
+
+		// Methods on the session-wide cache of decoded samples, shared by all render devices.
+		class __declspec(dllexport) SampleCacheInterop
+		{
+		public:
+			// Set the total bytes of decoded audio the cache may hold before evicting least-recently-used assets.
+			static HRESULT SampleCache_SetMemoryBudget(UINT64 bytes);
+
+			// Choose how samples decoded from now on are held in memory.  Compact formats are decoded on the fly
+			// by each voice as it mixes, trading a little audio thread time for memory.
+			static HRESULT SampleCache_SetStorageFormat(SampleStorageFormat storageFormat);
+
+			// Drop all cached assets; voices which are still playing keep theirs alive.
+			static HRESULT SampleCache_Clear();
+
+			static HRESULT SampleCache_GetStatistics(SAMPLECACHESTATS* stats);
 		};
 
 		// The ID of a callback object; avoids issues with marshaling function pointers.
@@ -134,6 +689,8 @@ namespace Wazappy
 		class __declspec(dllexport) WASAPIDeviceInterop
 		{
 		public:
+			// Set the volume (0 to 100) of the whole audio session, as shown in the system volume mixer.  Goes through
+			// the audio service on every call; render devices' bus gain is the in-engine alternative.
 			static HRESULT WASAPIDevice_SetVolumeOnSession(WazappyNodeHandle handle, UINT32 volume);
 
 			// Begin initializing the audio device(s).
@@ -143,6 +700,12 @@ namespace Wazappy
 			// Becomes true once the session is initialized.
 			static BOOL WASAPIDevice_IsInitialized(WazappyNodeHandle handle);
 
+			// Choose how this device's audio callbacks are dispatched; takes effect the next time it starts.
+			static HRESULT WASAPIDevice_SetEngineThreadProperties(WazappyNodeHandle handle, ENGINETHREADPROPS props);
+
+			// Get the callback dispatch timing of this device since it last started.
+			static HRESULT WASAPIDevice_GetDispatchStatistics(WazappyNodeHandle handle, DISPATCHSTATS* stats);
+
 			// Get the current device state of this device.
 			static DeviceState WASAPIDevice_GetDeviceState(WazappyNodeHandle handle);
 
@@ -163,6 +726,211 @@ namespace Wazappy
 			static HRESULT WASAPIRenderDevice_StartPlaybackAsync(WazappyNodeHandle handle);
 			static HRESULT WASAPIRenderDevice_StopPlaybackAsync(WazappyNodeHandle handle);
 			static HRESULT WASAPIRenderDevice_PausePlaybackAsync(WazappyNodeHandle handle);
+
+			// Decode the file at the given URL into the sample cache, in this device's mix format.
+			// The device must be initialized.  Blocks while decoding, so call from a worker thread.
+			static HRESULT WASAPIRenderDevice_LoadCachedSample(WazappyNodeHandle handle, LPCWSTR url);
+
+			// Start a one-shot voice playing a sample previously loaded into the cache.
+			// Never touches the disk or a decoder; fails with HRESULT_FROM_WIN32(ERROR_NOT_FOUND) if not cached.
+			static HRESULT WASAPIRenderDevice_PlayCachedSample(WazappyNodeHandle handle, LPCWSTR url, VoiceId* voiceId);
+
+			// Start a voice streaming the file at the given URL from disk, keeping prefetchMilliseconds of audio
+			// decoded ahead (at least two device periods).  Playback starts once one period is decoded.
+			static HRESULT WASAPIRenderDevice_PlayStreamingSample(WazappyNodeHandle handle, LPCWSTR url, UINT32 prefetchMilliseconds, VoiceId* voiceId);
+
+			// Get the counters of a streaming voice which is still playing.
+			static HRESULT WASAPIRenderDevice_GetStreamingVoiceStatistics(WazappyNodeHandle handle, VoiceId voiceId, STREAMINGVOICESTATS* stats);
+
+			// Get the memory saved and render cost of a cached-sample voice which is still playing.
+			static HRESULT WASAPIRenderDevice_GetSampleVoiceStatistics(WazappyNodeHandle handle, VoiceId voiceId, SAMPLEVOICESTATS* stats);
+
+			// Start a voice looping a sample previously loaded into the cache, forever, with its tempo stretched to
+			// follow the device's (see WASAPIRenderDevice_SetTempo) without changing its pitch.  loopBeatsPerMinute
+			// is the loop's own tempo; 0 plays it at its natural rate until WASAPIRenderDevice_SetVoiceStretch says
+			// otherwise.  Fails with HRESULT_FROM_WIN32(ERROR_NOT_FOUND) if not cached.
+			static HRESULT WASAPIRenderDevice_PlayStretchedLoop(WazappyNodeHandle handle, LPCWSTR url, float loopBeatsPerMinute, StretchQuality quality, VoiceId* voiceId);
+
+			// Change how a stretched loop voice is stretched: to follow the device's tempo, for a loop at
+			// loopBeatsPerMinute, or if that is 0 at a fixed rate of source frames per output frame (0.25 to 4).
+			// Changes take effect smoothly at the voice's next segment.
+			static HRESULT WASAPIRenderDevice_SetVoiceStretch(WazappyNodeHandle handle, VoiceId voiceId, float loopBeatsPerMinute, float rate);
+
+			// Get the rate and render cost of a stretched loop voice which is still playing.
+			static HRESULT WASAPIRenderDevice_GetStretchVoiceStatistics(WazappyNodeHandle handle, VoiceId voiceId, STRETCHVOICESTATS* stats);
+
+			// Start a voice playing a sample previously loaded into the cache at rate source frames per output
+			// frame, from -4 to 4, so its pitch follows its speed; negative rates play it backwards from the end.
+			// The voice ends when it runs off either end of the sample, or if isLooping wraps around forever.
+			// Fails with HRESULT_FROM_WIN32(ERROR_NOT_FOUND) if not cached.
+			static HRESULT WASAPIRenderDevice_PlayVarispeedSample(WazappyNodeHandle handle, LPCWSTR url, float rate, InterpolationQuality quality, BOOL isLooping, VoiceId* voiceId);
+
+			// Change a varispeed voice's rate and interpolation, from the next period.
+			static HRESULT WASAPIRenderDevice_SetVoiceVarispeed(WazappyNodeHandle handle, VoiceId voiceId, float rate, InterpolationQuality quality);
+
+			// Get the rate and render cost of a varispeed voice which is still playing.
+			static HRESULT WASAPIRenderDevice_GetVarispeedVoiceStatistics(WazappyNodeHandle handle, VoiceId voiceId, VARISPEEDVOICESTATS* stats);
+
+			// Start a voice playing urlCount files back to back.  Each track is opened and decoded ahead in the
+			// background while the previous one plays, so tracks are spliced sample-accurately with no gap;
+			// a nonzero crossfadeMilliseconds overlaps them with an equal-power crossfade instead.
+			static HRESULT WASAPIRenderDevice_PlayPlaylist(WazappyNodeHandle handle, const LPCWSTR* urls, UINT32 urlCount, UINT32 crossfadeMilliseconds, VoiceId* voiceId);
+
+			// Append a file to the end of a playlist voice which is still playing.
+			static HRESULT WASAPIRenderDevice_EnqueuePlaylistTrack(WazappyNodeHandle handle, VoiceId voiceId, LPCWSTR url);
+
+			// Move a voice playing on this device to the given frame of its source, sample accurately.
+			// Compressed files are seeked via an index built as they decode, so the first seek past the decoded
+			// range of a file decodes forward to reach it; later seeks are fast.
+			static HRESULT WASAPIRenderDevice_SeekVoice(WazappyNodeHandle handle, VoiceId voiceId, UINT64 frame);
+
+			// Stop a voice playing on this device.  HRESULT_FROM_WIN32(ERROR_NOT_FOUND) if there is no such voice or
+			// it has already finished, as for the other per voice calls.
+			static HRESULT WASAPIRenderDevice_StopVoice(WazappyNodeHandle handle, VoiceId voiceId);
+
+			// Move a playing voice's linear gain to the given value over rampMilliseconds, sample accurately.
+			// Never blocks the audio thread, so it is cheap enough to call on every fader move.
+			static HRESULT WASAPIRenderDevice_SetVoiceGain(WazappyNodeHandle handle, VoiceId voiceId, float gain, UINT32 rampMilliseconds, GainRampShape shape);
+
+			// Move a playing voice's pan (-1 full left, 0 centre, 1 full right) over rampMilliseconds.
+			static HRESULT WASAPIRenderDevice_SetVoicePan(WazappyNodeHandle handle, VoiceId voiceId, float pan, UINT32 rampMilliseconds);
+
+			// Move one stage (of FILTER_BANK_MAX_STAGES, run in series) of a playing voice's filters to a new
+			// response over rampMilliseconds; Filter_None takes the stage out.  frequency is in Hz, and gainDb
+			// (held within +-48dB) only matters for shelves and peaks.  Sweeps of one type are smooth; a change of
+			// type crossfades.
+			static HRESULT WASAPIRenderDevice_SetVoiceFilter(WazappyNodeHandle handle, VoiceId voiceId, UINT32 stage, FilterType type, float frequency, float q, float gainDb, UINT32 rampMilliseconds);
+
+			// Set a playing voice's priority (VOICE_PRIORITY_DEFAULT to start with).  When the device has a real voice
+			// budget, higher priority voices are rendered in preference to lower ones, and equal ones loudest first.
+			static HRESULT WASAPIRenderDevice_SetVoicePriority(WazappyNodeHandle handle, VoiceId voiceId, INT32 priority);
+
+			// Render at most maxRealVoices voices each period (0, the default, for no limit).  The others become
+			// virtual: they keep their place in time without being rendered, and fade back in when they rank
+			// highly enough again.
+			static HRESULT WASAPIRenderDevice_SetRealVoiceBudget(WazappyNodeHandle handle, UINT32 maxRealVoices);
+
+			// Gain and pan of this device's whole mix, applied inside the engine; prefer these to
+			// WASAPIDevice_SetVolumeOnSession for anything which changes continuously.
+			static HRESULT WASAPIRenderDevice_SetBusGain(WazappyNodeHandle handle, float gain, UINT32 rampMilliseconds, GainRampShape shape);
+			static HRESULT WASAPIRenderDevice_SetBusPan(WazappyNodeHandle handle, float pan, UINT32 rampMilliseconds);
+
+			// Filters on this device's whole mix, applied before the bus gain; as WASAPIRenderDevice_SetVoiceFilter.
+			static HRESULT WASAPIRenderDevice_SetBusFilter(WazappyNodeHandle handle, UINT32 stage, FilterType type, float frequency, float q, float gainDb, UINT32 rampMilliseconds);
+
+			// Run a playing voice through a delay line (an echo, or with a short modulated delay a chorus or
+			// flanger), after its filters and before its gain; a voice has none until this is first called.  Set a
+			// WetGain of 0 to take it out again.
+			static HRESULT WASAPIRenderDevice_SetVoiceDelay(WazappyNodeHandle handle, VoiceId voiceId, DELAYPARAMS params);
+
+			// A delay line on this device's whole mix, ahead of the reverb; as WASAPIRenderDevice_SetVoiceDelay.
+			static HRESULT WASAPIRenderDevice_SetBusDelay(WazappyNodeHandle handle, DELAYPARAMS params);
+
+			// Set the tempo which delays given in beats follow (120 beats per minute by default).  Delays glide to
+			// the new tempo over their ramps.
+			static HRESULT WASAPIRenderDevice_SetTempo(WazappyNodeHandle handle, float beatsPerMinute);
+
+			// Convolve this device's whole mix with the impulse response at the given URL (a room, a plate, a
+			// speaker cabinet), replacing any reverb already there; nullptr removes it.  The impulse may be many
+			// seconds long: only its first few thousand frames are convolved on the audio thread, the rest on
+			// worker threads.  The reverb runs CONVOLUTION_HEAD_BLOCK_FRAMES (128) frames behind the dry mix.
+			// Blocks while decoding, so call from a worker thread.
+			static HRESULT WASAPIRenderDevice_LoadBusReverb(WazappyNodeHandle handle, LPCWSTR impulseUrl);
+
+			// Gain and pan of the reverb's output, which is added to the dry mix before the bus filters; unity by
+			// default.
+			static HRESULT WASAPIRenderDevice_SetBusReverbGain(WazappyNodeHandle handle, float gain, UINT32 rampMilliseconds, GainRampShape shape);
+
+			static HRESULT WASAPIRenderDevice_GetReverbStatistics(WazappyNodeHandle handle, REVERBSTATS* stats);
+
+			// Load a dataset of head related impulse responses (see HRTFDATASET) and render every spatialized
+			// voice binaurally through it into the first two channels, with room for maxSources (up to 1024)
+			// voices at once; more go through the ambisonic bus if one is loaded, or are silent until others
+			// stop.  Replaces any dataset already loaded; nullptr removes it, and spatialized voices play straight
+			// into the mix again (or through the ambisonic bus).  Spatialized voices run 128 frames behind the
+			// rest.  The dataset is copied, so may be freed once this returns.  Blocks while
+			// transforming the responses, so call from a worker thread.
+			static HRESULT WASAPIRenderDevice_LoadHrtfDataset(WazappyNodeHandle handle, const HRTFDATASET* dataset, UINT32 maxSources);
+
+			// Spatialize a playing voice at the given position (its distance is left to the voice's gain), or if
+			// isSpatialized is false play it straight into the mix again.  Positions may change every period; a
+			// voice crossfades to each new direction's response over 128 frames.
+			static HRESULT WASAPIRenderDevice_SetVoiceSpatialPosition(WazappyNodeHandle handle, VoiceId voiceId, BOOL isSpatialized, SPATIALPOSITION position);
+
+			// Turn the listener's head, from a head tracker say; every spatialized voice follows as if it had
+			// moved.
+			static HRESULT WASAPIRenderDevice_SetListenerOrientation(WazappyNodeHandle handle, LISTENERORIENTATION orientation);
+
+			static HRESULT WASAPIRenderDevice_GetSpatializerStatistics(WazappyNodeHandle handle, SPATIALIZERSTATS* stats);
+
+			// Set up an ambisonic bus, which spatializes any number of voices for the cost of encoding each
+			// (see AMBISONICPARAMS), replacing any already loaded; nullptr removes it.  Spatialized voices go
+			// through it if they ask to (see SetVoiceSpatialRendering), if there is no HRTF dataset loaded, or
+			// if the dataset has no room left for them.  The parameters are copied, so may be freed once this
+			// returns.  Blocks while building the decoder, so call from a worker thread.
+			static HRESULT WASAPIRenderDevice_LoadAmbisonicBus(WazappyNodeHandle handle, const AMBISONICPARAMS* params);
+
+			// Choose whether a playing voice goes through the HRTF dataset (the default) or the ambisonic bus when
+			// both are loaded.
+			static HRESULT WASAPIRenderDevice_SetVoiceSpatialRendering(WazappyNodeHandle handle, VoiceId voiceId, SpatialRendering rendering);
+
+			static HRESULT WASAPIRenderDevice_GetAmbisonicStatistics(WazappyNodeHandle handle, AMBISONICSTATS* stats);
+
+			// Get counts of the mixing work this device has skipped because it was silent or inaudible.
+			static HRESULT WASAPIRenderDevice_GetMixerStatistics(WazappyNodeHandle handle, MIXERSTATS* stats);
+
+			// Set up the compressor and true peak limiter on this device's output, which keep a loud mix from
+			// clipping on its way to the device.  On by default, as a limiter alone at -1dBFS; the limiter looks
+			// DYNAMICS_LOOKAHEAD_MS (1.5) ahead, delaying the output by a little more, which the timeline and
+			// latency reports take in.  Turning it off or on skips the output by that much.
+			static HRESULT WASAPIRenderDevice_SetDynamics(WazappyNodeHandle handle, DYNAMICSPARAMS params);
+
+			static HRESULT WASAPIRenderDevice_GetDynamicsStatistics(WazappyNodeHandle handle, DYNAMICSSTATS* stats);
+
+			// Turn overload protection on (the default) or off.  While it is on, the device measures how much of each
+			// period mixing takes, and as that nears the deadline it sheds work a ShedLevel at a time, restoring it
+			// once the load has stayed low for a while.
+			static HRESULT WASAPIRenderDevice_SetOverloadProtection(WazappyNodeHandle handle, BOOL isEnabled);
+
+			static HRESULT WASAPIRenderDevice_GetLoadStatistics(WazappyNodeHandle handle, LOADSTATS* stats);
+
+			// Choose how this device picks its stream period.  Changing period reinitializes the audio stream
+			// (voices keep playing, after a short gap), so an adaptive policy only switches when activity starts
+			// or after a long idle stretch.
+			static HRESULT WASAPIRenderDevice_SetPeriodPolicy(WazappyNodeHandle handle, PERIODPOLICY policy);
+
+			static HRESULT WASAPIRenderDevice_GetPeriodStatistics(WazappyNodeHandle handle, PERIODSTATS* stats);
+
+			// Start a voice playing the live input of the given capture device, delayed by latencyMilliseconds.
+			// The devices may run on different hardware clocks; the link resamples adaptively to follow the drift.
+			static HRESULT WASAPIRenderDevice_ConnectCaptureDevice(WazappyNodeHandle handle, WazappyNodeHandle captureHandle, UINT32 latencyMilliseconds, VoiceId* voiceId);
+
+			// Start monitoring the given capture device's input on this device with as little delay as the system's
+			// scheduling jitter allows.  The link starts at one capture packet plus one render period and adapts
+			// from there; its statistics report the estimated round trip latency.
+			static HRESULT WASAPIRenderDevice_StartInputMonitoring(WazappyNodeHandle handle, WazappyNodeHandle captureHandle, VoiceId* voiceId);
+
+			static HRESULT WASAPIRenderDevice_GetCaptureLinkStatistics(WazappyNodeHandle handle, VoiceId voiceId, CAPTURELINKSTATS* stats);
+
+			// Find the render frame (in this device's frames since it started playing) which was audible when the
+			// given frame captured by the given capture device was played into its input, compensating for both
+			// devices' stream latencies and for drift between their clocks.  Use this to line recorded audio up
+			// with what was playing.  Both devices must be running; E_PENDING until both have reported positions.
+			static HRESULT WASAPIRenderDevice_MapCaptureFrame(WazappyNodeHandle handle, WazappyNodeHandle captureHandle, UINT64 capturedFrame, INT64* renderFrame);
+
+			// Get the offsets MapCaptureFrame is currently applying between the given capture device and this device.
+			static HRESULT WASAPIRenderDevice_GetTimelineOffsets(WazappyNodeHandle handle, WazappyNodeHandle captureHandle, TIMELINEOFFSETS* offsets);
+
+			// Measure the real round trip latency from this device to the given capture device, which must be
+			// hearing this device's output (by loopback cable, or a microphone near the speakers).  Plays a short
+			// chirp and records for under a second; both devices must be running.  Only one calibration per
+			// render device may run at a time.
+			static HRESULT WASAPIRenderDevice_StartLatencyCalibration(WazappyNodeHandle handle, WazappyNodeHandle captureHandle);
+
+			// Get the result of the last calibration: E_PENDING while it is running, HRESULT_FROM_WIN32(ERROR_NOT_FOUND)
+			// if the chirp was not heard, HRESULT_FROM_WIN32(ERROR_TIMEOUT) if the capture device recorded nothing.
+			// On success the result is also stored in the session for the two endpoint IDs, and used by MapCaptureFrame.
+			static HRESULT WASAPIRenderDevice_GetLatencyCalibration(WazappyNodeHandle handle, LATENCYCALIBRATION* calibration);
 		};
 
 		// Methods specific to CaptureDevices; all handles must be CaptureDevices.